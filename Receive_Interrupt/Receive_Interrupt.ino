@@ -37,9 +37,9 @@ SX1262 radio = new Module(RADIO_CS_PIN, RADIO_DIO1_PIN, RADIO_RST_PIN, RADIO_BUS
 // flag to indicate that a packet was sent
 static volatile bool receivedFlag = false;
 
-static String rssi = "0dBm";
-static String snr = "0dB";
-static String payload = "0";
+static float rssi = 0;
+static float snr = 0;
+static uint8_t payload[256];
 
 void wifiScan(void);
 // this function is called when a complete packet
@@ -234,8 +234,10 @@ void loop()
         // reset flag
         receivedFlag = false;
 
-        // you can read received data as an Arduino String
-        int state = radio.readData(payload);
+        // read into a static byte array, no String allocation per packet
+        size_t len = radio.getPacketLength();
+        int state = radio.readData(payload, len);
+        payload[len] = 0;
 
         // you can also read received data as byte array
         /*
@@ -246,8 +248,8 @@ void loop()
 
         if (state == RADIOLIB_ERR_NONE) {
 
-            rssi = String(radio.getRSSI()) + "dBm";
-            snr = String(radio.getSNR()) + "dB";
+            rssi = radio.getRSSI();
+            snr = radio.getSNR();
 
 
             // packet was successfully received
@@ -255,15 +257,17 @@ void loop()
 
             // print data of the packet
             Serial.print(F("Radio Data:\t\t"));
-            Serial.println(payload);
+            Serial.println((const char *)payload);
 
             // print RSSI (Received Signal Strength Indicator)
             Serial.print(F("Radio RSSI:\t\t"));
-            Serial.println(rssi);
+            Serial.print(rssi);
+            Serial.println("dBm");
 
             // print SNR (Signal-to-Noise Ratio)
             Serial.print(F("Radio SNR:\t\t"));
-            Serial.println(snr);
+            Serial.print(snr);
+            Serial.println("dB");
 
         } else if (state == RADIOLIB_ERR_CRC_MISMATCH) {
             // packet was received, but is malformed
@@ -38,7 +38,7 @@ static int transmissionState = RADIOLIB_ERR_NONE;
 // flag to indicate that a packet was sent
 static volatile bool transmittedFlag = false;
 static uint32_t counter = 0;
-static String payload;
+static char payload[16];
 
 void wifiScan(void);
 // this function is called when a complete packet
@@ -218,7 +218,8 @@ void setup()
 
     // you can transmit C-string or Arduino string up to
     // 256 characters long
-    transmissionState = radio.startTransmit(String(counter).c_str());
+    snprintf(payload, sizeof(payload), "%lu", (unsigned long)counter);
+    transmissionState = radio.startTransmit(payload);
 
     // you can also transmit byte array up to 256 bytes long
     /*
@@ -234,7 +235,7 @@ void loop()
     // check if the previous transmission finished
     if (transmittedFlag) {
 
-        payload = "#" + String(counter++);
+        snprintf(payload, sizeof(payload), "#%lu", (unsigned long)counter++);
 
         // reset flag
         transmittedFlag = false;
@@ -0,0 +1,120 @@
+// Hex codec (hex.cpp) against the per-byte isxdigit/strtol/printf path it
+// replaced: identical output and error codes for every length up to a full
+// frame, then time per call for payloads of 16-255 bytes. The timings are
+// printed, not checked; AT+HEXBENCH gives the same table on the target.
+#include "hex.h"
+#include "p2p.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#define ROUNDS      200000
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+static volatile size_t sink;
+
+// the decode AT+PSEND used before hex.cpp
+static int legacy_decode(uint8_t *out, size_t max, const char *p, size_t len) {
+    bool isHex = (len % 2 == 0);
+    for (size_t i = 0; i < len && isHex; i++) {
+        if (!isxdigit((unsigned char)p[i])) isHex = false;
+    }
+    if (!isHex) return HEX_ERR_INVALID;
+    if (len / 2 > max) return HEX_ERR_TOO_LONG;
+    for (size_t i = 0; i < len / 2; i++) {
+        char tmp[3] = {p[2*i], p[2*i+1], 0};
+        out[i] = (uint8_t)strtol(tmp, NULL, 16);
+    }
+    return (int)(len / 2);
+}
+
+// the encode the RX output used before hex.cpp
+static size_t legacy_encode(char *out, const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; i++) snprintf(out + 2 * i, 3, "%02X", data[i]);
+    return 2 * len;
+}
+
+static uint8_t data[P2P_MAX_FRAME];
+
+static void test_matches_legacy() {
+    printf("hex: codec matches the strtol/printf path, 0-%d bytes\n", P2P_MAX_FRAME);
+    uint8_t back[P2P_MAX_FRAME];
+    char text[2 * P2P_MAX_FRAME + 1];
+    char ref[2 * P2P_MAX_FRAME + 1];
+    for (size_t len = 0; len <= sizeof(data); len++) {
+        size_t n = hex_encode(text, data, len);
+        text[n] = 0;
+        ref[legacy_encode(ref, data, len)] = 0;
+        CHECK(n == 2 * len && strcmp(text, ref) == 0);
+        CHECK(hex_decode(back, sizeof(back), text, n) == (int)len && memcmp(back, data, len) == 0);
+
+        // lower case decodes the same, any bad digit is refused
+        for (size_t k = 0; k < n; k++) text[k] = (char)tolower((unsigned char)text[k]);
+        CHECK(hex_decode(back, sizeof(back), text, n) == (int)len && memcmp(back, data, len) == 0);
+        for (size_t k = 0; k < n; k++) {
+            char c = text[k];
+            text[k] = 'g';
+            CHECK(hex_decode(back, sizeof(back), text, n) == HEX_ERR_INVALID);
+            CHECK(legacy_decode(back, sizeof(back), text, n) == HEX_ERR_INVALID);
+            text[k] = c;
+        }
+        if (len) CHECK(hex_decode(back, len - 1, text, n) == HEX_ERR_TOO_LONG);
+        if (len) CHECK(legacy_decode(back, len - 1, text, n) == HEX_ERR_TOO_LONG);
+        if (n) CHECK(hex_decode(back, sizeof(back), text, n - 1) == HEX_ERR_INVALID);
+    }
+    char spaced[10];
+    spaced[hex_encode_spaced(spaced, data, 3)] = 0;
+    CHECK(strcmp(spaced, "0B 30 55 ") == 0);
+}
+
+template <typename F>
+static double ns_per_call(F f) {
+    auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < ROUNDS; r++) {
+        sink = f();
+        asm volatile("" ::: "memory");
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / ROUNDS;
+}
+
+static void bench() {
+    printf("hex: time per call, %d rounds\n", ROUNDS);
+    static const size_t lens[] = {16, 32, 64, 128, P2P_MAX_FRAME};
+    uint8_t out[P2P_MAX_FRAME];
+    char text[2 * P2P_MAX_FRAME + 1];
+    printf("  len  strtol ns  table ns  printf ns  table ns\n");
+    for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+        size_t len = lens[l];
+        size_t digits = hex_encode(text, data, len);
+        double dec_old = ns_per_call([&] { return (size_t)legacy_decode(out, sizeof(out), text, digits); });
+        double dec = ns_per_call([&] { return (size_t)hex_decode(out, sizeof(out), text, digits); });
+        double enc_old = ns_per_call([&] { return legacy_encode(text, data, len); });
+        double enc = ns_per_call([&] { return hex_encode(text, data, len); });
+        CHECK(hex_decode(out, sizeof(out), text, digits) == (int)len && memcmp(out, data, len) == 0);
+        printf("%5zu  %9.1f  %8.1f  %9.1f  %8.1f\n", len, dec_old, dec, enc_old, enc);
+    }
+}
+
+int main() {
+    for (size_t i = 0; i < sizeof(data); i++) data[i] = (uint8_t)(i * 37 + 11);
+    test_matches_legacy();
+    bench();
+    if (failures) {
+        printf("hex: %d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("hex: OK\n");
+    return 0;
+}
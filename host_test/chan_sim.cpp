@@ -0,0 +1,456 @@
+#include "chan_sim.h"
+
+#include <math.h>
+#include <string.h>
+
+enum SimState {
+    SIM_STANDBY = 0,
+    SIM_RX,
+    SIM_TX,
+    SIM_CAD
+};
+
+struct SimAir {
+    bool used;
+    int node;
+    SIM_Modem m;
+    float carrier_mhz;        // nominal frequency plus the sender's crystal error
+    uint8_t data[SIM_MAX_FRAME];
+    size_t len;
+    uint64_t start_us;
+    uint64_t end_us;
+    bool done;
+};
+
+struct SimNode {
+    bool used;
+    float x;
+    float y;
+    float ppm;
+    uint8_t state;
+    SIM_Modem m;
+    bool continuous;          // RX stays on after a frame
+    bool stop_on_preamble;
+    uint64_t timeout_us;      // absolute, 0 = none
+    int lock;                 // air slot being received, -1 = none
+    float lock_fade_db;
+    uint64_t tx_end_us;
+    int tx_air;
+    uint64_t cad_end_us;
+    uint16_t irq;
+    SIM_Rx rx;
+    SIM_Action action;
+    void *ctx;
+};
+
+static SimNode sim_nodes[SIM_MAX_NODES];
+static SimAir sim_air[SIM_MAX_AIR];
+static float sim_loss[SIM_MAX_NODES][SIM_MAX_NODES];    // NAN = path loss model
+static SIM_Stats sim_st;
+static uint64_t sim_now = 0;
+static uint32_t sim_seed = 1;
+static uint32_t sim_rng = 1;
+static float sim_pl0 = 40.0f;             // loss at 1 m
+static float sim_exp = 2.7f;
+static float sim_shadow = 0.0f;
+static float sim_fading = 0.0f;
+
+// LoRa demodulation floor for SF5..SF12 (dB)
+static const float sim_lora_req_snr[8] = {-2.5f, -5.0f, -7.5f, -10.0f, -12.5f, -15.0f, -17.5f, -20.0f};
+// rejection of another SF at the same bandwidth, by SF distance (dB)
+static const float sim_sf_isolation[8] = {0.0f, 16.0f, 18.0f, 19.0f, 19.0f, 20.0f, 20.0f, 20.0f};
+
+static uint32_t xorshift(uint32_t *s) {
+    uint32_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *s = x ? x : 0x9E3779B9u;
+    return *s;
+}
+
+// standard normal from two uniforms of the given generator
+static float gauss(uint32_t *s) {
+    float u1 = (xorshift(s) + 1.0f) / 4294967297.0f;
+    float u2 = (xorshift(s) + 1.0f) / 4294967297.0f;
+    return sqrtf(-2.0f * logf(u1)) * cosf(6.2831853f * u2);
+}
+
+static float dbm_to_mw(float dbm) { return powf(10.0f, dbm / 10.0f); }
+static float mw_to_dbm(float mw) { return 10.0f * log10f(mw); }
+
+void sim_init(uint32_t seed) {
+    memset(sim_nodes, 0, sizeof(sim_nodes));
+    memset(sim_air, 0, sizeof(sim_air));
+    memset(&sim_st, 0, sizeof(sim_st));
+    for (int a = 0; a < SIM_MAX_NODES; a++) {
+        for (int b = 0; b < SIM_MAX_NODES; b++) sim_loss[a][b] = NAN;
+    }
+    sim_now = 0;
+    sim_seed = seed ? seed : 1;
+    sim_rng = sim_seed;
+}
+
+int sim_add_node(float x_m, float y_m, float ppm) {
+    for (int i = 0; i < SIM_MAX_NODES; i++) {
+        SimNode *n = &sim_nodes[i];
+        if (n->used) continue;
+        memset(n, 0, sizeof(*n));
+        n->used = true;
+        n->x = x_m;
+        n->y = y_m;
+        n->ppm = ppm;
+        n->lock = -1;
+        n->tx_air = -1;
+        return i;
+    }
+    return -1;
+}
+
+void sim_set_path_loss(float pl0_db, float exponent, float shadow_sigma_db, float fading_sigma_db) {
+    sim_pl0 = pl0_db;
+    sim_exp = exponent;
+    sim_shadow = shadow_sigma_db;
+    sim_fading = fading_sigma_db;
+}
+
+void sim_set_link_loss(int a, int b, float loss_db) {
+    if (a < 0 || b < 0 || a >= SIM_MAX_NODES || b >= SIM_MAX_NODES) return;
+    sim_loss[a][b] = loss_db;
+    sim_loss[b][a] = loss_db;
+}
+
+// Shadowing is drawn from the seed and the node pair, so it is the same in
+// both directions and does not depend on the order of events
+float sim_link_loss(int a, int b) {
+    if (!isnan(sim_loss[a][b])) return sim_loss[a][b];
+    float dx = sim_nodes[a].x - sim_nodes[b].x;
+    float dy = sim_nodes[a].y - sim_nodes[b].y;
+    float d = sqrtf(dx * dx + dy * dy);
+    if (d < 1.0f) d = 1.0f;
+    float loss = sim_pl0 + 10.0f * sim_exp * log10f(d);
+    if (sim_shadow > 0) {
+        int lo = a < b ? a : b;
+        int hi = a < b ? b : a;
+        uint32_t s = sim_seed ^ (uint32_t)(lo * 2654435761u) ^ (uint32_t)(hi * 40503u + 1);
+        xorshift(&s);
+        loss += sim_shadow * gauss(&s);
+    }
+    return loss;
+}
+
+uint64_t sim_now_us() {
+    return sim_now;
+}
+
+uint32_t sim_time_on_air_us(const SIM_Modem *m, size_t len) {
+    if (!m->lora) {
+        // preamble, sync word, length byte, payload, CRC
+        float bits = m->preamble + 8.0f * (m->sync_len + 1 + len + 2);
+        return (uint32_t)ceilf(bits * 1000.0f / m->bitrate_kbps);
+    }
+    float tsym_us = (float)(1UL << m->sf) * 1000.0f / m->bw_khz;
+    int de = (tsym_us >= 16000.0f) ? 1 : 0;
+    float num = 8.0f * len - 4.0f * m->sf + 28 + 16;
+    int nsym = (int)ceilf(num / (4.0f * (m->sf - 2 * de)));
+    if (nsym < 0) nsym = 0;
+    float n = m->preamble + 4.25f + 8 + nsym * m->cr;
+    return (uint32_t)ceilf(n * tsym_us);
+}
+
+static float req_snr(const SIM_Modem *m) {
+    if (!m->lora) return SIM_FSK_REQ_SNR_DB;
+    int sf = m->sf < 5 ? 5 : (m->sf > 12 ? 12 : m->sf);
+    return sim_lora_req_snr[sf - 5];
+}
+
+static float noise_dbm(const SIM_Modem *m) {
+    return -174.0f + 10.0f * log10f(m->bw_khz * 1000.0f) + SIM_NOISE_FIGURE_DB;
+}
+
+static bool same_modem(const SIM_Modem *a, const SIM_Modem *b) {
+    if (a->lora != b->lora) return false;
+    if (a->lora) return a->sf == b->sf && fabsf(a->bw_khz - b->bw_khz) < 0.5f;
+    return fabsf(a->bitrate_kbps - b->bitrate_kbps) < 0.01f * b->bitrate_kbps;
+}
+
+static bool spectra_overlap(const SimAir *x, const SimAir *y) {
+    float df_khz = fabsf(x->carrier_mhz - y->carrier_mhz) * 1000.0f;
+    return df_khz < (x->m.bw_khz + y->m.bw_khz) / 2;
+}
+
+// carrier offset of a frame as seen by a receiver, Hz
+static float offset_hz(const SimAir *a, const SimNode *rx) {
+    float rx_mhz = rx->m.freq_mhz * (1.0f + rx->ppm * 1e-6f);
+    return (a->carrier_mhz - rx_mhz) * 1e6f;
+}
+
+static void node_fire(SimNode *n, uint16_t irq) {
+    n->irq |= irq;
+    if (n->action) n->action(n->ctx);
+}
+
+// Receiver i, listening on the frame's modem, tries to lock onto it
+static void air_lock(int idx, int i) {
+    SimAir *a = &sim_air[idx];
+    SimNode *n = &sim_nodes[i];
+    float tol = (a->m.lora ? SIM_LORA_PULL_IN : SIM_FSK_PULL_IN) * n->m.bw_khz * 1000.0f;
+    if (fabsf(offset_hz(a, n)) > tol) {
+        sim_st.offset++;
+        return;
+    }
+    float rssi = a->m.power_dbm - sim_link_loss(a->node, i);
+    if (rssi - noise_dbm(&n->m) < req_snr(&n->m)) {
+        sim_st.weak++;
+        return;
+    }
+    n->lock = idx;
+    n->lock_fade_db = sim_fading > 0 ? sim_fading * gauss(&sim_rng) : 0;
+    sim_st.locked++;
+    // LoRa stops the RX timer on a valid header, FSK only when asked to
+    if (a->m.lora || n->stop_on_preamble) n->timeout_us = 0;
+    n->irq |= SIM_IRQ_PREAMBLE;
+}
+
+// A frame starts: idle receivers on the same modem try to lock onto it
+static void air_start(int idx) {
+    SimAir *a = &sim_air[idx];
+    for (int i = 0; i < SIM_MAX_NODES; i++) {
+        SimNode *n = &sim_nodes[i];
+        if (!n->used || i == a->node) continue;
+        if (n->state != SIM_RX || n->lock >= 0 || !same_modem(&a->m, &n->m)) {
+            if (n->state != SIM_RX || n->lock >= 0) sim_st.deaf++;
+            continue;
+        }
+        air_lock(idx, i);
+    }
+}
+
+// Time from frame start until too little preamble is left to detect it
+static uint64_t air_detect_us(const SIM_Modem *m) {
+    if (!m->lora) {
+        if (m->preamble <= SIM_FSK_DETECT_BITS) return 0;
+        return (uint64_t)((m->preamble - SIM_FSK_DETECT_BITS) * 1000.0f / m->bitrate_kbps);
+    }
+    if (m->preamble <= SIM_LORA_DETECT_SYMBOLS) return 0;
+    float tsym_us = (float)(1UL << m->sf) * 1000.0f / m->bw_khz;
+    return (uint64_t)((m->preamble - SIM_LORA_DETECT_SYMBOLS) * tsym_us);
+}
+
+// A frame ends: decide for every receiver locked onto it
+static void air_end(int idx) {
+    SimAir *a = &sim_air[idx];
+    a->done = true;
+    for (int i = 0; i < SIM_MAX_NODES; i++) {
+        SimNode *n = &sim_nodes[i];
+        if (!n->used || n->lock != idx) continue;
+        float s = a->m.power_dbm - sim_link_loss(a->node, i) + n->lock_fade_db;
+        float noise_mw = dbm_to_mw(noise_dbm(&n->m));
+        float co_mw = 0;
+        for (int j = 0; j < SIM_MAX_AIR; j++) {
+            SimAir *o = &sim_air[j];
+            if (j == idx || !o->used || o->node == i) continue;
+            if (o->start_us >= a->end_us || o->end_us <= a->start_us || !spectra_overlap(a, o)) continue;
+            float in = o->m.power_dbm - sim_link_loss(o->node, i);
+            if (same_modem(&a->m, &o->m)) {
+                co_mw += dbm_to_mw(in);
+            } else if (a->m.lora && o->m.lora && fabsf(a->m.bw_khz - o->m.bw_khz) < 0.5f) {
+                int dsf = a->m.sf > o->m.sf ? a->m.sf - o->m.sf : o->m.sf - a->m.sf;
+                noise_mw += dbm_to_mw(in - sim_sf_isolation[dsf & 7]);
+            } else {
+                noise_mw += dbm_to_mw(in);
+            }
+        }
+        bool captured = co_mw == 0 || s - mw_to_dbm(co_mw) >= SIM_CAPTURE_DB;
+        float snr = s - mw_to_dbm(noise_mw);
+        bool ok = captured && snr >= req_snr(&n->m);
+        if (ok) {
+            sim_st.delivered++;
+        } else if (co_mw > 0 || noise_mw > dbm_to_mw(noise_dbm(&n->m)) * 1.01f) {
+            sim_st.collided++;
+        } else {
+            sim_st.faded++;
+        }
+
+        SIM_Rx *rx = &n->rx;
+        memcpy(rx->data, a->data, a->len);
+        rx->len = a->len;
+        rx->crc_ok = ok;
+        rx->src = a->node;
+        rx->rssi = s;
+        rx->snr = snr;
+        rx->freq_err_hz = offset_hz(a, n);
+        rx->t_us = a->end_us;
+        n->lock = -1;
+        if (!n->continuous) n->state = SIM_STANDBY;
+        node_fire(n, ok ? SIM_IRQ_RX_DONE : (SIM_IRQ_RX_DONE | SIM_IRQ_CRC_ERR));
+    }
+}
+
+// CAD sees a LoRa frame of the same SF/BW on air that would clear the floor
+static bool cad_hit(int node) {
+    SimNode *n = &sim_nodes[node];
+    for (int j = 0; j < SIM_MAX_AIR; j++) {
+        SimAir *a = &sim_air[j];
+        if (!a->used || a->done || a->node == node || !same_modem(&a->m, &n->m)) continue;
+        if (fabsf(offset_hz(a, n)) > SIM_LORA_PULL_IN * n->m.bw_khz * 1000.0f) continue;
+        float rssi = a->m.power_dbm - sim_link_loss(a->node, node);
+        if (rssi - noise_dbm(&n->m) >= req_snr(&n->m)) return true;
+    }
+    return false;
+}
+
+// Drop finished frames that no longer overlap anything on air
+static void air_gc() {
+    uint64_t oldest = sim_now;
+    for (int j = 0; j < SIM_MAX_AIR; j++) {
+        if (sim_air[j].used && !sim_air[j].done && sim_air[j].start_us < oldest) oldest = sim_air[j].start_us;
+    }
+    for (int j = 0; j < SIM_MAX_AIR; j++) {
+        SimAir *a = &sim_air[j];
+        if (a->used && a->done && a->end_us <= oldest) {
+            bool locked = false;
+            for (int i = 0; i < SIM_MAX_NODES; i++) {
+                if (sim_nodes[i].lock == j) locked = true;
+            }
+            if (!locked) a->used = false;
+        }
+    }
+}
+
+uint64_t sim_next_event_us() {
+    uint64_t t = UINT64_MAX;
+    for (int j = 0; j < SIM_MAX_AIR; j++) {
+        if (sim_air[j].used && !sim_air[j].done && sim_air[j].end_us < t) t = sim_air[j].end_us;
+    }
+    for (int i = 0; i < SIM_MAX_NODES; i++) {
+        const SimNode *n = &sim_nodes[i];
+        if (!n->used) continue;
+        if (n->state == SIM_RX && n->timeout_us && n->timeout_us < t) t = n->timeout_us;
+        if (n->state == SIM_CAD && n->cad_end_us < t) t = n->cad_end_us;
+    }
+    return t;
+}
+
+// Process events in time order up to t; actions may start new operations
+void sim_run_until(uint64_t t_us) {
+    for (;;) {
+        uint64_t next = sim_next_event_us();
+        if (next > t_us) break;
+        sim_now = next;
+
+        for (int j = 0; j < SIM_MAX_AIR; j++) {
+            SimAir *a = &sim_air[j];
+            if (!a->used || a->done || a->end_us != next) continue;
+            SimNode *tx = &sim_nodes[a->node];
+            if (tx->state == SIM_TX && tx->tx_air == j) {
+                tx->state = SIM_STANDBY;
+                tx->tx_air = -1;
+            }
+            air_end(j);
+            node_fire(tx, SIM_IRQ_TX_DONE);
+        }
+        for (int i = 0; i < SIM_MAX_NODES; i++) {
+            SimNode *n = &sim_nodes[i];
+            if (!n->used) continue;
+            if (n->state == SIM_RX && n->timeout_us == next) {
+                // an FSK frame still being received is cut off, as on the radio
+                n->state = SIM_STANDBY;
+                n->lock = -1;
+                n->timeout_us = 0;
+                node_fire(n, SIM_IRQ_TIMEOUT);
+            } else if (n->state == SIM_CAD && n->cad_end_us == next) {
+                n->state = SIM_STANDBY;
+                node_fire(n, cad_hit(i) ? (SIM_IRQ_CAD_DONE | SIM_IRQ_CAD_DETECTED) : SIM_IRQ_CAD_DONE);
+            }
+        }
+        air_gc();
+    }
+    if (t_us > sim_now) sim_now = t_us;
+}
+
+void sim_set_action(int node, SIM_Action action, void *ctx) {
+    sim_nodes[node].action = action;
+    sim_nodes[node].ctx = ctx;
+}
+
+int sim_transmit(int node, const SIM_Modem *m, const uint8_t *data, size_t len) {
+    if (len > SIM_MAX_FRAME) return -1;
+    int idx = -1;
+    air_gc();
+    for (int j = 0; j < SIM_MAX_AIR && idx < 0; j++) {
+        if (!sim_air[j].used) idx = j;
+    }
+    if (idx < 0) return -1;
+    SimNode *n = &sim_nodes[node];
+    n->lock = -1;               // half duplex: a frame being received is lost
+    n->m = *m;
+    n->state = SIM_TX;
+    n->timeout_us = 0;
+
+    SimAir *a = &sim_air[idx];
+    a->used = true;
+    a->done = false;
+    a->node = node;
+    a->m = *m;
+    a->carrier_mhz = m->freq_mhz * (1.0f + n->ppm * 1e-6f);
+    memcpy(a->data, data, len);
+    a->len = len;
+    a->start_us = sim_now;
+    a->end_us = sim_now + sim_time_on_air_us(m, len);
+    n->tx_end_us = a->end_us;
+    n->tx_air = idx;
+    sim_st.tx++;
+    air_start(idx);
+    return 0;
+}
+
+// timeout 0 = continuous RX
+void sim_receive(int node, const SIM_Modem *m, uint32_t timeout_us, bool stop_on_preamble) {
+    SimNode *n = &sim_nodes[node];
+    n->m = *m;
+    n->state = SIM_RX;
+    n->lock = -1;
+    n->continuous = (timeout_us == 0);
+    n->stop_on_preamble = stop_on_preamble;
+    n->timeout_us = timeout_us ? sim_now + timeout_us : 0;
+    // armed during the preamble of a frame: enough of it is left to detect
+    for (int idx = 0; idx < SIM_MAX_AIR; idx++) {
+        SimAir *a = &sim_air[idx];
+        if (!a->used || a->done || a->node == node || !same_modem(&a->m, m)) continue;
+        if (sim_now >= a->start_us + air_detect_us(&a->m)) continue;
+        air_lock(idx, node);
+        if (n->lock >= 0) break;
+    }
+}
+
+void sim_cad(int node, const SIM_Modem *m) {
+    SimNode *n = &sim_nodes[node];
+    n->m = *m;
+    n->state = SIM_CAD;
+    n->lock = -1;
+    n->cad_end_us = sim_now + SIM_CAD_SYMBOLS * (uint64_t)((1UL << m->sf) * 1000.0f / m->bw_khz);
+}
+
+void sim_standby(int node) {
+    SimNode *n = &sim_nodes[node];
+    n->state = SIM_STANDBY;
+    n->lock = -1;
+    n->timeout_us = 0;
+}
+
+uint16_t sim_irq(int node) {
+    return sim_nodes[node].irq;
+}
+
+void sim_clear_irq(int node, uint16_t mask) {
+    sim_nodes[node].irq &= ~mask;
+}
+
+const SIM_Rx *sim_last_rx(int node) {
+    return &sim_nodes[node].rx;
+}
+
+const SIM_Stats *sim_stats() {
+    return &sim_st;
+}
@@ -0,0 +1,104 @@
+#ifndef CHAN_SIM_H
+#define CHAN_SIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Shared radio channel for host-side simulation. It lives here rather than
+// in the sketch folder, which the Arduino build compiles wholesale, and has
+// no Arduino or RadioLib dependency. Several nodes share one channel model
+// driven by a virtual microsecond clock, so a scenario runs the same way
+// every time for a given seed (test_chan_sim.cpp).
+//
+// Model, per frame and receiver:
+//  - time on air from the modem settings (SX126x formulas)
+//  - log-distance path loss with fixed per-link shadowing, or a scripted loss
+//  - thermal noise over the channel bandwidth plus a noise figure
+//  - lock at frame start: same modem, same SF/BW, carrier offset inside the
+//    pull-in range, SNR above the demodulation floor; half duplex. A receiver
+//    armed during a preamble still locks while enough of it is left
+//  - at frame end: co-SF interferers need the capture margin, other SFs and
+//    FSK add to the noise minus an SF isolation, then the SINR must clear the
+//    floor; a failed frame is reported as a CRC error, as the radio does
+#define SIM_MAX_NODES       16
+#define SIM_MAX_AIR         32          // transmissions kept for overlap checks
+#define SIM_MAX_FRAME       255
+#define SIM_NOISE_FIGURE_DB 6.0f
+#define SIM_CAPTURE_DB      6.0f        // co-SF capture threshold
+#define SIM_FSK_REQ_SNR_DB  10.0f       // FSK demodulation floor
+#define SIM_LORA_PULL_IN    0.25f       // LoRa offset tolerance, fraction of BW
+#define SIM_FSK_PULL_IN     0.25f       // FSK offset tolerance, fraction of RX BW
+#define SIM_CAD_SYMBOLS     2
+#define SIM_LORA_DETECT_SYMBOLS 4       // preamble left for an RX armed mid-frame
+#define SIM_FSK_DETECT_BITS 16
+
+// SX126x IRQ bits, as RadioLib names them
+#define SIM_IRQ_TX_DONE         0x0001
+#define SIM_IRQ_RX_DONE         0x0002
+#define SIM_IRQ_PREAMBLE        0x0004
+#define SIM_IRQ_CRC_ERR         0x0040
+#define SIM_IRQ_CAD_DONE        0x0080
+#define SIM_IRQ_CAD_DETECTED    0x0100
+#define SIM_IRQ_TIMEOUT         0x0200
+
+struct SIM_Modem {
+    bool lora;
+    float freq_mhz;
+    float bw_khz;           // LoRa bandwidth or FSK RX bandwidth
+    uint8_t sf;
+    uint8_t cr;             // coding rate denominator, 5-8
+    uint16_t preamble;      // symbols (LoRa) or bits (FSK)
+    float bitrate_kbps;     // FSK only
+    uint8_t sync_len;       // FSK sync word bytes
+    int8_t power_dbm;
+};
+
+struct SIM_Rx {
+    uint8_t data[SIM_MAX_FRAME];
+    size_t len;
+    bool crc_ok;
+    int src;
+    float rssi;
+    float snr;
+    float freq_err_hz;      // carrier offset seen by the receiver
+    uint64_t t_us;          // end of the frame
+};
+
+struct SIM_Stats {
+    uint32_t tx;
+    uint32_t locked;        // frame/receiver pairs that reached lock
+    uint32_t delivered;
+    uint32_t collided;      // locked but lost to interference
+    uint32_t faded;         // locked but lost without interference
+    uint32_t weak;          // below the floor at frame start
+    uint32_t offset;        // outside the pull-in range
+    uint32_t deaf;          // receiver busy (TX, other frame) or not in RX
+};
+
+typedef void (*SIM_Action)(void *ctx);
+
+void sim_init(uint32_t seed);
+int sim_add_node(float x_m, float y_m, float ppm);
+void sim_set_path_loss(float pl0_db, float exponent, float shadow_sigma_db, float fading_sigma_db);
+void sim_set_link_loss(int a, int b, float loss_db);   // scripted loss, both directions
+float sim_link_loss(int a, int b);
+
+uint64_t sim_now_us();
+void sim_run_until(uint64_t t_us);
+uint64_t sim_next_event_us();                           // UINT64_MAX when idle
+
+uint32_t sim_time_on_air_us(const SIM_Modem *m, size_t len);
+
+// radio operations of one node; results come back as IRQ bits + action
+void sim_set_action(int node, SIM_Action action, void *ctx);
+int sim_transmit(int node, const SIM_Modem *m, const uint8_t *data, size_t len);
+void sim_receive(int node, const SIM_Modem *m, uint32_t timeout_us, bool stop_on_preamble);
+void sim_cad(int node, const SIM_Modem *m);
+void sim_standby(int node);
+uint16_t sim_irq(int node);
+void sim_clear_irq(int node, uint16_t mask);
+const SIM_Rx *sim_last_rx(int node);
+
+const SIM_Stats *sim_stats();
+
+#endif // CHAN_SIM_H
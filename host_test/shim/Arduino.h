@@ -0,0 +1,90 @@
+#ifndef SHIM_ARDUINO_H
+#define SHIM_ARDUINO_H
+
+// Just enough of the Arduino ESP32 core to build the sketch modules on the
+// host (sim_node.cpp). Time is the virtual clock of chan_sim: delay() runs
+// the channel forward, and every clock read costs a microsecond so that
+// busy-waits on micros() end. Serial output is collected per node.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <math.h>
+#include <strings.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+
+#define F(x)            (x)
+#define IRAM_ATTR
+#define HEX             16
+#define DEC             10
+#define INPUT           0
+#define OUTPUT          1
+#define INPUT_PULLUP    2
+#define LOW             0
+#define HIGH            1
+#define RISING          1
+#define FALLING         2
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+class HardwareSerial {
+public:
+    void begin(unsigned long baud) { (void)baud; }
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *data, size_t len);
+    size_t print(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int v, int base = DEC) { return print((long)v, base); }
+    size_t print(unsigned v, int base = DEC) { return print((unsigned long)v, base); }
+    size_t print(long v, int base = DEC);
+    size_t print(unsigned long v, int base = DEC);
+    size_t print(double v, int digits = 2);
+    size_t println() { return print("\r\n"); }
+    template <typename T> size_t println(T v) { return print(v) + println(); }
+    template <typename T> size_t println(T v, int f) { return print(v, f) + println(); }
+    size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+    int available() { return 0; }
+    int read() { return -1; }
+    void flush() {}
+    operator bool() { return true; }
+};
+extern HardwareSerial Serial;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int val);
+int digitalRead(int pin);
+int digitalPinToInterrupt(int pin);
+void attachInterrupt(int irq, void (*isr)(void), int mode);
+void detachInterrupt(int irq);
+long random(long max);
+long random(long min, long max);
+uint32_t esp_random();
+bool psramFound();
+void *ps_malloc(size_t n);
+
+class EspClass {
+public:
+    uint64_t getEfuseMac();
+    uint32_t getFreeHeap() { return 0; }
+    uint32_t getCpuFreqMHz() { return 240; }
+};
+extern EspClass ESP;
+
+template <typename T, typename L, typename H> T constrain(T v, L lo, H hi) {
+    return v < lo ? (T)lo : (v > hi ? (T)hi : v);
+}
+
+#endif // SHIM_ARDUINO_H
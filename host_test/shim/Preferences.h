@@ -0,0 +1,33 @@
+#ifndef SHIM_PREFERENCES_H
+#define SHIM_PREFERENCES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// NVS in RAM, one store per node; lost when the node is unloaded
+class Preferences {
+public:
+    bool begin(const char *name, bool read_only = false);
+    void end() {}
+    size_t putBytes(const char *key, const void *value, size_t len);
+    size_t getBytes(const char *key, void *buf, size_t max);
+    size_t getBytesLength(const char *key);
+    size_t putString(const char *key, const char *value);
+    size_t getString(const char *key, char *buf, size_t max);
+    size_t putUChar(const char *key, uint8_t value) { return putBytes(key, &value, sizeof(value)); }
+    uint8_t getUChar(const char *key, uint8_t def = 0) { return get(key, def); }
+    size_t putUInt(const char *key, uint32_t value) { return putBytes(key, &value, sizeof(value)); }
+    uint32_t getUInt(const char *key, uint32_t def = 0) { return get(key, def); }
+    bool isKey(const char *key) { return getBytesLength(key) > 0; }
+    bool remove(const char *key);
+    bool clear();
+
+private:
+    char ns[16];
+    template <typename T> T get(const char *key, T def) {
+        T v;
+        return getBytes(key, &v, sizeof(v)) == sizeof(v) ? v : def;
+    }
+};
+
+#endif // SHIM_PREFERENCES_H
@@ -0,0 +1,128 @@
+#ifndef SHIM_RADIOLIB_H
+#define SHIM_RADIOLIB_H
+
+// The RadioLib SX1262 API the sketch uses, backed by the shared channel of
+// chan_sim instead of SPI (sim_radio.cpp). Settings are checked against the
+// SX126x ranges; CW, raw SPI commands other than the packet type, and IRQ
+// routing are accepted and ignored.
+#include <stdint.h>
+#include <stddef.h>
+#include "chan_sim.h"
+
+#define RADIOLIB_ERR_NONE                       (0)
+#define RADIOLIB_ERR_UNKNOWN                    (-1)
+#define RADIOLIB_ERR_MEMORY_ALLOCATION_FAILED   (-3)
+#define RADIOLIB_ERR_PACKET_TOO_LONG            (-4)
+#define RADIOLIB_ERR_TX_TIMEOUT                 (-5)
+#define RADIOLIB_ERR_RX_TIMEOUT                 (-6)
+#define RADIOLIB_ERR_CRC_MISMATCH               (-7)
+#define RADIOLIB_ERR_INVALID_BANDWIDTH          (-8)
+#define RADIOLIB_ERR_INVALID_SPREADING_FACTOR   (-9)
+#define RADIOLIB_ERR_INVALID_CODING_RATE        (-10)
+#define RADIOLIB_ERR_INVALID_FREQUENCY          (-12)
+#define RADIOLIB_ERR_INVALID_OUTPUT_POWER       (-13)
+#define RADIOLIB_PREAMBLE_DETECTED              (-14)
+#define RADIOLIB_CHANNEL_FREE                   (-15)
+#define RADIOLIB_ERR_INVALID_CURRENT_LIMIT      (-17)
+#define RADIOLIB_ERR_INVALID_PREAMBLE_LENGTH    (-18)
+#define RADIOLIB_ERR_WRONG_MODEM                (-20)
+#define RADIOLIB_ERR_INVALID_BIT_RATE           (-101)
+#define RADIOLIB_ERR_INVALID_FREQUENCY_DEVIATION (-102)
+#define RADIOLIB_ERR_INVALID_RX_BANDWIDTH       (-104)
+#define RADIOLIB_ERR_INVALID_SYNC_WORD          (-105)
+#define RADIOLIB_ERR_INVALID_CRC_CONFIGURATION  (-107)
+#define RADIOLIB_LORA_DETECTED                  (-1101)
+
+#define RADIOLIB_SX126X_IRQ_TX_DONE             SIM_IRQ_TX_DONE
+#define RADIOLIB_SX126X_IRQ_RX_DONE             SIM_IRQ_RX_DONE
+#define RADIOLIB_SX126X_IRQ_PREAMBLE_DETECTED   SIM_IRQ_PREAMBLE
+#define RADIOLIB_SX126X_IRQ_HEADER_VALID        0x0010
+#define RADIOLIB_SX126X_IRQ_CRC_ERR             SIM_IRQ_CRC_ERR
+#define RADIOLIB_SX126X_IRQ_CAD_DONE            SIM_IRQ_CAD_DONE
+#define RADIOLIB_SX126X_IRQ_CAD_DETECTED        SIM_IRQ_CAD_DETECTED
+#define RADIOLIB_SX126X_IRQ_TIMEOUT             SIM_IRQ_TIMEOUT
+#define RADIOLIB_SX126X_IRQ_ALL                 0x43FF
+#define RADIOLIB_SX126X_IRQ_RX_DEFAULT          0x0262
+#define RADIOLIB_SX126X_RX_TIMEOUT_INF          0xFFFFFF
+
+#define RADIOLIB_SX126X_CMD_SET_PACKET_TYPE         0x8A
+#define RADIOLIB_SX126X_CMD_STOP_TIMER_ON_PREAMBLE  0x9F
+#define RADIOLIB_SX126X_PACKET_TYPE_GFSK            0x00
+#define RADIOLIB_SX126X_PACKET_TYPE_LORA            0x01
+
+class SX1262;
+
+class Module {
+public:
+    Module(int cs, int irq, int rst, int gpio) { (void)cs; (void)irq; (void)rst; (void)gpio; }
+    int16_t SPIwriteStream(uint8_t cmd, uint8_t *data, size_t len, bool wait = true, bool verify = true);
+
+private:
+    friend class SX1262;
+    SX1262 *owner = nullptr;
+};
+
+class SX1262 {
+public:
+    SX1262(Module *mod);
+
+    int16_t begin(float freq = 434.0, float bw = 125.0, uint8_t sf = 9, uint8_t cr = 7, uint8_t sync = 0x12,
+                  int8_t power = 10, uint16_t preamble = 8, float tcxo = 1.6, bool ldo = false);
+    int16_t beginFSK(float freq = 434.0, float br = 4.8, float dev = 5.0, float rx_bw = 156.2, int8_t power = 10,
+                     uint16_t preamble = 16, float tcxo = 1.6, bool ldo = false);
+
+    int16_t setFrequency(float freq);
+    int16_t setBandwidth(float bw);
+    int16_t setSpreadingFactor(uint8_t sf);
+    int16_t setCodingRate(uint8_t cr);
+    int16_t setSyncWord(uint8_t sync, uint8_t control = 0x44);
+    int16_t setSyncWord(uint8_t *sync, size_t len);
+    int16_t setOutputPower(int8_t power);
+    int16_t setCurrentLimit(float ma);
+    int16_t setPreambleLength(size_t len);
+    int16_t setCRC(uint8_t len, uint16_t init = 0x1D0F, uint16_t poly = 0x1021, bool inverted = true);
+    int16_t setBitRate(float kbps);
+    int16_t setFrequencyDeviation(float khz);
+    int16_t setRxBandwidth(float khz);
+    int16_t setWhitening(bool on, uint16_t init = 0x01FF);
+    int16_t fixedPacketLengthMode(uint8_t len = 255);
+    int16_t variablePacketLengthMode(uint8_t max = 255);
+    int16_t setDio2AsRfSwitch(bool on = true);
+    int16_t setTCXO(float volt, uint32_t delay_us = 5000);
+    void setPacketReceivedAction(void (*isr)(void));
+    void setPacketSentAction(void (*isr)(void));
+
+    int16_t transmit(const uint8_t *data, size_t len, uint8_t addr = 0);
+    int16_t startTransmit(const uint8_t *data, size_t len, uint8_t addr = 0);
+    int16_t finishTransmit();
+    int16_t transmitDirect(uint32_t frf = 0);
+    int16_t startReceive();
+    int16_t startReceive(uint32_t timeout, uint16_t irq_flags = RADIOLIB_SX126X_IRQ_RX_DEFAULT,
+                         uint16_t irq_mask = RADIOLIB_SX126X_IRQ_RX_DONE, size_t len = 0);
+    int16_t startChannelScan();
+    int16_t getChannelScanResult();
+    int16_t readData(uint8_t *data, size_t len);
+    size_t getPacketLength(bool update = true);
+    float getRSSI();
+    float getSNR();
+    float getFrequencyError();
+    uint32_t getTimeOnAir(size_t len);
+    int16_t standby();
+    uint16_t getIrqStatus();
+    int16_t clearIrqStatus(uint16_t mask = RADIOLIB_SX126X_IRQ_ALL);
+    Module *getMod() { return mod; }
+
+private:
+    friend class Module;
+    Module *mod;
+    bool lora = true;
+    SIM_Modem lora_m;
+    SIM_Modem fsk_m;
+    void (*isr)(void) = nullptr;
+    bool stop_on_preamble = false;
+
+    SIM_Modem *modem() { return lora ? &lora_m : &fsk_m; }
+    static void on_irq(void *ctx);
+};
+
+#endif // SHIM_RADIOLIB_H
@@ -0,0 +1,258 @@
+// Arduino core, FreeRTOS and NVS for one host node (shim/Arduino.h)
+#include "Arduino.h"
+#include "Preferences.h"
+#include "esp_heap_caps.h"
+#include "chan_sim.h"
+#include "sim_node.h"
+
+#include <stdarg.h>
+#include <map>
+#include <string>
+#include <vector>
+
+int sim_self = -1;
+bool sim_in_isr = false;
+std::string sim_serial_out;
+
+HardwareSerial Serial;
+EspClass ESP;
+
+static uint32_t sim_rand_state = 1;
+
+void sim_seed_random(uint32_t seed) {
+    sim_rand_state = seed ? seed : 1;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+    sim_serial_out += (char)c;
+    return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *data, size_t len) {
+    sim_serial_out.append((const char *)data, len);
+    return len;
+}
+
+size_t HardwareSerial::print(long v, int base) {
+    if (base != HEX) return printf("%ld", v);
+    return printf("%lX", (unsigned long)v);
+}
+
+size_t HardwareSerial::print(unsigned long v, int base) {
+    return printf(base == HEX ? "%lX" : "%lu", v);
+}
+
+size_t HardwareSerial::print(double v, int digits) {
+    return printf("%.*f", digits, v);
+}
+
+size_t HardwareSerial::printf(const char *fmt, ...) {
+    char buf[512];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n < 0) return 0;
+    return write((const uint8_t *)buf, (size_t)n < sizeof(buf) ? n : sizeof(buf) - 1);
+}
+
+// Reading the clock costs a microsecond, except in a radio callback, which
+// runs inside the channel's own event loop
+static uint64_t sim_clock_read() {
+    if (!sim_in_isr) sim_run_until(sim_now_us() + 1);
+    return sim_now_us();
+}
+
+unsigned long millis() {
+    return (unsigned long)(sim_clock_read() / 1000);
+}
+
+unsigned long micros() {
+    return (unsigned long)sim_clock_read();
+}
+
+int64_t esp_timer_get_time() {
+    return (int64_t)sim_clock_read();
+}
+
+void delay(unsigned long ms) {
+    sim_run_until(sim_now_us() + (uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+    sim_run_until(sim_now_us() + us);
+}
+
+void yield() {}
+void pinMode(int, int) {}
+void digitalWrite(int, int) {}
+int digitalRead(int) { return LOW; }
+int digitalPinToInterrupt(int pin) { return pin; }
+void attachInterrupt(int, void (*)(void), int) {}
+void detachInterrupt(int) {}
+
+uint32_t esp_random() {
+    uint32_t x = sim_rand_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sim_rand_state = x ? x : 0x9E3779B9u;
+    return sim_rand_state;
+}
+
+long random(long max) {
+    return max > 0 ? (long)(esp_random() % (uint32_t)max) : 0;
+}
+
+long random(long min, long max) {
+    return max > min ? min + random(max - min) : min;
+}
+
+bool psramFound() {
+    return false;
+}
+
+void *ps_malloc(size_t n) {
+    return malloc(n);
+}
+
+uint64_t EspClass::getEfuseMac() {
+    return 0x0000A1B2C3D40000ull | (uint64_t)(sim_self + 1);
+}
+
+void heap_caps_get_info(multi_heap_info_t *info, uint32_t) {
+    memset(info, 0, sizeof(*info));
+}
+
+// ---- FreeRTOS: one thread, no tasks ----
+
+BaseType_t xTaskCreate(TaskFunction_t, const char *, uint32_t, void *, UBaseType_t, TaskHandle_t *) {
+    return pdFAIL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t, const char *, uint32_t, void *, UBaseType_t, TaskHandle_t *, int) {
+    return pdFAIL;
+}
+
+void vTaskDelete(TaskHandle_t) {}
+
+void vTaskDelay(TickType_t ticks) {
+    delay(ticks);
+}
+
+TickType_t xTaskGetTickCount() {
+    return (TickType_t)millis();
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t, BaseType_t *) {}
+
+uint32_t ulTaskNotifyTake(BaseType_t, TickType_t) {
+    return 0;
+}
+
+static int sim_mutex;
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    return &sim_mutex;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t) {
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t) {
+    return pdTRUE;
+}
+
+struct SimQueue {
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    uint8_t data[1];
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    SimQueue *q = (SimQueue *)calloc(1, sizeof(SimQueue) + length * item_size);
+    if (!q) return NULL;
+    q->length = length;
+    q->item_size = item_size;
+    return q;
+}
+
+BaseType_t xQueueSend(QueueHandle_t h, const void *item, TickType_t) {
+    SimQueue *q = (SimQueue *)h;
+    if (q->count == q->length) return pdFALSE;
+    memcpy(q->data + ((q->head + q->count) % q->length) * q->item_size, item, q->item_size);
+    q->count++;
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t h, void *item, TickType_t) {
+    SimQueue *q = (SimQueue *)h;
+    if (q->count == 0) return pdFALSE;
+    memcpy(item, q->data + q->head * q->item_size, q->item_size);
+    q->head = (q->head + 1) % q->length;
+    q->count--;
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t h) {
+    return ((SimQueue *)h)->count;
+}
+
+// ---- NVS ----
+
+static std::map<std::string, std::vector<uint8_t> > sim_nvs;
+
+static std::string nvs_key(const char *ns, const char *key) {
+    return std::string(ns) + "/" + key;
+}
+
+bool Preferences::begin(const char *name, bool) {
+    snprintf(ns, sizeof(ns), "%s", name);
+    return true;
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t len) {
+    sim_nvs[nvs_key(ns, key)].assign((const uint8_t *)value, (const uint8_t *)value + len);
+    return len;
+}
+
+size_t Preferences::getBytes(const char *key, void *buf, size_t max) {
+    auto it = sim_nvs.find(nvs_key(ns, key));
+    if (it == sim_nvs.end() || it->second.size() > max) return 0;
+    memcpy(buf, it->second.data(), it->second.size());
+    return it->second.size();
+}
+
+size_t Preferences::getBytesLength(const char *key) {
+    auto it = sim_nvs.find(nvs_key(ns, key));
+    return it == sim_nvs.end() ? 0 : it->second.size();
+}
+
+size_t Preferences::putString(const char *key, const char *value) {
+    return putBytes(key, value, strlen(value) + 1);
+}
+
+size_t Preferences::getString(const char *key, char *buf, size_t max) {
+    size_t n = getBytes(key, buf, max);
+    if (n == 0 && max) buf[0] = 0;
+    return n;
+}
+
+bool Preferences::remove(const char *key) {
+    return sim_nvs.erase(nvs_key(ns, key)) > 0;
+}
+
+bool Preferences::clear() {
+    std::string prefix = std::string(ns) + "/";
+    for (auto it = sim_nvs.begin(); it != sim_nvs.end();) {
+        if (it->first.compare(0, prefix.size(), prefix) == 0) {
+            it = sim_nvs.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,276 @@
+// SX1262 facade over chan_sim (shim/RadioLib.h): the node's radio is node
+// sim_self of the shared channel. The LoRa and FSK settings are kept apart,
+// as in the chip, and the packet type picks which one goes on air.
+#include "RadioLib.h"
+#include "sim_node.h"
+
+#include <math.h>
+#include <string.h>
+
+#define SIM_RX_TIMEOUT_STEP_US  15.625f     // SX126x RX timeout unit
+
+static const float sim_lora_bw[] = {7.8f, 10.4f, 15.6f, 20.8f, 31.25f, 41.7f, 62.5f, 125.0f, 250.0f, 500.0f};
+
+int16_t Module::SPIwriteStream(uint8_t cmd, uint8_t *data, size_t len, bool, bool) {
+    if (!owner || len < 1) return RADIOLIB_ERR_NONE;
+    if (cmd == RADIOLIB_SX126X_CMD_SET_PACKET_TYPE) {
+        owner->lora = (data[0] == RADIOLIB_SX126X_PACKET_TYPE_LORA);
+    } else if (cmd == RADIOLIB_SX126X_CMD_STOP_TIMER_ON_PREAMBLE) {
+        owner->stop_on_preamble = data[0] != 0;
+    }
+    return RADIOLIB_ERR_NONE;
+}
+
+SX1262::SX1262(Module *m) : mod(m) {
+    mod->owner = this;
+    memset(&lora_m, 0, sizeof(lora_m));
+    memset(&fsk_m, 0, sizeof(fsk_m));
+    lora_m.lora = true;
+}
+
+// DIO1: the sketch's ISR, with the clock held while it runs
+void SX1262::on_irq(void *ctx) {
+    SX1262 *r = (SX1262 *)ctx;
+    if (!r->isr) return;
+    sim_in_isr = true;
+    r->isr();
+    sim_in_isr = false;
+}
+
+int16_t SX1262::begin(float freq, float bw, uint8_t sf, uint8_t cr, uint8_t sync, int8_t power, uint16_t preamble,
+                      float, bool) {
+    sim_set_action(sim_self, on_irq, this);
+    sim_standby(sim_self);
+    lora = true;
+    int16_t state = setFrequency(freq);
+    if (state == RADIOLIB_ERR_NONE) state = setBandwidth(bw);
+    if (state == RADIOLIB_ERR_NONE) state = setSpreadingFactor(sf);
+    if (state == RADIOLIB_ERR_NONE) state = setCodingRate(cr);
+    if (state == RADIOLIB_ERR_NONE) state = setSyncWord(sync);
+    if (state == RADIOLIB_ERR_NONE) state = setOutputPower(power);
+    if (state == RADIOLIB_ERR_NONE) state = setPreambleLength(preamble);
+    return state;
+}
+
+int16_t SX1262::beginFSK(float freq, float br, float dev, float rx_bw, int8_t power, uint16_t preamble, float, bool) {
+    sim_set_action(sim_self, on_irq, this);
+    sim_standby(sim_self);
+    lora = false;
+    fsk_m.sync_len = 2;
+    int16_t state = setFrequency(freq);
+    if (state == RADIOLIB_ERR_NONE) state = setBitRate(br);
+    if (state == RADIOLIB_ERR_NONE) state = setFrequencyDeviation(dev);
+    if (state == RADIOLIB_ERR_NONE) state = setRxBandwidth(rx_bw);
+    if (state == RADIOLIB_ERR_NONE) state = setOutputPower(power);
+    if (state == RADIOLIB_ERR_NONE) state = setPreambleLength(preamble);
+    return state;
+}
+
+int16_t SX1262::setFrequency(float freq) {
+    if (freq < 150.0f || freq > 960.0f) return RADIOLIB_ERR_INVALID_FREQUENCY;
+    lora_m.freq_mhz = freq;
+    fsk_m.freq_mhz = freq;
+    return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::setBandwidth(float bw) {
+    if (!lora) return RADIOLIB_ERR_WRONG_MODEM;
+    for (size_t i = 0; i < sizeof(sim_lora_bw) / sizeof(sim_lora_bw[0]); i++) {
+        if (fabsf(bw - sim_lora_bw[i]) < 0.01f) {
+            lora_m.bw_khz = bw;
+            return RADIOLIB_ERR_NONE;
+        }
+    }
+    return RADIOLIB_ERR_INVALID_BANDWIDTH;
+}
+
+int16_t SX1262::setSpreadingFactor(uint8_t sf) {
+    if (!lora) return RADIOLIB_ERR_WRONG_MODEM;
+    if (sf < 5 || sf > 12) return RADIOLIB_ERR_INVALID_SPREADING_FACTOR;
+    lora_m.sf = sf;
+    return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::setCodingRate(uint8_t cr) {
+    if (!lora) return RADIOLIB_ERR_WRONG_MODEM;
+    if (cr < 5 || cr > 8) return RADIOLIB_ERR_INVALID_CODING_RATE;
+    lora_m.cr = cr;
+    return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::setSyncWord(uint8_t, uint8_t) {
+    return lora ? RADIOLIB_ERR_NONE : RADIOLIB_ERR_WRONG_MODEM;
+}
+
+int16_t SX1262::setSyncWord(uint8_t *, size_t len) {
+    if (lora) return RADIOLIB_ERR_WRONG_MODEM;
+    if (len < 1 || len > 8) return RADIOLIB_ERR_INVALID_SYNC_WORD;
+    fsk_m.sync_len = (uint8_t)len;
+    return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::setOutputPower(int8_t power) {
+    if (power < -9 || power > 22) return RADIOLIB_ERR_INVALID_OUTPUT_POWER;
+    lora_m.power_dbm = power;
+    fsk_m.power_dbm = power;
+    return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::setCurrentLimit(float ma) {
+    return (ma < 0 || ma > 140) ? RADIOLIB_ERR_INVALID_CURRENT_LIMIT : RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::setPreambleLength(size_t len) {
+    if (len < 1 || len > 65535) return RADIOLIB_ERR_INVALID_PREAMBLE_LENGTH;
+    modem()->preamble = (uint16_t)len;
+    return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::setCRC(uint8_t len, uint16_t, uint16_t, bool) {
+    if (!lora && len > 2) return RADIOLIB_ERR_INVALID_CRC_CONFIGURATION;
+    return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::setBitRate(float kbps) {
+    if (lora) return RADIOLIB_ERR_WRONG_MODEM;
+    if (kbps < 0.6f || kbps > 300.0f) return RADIOLIB_ERR_INVALID_BIT_RATE;
+    fsk_m.bitrate_kbps = kbps;
+    return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::setFrequencyDeviation(float khz) {
+    if (lora) return RADIOLIB_ERR_WRONG_MODEM;
+    return (khz < 0 || khz > 200.0f) ? RADIOLIB_ERR_INVALID_FREQUENCY_DEVIATION : RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::setRxBandwidth(float khz) {
+    if (lora) return RADIOLIB_ERR_WRONG_MODEM;
+    if (khz <= 0 || khz > 467.0f) return RADIOLIB_ERR_INVALID_RX_BANDWIDTH;
+    fsk_m.bw_khz = khz;
+    return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::setWhitening(bool, uint16_t) {
+    return lora ? RADIOLIB_ERR_WRONG_MODEM : RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::fixedPacketLengthMode(uint8_t) {
+    return lora ? RADIOLIB_ERR_WRONG_MODEM : RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::variablePacketLengthMode(uint8_t) {
+    return lora ? RADIOLIB_ERR_WRONG_MODEM : RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::setDio2AsRfSwitch(bool) {
+    return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::setTCXO(float, uint32_t) {
+    return RADIOLIB_ERR_NONE;
+}
+
+// Both actions are DIO1, as in RadioLib: the last one set wins
+void SX1262::setPacketReceivedAction(void (*f)(void)) {
+    isr = f;
+}
+
+void SX1262::setPacketSentAction(void (*f)(void)) {
+    isr = f;
+}
+
+// Blocking: the channel runs to the end of the frame
+int16_t SX1262::transmit(const uint8_t *data, size_t len, uint8_t) {
+    int16_t state = startTransmit(data, len);
+    if (state != RADIOLIB_ERR_NONE) return state;
+    sim_run_until(sim_now_us() + sim_time_on_air_us(modem(), len));
+    if (!(sim_irq(sim_self) & SIM_IRQ_TX_DONE)) state = RADIOLIB_ERR_TX_TIMEOUT;
+    finishTransmit();
+    return state;
+}
+
+int16_t SX1262::startTransmit(const uint8_t *data, size_t len, uint8_t) {
+    if (len > SIM_MAX_FRAME) return RADIOLIB_ERR_PACKET_TOO_LONG;
+    sim_clear_irq(sim_self, RADIOLIB_SX126X_IRQ_ALL);
+    return sim_transmit(sim_self, modem(), data, len) == 0 ? RADIOLIB_ERR_NONE : RADIOLIB_ERR_UNKNOWN;
+}
+
+int16_t SX1262::finishTransmit() {
+    sim_clear_irq(sim_self, RADIOLIB_SX126X_IRQ_ALL);
+    return standby();
+}
+
+// No carrier model: CW leaves the channel untouched
+int16_t SX1262::transmitDirect(uint32_t) {
+    return standby();
+}
+
+int16_t SX1262::startReceive() {
+    return startReceive(RADIOLIB_SX126X_RX_TIMEOUT_INF);
+}
+
+// Timeouts in SX126x steps; "none" and "infinite" both stay in RX
+int16_t SX1262::startReceive(uint32_t timeout, uint16_t, uint16_t, size_t) {
+    sim_clear_irq(sim_self, RADIOLIB_SX126X_IRQ_ALL);
+    uint32_t us = (timeout == 0 || timeout == RADIOLIB_SX126X_RX_TIMEOUT_INF)
+                      ? 0 : (uint32_t)ceilf(timeout * SIM_RX_TIMEOUT_STEP_US);
+    sim_receive(sim_self, modem(), us, stop_on_preamble);
+    return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::startChannelScan() {
+    if (!lora) return RADIOLIB_ERR_WRONG_MODEM;
+    sim_clear_irq(sim_self, RADIOLIB_SX126X_IRQ_ALL);
+    sim_cad(sim_self, &lora_m);
+    return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::getChannelScanResult() {
+    uint16_t irq = sim_irq(sim_self);
+    if (irq & SIM_IRQ_CAD_DETECTED) return RADIOLIB_LORA_DETECTED;
+    if (irq & SIM_IRQ_CAD_DONE) return RADIOLIB_CHANNEL_FREE;
+    return RADIOLIB_ERR_UNKNOWN;
+}
+
+int16_t SX1262::readData(uint8_t *data, size_t len) {
+    const SIM_Rx *rx = sim_last_rx(sim_self);
+    size_t n = (len == 0 || len > rx->len) ? rx->len : len;
+    memcpy(data, rx->data, n);
+    bool crc_err = sim_irq(sim_self) & SIM_IRQ_CRC_ERR;
+    sim_clear_irq(sim_self, RADIOLIB_SX126X_IRQ_ALL);
+    return crc_err ? RADIOLIB_ERR_CRC_MISMATCH : RADIOLIB_ERR_NONE;
+}
+
+size_t SX1262::getPacketLength(bool) {
+    return sim_last_rx(sim_self)->len;
+}
+
+float SX1262::getRSSI() {
+    return sim_last_rx(sim_self)->rssi;
+}
+
+float SX1262::getSNR() {
+    return sim_last_rx(sim_self)->snr;
+}
+
+float SX1262::getFrequencyError() {
+    return sim_last_rx(sim_self)->freq_err_hz;
+}
+
+uint32_t SX1262::getTimeOnAir(size_t len) {
+    return sim_time_on_air_us(modem(), len);
+}
+
+int16_t SX1262::standby() {
+    sim_standby(sim_self);
+    return RADIOLIB_ERR_NONE;
+}
+
+uint16_t SX1262::getIrqStatus() {
+    return sim_irq(sim_self);
+}
+
+int16_t SX1262::clearIrqStatus(uint16_t mask) {
+    sim_clear_irq(sim_self, mask);
+    return RADIOLIB_ERR_NONE;
+}
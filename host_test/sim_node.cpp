@@ -0,0 +1,86 @@
+// Entry points of a virtual node (sim_node.h): setup() and loop() of the
+// sketch (rak3112_test.ino) minus the board peripherals, and the console.
+#include "sim_node.h"
+#include "Arduino.h"
+#include "command.h"
+#include "lora.h"
+#include "pktbuf.h"
+#include "rx_capture.h"
+#include "rx_output.h"
+#include "rx_stats.h"
+#include "irq_lat.h"
+#include "p2p.h"
+#include "afc.h"
+#include "xfer.h"
+#include "arq.h"
+#include "adr.h"
+#include "compress.h"
+#include "secure.h"
+#include "dualrx.h"
+#include "profile.h"
+#include "sweep.h"
+#include "timebase.h"
+#include "tdma.h"
+#include "collector.h"
+#include "relay.h"
+#include "agg.h"
+#include "txq.h"
+
+#include <string>
+
+extern std::string sim_serial_out;
+
+extern "C" void sim_node_setup(int sim_node, uint16_t node_id) {
+    sim_self = sim_node;
+    sim_seed_random(0x5EED0000u + sim_node);
+    init_lora_radio();
+    init_pktbuf();
+    init_rx_capture();
+    init_rx_output();
+    init_rx_stats();
+    init_collector();
+    init_irqlat();
+    init_p2p();
+    init_afc();
+    init_xfer();
+    init_arq();
+    init_adr();
+    init_compress();
+    init_secure();
+    init_dualrx();
+    init_sweep();
+    init_timebase();
+    init_tdma();
+    init_relay();
+    init_agg();
+    init_txq();
+    // init_hex: AT+HEXBENCH is built for the target only
+    init_profile();
+    g_node_id = node_id;
+}
+
+extern "C" void sim_node_loop() {
+    receive_packet();
+    fhss_auto_hop_send_loop();
+    xfer_loop();
+    arq_loop();
+    adr_loop();
+    sweep_loop();
+    timebase_loop();
+    tdma_loop();
+    relay_loop();
+    agg_loop();
+    txq_loop();
+}
+
+extern "C" void sim_node_at(const char *line) {
+    process_AT_Command(line);
+}
+
+extern "C" const char *sim_node_output() {
+    return sim_serial_out.c_str();
+}
+
+extern "C" void sim_node_clear_output() {
+    sim_serial_out.clear();
+}
@@ -0,0 +1,34 @@
+#ifndef SIM_NODE_H
+#define SIM_NODE_H
+
+#include <stdint.h>
+
+// One virtual node: the sketch modules built with the host shims (shim/)
+// into a shared object of their own, so every node has its own globals,
+// radio and packet pool. The channel and the clock live in the test
+// program, which loads one copy per node and drives them through these
+// entry points; the radio calls back into chan_sim directly.
+extern "C" {
+// setup() of the sketch without the board peripherals
+void sim_node_setup(int sim_node, uint16_t node_id);
+// one pass of loop(), without its delay: the test advances the clock
+void sim_node_loop();
+// run one AT command line as the AT task would
+void sim_node_at(const char *line);
+// Serial output since the last clear, NUL terminated
+const char *sim_node_output();
+void sim_node_clear_output();
+}
+
+typedef void (*SimNodeSetup)(int sim_node, uint16_t node_id);
+typedef void (*SimNodeLoop)();
+typedef void (*SimNodeAt)(const char *line);
+typedef const char *(*SimNodeOutput)();
+typedef void (*SimNodeClear)();
+
+// shim internals of the node library
+extern int sim_self;            // chan_sim node of this library
+extern bool sim_in_isr;         // inside a radio callback: the clock stands still
+void sim_seed_random(uint32_t seed);
+
+#endif // SIM_NODE_H
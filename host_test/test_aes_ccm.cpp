@@ -0,0 +1,118 @@
+// Software AES-128-CCM (aes_ccm.cpp) against the RFC 3610 packet vectors
+// that match the P2P parameters: 13-byte nonce, 8-byte tag, 8-byte aad.
+#include "aes_ccm.h"
+#include "p2p.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+struct Vector {
+    const char *name;
+    uint8_t nonce[AES_CCM_NONCE_LEN];
+    size_t len;             // payload bytes after the 8 aad bytes
+    const uint8_t *cipher;
+    uint8_t tag[AES_CCM_TAG_LEN];
+};
+
+// RFC 3610 section 8, packet vectors #1 and #2. Key C0..CF; the packet is
+// bytes 00.. of which the first 8 are aad.
+static const uint8_t v1_cipher[] = {
+    0x58, 0x8C, 0x97, 0x9A, 0x61, 0xC6, 0x63, 0xD2, 0xF0, 0x66, 0xD0, 0xC2,
+    0xC0, 0xF9, 0x89, 0x80, 0x6D, 0x5F, 0x6B, 0x61, 0xDA, 0xC3, 0x84,
+};
+static const uint8_t v2_cipher[] = {
+    0x72, 0xC9, 0x1A, 0x36, 0xE1, 0x35, 0xF8, 0xCF, 0x29, 0x1C, 0xA8, 0x94,
+    0x08, 0x5C, 0x87, 0xE3, 0xCC, 0x15, 0xC4, 0x39, 0xC9, 0xE4, 0x3A, 0x3B,
+};
+
+static const Vector vectors[] = {
+    {"#1", {0x00, 0x00, 0x00, 0x03, 0x02, 0x01, 0x00, 0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5},
+     sizeof(v1_cipher), v1_cipher, {0x17, 0xE8, 0xD1, 0x2C, 0xFD, 0xF9, 0x26, 0xE0}},
+    {"#2", {0x00, 0x00, 0x00, 0x04, 0x03, 0x02, 0x01, 0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5},
+     sizeof(v2_cipher), v2_cipher, {0xA0, 0x91, 0xD5, 0x6E, 0x10, 0x40, 0x09, 0x16}},
+};
+
+static void test_vector(const Vector *v) {
+    uint8_t key[AES_CCM_KEY_LEN];
+    uint8_t aad[8];
+    uint8_t buf[32];
+    uint8_t tag[AES_CCM_TAG_LEN];
+    for (int i = 0; i < AES_CCM_KEY_LEN; i++) key[i] = (uint8_t)(0xC0 + i);
+    for (int i = 0; i < 8; i++) aad[i] = (uint8_t)i;
+    for (size_t i = 0; i < v->len; i++) buf[i] = (uint8_t)(8 + i);
+
+    AES_CCM_Ctx ctx;
+    aes_ccm_init(&ctx, key);
+    printf("aes_ccm: RFC 3610 packet vector %s\n", v->name);
+    CHECK(aes_ccm_encrypt(&ctx, v->nonce, aad, sizeof(aad), buf, v->len, tag) == 0);
+    CHECK(memcmp(buf, v->cipher, v->len) == 0);
+    CHECK(memcmp(tag, v->tag, sizeof(tag)) == 0);
+
+    CHECK(aes_ccm_decrypt(&ctx, v->nonce, aad, sizeof(aad), buf, v->len, tag));
+    for (size_t i = 0; i < v->len; i++) CHECK(buf[i] == (uint8_t)(8 + i));
+
+    // a flipped bit anywhere fails and wipes the buffer
+    uint8_t bad_tag[AES_CCM_TAG_LEN];
+    memcpy(buf, v->cipher, v->len);
+    memcpy(bad_tag, v->tag, sizeof(bad_tag));
+    bad_tag[3] ^= 0x01;
+    CHECK(!aes_ccm_decrypt(&ctx, v->nonce, aad, sizeof(aad), buf, v->len, bad_tag));
+    for (size_t i = 0; i < v->len; i++) CHECK(buf[i] == 0);
+
+    memcpy(buf, v->cipher, v->len);
+    buf[v->len - 1] ^= 0x80;
+    CHECK(!aes_ccm_decrypt(&ctx, v->nonce, aad, sizeof(aad), buf, v->len, v->tag));
+
+    uint8_t bad_aad[8];
+    memcpy(bad_aad, aad, sizeof(bad_aad));
+    bad_aad[0] ^= 0x01;
+    memcpy(buf, v->cipher, v->len);
+    CHECK(!aes_ccm_decrypt(&ctx, v->nonce, bad_aad, sizeof(bad_aad), buf, v->len, v->tag));
+    aes_ccm_free(&ctx);
+}
+
+// seal and open every P2P payload length, including empty and multi-block
+static void test_round_trip() {
+    printf("aes_ccm: round trip 0-%d bytes\n", P2P_MAX_PAYLOAD);
+    uint8_t key[AES_CCM_KEY_LEN];
+    uint8_t nonce[AES_CCM_NONCE_LEN] = {0};
+    uint8_t aad[10] = {0xA7, 0x01, 0x08};
+    uint8_t plain[P2P_MAX_PAYLOAD];
+    uint8_t buf[sizeof(plain)];
+    uint8_t tag[AES_CCM_TAG_LEN];
+    for (int i = 0; i < AES_CCM_KEY_LEN; i++) key[i] = (uint8_t)(i * 7);
+    AES_CCM_Ctx ctx;
+    aes_ccm_init(&ctx, key);
+    for (size_t len = 0; len <= sizeof(plain); len++) {
+        for (size_t i = 0; i < len; i++) plain[i] = (uint8_t)(i ^ len);
+        memcpy(buf, plain, len);
+        nonce[4] = (uint8_t)len;
+        CHECK(aes_ccm_encrypt(&ctx, nonce, aad, sizeof(aad), buf, len, tag) == 0);
+        CHECK(len < 4 || memcmp(buf, plain, len) != 0);
+        CHECK(aes_ccm_decrypt(&ctx, nonce, aad, sizeof(aad), buf, len, tag));
+        CHECK(memcmp(buf, plain, len) == 0);
+    }
+    aes_ccm_free(&ctx);
+}
+
+int main() {
+    CHECK(!aes_ccm_hw_available());
+    for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) test_vector(&vectors[i]);
+    test_round_trip();
+    if (failures) {
+        printf("aes_ccm: %d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("aes_ccm: OK\n");
+    return 0;
+}
@@ -0,0 +1,265 @@
+// ARQ engine (arq_core.cpp) over a simulated lossy link. The engine talks
+// to itself through peer PEER: every DATA frame it sends comes back in
+// through arq_on_data and every ack through arq_on_ack, so one instance
+// exercises both the sender and the receiver side. Loss is drawn from a
+// fixed seed, so every run sees the same link.
+#include "arq_core.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#define PEER        7
+#define MSG_LEN     20
+#define MSG_COUNT   300
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+// xorshift32, so results do not depend on the C library's rand()
+static uint32_t rng_state;
+
+static uint32_t rng() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+struct Frame {
+    uint32_t due_ms;
+    bool ack;
+    uint16_t seq;
+    bool ackreq;
+    uint8_t data[ARQ_MAX_PAYLOAD];
+    size_t len;
+};
+
+static uint32_t now = 0;
+static uint32_t loss_pct = 0;
+static std::vector<Frame> air;
+
+static int app_rx[MSG_COUNT];          // times each message reached the application
+static int app_dup_passed = 0;
+static int results_ok = 0;
+static int results_failed = 0;
+static uint8_t max_tries = 0;
+
+static bool link_lost() {
+    return rng() % 100 < loss_pct;
+}
+
+static uint32_t io_toa(size_t len) {
+    return 40 + (uint32_t)len;
+}
+
+static int io_send_data(uint16_t dst, uint16_t seq, bool ackreq, const uint8_t *data, size_t len) {
+    (void)dst;
+    now += io_toa(len);
+    if (link_lost()) return 0;
+    Frame f = {};
+    f.due_ms = now;
+    f.seq = seq;
+    f.ackreq = ackreq;
+    memcpy(f.data, data, len);
+    f.len = len;
+    air.push_back(f);
+    return 0;
+}
+
+static int io_send_ack(uint16_t dst, const uint8_t *ack, size_t len) {
+    (void)dst;
+    if (link_lost()) return 0;
+    Frame f = {};
+    f.due_ms = now + io_toa(len) + 20;
+    f.ack = true;
+    memcpy(f.data, ack, len);
+    f.len = len;
+    air.push_back(f);
+    return 0;
+}
+
+static uint32_t io_now() {
+    return now;
+}
+
+static void io_result(uint16_t dst, uint16_t seq, bool delivered, uint32_t latency_ms, uint8_t tries) {
+    (void)dst;
+    (void)seq;
+    (void)latency_ms;
+    if (delivered) {
+        results_ok++;
+    } else {
+        results_failed++;
+    }
+    if (tries > max_tries) max_tries = tries;
+}
+
+static const ARQ_Io io = {io_send_data, io_send_ack, io_now, io_toa, io_result};
+
+// Hand frames that are due to the engine. Acks sent while handling them go
+// on the air list and are picked up on a later pass.
+static void deliver() {
+    std::vector<Frame> due;
+    for (size_t i = 0; i < air.size();) {
+        if ((int32_t)(now - air[i].due_ms) >= 0) {
+            due.push_back(air[i]);
+            air.erase(air.begin() + i);
+        } else {
+            i++;
+        }
+    }
+    for (size_t i = 0; i < due.size(); i++) {
+        const Frame &f = due[i];
+        if (f.ack) {
+            arq_on_ack(PEER, f.data, f.len);
+            continue;
+        }
+        if (!arq_on_data(PEER, f.seq, f.ackreq)) continue;
+        uint32_t id;
+        memcpy(&id, f.data, sizeof(id));
+        if (id < MSG_COUNT) {
+            if (app_rx[id]) app_dup_passed++;
+            app_rx[id]++;
+        }
+    }
+}
+
+struct RunResult {
+    int delivered;
+    int missing;
+    int dup_passed;
+    int ok;
+    int failed;
+    uint8_t max_tries;
+    const ARQ_PeerStats *st;
+};
+
+static RunResult run(uint32_t seed, uint32_t loss, uint8_t window, int count) {
+    rng_state = seed;
+    loss_pct = loss;
+    now = 1000;
+    air.clear();
+    memset(app_rx, 0, sizeof(app_rx));
+    app_dup_passed = results_ok = results_failed = 0;
+    max_tries = 0;
+    arq_init(&io);
+    arq_set_window(window);
+    arq_set_retries(ARQ_DEFAULT_RETRIES);
+
+    int submitted = 0;
+    for (uint32_t step = 0; step < 5000000 && (submitted < count || arq_pending() || !air.empty()); step++) {
+        while (submitted < count && arq_pending() < ARQ_QUEUE_LEN) {
+            uint8_t msg[MSG_LEN] = {0};
+            uint32_t id = (uint32_t)submitted;
+            memcpy(msg, &id, sizeof(id));
+            if (arq_submit(PEER, msg, sizeof(msg)) < 0) break;
+            submitted++;
+        }
+        arq_poll();
+        deliver();
+        now++;
+    }
+
+    RunResult r = {};
+    for (int i = 0; i < count; i++) {
+        if (app_rx[i]) {
+            r.delivered++;
+        } else {
+            r.missing++;
+        }
+    }
+    r.dup_passed = app_dup_passed;
+    r.ok = results_ok;
+    r.failed = results_failed;
+    r.max_tries = max_tries;
+    r.st = arq_peer_stats(0);
+    return r;
+}
+
+static void test_clean_link() {
+    RunResult r = run(1, 0, 1, MSG_COUNT);
+    CHECK(r.delivered == MSG_COUNT);
+    CHECK(r.ok == MSG_COUNT);
+    CHECK(r.failed == 0);
+    CHECK(r.st && r.st->retransmits == 0);
+    CHECK(r.st && r.st->timeouts == 0);
+    CHECK(r.st && r.st->rx_dup == 0);
+    CHECK(r.max_tries == 1);
+}
+
+// 10% loss each way: everything arrives once, lost acks show up as
+// duplicates at the receiver and are not passed up
+static void test_lossy_link(uint8_t window) {
+    RunResult r = run(0x2545F491, 10, window, MSG_COUNT);
+    printf("  window %u: retransmits %u, timeouts %u, dups dropped %u, max tries %u\n", window,
+           r.st ? r.st->retransmits : 0, r.st ? r.st->timeouts : 0, r.st ? r.st->rx_dup : 0, r.max_tries);
+    CHECK(r.missing == 0);
+    CHECK(r.dup_passed == 0);
+    CHECK(r.ok == MSG_COUNT);
+    CHECK(r.failed == 0);
+    CHECK(r.st && r.st->delivered == MSG_COUNT);
+    CHECK(r.st && r.st->retransmits > 0);
+    CHECK(r.st && r.st->timeouts > 0);
+    CHECK(r.st && r.st->rx_dup > 0);
+    CHECK(r.st && r.st->rx_new == MSG_COUNT);
+    CHECK(r.st && r.st->tx_frames == MSG_COUNT + r.st->retransmits);
+    CHECK(r.max_tries <= ARQ_DEFAULT_RETRIES + 1);
+}
+
+// dead link: every message fails after exactly retries + 1 tries
+static void test_dead_link() {
+    RunResult r = run(3, 100, 1, 4);
+    CHECK(r.delivered == 0);
+    CHECK(r.ok == 0);
+    CHECK(r.failed == 4);
+    CHECK(r.max_tries == ARQ_DEFAULT_RETRIES + 1);
+    CHECK(r.st && r.st->tx_frames == 4 * (ARQ_DEFAULT_RETRIES + 1));
+    CHECK(arq_pending() == 0);
+}
+
+// the same seed gives the same run
+static void test_deterministic() {
+    RunResult a = run(42, 30, 4, 100);
+    uint32_t retx = a.st ? a.st->retransmits : 0;
+    uint32_t end = now;
+    RunResult b = run(42, 30, 4, 100);
+    CHECK(b.st && b.st->retransmits == retx);
+    CHECK(now == end);
+}
+
+static void test_limits() {
+    uint8_t big[ARQ_MAX_PAYLOAD + 1] = {0};
+    arq_init(&io);
+    CHECK(ARQ_MAX_PAYLOAD == P2P_MAX_PAYLOAD);
+    CHECK(arq_submit(PEER, big, sizeof(big)) < 0);
+    CHECK(arq_submit(PEER, big, ARQ_MAX_PAYLOAD) >= 0);
+    arq_reset();
+}
+
+int main() {
+    printf("arq: clean link\n");
+    test_clean_link();
+    printf("arq: lossy link\n");
+    test_lossy_link(1);
+    test_lossy_link(4);
+    printf("arq: dead link\n");
+    test_dead_link();
+    printf("arq: determinism\n");
+    test_deterministic();
+    printf("arq: limits\n");
+    test_limits();
+    if (failures) {
+        printf("arq: %d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("arq: OK\n");
+    return 0;
+}
@@ -0,0 +1,215 @@
+// Channel model (chan_sim.cpp) scenarios: airtime, collision, capture, SF
+// isolation, channel separation, RX timeout, CAD and seeded repeatability.
+// Receiver at the origin, wanted sender 1 km away, interferer placed per
+// scenario; path loss 40 dB at 1 m with exponent 2.7 and no shadowing.
+#include "chan_sim.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+#define SEED        42
+#define FRAME_LEN   20
+
+static SIM_Modem lora_modem(uint8_t sf, float freq_mhz) {
+    SIM_Modem m;
+    memset(&m, 0, sizeof(m));
+    m.lora = true;
+    m.freq_mhz = freq_mhz;
+    m.bw_khz = 125.0f;
+    m.sf = sf;
+    m.cr = 5;
+    m.preamble = 8;
+    m.power_dbm = 14;
+    return m;
+}
+
+struct Outcome {
+    uint16_t irq;
+    bool crc_ok;
+    uint8_t first;          // first payload byte of the frame received
+    SIM_Stats st;
+};
+
+// Receiver on SF9 868.1 MHz. The wanted frame starts at 0; the interferer
+// (if any) starts delay_us later from dist_m away on its own modem.
+static Outcome run(bool interferer, float dist_m, uint8_t sf, float freq_mhz, uint64_t delay_us) {
+    sim_init(SEED);
+    sim_set_path_loss(40.0f, 2.7f, 0.0f, 0.0f);
+    int rx = sim_add_node(0, 0, 0);
+    int a = sim_add_node(1000, 0, 0);
+    int b = sim_add_node(dist_m, 0, 0);
+
+    SIM_Modem m = lora_modem(9, 868.1f);
+    sim_receive(rx, &m, 0, false);
+    uint8_t wanted[FRAME_LEN] = {0xAA};
+    uint8_t other[FRAME_LEN] = {0xBB};
+    sim_transmit(a, &m, wanted, sizeof(wanted));
+    if (interferer) {
+        sim_run_until(delay_us);
+        SIM_Modem mi = lora_modem(sf, freq_mhz);
+        sim_transmit(b, &mi, other, sizeof(other));
+    }
+    sim_run_until(2000000);
+
+    Outcome o;
+    o.irq = sim_irq(rx);
+    o.crc_ok = sim_last_rx(rx)->crc_ok;
+    o.first = sim_last_rx(rx)->len ? sim_last_rx(rx)->data[0] : 0;
+    o.st = *sim_stats();
+    return o;
+}
+
+static void test_time_on_air() {
+    printf("chan_sim: time on air\n");
+    // SX126x formula: SF7/125 kHz, CR 4/5, 8 symbol preamble, 20 bytes
+    // -> 12.25 + 8 + 7 * 5 symbols of 1.024 ms
+    SIM_Modem m = lora_modem(7, 868.1f);
+    CHECK(sim_time_on_air_us(&m, FRAME_LEN) == 56576);
+    // SF12/125 kHz turns on low data rate optimization: 40.25 symbols of
+    // 32.768 ms
+    m = lora_modem(12, 868.1f);
+    CHECK(sim_time_on_air_us(&m, FRAME_LEN) == 1318912);
+    // FSK 50 kbps: 32 bit preamble + (4 sync + 1 length + 20 + 2 CRC) bytes
+    SIM_Modem f;
+    memset(&f, 0, sizeof(f));
+    f.freq_mhz = 868.0f;
+    f.bw_khz = 117.0f;
+    f.bitrate_kbps = 50.0f;
+    f.preamble = 32;
+    f.sync_len = 4;
+    CHECK(sim_time_on_air_us(&f, FRAME_LEN) == (32 + 8 * 27) * 20);
+}
+
+static void test_clean() {
+    printf("chan_sim: clean link\n");
+    Outcome o = run(false, 0, 0, 0, 0);
+    CHECK(o.irq & SIM_IRQ_RX_DONE);
+    CHECK(!(o.irq & SIM_IRQ_CRC_ERR));
+    CHECK(o.crc_ok && o.first == 0xAA);
+    CHECK(o.st.tx == 1 && o.st.delivered == 1 && o.st.collided == 0);
+}
+
+// equal power on the same SF: neither clears the capture margin
+static void test_collision() {
+    printf("chan_sim: co-SF collision\n");
+    Outcome o = run(true, 1000, 9, 868.1f, 1000);
+    CHECK(o.irq & SIM_IRQ_CRC_ERR);
+    CHECK(!o.crc_ok);
+    CHECK(o.st.collided == 1 && o.st.delivered == 0);
+}
+
+// interferer 10x farther (27 dB weaker): the locked frame survives
+static void test_capture() {
+    printf("chan_sim: capture\n");
+    Outcome o = run(true, 10000, 9, 868.1f, 1000);
+    CHECK(o.irq & SIM_IRQ_RX_DONE);
+    CHECK(o.crc_ok && o.first == 0xAA);
+    CHECK(o.st.delivered == 1 && o.st.collided == 0);
+}
+
+// SF7 at equal power is below the SF7/SF9 isolation
+static void test_sf_isolation() {
+    printf("chan_sim: SF isolation\n");
+    Outcome o = run(true, 1000, 7, 868.1f, 1000);
+    CHECK(o.crc_ok && o.first == 0xAA);
+    CHECK(o.st.delivered == 1 && o.st.collided == 0);
+
+    // the same SF7 frame from 20 m away overwhelms the isolation
+    o = run(true, 20, 7, 868.1f, 1000);
+    CHECK(!o.crc_ok);
+    CHECK(o.st.collided == 1);
+}
+
+// 200 kHz apart, the spectra do not overlap
+static void test_channel_separation() {
+    printf("chan_sim: adjacent channel\n");
+    Outcome o = run(true, 1000, 9, 868.3f, 1000);
+    CHECK(o.crc_ok && o.first == 0xAA);
+    CHECK(o.st.delivered == 1);
+}
+
+static void test_timeout_and_cad() {
+    printf("chan_sim: RX timeout and CAD\n");
+    sim_init(1);
+    int rx = sim_add_node(0, 0, 0);
+    int tx = sim_add_node(1000, 0, 0);
+    SIM_Modem m = lora_modem(7, 868.1f);
+    sim_receive(rx, &m, 5000, false);
+    sim_run_until(100000);
+    CHECK(sim_irq(rx) & SIM_IRQ_TIMEOUT);
+    CHECK(!(sim_irq(rx) & SIM_IRQ_RX_DONE));
+
+    // idle channel: CAD done without detection
+    sim_clear_irq(rx, 0xFFFF);
+    sim_cad(rx, &m);
+    sim_run_until(200000);
+    CHECK(sim_irq(rx) & SIM_IRQ_CAD_DONE);
+    CHECK(!(sim_irq(rx) & SIM_IRQ_CAD_DETECTED));
+
+    // a frame on air: detected
+    uint8_t data[FRAME_LEN] = {0};
+    sim_clear_irq(rx, 0xFFFF);
+    sim_transmit(tx, &m, data, sizeof(data));
+    sim_run_until(sim_now_us() + 1000);
+    sim_cad(rx, &m);
+    sim_run_until(sim_now_us() + 10000);
+    CHECK(sim_irq(rx) & SIM_IRQ_CAD_DETECTED);
+}
+
+// Many frames over a fading link: the same seed reproduces every outcome,
+// another seed gives a different run
+static SIM_Stats fading_run(uint32_t seed) {
+    sim_init(seed);
+    sim_set_path_loss(40.0f, 2.7f, 0.0f, 6.0f);
+    int rx = sim_add_node(0, 0, 0);
+    int tx = sim_add_node(5000, 0, 0);
+    SIM_Modem m = lora_modem(9, 868.1f);
+    uint8_t data[FRAME_LEN] = {0};
+    uint64_t t = 0;
+    for (int i = 0; i < 200; i++) {
+        sim_receive(rx, &m, 0, false);
+        sim_transmit(tx, &m, data, sizeof(data));
+        t += sim_time_on_air_us(&m, sizeof(data)) + 10000;
+        sim_run_until(t);
+    }
+    return *sim_stats();
+}
+
+static void test_deterministic() {
+    printf("chan_sim: seeded repeatability\n");
+    SIM_Stats a = fading_run(SEED);
+    SIM_Stats b = fading_run(SEED);
+    SIM_Stats c = fading_run(SEED + 1);
+    printf("  seed %u: %u of %u delivered, %u faded, %u weak\n", SEED, a.delivered, a.tx, a.faded, a.weak);
+    CHECK(a.tx == 200);
+    CHECK(memcmp(&a, &b, sizeof(a)) == 0);
+    CHECK(a.delivered > 0 && a.delivered < a.tx);
+    CHECK(memcmp(&a, &c, sizeof(a)) != 0);
+}
+
+int main() {
+    test_time_on_air();
+    test_clean();
+    test_collision();
+    test_capture();
+    test_sf_isolation();
+    test_channel_separation();
+    test_timeout_and_cad();
+    test_deterministic();
+    if (failures) {
+        printf("chan_sim: %d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("chan_sim: OK\n");
+    return 0;
+}
@@ -0,0 +1,451 @@
+#include "adr.h"
+#include "lora.h"
+#include "p2p.h"
+#include "Arduino.h"
+#include <RadioLib.h>
+#include "command.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ADR_OP_REQ          1
+#define ADR_OP_ACK          2
+#define ADR_OP_PROBE        3
+#define ADR_OP_PROBE_ACK    4
+#define ADR_OP_NAK          5
+
+// Data rate ladder, slowest first
+static const ADR_Rate adr_rates[ADR_NUM_RATES] = {
+    {12, 125}, {11, 125}, {10, 125}, {9, 125}, {8, 125}, {7, 125}, {7, 250}, {7, 500}
+};
+
+// SX126x demodulation SNR floor for SF5..SF12 (dB)
+static const float adr_req_snr[8] = {-2.5f, -5.0f, -7.5f, -10.0f, -12.5f, -15.0f, -17.5f, -20.0f};
+
+static const char *adr_event_names[] = {
+    "UP", "DOWN_SNR", "DOWN_PER", "POWER_UP", "POWER_TRIM", "COMMIT", "NOACK", "REVERT", "FAIL"
+};
+
+enum AdrMode {
+    ADR_OFF = 0,
+    ADR_FOLLOW,         // accept changes requested by a peer
+    ADR_CONTROL         // also measure adr_peer and drive changes
+};
+
+enum AdrTxState {
+    AS_IDLE = 0,
+    AS_REQ,             // REQ sent at the old rate, waiting for ACK
+    AS_PROBE            // switched, waiting for PROBE_ACK at the new rate
+};
+
+static AdrMode adr_mode = ADR_OFF;
+static uint16_t adr_peer = P2P_ANON_ID;
+static float adr_margin_db = ADR_DEFAULT_MARGIN;
+static int adr_max_power = 22;
+
+// measurement window over frames from adr_peer
+static float win_snr[ADR_WINDOW];
+static uint8_t win_next = 0;
+static uint8_t win_count = 0;
+static uint32_t win_rx = 0;
+static uint32_t win_lost = 0;
+static bool seq_valid = false;
+static uint16_t seq_last = 0;
+static float last_snr = 0;
+static float last_margin = 0;
+static float last_per = 0;
+
+// controller side of the exchange
+static AdrTxState tx_state = AS_IDLE;
+static uint8_t tx_token = 0;
+static int tx_rate = 0;
+static int tx_power = 0;
+static int old_rate = 0;
+static int old_power = 0;
+static uint8_t tx_tries = 0;
+static uint32_t tx_deadline = 0;
+static uint32_t last_change_ms = 0;
+
+// responder side: switched on REQ, reverts unless PROBE arrives in time
+static bool rsp_pending = false;
+static uint8_t rsp_token = 0;
+static uint16_t rsp_src = P2P_ANON_ID;
+static int rsp_old_rate = 0;
+static int rsp_old_power = 0;
+static uint32_t rsp_deadline = 0;
+
+static ADR_LogEntry adr_log[ADR_LOG_LEN];
+static uint8_t adr_log_next = 0;
+static uint8_t adr_log_count = 0;
+
+// per rate throughput, last slot for settings off the ladder
+static ADR_RateStats adr_stats[ADR_NUM_RATES + 1];
+static uint32_t stat_mark_ms = 0;
+
+static int adr_current_rate() {
+    if (g_radio_mode != RADIO_MODE_LORA) return -1;
+    for (int i = 0; i < ADR_NUM_RATES; i++) {
+        if (adr_rates[i].sf == g_lora_sf && fabsf(adr_rates[i].bw - g_lora_bandwidth) < 0.1f) return i;
+    }
+    return -1;
+}
+
+static ADR_RateStats *adr_bucket(int rate) {
+    return &adr_stats[rate < 0 ? ADR_NUM_RATES : rate];
+}
+
+// charge the time since the last mark to the current rate
+static void adr_account() {
+    uint32_t now = millis();
+    adr_bucket(adr_current_rate())->dwell_ms += now - stat_mark_ms;
+    stat_mark_ms = now;
+}
+
+static int adr_apply(int rate, int power) {
+    adr_account();
+    return lora_set_rate(adr_rates[rate].sf, adr_rates[rate].bw, power);
+}
+
+// Predicted margin at a rung: SNR is measured in the channel bandwidth, so
+// only a bandwidth change moves it; the SF sets the demodulation floor.
+static float adr_margin_at(int rate, float snr) {
+    float bw_penalty = 10.0f * log10f(adr_rates[rate].bw / g_lora_bandwidth);
+    return snr - bw_penalty - adr_req_snr[adr_rates[rate].sf - 5] - adr_margin_db;
+}
+
+static void adr_window_reset() {
+    win_next = 0;
+    win_count = 0;
+    win_rx = 0;
+    win_lost = 0;
+}
+
+static void adr_log_event(uint8_t event, int from_rate, int to_rate, int power) {
+    ADR_LogEntry *e = &adr_log[adr_log_next];
+    e->t_ms = millis();
+    e->event = event;
+    e->from_rate = (int8_t)from_rate;
+    e->to_rate = (int8_t)to_rate;
+    e->power = (int8_t)power;
+    e->snr_x10 = (int16_t)lroundf(last_snr * 10);
+    e->margin_x10 = (int16_t)lroundf(last_margin * 10);
+    e->per_pct = (uint8_t)lroundf(last_per * 100);
+    adr_log_next = (adr_log_next + 1) % ADR_LOG_LEN;
+    if (adr_log_count < ADR_LOG_LEN) adr_log_count++;
+}
+
+static void adr_send(uint8_t op, uint8_t token, int rate, int power, uint16_t dst) {
+    uint8_t msg[ADR_LINK_LEN] = {op, token, (uint8_t)rate, (uint8_t)(int8_t)power};
+    p2p_send(P2P_TYPE_LINK, 0, dst, msg, sizeof(msg));
+}
+
+static uint32_t adr_timeout_ms() {
+    return 2 * lora_time_on_air_ms(P2P_HDR_LEN + ADR_LINK_LEN) + ADR_TURNAROUND_MS;
+}
+
+// (Re)send the message for the current exchange step
+static void adr_send_step() {
+    adr_send(tx_state == AS_REQ ? ADR_OP_REQ : ADR_OP_PROBE, tx_token, tx_rate, tx_power, adr_peer);
+    tx_tries++;
+    tx_deadline = millis() + adr_timeout_ms();
+}
+
+static void adr_exchange_done(uint8_t event) {
+    adr_log_event(event, old_rate, event == ADR_EV_COMMIT ? tx_rate : old_rate,
+                  event == ADR_EV_COMMIT ? tx_power : old_power);
+    tx_state = AS_IDLE;
+    last_change_ms = millis();
+    adr_window_reset();
+}
+
+// LoRaWAN-style decision over one full window: PER and a negative margin
+// step towards robustness (power first, then rate), spare margin steps the
+// rate up one rung and only then trims power.
+static void adr_decide() {
+    if (win_count < ADR_WINDOW) return;
+    if (millis() - last_change_ms < ADR_HOLDOFF_MS) return;
+    int cur = adr_current_rate();
+    if (cur < 0) return;
+
+    float snr = win_snr[0];
+    for (int i = 1; i < win_count; i++) {
+        if (win_snr[i] > snr) snr = win_snr[i];
+    }
+    last_snr = snr;
+    last_per = (win_rx + win_lost) ? (float)win_lost / (win_rx + win_lost) : 0;
+    last_margin = adr_margin_at(cur, snr);
+
+    int rate = cur;
+    int power = g_lora_power;
+    uint8_t event;
+    if (last_per > ADR_PER_DOWN && cur > 0) {
+        rate = cur - 1;
+        event = ADR_EV_DOWN_PER;
+    } else if (last_margin < 0 && power < adr_max_power) {
+        power += (int)ceilf(-last_margin);
+        if (power > adr_max_power) power = adr_max_power;
+        event = ADR_EV_POWER_UP;
+    } else if (last_margin < 0 && cur > 0) {
+        rate = cur - 1;
+        event = ADR_EV_DOWN_SNR;
+    } else if (last_margin >= 0 && cur < ADR_NUM_RATES - 1 && adr_margin_at(cur + 1, snr) >= 0) {
+        rate = cur + 1;
+        event = ADR_EV_UP;
+    } else if (last_margin >= ADR_STEP_DB && power > ADR_MIN_POWER) {
+        power -= ADR_POWER_STEP * (int)(last_margin / ADR_STEP_DB);
+        if (power < ADR_MIN_POWER) power = ADR_MIN_POWER;
+        event = ADR_EV_POWER_TRIM;
+    } else {
+        adr_window_reset();
+        return;
+    }
+
+    adr_log_event(event, cur, rate, power);
+    old_rate = cur;
+    old_power = g_lora_power;
+    tx_rate = rate;
+    tx_power = power;
+    tx_token++;
+    tx_tries = 0;
+    tx_state = AS_REQ;
+    adr_send_step();
+}
+
+static bool adr_on_link(const P2P_Header *hdr, const uint8_t *payload, size_t len, const RX_Packet_Info *info) {
+    if (len < ADR_LINK_LEN) return true;
+    uint8_t op = payload[0];
+    uint8_t token = payload[1];
+    int rate = payload[2];
+    int power = (int8_t)payload[3];
+
+    switch (op) {
+    case ADR_OP_REQ: {
+        int cur = adr_current_rate();
+        // dual RX or another radio owner would refuse the switch
+        if (adr_mode == ADR_OFF || cur < 0 || rate >= ADR_NUM_RATES || power < -9 || power > 22 ||
+            !lora_listening()) {
+            adr_send(ADR_OP_NAK, token, rate, power, hdr->src);
+            break;
+        }
+        // answer at the old rate, then follow
+        adr_send(ADR_OP_ACK, token, rate, power, hdr->src);
+        int cur_power = g_lora_power;
+        if (adr_apply(rate, power) != RADIOLIB_ERR_NONE) {
+            // still at the old rate: the controller's PROBE goes unanswered
+            // and it falls back
+            adr_log_event(ADR_EV_FAIL, cur, rate, power);
+            break;
+        }
+        if (!rsp_pending) {
+            rsp_old_rate = cur;
+            rsp_old_power = cur_power;
+        }
+        rsp_pending = true;
+        rsp_token = token;
+        rsp_src = hdr->src;
+        rsp_deadline = millis() + ADR_REVERT_MS;
+        break;
+    }
+    case ADR_OP_ACK:
+        if (tx_state == AS_REQ && hdr->src == adr_peer && token == tx_token) {
+            if (adr_apply(tx_rate, tx_power) != RADIOLIB_ERR_NONE) {
+                // the peer reverts on its own without our PROBE
+                adr_exchange_done(ADR_EV_FAIL);
+                break;
+            }
+            tx_state = AS_PROBE;
+            tx_tries = 0;
+            adr_send_step();
+        }
+        break;
+    case ADR_OP_PROBE:
+        if (rsp_pending && hdr->src == rsp_src && token == rsp_token) {
+            rsp_pending = false;
+            adr_log_event(ADR_EV_COMMIT, rsp_old_rate, adr_current_rate(), g_lora_power);
+        }
+        // answer repeats too, our PROBE_ACK may have been lost
+        adr_send(ADR_OP_PROBE_ACK, token, rate, power, hdr->src);
+        break;
+    case ADR_OP_PROBE_ACK:
+        if (tx_state == AS_PROBE && hdr->src == adr_peer && token == tx_token) {
+            adr_exchange_done(ADR_EV_COMMIT);
+        }
+        break;
+    case ADR_OP_NAK:
+        if (tx_state == AS_REQ && hdr->src == adr_peer && token == tx_token) {
+            adr_exchange_done(ADR_EV_NOACK);
+        }
+        break;
+    }
+    return true;
+}
+
+void init_adr() {
+    stat_mark_ms = millis();
+    p2p_register_handler(P2P_TYPE_LINK, adr_on_link);
+
+    register_at_handler("AT+ADR", handle_at_adr, "Link adaptation: AT+ADR=1 (follow peer requests), AT+ADR=1,peer[,margin_db] (control link to peer), AT+ADR=0 or AT+ADR=?");
+    register_at_handler("AT+ADRLOG", handle_at_adrlog, "Show link adaptation decisions: AT+ADRLOG or AT+ADRLOG=CLR");
+    register_at_handler("AT+ADRSTAT", handle_at_adrstat, "Show receive throughput per data rate: AT+ADRSTAT or AT+ADRSTAT=CLR");
+}
+
+// Every received frame, before dispatch: throughput per rate and the
+// controller's measurement window.
+void adr_on_rx(const uint8_t *frame, size_t len, const RX_Packet_Info *info) {
+    ADR_RateStats *s = adr_bucket(adr_current_rate());
+    s->rx_frames++;
+    s->rx_bytes += len;
+
+    P2P_Header hdr;
+    if (adr_mode != ADR_CONTROL || !p2p_parse(frame, len, &hdr) || hdr.src != adr_peer) return;
+    win_snr[win_next] = info->snr;
+    win_next = (win_next + 1) % ADR_WINDOW;
+    if (win_count < ADR_WINDOW) win_count++;
+    win_rx++;
+    // reliable DATA has its own per-peer sequence and repeats it on retry
+    if (!(hdr.flags & P2P_FLAG_RELIABLE)) {
+        int16_t d = (int16_t)(hdr.seq - seq_last);
+        if (seq_valid && d > 0 && d < 64) win_lost += d - 1;
+        if (!seq_valid || d > 0 || d <= -64) {
+            seq_last = hdr.seq;
+            seq_valid = true;
+        }
+    }
+}
+
+// Called from the main loop: exchange timeouts, responder fallback, decisions
+void adr_loop() {
+    uint32_t now = millis();
+    if (rsp_pending && (int32_t)(now - rsp_deadline) >= 0) {
+        rsp_pending = false;
+        int from = adr_current_rate();
+        bool ok = adr_apply(rsp_old_rate, rsp_old_power) == RADIOLIB_ERR_NONE;
+        adr_log_event(ok ? ADR_EV_REVERT : ADR_EV_FAIL, from, rsp_old_rate, rsp_old_power);
+    }
+
+    switch (tx_state) {
+    case AS_IDLE:
+        if (adr_mode == ADR_CONTROL && lora_listening()) adr_decide();
+        break;
+    case AS_REQ:
+    case AS_PROBE:
+        if ((int32_t)(now - tx_deadline) < 0) break;
+        if (tx_tries < ADR_RETRIES) {
+            adr_send_step();
+        } else if (tx_state == AS_PROBE) {
+            bool ok = adr_apply(old_rate, old_power) == RADIOLIB_ERR_NONE;
+            adr_exchange_done(ok ? ADR_EV_REVERT : ADR_EV_FAIL);
+        } else {
+            adr_exchange_done(ADR_EV_NOACK);
+        }
+        break;
+    }
+}
+
+// AT+ADR=0 / AT+ADR=1 / AT+ADR=1,peer[,margin_db] / AT+ADR=?
+void handle_at_adr(const AT_Command *cmd) {
+    if (strcmp(cmd->params, "?") == 0) {
+        int cur = adr_current_rate();
+        Serial.printf("ADR: %s", adr_mode == ADR_OFF ? "OFF" : adr_mode == ADR_FOLLOW ? "FOLLOW" : "CONTROL");
+        if (adr_mode == ADR_CONTROL) {
+            Serial.printf(", peer=%u, margin=%.1f dB, max power=%d", adr_peer, adr_margin_db, adr_max_power);
+        }
+        Serial.printf(", rate=DR%d (SF%d/%.0f kHz), power=%d, window %u frames, lost %lu\r\n",
+                      cur, g_lora_sf, g_lora_bandwidth, g_lora_power, win_count, (unsigned long)win_lost);
+        return;
+    }
+    char buf[32];
+    strncpy(buf, cmd->params, sizeof(buf)-1);
+    buf[sizeof(buf)-1] = 0;
+    char *p = strtok(buf, ",");
+    if (!p) {
+        Serial.println("ERROR: Need params: on[,peer[,margin_db]]");
+        return;
+    }
+    int on = atoi(p);
+    p = strtok(NULL, ",");
+    long peer = p ? atol(p) : P2P_ANON_ID;
+    p = strtok(NULL, ",");
+    float margin = p ? atof(p) : ADR_DEFAULT_MARGIN;
+
+    if (!on) {
+        bool ok = tx_state != AS_PROBE || adr_apply(old_rate, old_power) == RADIOLIB_ERR_NONE;
+        tx_state = AS_IDLE;
+        adr_mode = ADR_OFF;
+        if (ok) {
+            Serial.println("OK, ADR=0");
+        } else {
+            Serial.printf("OK, ADR=0, unable to restore DR%d\r\n", old_rate);
+        }
+        return;
+    }
+    if (g_radio_mode != RADIO_MODE_LORA) {
+        Serial.println("ERROR: Not in LoRa mode");
+        return;
+    }
+    if (adr_current_rate() < 0) {
+        Serial.println("ERROR: SF/BW not on the rate ladder (SF7-12 at 125 kHz, SF7 at 250/500 kHz)");
+        return;
+    }
+    if (peer < 0 || peer >= P2P_BROADCAST || margin < 0 || margin > 30) {
+        Serial.println("ERROR: Invalid peer (1-65534) or margin (0-30 dB)");
+        return;
+    }
+    if (peer == P2P_ANON_ID) {
+        adr_mode = ADR_FOLLOW;
+        Serial.println("OK, ADR=1 (follow)");
+        return;
+    }
+    if (lora_listen() != RADIOLIB_ERR_NONE) {
+        Serial.println("ERROR: Unable to enter RX mode");
+        return;
+    }
+    adr_mode = ADR_CONTROL;
+    adr_peer = (uint16_t)peer;
+    adr_margin_db = margin;
+    adr_max_power = g_lora_power;   // never go above what the user set
+    seq_valid = false;
+    adr_window_reset();
+    Serial.printf("OK, ADR=1 (control), peer=%u, margin=%.1f dB, max power=%d\r\n", adr_peer, adr_margin_db, adr_max_power);
+}
+
+// AT+ADRLOG / AT+ADRLOG=CLR
+void handle_at_adrlog(const AT_Command *cmd) {
+    if (strcasecmp(cmd->params, "CLR") == 0) {
+        adr_log_next = 0;
+        adr_log_count = 0;
+        Serial.println("OK, ADR log cleared");
+        return;
+    }
+    Serial.printf("ADR log: %u entries\r\n", adr_log_count);
+    for (int i = 0; i < adr_log_count; i++) {
+        const ADR_LogEntry *e = &adr_log[(adr_log_next + ADR_LOG_LEN - adr_log_count + i) % ADR_LOG_LEN];
+        Serial.printf("%10lu ms %-10s DR%d->DR%d power %3d, snr %5.1f dB, margin %5.1f dB, per %u%%\r\n",
+                      (unsigned long)e->t_ms, adr_event_names[e->event], e->from_rate, e->to_rate, e->power,
+                      e->snr_x10 / 10.0f, e->margin_x10 / 10.0f, e->per_pct);
+    }
+}
+
+// AT+ADRSTAT / AT+ADRSTAT=CLR
+void handle_at_adrstat(const AT_Command *cmd) {
+    if (strcasecmp(cmd->params, "CLR") == 0) {
+        memset(adr_stats, 0, sizeof(adr_stats));
+        stat_mark_ms = millis();
+        Serial.println("OK, ADR stats cleared");
+        return;
+    }
+    adr_account();
+    for (int i = 0; i <= ADR_NUM_RATES; i++) {
+        const ADR_RateStats *s = &adr_stats[i];
+        if (s->dwell_ms == 0 && s->rx_frames == 0) continue;
+        unsigned long bps = s->dwell_ms ? (unsigned long)((uint64_t)s->rx_bytes * 8000 / s->dwell_ms) : 0;
+        if (i < ADR_NUM_RATES) {
+            Serial.printf("DR%d SF%2d/%3.0f kHz: ", i, adr_rates[i].sf, adr_rates[i].bw);
+        } else {
+            Serial.print("other            : ");
+        }
+        Serial.printf("%8lu ms, %6lu frames, %8lu bytes, %6lu bit/s\r\n", (unsigned long)s->dwell_ms,
+                      (unsigned long)s->rx_frames, (unsigned long)s->rx_bytes, bps);
+    }
+}
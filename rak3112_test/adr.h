@@ -0,0 +1,77 @@
+#ifndef ADR_H
+#define ADR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "command.h"
+#include "lora.h"
+
+// Link adaptation for a P2P LoRa link. The controller node measures the SNR
+// margin and PER (from P2P sequence gaps) of frames from its peer, picks a
+// rung on the data rate ladder and an output power, and agrees the change
+// with the peer over LINK frames:
+//
+//   REQ (old rate) -> ACK (old rate) -> both switch -> PROBE -> PROBE_ACK
+//
+// Either side falls back to the previous setting when the exchange at the
+// new rate does not complete. Power is applied on both ends (the link is
+// assumed symmetric).
+#define ADR_NUM_RATES       8
+#define ADR_WINDOW          16      // frames per decision
+#define ADR_HOLDOFF_MS      5000    // minimum time between changes
+#define ADR_DEFAULT_MARGIN  6.0f    // dB kept above the demodulation floor
+#define ADR_STEP_DB         3.0f
+#define ADR_PER_DOWN        0.20f   // PER that forces a step down
+#define ADR_MIN_POWER       0
+#define ADR_POWER_STEP      2
+#define ADR_RETRIES         3
+#define ADR_TURNAROUND_MS   150
+#define ADR_REVERT_MS       15000   // responder fallback if no PROBE arrives
+#define ADR_LOG_LEN         32
+
+// LINK payload: op u8 | token u8 | rate u8 | power i8
+#define ADR_LINK_LEN        4
+
+enum ADR_Event {
+    ADR_EV_UP = 0,      // data rate stepped up
+    ADR_EV_DOWN_SNR,    // margin exhausted at max power
+    ADR_EV_DOWN_PER,    // too many frames lost
+    ADR_EV_POWER_UP,
+    ADR_EV_POWER_TRIM,
+    ADR_EV_COMMIT,      // new setting confirmed by PROBE/PROBE_ACK
+    ADR_EV_NOACK,       // peer did not answer REQ, setting kept
+    ADR_EV_REVERT,      // exchange at the new rate failed, fell back
+    ADR_EV_FAIL         // the radio refused the setting
+};
+
+struct ADR_Rate {
+    uint8_t sf;
+    float bw;
+};
+
+struct ADR_LogEntry {
+    uint32_t t_ms;
+    uint8_t event;
+    int8_t from_rate;
+    int8_t to_rate;
+    int8_t power;
+    int16_t snr_x10;        // max SNR of the window
+    int16_t margin_x10;     // margin at the current rate
+    uint8_t per_pct;
+};
+
+struct ADR_RateStats {
+    uint32_t dwell_ms;
+    uint32_t rx_frames;
+    uint32_t rx_bytes;
+};
+
+void init_adr();
+void adr_loop();
+void adr_on_rx(const uint8_t *frame, size_t len, const RX_Packet_Info *info);
+
+void handle_at_adr(const AT_Command *cmd);
+void handle_at_adrlog(const AT_Command *cmd);
+void handle_at_adrstat(const AT_Command *cmd);
+
+#endif // ADR_H
@@ -0,0 +1,204 @@
+#include "aes_ccm.h"
+
+#include <string.h>
+
+static const uint8_t aes_sbox[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+static const uint8_t aes_rcon[10] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36};
+
+#ifdef ESP_PLATFORM
+static bool ccm_hw = true;
+#else
+static bool ccm_hw = false;
+#endif
+
+// ---------------- Software AES-128 (encrypt direction only) ----------------
+
+static void aes_expand_key(uint8_t *rk, const uint8_t *key) {
+    memcpy(rk, key, 16);
+    for (int i = 4; i < 44; i++) {
+        uint8_t t[4];
+        memcpy(t, rk + 4 * (i - 1), 4);
+        if (i % 4 == 0) {
+            uint8_t u = t[0];
+            t[0] = aes_sbox[t[1]] ^ aes_rcon[i / 4 - 1];
+            t[1] = aes_sbox[t[2]];
+            t[2] = aes_sbox[t[3]];
+            t[3] = aes_sbox[u];
+        }
+        for (int j = 0; j < 4; j++) rk[4 * i + j] = rk[4 * (i - 4) + j] ^ t[j];
+    }
+}
+
+static inline uint8_t aes_xtime(uint8_t x) {
+    return (uint8_t)((x << 1) ^ ((x >> 7) * 0x1b));
+}
+
+static void aes_encrypt_block(const uint8_t *rk, const uint8_t *in, uint8_t *out) {
+    uint8_t s[16];
+    uint8_t t[16];
+    for (int i = 0; i < 16; i++) s[i] = in[i] ^ rk[i];
+    for (int round = 1; round <= 10; round++) {
+        // SubBytes and ShiftRows, state is column major
+        for (int c = 0; c < 4; c++) {
+            for (int r = 0; r < 4; r++) t[4 * c + r] = aes_sbox[s[4 * ((c + r) % 4) + r]];
+        }
+        if (round < 10) {
+            for (int c = 0; c < 4; c++) {
+                uint8_t *a = &t[4 * c];
+                uint8_t a0 = a[0], a1 = a[1], a2 = a[2], a3 = a[3];
+                uint8_t all = a0 ^ a1 ^ a2 ^ a3;
+                a[0] = a0 ^ all ^ aes_xtime(a0 ^ a1);
+                a[1] = a1 ^ all ^ aes_xtime(a1 ^ a2);
+                a[2] = a2 ^ all ^ aes_xtime(a2 ^ a3);
+                a[3] = a3 ^ all ^ aes_xtime(a3 ^ a0);
+            }
+        }
+        for (int i = 0; i < 16; i++) s[i] = t[i] ^ rk[16 * round + i];
+    }
+    memcpy(out, s, 16);
+}
+
+// ---------------- Software CCM ----------------
+
+static void ccm_ctr_block(uint8_t *a, const uint8_t *nonce, uint16_t i) {
+    a[0] = 1;                                   // L - 1, L = 2
+    memcpy(a + 1, nonce, AES_CCM_NONCE_LEN);
+    a[14] = i >> 8;
+    a[15] = i & 0xFF;
+}
+
+static void ccm_ctr(const uint8_t *rk, const uint8_t *nonce, uint8_t *buf, size_t len) {
+    uint8_t a[16];
+    uint8_t ks[16];
+    for (uint16_t i = 1; len > 0; i++) {
+        ccm_ctr_block(a, nonce, i);
+        aes_encrypt_block(rk, a, ks);
+        size_t n = len < 16 ? len : 16;
+        for (size_t j = 0; j < n; j++) buf[j] ^= ks[j];
+        buf += n;
+        len -= n;
+    }
+}
+
+// Absorb data into the CBC-MAC, zero padding the last block
+static void ccm_mac_absorb(const uint8_t *rk, uint8_t *x, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        size_t n = len < 16 ? len : 16;
+        for (size_t j = 0; j < n; j++) x[j] ^= data[j];
+        aes_encrypt_block(rk, x, x);
+        data += n;
+        len -= n;
+    }
+}
+
+static void ccm_mac(const uint8_t *rk, const uint8_t *nonce, const uint8_t *aad, size_t aad_len,
+                    const uint8_t *plain, size_t len, uint8_t *tag) {
+    uint8_t x[16];
+    uint8_t b[16];
+    b[0] = (aad_len ? 0x40 : 0) | (((AES_CCM_TAG_LEN - 2) / 2) << 3) | 1;
+    memcpy(b + 1, nonce, AES_CCM_NONCE_LEN);
+    b[14] = (len >> 8) & 0xFF;
+    b[15] = len & 0xFF;
+    aes_encrypt_block(rk, b, x);
+
+    if (aad_len) {
+        // 2-byte length prefix shares the first block with the aad
+        uint8_t first[16] = {0};
+        first[0] = (aad_len >> 8) & 0xFF;
+        first[1] = aad_len & 0xFF;
+        size_t n = aad_len < 14 ? aad_len : 14;
+        memcpy(first + 2, aad, n);
+        ccm_mac_absorb(rk, x, first, 16);
+        ccm_mac_absorb(rk, x, aad + n, aad_len - n);
+    }
+    ccm_mac_absorb(rk, x, plain, len);
+
+    uint8_t s0[16];
+    ccm_ctr_block(b, nonce, 0);
+    aes_encrypt_block(rk, b, s0);
+    for (int i = 0; i < AES_CCM_TAG_LEN; i++) tag[i] = x[i] ^ s0[i];
+}
+
+// ---------------- API ----------------
+
+void aes_ccm_init(AES_CCM_Ctx *ctx, const uint8_t *key) {
+    aes_expand_key(ctx->rk, key);
+#ifdef ESP_PLATFORM
+    mbedtls_ccm_init(&ctx->hw);
+    mbedtls_ccm_setkey(&ctx->hw, MBEDTLS_CIPHER_ID_AES, key, AES_CCM_KEY_LEN * 8);
+#endif
+}
+
+void aes_ccm_free(AES_CCM_Ctx *ctx) {
+#ifdef ESP_PLATFORM
+    mbedtls_ccm_free(&ctx->hw);
+#endif
+    memset(ctx->rk, 0, sizeof(ctx->rk));
+}
+
+int aes_ccm_encrypt(AES_CCM_Ctx *ctx, const uint8_t *nonce, const uint8_t *aad, size_t aad_len,
+                    uint8_t *buf, size_t len, uint8_t *tag) {
+#ifdef ESP_PLATFORM
+    if (ccm_hw) {
+        return mbedtls_ccm_encrypt_and_tag(&ctx->hw, len, nonce, AES_CCM_NONCE_LEN, aad, aad_len,
+                                           buf, buf, tag, AES_CCM_TAG_LEN);
+    }
+#endif
+    ccm_mac(ctx->rk, nonce, aad, aad_len, buf, len, tag);
+    ccm_ctr(ctx->rk, nonce, buf, len);
+    return 0;
+}
+
+bool aes_ccm_decrypt(AES_CCM_Ctx *ctx, const uint8_t *nonce, const uint8_t *aad, size_t aad_len,
+                     uint8_t *buf, size_t len, const uint8_t *tag) {
+#ifdef ESP_PLATFORM
+    if (ccm_hw) {
+        return mbedtls_ccm_auth_decrypt(&ctx->hw, len, nonce, AES_CCM_NONCE_LEN, aad, aad_len,
+                                        buf, buf, tag, AES_CCM_TAG_LEN) == 0;
+    }
+#endif
+    uint8_t expect[AES_CCM_TAG_LEN];
+    ccm_ctr(ctx->rk, nonce, buf, len);
+    ccm_mac(ctx->rk, nonce, aad, aad_len, buf, len, expect);
+    uint8_t diff = 0;
+    for (int i = 0; i < AES_CCM_TAG_LEN; i++) diff |= expect[i] ^ tag[i];
+    if (diff) {
+        memset(buf, 0, len);
+        return false;
+    }
+    return true;
+}
+
+bool aes_ccm_hw_available() {
+#ifdef ESP_PLATFORM
+    return true;
+#else
+    return false;
+#endif
+}
+
+void aes_ccm_use_hw(bool on) {
+    ccm_hw = on && aes_ccm_hw_available();
+}
+
+bool aes_ccm_hw_in_use() {
+    return ccm_hw;
+}
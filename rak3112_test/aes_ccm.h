@@ -0,0 +1,40 @@
+#ifndef AES_CCM_H
+#define AES_CCM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef ESP_PLATFORM
+#include "mbedtls/ccm.h"
+#endif
+
+// AES-128-CCM (RFC 3610, 13-byte nonce, 8-byte tag) for P2P frames. On
+// ESP32 builds mbedtls drives the AES peripheral; the built-in software
+// AES is always compiled in, used elsewhere (host builds) and selectable on
+// the target for comparison.
+#define AES_CCM_KEY_LEN     16
+#define AES_CCM_NONCE_LEN   13
+#define AES_CCM_TAG_LEN     8
+
+struct AES_CCM_Ctx {
+    uint8_t rk[176];            // software key schedule
+#ifdef ESP_PLATFORM
+    mbedtls_ccm_context hw;
+#endif
+};
+
+void aes_ccm_init(AES_CCM_Ctx *ctx, const uint8_t *key);
+void aes_ccm_free(AES_CCM_Ctx *ctx);
+// In place; tag receives AES_CCM_TAG_LEN bytes. Returns 0, or the mbedtls
+// error when the hardware path fails (buf and tag are then not usable).
+int aes_ccm_encrypt(AES_CCM_Ctx *ctx, const uint8_t *nonce, const uint8_t *aad, size_t aad_len,
+                    uint8_t *buf, size_t len, uint8_t *tag);
+// In place; false (and buf wiped) when the tag does not match
+bool aes_ccm_decrypt(AES_CCM_Ctx *ctx, const uint8_t *nonce, const uint8_t *aad, size_t aad_len,
+                     uint8_t *buf, size_t len, const uint8_t *tag);
+
+bool aes_ccm_hw_available();
+void aes_ccm_use_hw(bool on);
+bool aes_ccm_hw_in_use();
+
+#endif // AES_CCM_H
@@ -0,0 +1,193 @@
+#include "afc.h"
+#include "lora.h"
+#include "p2p.h"
+#include "Arduino.h"
+#include <RadioLib.h>
+#include "command.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern SX1262 radio;
+
+static bool afc_on = false;
+static float afc_gain = AFC_DEFAULT_GAIN;
+static float afc_base_mhz = 0;      // nominal channel currently tuned
+static float afc_applied_hz = 0;    // correction currently programmed
+static uint16_t afc_last_peer = P2P_ANON_ID;
+static bool afc_pinned = false;     // RX tuning follows afc_last_peer unless pinned
+static AFC_Peer afc_peers[AFC_MAX_PEERS];
+
+static AFC_Peer *afc_find(uint16_t id, bool create) {
+    for (int i = 0; i < AFC_MAX_PEERS; i++) {
+        if (afc_peers[i].used && afc_peers[i].id == id) return &afc_peers[i];
+    }
+    if (!create) return NULL;
+
+    // take a free slot, otherwise evict the peer heard least recently
+    AFC_Peer *victim = NULL;
+    for (int i = 0; i < AFC_MAX_PEERS; i++) {
+        AFC_Peer *p = &afc_peers[i];
+        if (!p->used) {
+            victim = p;
+            break;
+        }
+        if (!victim || p->last_ms < victim->last_ms) victim = p;
+    }
+    memset(victim, 0, sizeof(*victim));
+    victim->used = true;
+    victim->id = id;
+    return victim;
+}
+
+void init_afc() {
+    afc_base_mhz = g_lora_freq;
+    register_at_handler("AT+AFC", handle_at_afc, "Set/query frequency offset tracking: AT+AFC=1[,gain], AT+AFC=0, AT+AFC=PIN,peer, AT+AFC=CLR or AT+AFC=?");
+    register_at_handler("AT+AFCHIST", handle_at_afchist, "Show frequency offset history of a peer, e.g. AT+AFCHIST=42 (0 = raw frames)");
+}
+
+bool afc_enabled() {
+    return afc_on;
+}
+
+float afc_base_freq() {
+    return afc_base_mhz;
+}
+
+float afc_correction(uint16_t peer) {
+    if (!afc_on) return 0;
+    AFC_Peer *p = afc_find(peer, false);
+    return p ? p->corr_hz : 0;
+}
+
+uint16_t afc_rx_peer() {
+    return afc_last_peer;
+}
+
+// Tune to a nominal channel plus the correction for the given peer
+int afc_tune(float base_mhz, uint16_t peer) {
+    float corr = afc_correction(peer);
+    int state = radio.setFrequency(base_mhz + corr / 1e6f);
+    if (state == RADIOLIB_ERR_NONE) {
+        afc_base_mhz = base_mhz;
+        afc_applied_hz = corr;
+    }
+    return state;
+}
+
+// Re-program only if the peer's correction moved away from what is tuned
+int afc_retune(uint16_t peer) {
+    if (g_radio_mode != RADIO_MODE_LORA) return RADIOLIB_ERR_NONE;
+    if (fabsf(afc_correction(peer) - afc_applied_hz) < AFC_RETUNE_HZ) return RADIOLIB_ERR_NONE;
+    return afc_tune(afc_base_mhz, peer);
+}
+
+// RX path: fold one frequency error sample into the peer estimate. The radio
+// is still in RX here; the caller re-arms it with startReceive afterwards.
+// Only plain RX is retuned here: frames from dual RX are handled on loop()
+// while the dualRx task owns the radio, and it applies the correction when
+// it next switches to LoRa (lora_switch_modem).
+void afc_on_rx(uint16_t peer, float freq_err_hz) {
+    if (!afc_on || g_radio_mode != RADIO_MODE_LORA) return;
+    if (fabsf(freq_err_hz) > g_lora_bandwidth * 1000.0f * AFC_MAX_ERR_FRAC) return;
+
+    AFC_Peer *p = afc_find(peer, true);
+    // the error is relative to what was tuned, not to the nominal channel
+    float target = afc_applied_hz + freq_err_hz;
+    p->corr_hz += afc_gain * (target - p->corr_hz);
+    p->samples++;
+    p->last_ms = millis();
+
+    AFC_Sample *s = &p->hist[p->hist_next];
+    s->t_ms = p->last_ms;
+    s->err_hz = freq_err_hz;
+    s->corr_hz = p->corr_hz;
+    p->hist_next = (p->hist_next + 1) % AFC_HISTORY;
+    if (p->hist_count < AFC_HISTORY) p->hist_count++;
+
+    if (!afc_pinned) afc_last_peer = peer;
+    if (lora_listening() && peer == afc_last_peer && fabsf(p->corr_hz - afc_applied_hz) >= AFC_RETUNE_HZ) {
+        radio.standby();
+        afc_tune(afc_base_mhz, peer);
+    }
+}
+
+// AT+AFC=1[,gain] / AT+AFC=0 / AT+AFC=PIN,peer / AT+AFC=CLR / AT+AFC=?
+void handle_at_afc(const AT_Command *cmd) {
+    if (strcmp(cmd->params, "?") == 0) {
+        Serial.printf("AFC: %s, gain=%.2f, base=%.4f MHz, applied=%.0f Hz, rx peer=%u%s\r\n",
+                      afc_on ? "ON" : "OFF", afc_gain, afc_base_mhz, afc_applied_hz,
+                      afc_last_peer, afc_pinned ? " (pinned)" : "");
+        for (int i = 0; i < AFC_MAX_PEERS; i++) {
+            const AFC_Peer *p = &afc_peers[i];
+            if (!p->used) continue;
+            float last_err = p->hist_count ? p->hist[(p->hist_next + AFC_HISTORY - 1) % AFC_HISTORY].err_hz : 0;
+            Serial.printf("Peer %5u: corr=%8.0f Hz, last err=%8.0f Hz, samples=%lu, age=%lu ms\r\n",
+                          p->id, p->corr_hz, last_err, (unsigned long)p->samples,
+                          (unsigned long)(millis() - p->last_ms));
+        }
+        return;
+    }
+    if (strcasecmp(cmd->params, "CLR") == 0) {
+        memset(afc_peers, 0, sizeof(afc_peers));
+        afc_pinned = false;
+        if (g_radio_mode == RADIO_MODE_LORA) afc_tune(afc_base_mhz, P2P_ANON_ID);
+        Serial.println("OK, AFC peers cleared");
+        return;
+    }
+    if (strncasecmp(cmd->params, "PIN,", 4) == 0) {
+        long id = atol(cmd->params + 4);
+        if (id < 0 || id > 0xFFFF) {
+            Serial.println("ERROR: Invalid peer");
+            return;
+        }
+        afc_last_peer = (uint16_t)id;
+        afc_pinned = true;
+        afc_retune(afc_last_peer);
+        Serial.print("OK, AFC RX pinned to peer ");
+        Serial.println(afc_last_peer);
+        return;
+    }
+
+    char buf[32];
+    strncpy(buf, cmd->params, sizeof(buf)-1);
+    buf[sizeof(buf)-1] = 0;
+    char *p = strtok(buf, ",");
+    if (!p) {
+        Serial.println("ERROR: Need params: on[,gain]");
+        return;
+    }
+    int on = atoi(p);
+    p = strtok(NULL, ",");
+    float gain = p ? atof(p) : afc_gain;
+    if (gain <= 0.0f || gain > 1.0f) {
+        Serial.println("ERROR: Invalid gain (0-1]");
+        return;
+    }
+    afc_gain = gain;
+    afc_on = on != 0;
+    if (!afc_on) afc_pinned = false;
+    // back to nominal when turned off, the peer correction when turned on
+    if (g_radio_mode == RADIO_MODE_LORA) afc_tune(afc_base_mhz, afc_last_peer);
+    Serial.printf("OK, AFC %s, gain=%.2f\r\n", afc_on ? "ON" : "OFF", afc_gain);
+}
+
+// AT+AFCHIST=<peer>
+void handle_at_afchist(const AT_Command *cmd) {
+    if (strlen(cmd->params) == 0) {
+        Serial.println("ERROR: Need peer id");
+        return;
+    }
+    AFC_Peer *p = afc_find((uint16_t)atol(cmd->params), false);
+    if (!p) {
+        Serial.println("ERROR: Unknown peer");
+        return;
+    }
+    Serial.println("t_ms,err_hz,corr_hz");
+    for (uint8_t i = 0; i < p->hist_count; i++) {
+        const AFC_Sample *s = &p->hist[(p->hist_next + AFC_HISTORY - p->hist_count + i) % AFC_HISTORY];
+        Serial.printf("%lu,%.0f,%.0f\r\n", (unsigned long)s->t_ms, s->err_hz, s->corr_hz);
+    }
+    Serial.println("OK");
+}
@@ -0,0 +1,45 @@
+#ifndef AFC_H
+#define AFC_H
+
+#include <stdint.h>
+#include "command.h"
+
+// Automatic frequency control: the SX1262 reports the carrier offset of each
+// received LoRa packet; a per-peer correction is kept and added on top of
+// the nominal channel (g_lora_freq or the current fh_channels entry).
+#define AFC_MAX_PEERS       16
+#define AFC_HISTORY         16
+#define AFC_DEFAULT_GAIN    0.5f    // < 1 so two AFC nodes meet in the middle
+#define AFC_RETUNE_HZ       100.0f  // float MHz resolution is ~61 Hz at 915 MHz
+#define AFC_MAX_ERR_FRAC    0.5f    // ignore samples beyond BW/2 (bogus)
+
+struct AFC_Sample {
+    uint32_t t_ms;
+    float err_hz;     // measured frequency error
+    float corr_hz;    // peer correction after this sample
+};
+
+struct AFC_Peer {
+    bool used;
+    uint16_t id;
+    float corr_hz;                // correction applied when talking to this peer
+    uint32_t samples;
+    uint32_t last_ms;
+    AFC_Sample hist[AFC_HISTORY];
+    uint8_t hist_next;
+    uint8_t hist_count;
+};
+
+void init_afc();
+bool afc_enabled();
+int afc_tune(float base_mhz, uint16_t peer);
+int afc_retune(uint16_t peer);
+void afc_on_rx(uint16_t peer, float freq_err_hz);
+uint16_t afc_rx_peer();
+float afc_base_freq();
+float afc_correction(uint16_t peer);
+
+void handle_at_afc(const AT_Command *cmd);
+void handle_at_afchist(const AT_Command *cmd);
+
+#endif // AFC_H
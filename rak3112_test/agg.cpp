@@ -0,0 +1,239 @@
+#include "agg.h"
+#include "lora.h"
+#include "p2p.h"
+#include "afc.h"
+#include "txq.h"
+#include "rx_capture.h"
+#include "rx_output.h"
+#include "collector.h"
+#include "Arduino.h"
+#include <RadioLib.h>
+#include "command.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static bool ag_on = false;
+static size_t ag_max_len = P2P_MAX_PAYLOAD;     // aggregated payload limit
+static uint32_t ag_wait_ms = AGG_DEFAULT_WAIT_MS;
+
+// pending frame; AT+PSEND fills it on the AT task and loop() flushes it by
+// age, so it is only touched under ag_lock
+static SemaphoreHandle_t ag_lock = NULL;
+static uint8_t ag_buf[P2P_MAX_PAYLOAD];
+static size_t ag_len = 0;
+static uint16_t ag_dst = P2P_BROADCAST;
+static uint8_t ag_count = 0;
+static uint8_t ag_msg_len[AGG_MAX_MSGS];
+static uint32_t ag_msg_ms[AGG_MAX_MSGS];
+
+struct AggStats {
+    uint32_t msgs;
+    uint32_t frames;
+    uint32_t by_size;       // flushed because the next message did not fit
+    uint32_t by_full;
+    uint32_t by_age;
+    uint32_t failed;        // frames the radio refused, messages lost
+    uint64_t air_us;        // airtime of the aggregated frames
+    uint64_t air_single_us; // the same messages sent one per frame
+    uint64_t wait_sum_ms;
+    uint32_t wait_max_ms;
+    uint32_t rx_frames;
+    uint32_t rx_msgs;
+    uint32_t rx_bad;        // malformed record list
+};
+static AggStats ag_st;
+
+bool agg_enabled() {
+    return ag_on;
+}
+
+bool agg_accepts(size_t len) {
+    return ag_on && len > 0 && 1 + len <= ag_max_len;
+}
+
+// Queue the pending frame for sending. Returns a RadioLib code; the
+// messages stay pending while the TX queue or the buffer pool is full.
+// Caller holds ag_lock.
+static int agg_flush() {
+    if (ag_count == 0) return RADIOLIB_ERR_NONE;
+    PKT_Buf *frame = pkt_alloc();
+    if (!frame) return RADIOLIB_ERR_MEMORY_ALLOCATION_FAILED;
+    P2P_Header hdr = {P2P_TYPE_AGG, 0, 0, g_node_id, ag_dst, p2p_next_seq()};
+    size_t n = p2p_build(frame->data, &hdr, ag_buf, ag_len);
+    frame->len = n;
+    bool sealed = (frame->data[2] & P2P_FLAG_SEC) != 0;
+    int state = P2P_ERR_NO_KEY;
+    if (n) state = txq_submit_buf(TXQ_NORMAL, frame, ag_dst == P2P_BROADCAST ? afc_rx_peer() : ag_dst, 0, 0);
+    if (state != RADIOLIB_ERR_NONE) pkt_unref(frame);
+    if (state == TXQ_ERR_FULL) return state;
+
+    if (state != RADIOLIB_ERR_NONE) {
+        ag_st.failed++;
+        Serial.printf("+AGG: %u messages dropped, code %d\r\n", ag_count, state);
+    } else {
+        // what the same messages would have cost one frame each
+        size_t extra = P2P_HDR_LEN + (sealed ? P2P_SEC_OVERHEAD : 0);
+        uint32_t now = millis();
+        for (int i = 0; i < ag_count; i++) {
+            ag_st.air_single_us += lora_time_on_air_us(extra + ag_msg_len[i]);
+            uint32_t wait = now - ag_msg_ms[i];
+            ag_st.wait_sum_ms += wait;
+            if (wait > ag_st.wait_max_ms) ag_st.wait_max_ms = wait;
+        }
+        ag_st.air_us += lora_time_on_air_us(n);
+        ag_st.msgs += ag_count;
+        ag_st.frames++;
+    }
+    ag_len = 0;
+    ag_count = 0;
+    return state;
+}
+
+int agg_queue(const uint8_t *data, size_t len) {
+    uint16_t dst = p2p_default_dst();
+    xSemaphoreTake(ag_lock, portMAX_DELAY);
+    if (ag_count && (dst != ag_dst || ag_len + 1 + len > ag_max_len)) {
+        int state = agg_flush();
+        if (ag_count) {
+            // queue or pool full, nothing freed
+            xSemaphoreGive(ag_lock);
+            return state;
+        }
+        ag_st.by_size++;
+    }
+    if (ag_count == 0) ag_dst = dst;
+    ag_buf[ag_len++] = (uint8_t)len;
+    memcpy(ag_buf + ag_len, data, len);
+    ag_len += len;
+    ag_msg_len[ag_count] = (uint8_t)len;
+    ag_msg_ms[ag_count] = millis();
+    ag_count++;
+    // no room for even a one byte message
+    if (ag_len + 2 > ag_max_len || ag_count >= AGG_MAX_MSGS) {
+        agg_flush();
+        if (ag_count == 0) ag_st.by_full++;
+    }
+    xSemaphoreGive(ag_lock);
+    return RADIOLIB_ERR_NONE;
+}
+
+void agg_loop() {
+    if (ag_count == 0) return;
+    xSemaphoreTake(ag_lock, portMAX_DELAY);
+    if (ag_count && millis() - ag_msg_ms[0] >= ag_wait_ms) {
+        agg_flush();
+        if (ag_count == 0) ag_st.by_age++;
+    }
+    xSemaphoreGive(ag_lock);
+}
+
+// Split into DATA frames from the same sender and pass each on as if it
+// had arrived alone
+static bool agg_on_frame(const P2P_Header *hdr, const uint8_t *payload, size_t len, const RX_Packet_Info *info) {
+    static uint8_t frame[P2P_MAX_FRAME];
+    ag_st.rx_frames++;
+    P2P_Header h = *hdr;
+    h.type = P2P_TYPE_DATA;
+    size_t pos = 0;
+    while (pos < len) {
+        size_t n = payload[pos++];
+        if (n == 0 || pos + n > len) {
+            ag_st.rx_bad++;
+            break;
+        }
+        size_t flen = p2p_write_header(frame, &h);
+        memcpy(frame + flen, payload + pos, n);
+        flen += n;
+        pos += n;
+        ag_st.rx_msgs++;
+
+        RX_Packet_Info msg = *info;
+        msg.len = flen;
+        if (!p2p_dispatch(frame, flen, &msg) && !rx_capture_quiet() && !collector_quiet() && rx_output_pass(frame, &msg)) {
+            rx_output_emit(frame, &msg);
+        }
+    }
+    return true;
+}
+
+void init_agg() {
+    ag_lock = xSemaphoreCreateMutex();
+    p2p_register_handler(P2P_TYPE_AGG, agg_on_frame);
+    register_at_handler("AT+AGG", handle_at_agg, "Pack small AT+PSEND payloads into one frame: AT+AGG=1[,max len[,max wait ms]], AT+AGG=0, AT+AGG=CLR or AT+AGG=?");
+}
+
+static void agg_print() {
+    Serial.printf("AGG: %s, max len %u, max wait %lu ms, pending %u messages (%u bytes)\r\n", ag_on ? "ON" : "OFF",
+                  (unsigned)ag_max_len, (unsigned long)ag_wait_ms, ag_count, (unsigned)ag_len);
+    Serial.printf("TX: %lu messages in %lu frames (%.2f per frame), flushed by size %lu, full %lu, age %lu, failed %lu\r\n",
+                  (unsigned long)ag_st.msgs, (unsigned long)ag_st.frames,
+                  ag_st.frames ? (float)ag_st.msgs / ag_st.frames : 0.0f, (unsigned long)ag_st.by_size,
+                  (unsigned long)ag_st.by_full, (unsigned long)ag_st.by_age, (unsigned long)ag_st.failed);
+    uint64_t saved = ag_st.air_single_us > ag_st.air_us ? ag_st.air_single_us - ag_st.air_us : 0;
+    Serial.printf("Airtime: %llu ms aggregated vs %llu ms one per frame, saved %llu ms (%.1f%%, %lu us per message)\r\n",
+                  (unsigned long long)(ag_st.air_us / 1000), (unsigned long long)(ag_st.air_single_us / 1000),
+                  (unsigned long long)(saved / 1000),
+                  ag_st.air_single_us ? 100.0 * saved / ag_st.air_single_us : 0.0,
+                  (unsigned long)(ag_st.msgs ? saved / ag_st.msgs : 0));
+    Serial.printf("Added latency: avg %lu max %lu ms per message\r\n",
+                  (unsigned long)(ag_st.msgs ? ag_st.wait_sum_ms / ag_st.msgs : 0), (unsigned long)ag_st.wait_max_ms);
+    Serial.printf("RX: %lu frames, %lu messages, malformed %lu\r\n", (unsigned long)ag_st.rx_frames,
+                  (unsigned long)ag_st.rx_msgs, (unsigned long)ag_st.rx_bad);
+}
+
+// AT+AGG=1[,max len[,max wait ms]] / 0 / CLR / ?
+void handle_at_agg(const AT_Command *cmd) {
+    if (strcmp(cmd->params, "?") == 0) {
+        xSemaphoreTake(ag_lock, portMAX_DELAY);
+        agg_print();
+        xSemaphoreGive(ag_lock);
+        return;
+    }
+    if (strcasecmp(cmd->params, "CLR") == 0) {
+        xSemaphoreTake(ag_lock, portMAX_DELAY);
+        memset(&ag_st, 0, sizeof(ag_st));
+        xSemaphoreGive(ag_lock);
+        Serial.println("OK, aggregation statistics cleared");
+        return;
+    }
+
+    char buf[32];
+    strncpy(buf, cmd->params, sizeof(buf)-1);
+    buf[sizeof(buf)-1] = 0;
+    char *p = strtok(buf, ",");
+    if (!p) {
+        Serial.println("ERROR: Need params: on[,max len[,max wait ms]]");
+        return;
+    }
+    int on = atoi(p);
+    if (!on) {
+        // pending messages still go out
+        xSemaphoreTake(ag_lock, portMAX_DELAY);
+        bool stuck = agg_flush() != RADIOLIB_ERR_NONE && ag_count;
+        if (!stuck) ag_on = false;
+        xSemaphoreGive(ag_lock);
+        if (stuck) {
+            Serial.println("ERROR: TX queue or buffer pool full, pending messages not sent");
+            return;
+        }
+        Serial.println("OK, AGG OFF");
+        return;
+    }
+    char *s_len = strtok(NULL, ",");
+    char *s_wait = strtok(NULL, ",");
+    long max_len = s_len ? atol(s_len) : P2P_MAX_PAYLOAD;
+    long wait = s_wait ? atol(s_wait) : AGG_DEFAULT_WAIT_MS;
+    if (max_len < AGG_MIN_LEN || max_len > P2P_MAX_PAYLOAD || wait < 0 || wait > AGG_MAX_WAIT_MS) {
+        Serial.printf("ERROR: Max len %d-%d, max wait 0-%d ms\r\n", AGG_MIN_LEN, P2P_MAX_PAYLOAD, AGG_MAX_WAIT_MS);
+        return;
+    }
+    xSemaphoreTake(ag_lock, portMAX_DELAY);
+    if (ag_count && (size_t)max_len < ag_len) agg_flush();
+    ag_max_len = (size_t)max_len;
+    ag_wait_ms = (uint32_t)wait;
+    ag_on = true;
+    xSemaphoreGive(ag_lock);
+    Serial.printf("OK, AGG ON, max len %u, max wait %lu ms%s\r\n", (unsigned)ag_max_len, (unsigned long)ag_wait_ms,
+                  p2p_header_mode() ? "" : " (takes effect with AT+P2PHDR=1)");
+}
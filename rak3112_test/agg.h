@@ -0,0 +1,31 @@
+#ifndef AGG_H
+#define AGG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "command.h"
+#include "p2p.h"
+
+// Aggregation of small AT+PSEND payloads (P2P header mode). Messages are
+// held and packed into one P2P_TYPE_AGG frame, so they share a preamble,
+// header and (when sealed) one counter and tag:
+//
+//   len u8 | data | len u8 | data | ...
+//
+// A frame goes out when the next message would not fit, when it is full,
+// or when its oldest message has waited the latency bound. Receivers split
+// it back into one DATA frame per message before output.
+#define AGG_MAX_MSGS            (P2P_MAX_PAYLOAD / 2)
+#define AGG_DEFAULT_WAIT_MS     500
+#define AGG_MAX_WAIT_MS         60000
+#define AGG_MIN_LEN             16
+
+void init_agg();
+void agg_loop();
+bool agg_enabled();
+bool agg_accepts(size_t len);
+int agg_queue(const uint8_t *data, size_t len);
+
+void handle_at_agg(const AT_Command *cmd);
+
+#endif // AGG_H
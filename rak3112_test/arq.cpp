@@ -0,0 +1,171 @@
+#include "arq.h"
+#include "lora.h"
+#include "p2p.h"
+#include "Arduino.h"
+#include <RadioLib.h>
+#include "command.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static bool arq_on = false;
+// arq_core is shared by the AT task (arq_queue, AT+ARQSTAT) and loop()
+// (arq_loop and the RX handlers); every call into it is under arq_lock
+static SemaphoreHandle_t arq_lock = NULL;
+
+static int arq_io_send_data(uint16_t dst, uint16_t seq, bool ackreq, const uint8_t *data, size_t len) {
+    uint8_t flags = P2P_FLAG_RELIABLE | (ackreq ? P2P_FLAG_ACKREQ : 0);
+    return p2p_send_seq(P2P_TYPE_DATA, flags, dst, seq, data, len);
+}
+
+static int arq_io_send_ack(uint16_t dst, const uint8_t *ack, size_t len) {
+    return p2p_send(P2P_TYPE_ACK, 0, dst, ack, len);
+}
+
+static uint32_t arq_io_now_ms() {
+    return millis();
+}
+
+static uint32_t arq_io_toa_ms(size_t len) {
+    return lora_time_on_air_ms(P2P_HDR_LEN + len);
+}
+
+static void arq_io_result(uint16_t dst, uint16_t seq, bool delivered, uint32_t latency_ms, uint8_t tries) {
+    Serial.printf("+PSEND: dst=%u, seq=%u, %s, %lu ms, tries=%u\r\n", dst, seq,
+                  delivered ? "DELIVERED" : "FAILED", (unsigned long)latency_ms, tries);
+}
+
+static const ARQ_Io arq_radio_io = {
+    arq_io_send_data,
+    arq_io_send_ack,
+    arq_io_now_ms,
+    arq_io_toa_ms,
+    arq_io_result
+};
+
+// Reliable DATA: suppress duplicates, let fresh frames print as usual
+static bool arq_on_data_frame(const P2P_Header *hdr, const uint8_t *payload, size_t len, const RX_Packet_Info *info) {
+    if (!(hdr->flags & P2P_FLAG_RELIABLE)) return false;
+    xSemaphoreTake(arq_lock, portMAX_DELAY);
+    bool fresh = arq_on_data(hdr->src, hdr->seq, (hdr->flags & P2P_FLAG_ACKREQ) != 0);
+    xSemaphoreGive(arq_lock);
+    return !fresh;
+}
+
+static bool arq_on_ack_frame(const P2P_Header *hdr, const uint8_t *payload, size_t len, const RX_Packet_Info *info) {
+    xSemaphoreTake(arq_lock, portMAX_DELAY);
+    arq_on_ack(hdr->src, payload, len);
+    xSemaphoreGive(arq_lock);
+    return true;
+}
+
+void init_arq() {
+    arq_lock = xSemaphoreCreateMutex();
+    arq_init(&arq_radio_io);
+    p2p_register_handler(P2P_TYPE_DATA, arq_on_data_frame);
+    p2p_register_handler(P2P_TYPE_ACK, arq_on_ack_frame);
+
+    register_at_handler("AT+ARQ", handle_at_arq, "Reliable AT+PSEND/AT+FSKSEND to the AT+P2PHDR dst: AT+ARQ=1[,window[,retries]] (window 1 = stop-and-wait), AT+ARQ=0 or AT+ARQ=?");
+    register_at_handler("AT+ARQSTAT", handle_at_arqstat, "Per-peer ARQ retries, latency and RTO: AT+ARQSTAT or AT+ARQSTAT=CLR");
+}
+
+// Called from the main loop: retransmit on timeout, send queued messages
+void arq_loop() {
+    xSemaphoreTake(arq_lock, portMAX_DELAY);
+    if (arq_pending() > 0) arq_poll();
+    xSemaphoreGive(arq_lock);
+}
+
+bool arq_enabled() {
+    return arq_on;
+}
+
+int arq_queue(const uint8_t *data, size_t len) {
+    uint16_t dst = p2p_default_dst();
+    if (dst == P2P_BROADCAST) return ARQ_ERR_BROADCAST;
+    if (len > ARQ_MAX_PAYLOAD) return RADIOLIB_ERR_PACKET_TOO_LONG;
+    // acks can only be heard in RX
+    if (!lora_listening()) {
+        int state = lora_listen();
+        if (state != RADIOLIB_ERR_NONE) return state;
+    }
+    xSemaphoreTake(arq_lock, portMAX_DELAY);
+    int seq = arq_submit(dst, data, len);
+    xSemaphoreGive(arq_lock);
+    if (seq < 0) return ARQ_ERR_QUEUE_FULL;
+    Serial.printf("+PSEND: dst=%u, seq=%d, QUEUED\r\n", dst, seq);
+    return RADIOLIB_ERR_NONE;
+}
+
+// AT+ARQ=0 / AT+ARQ=1[,window[,retries]] / AT+ARQ=?
+void handle_at_arq(const AT_Command *cmd) {
+    if (strcmp(cmd->params, "?") == 0) {
+        xSemaphoreTake(arq_lock, portMAX_DELAY);
+        int pending = arq_pending();
+        xSemaphoreGive(arq_lock);
+        Serial.printf("ARQ: %s, window=%u, retries=%u, pending=%d\r\n", arq_on ? "ON" : "OFF",
+                      arq_window(), arq_retries(), pending);
+        return;
+    }
+    char buf[32];
+    strncpy(buf, cmd->params, sizeof(buf)-1);
+    buf[sizeof(buf)-1] = 0;
+    char *p = strtok(buf, ",");
+    if (!p) {
+        Serial.println("ERROR: Need params: on[,window[,retries]]");
+        return;
+    }
+    int on = atoi(p);
+    p = strtok(NULL, ",");
+    int window = p ? atoi(p) : arq_window();
+    p = strtok(NULL, ",");
+    int retries = p ? atoi(p) : arq_retries();
+    if (window < 1 || window > ARQ_MAX_WINDOW) {
+        Serial.printf("ERROR: Invalid window (1-%d)\r\n", ARQ_MAX_WINDOW);
+        return;
+    }
+    if (retries < 0 || retries > 20) {
+        Serial.println("ERROR: Invalid retries (0-20)");
+        return;
+    }
+    if (on && p2p_default_dst() == P2P_BROADCAST) {
+        Serial.println("ERROR: Set a unicast dst first, e.g. AT+P2PHDR=1,42");
+        return;
+    }
+    arq_on = on != 0;
+    xSemaphoreTake(arq_lock, portMAX_DELAY);
+    arq_set_window((uint8_t)window);
+    arq_set_retries((uint8_t)retries);
+    xSemaphoreGive(arq_lock);
+    Serial.printf("OK, ARQ=%d, window=%d, retries=%d\r\n", arq_on ? 1 : 0, window, retries);
+}
+
+// AT+ARQSTAT / AT+ARQSTAT=CLR
+void handle_at_arqstat(const AT_Command *cmd) {
+    xSemaphoreTake(arq_lock, portMAX_DELAY);
+    if (strcasecmp(cmd->params, "CLR") == 0) {
+        bool pending = arq_pending() > 0;
+        if (!pending) arq_reset();
+        xSemaphoreGive(arq_lock);
+        Serial.println(pending ? "ERROR: Messages pending" : "OK, ARQ stats cleared");
+        return;
+    }
+    // print from a copy; the lock is not held over Serial
+    ARQ_PeerStats stats[ARQ_MAX_PEERS];
+    int n = arq_peer_count();
+    int pending = arq_pending();
+    for (int i = 0; i < n; i++) stats[i] = *arq_peer_stats(i);
+    xSemaphoreGive(arq_lock);
+    Serial.printf("ARQ peers: %d, pending: %d\r\n", n, pending);
+    for (int i = 0; i < n; i++) {
+        const ARQ_PeerStats *s = &stats[i];
+        unsigned long avg = s->delivered ? s->lat_sum_ms / s->delivered : 0;
+        Serial.printf("Peer %5u: sent %lu, delivered %lu, failed %lu, frames %lu, retx %lu, timeouts %lu\r\n",
+                      s->id, (unsigned long)s->submitted, (unsigned long)s->delivered, (unsigned long)s->failed,
+                      (unsigned long)s->tx_frames, (unsigned long)s->retransmits, (unsigned long)s->timeouts);
+        Serial.printf("            latency min/avg/max %lu/%lu/%lu ms, srtt %lu ms, rttvar %lu ms, rto %lu ms, rx %lu, dup %lu\r\n",
+                      (unsigned long)s->lat_min_ms, avg, (unsigned long)s->lat_max_ms,
+                      (unsigned long)s->srtt_ms, (unsigned long)s->rttvar_ms, (unsigned long)s->rto_ms,
+                      (unsigned long)s->rx_new, (unsigned long)s->rx_dup);
+    }
+}
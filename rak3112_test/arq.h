@@ -0,0 +1,24 @@
+#ifndef ARQ_H
+#define ARQ_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "command.h"
+#include "arq_core.h"
+
+// Reliable mode for AT+PSEND / AT+FSKSEND on top of arq_core: payloads go
+// out as P2P DATA frames with P2P_FLAG_RELIABLE to the AT+P2PHDR
+// destination and are retried until the peer acks them. Results are
+// reported asynchronously as +PSEND lines.
+#define ARQ_ERR_QUEUE_FULL  (-1301)
+#define ARQ_ERR_BROADCAST   (-1302)   // reliable mode needs a unicast dst
+
+void init_arq();
+void arq_loop();
+bool arq_enabled();
+int arq_queue(const uint8_t *data, size_t len);
+
+void handle_at_arq(const AT_Command *cmd);
+void handle_at_arqstat(const AT_Command *cmd);
+
+#endif // ARQ_H
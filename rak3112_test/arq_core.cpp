@@ -0,0 +1,327 @@
+#include "arq_core.h"
+
+#include <string.h>
+
+struct ArqMsg {
+    bool used;
+    bool inflight;
+    uint16_t dst;
+    uint16_t seq;
+    uint8_t len;
+    uint8_t tries;            // transmissions so far
+    uint32_t order;           // submission order, FIFO per peer
+    uint32_t submit_ms;
+    uint8_t data[ARQ_MAX_PAYLOAD];
+};
+
+struct ArqPeer {
+    bool used;
+    uint32_t last_ms;
+    // sender
+    uint16_t tx_seq;
+    bool waiting;             // burst out, ack pending
+    uint32_t deadline;
+    uint8_t backoff;
+    uint16_t burst_seq;       // frame that carried ACKREQ
+    uint32_t burst_tx_ms;
+    bool burst_clean;         // first transmission, usable as RTT sample (Karn)
+    // receiver
+    bool rx_valid;
+    uint16_t rx_high;         // highest seq seen
+    uint16_t rx_hist;         // bit i: rx_high - i seen
+    ARQ_PeerStats st;
+};
+
+static const ARQ_Io *arq_io = NULL;
+static ArqMsg arq_msgs[ARQ_QUEUE_LEN];
+static ArqPeer arq_peers[ARQ_MAX_PEERS];
+static uint8_t arq_win = 1;
+static uint8_t arq_max_retries = ARQ_DEFAULT_RETRIES;
+static uint32_t arq_order = 0;
+
+static void put_u16(uint8_t *p, uint16_t v) { p[0] = v & 0xFF; p[1] = v >> 8; }
+static uint16_t get_u16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+void arq_init(const ARQ_Io *io) {
+    arq_io = io;
+    arq_reset();
+}
+
+void arq_reset() {
+    memset(arq_msgs, 0, sizeof(arq_msgs));
+    memset(arq_peers, 0, sizeof(arq_peers));
+    arq_order = 0;
+}
+
+void arq_set_window(uint8_t window) {
+    if (window < 1) window = 1;
+    if (window > ARQ_MAX_WINDOW) window = ARQ_MAX_WINDOW;
+    arq_win = window;
+}
+
+void arq_set_retries(uint8_t retries) {
+    arq_max_retries = retries;
+}
+
+uint8_t arq_window() {
+    return arq_win;
+}
+
+uint8_t arq_retries() {
+    return arq_max_retries;
+}
+
+static bool peer_busy(uint16_t id) {
+    for (int i = 0; i < ARQ_QUEUE_LEN; i++) {
+        if (arq_msgs[i].used && arq_msgs[i].dst == id) return true;
+    }
+    return false;
+}
+
+// Find a peer, or claim a slot for it: free first, then the least recently
+// heard peer with nothing queued.
+static ArqPeer *peer_get(uint16_t id, bool create) {
+    ArqPeer *free_slot = NULL;
+    ArqPeer *oldest = NULL;
+    for (int i = 0; i < ARQ_MAX_PEERS; i++) {
+        ArqPeer *p = &arq_peers[i];
+        if (p->used && p->st.id == id) return p;
+        if (!p->used) {
+            if (!free_slot) free_slot = p;
+        } else if (!peer_busy(p->st.id) && (!oldest || (int32_t)(p->last_ms - oldest->last_ms) < 0)) {
+            oldest = p;
+        }
+    }
+    if (!create) return NULL;
+    ArqPeer *p = free_slot ? free_slot : oldest;
+    if (!p) return NULL;
+    uint32_t now = arq_io->now_ms();
+    memset(p, 0, sizeof(*p));
+    p->used = true;
+    p->st.id = id;
+    p->last_ms = now;
+    // start away from 0 so a rebooted sender is not taken for a duplicate
+    p->tx_seq = (uint16_t)((now * 2654435761u) >> 16);
+    return p;
+}
+
+// Retransmission timeout for a burst ending in a frame of len bytes:
+// Jacobson SRTT + 4*RTTVAR, never below the airtime of frame + ack.
+static uint32_t peer_rto(ArqPeer *p, size_t len) {
+    uint32_t floor_ms = arq_io->toa_ms(len) + arq_io->toa_ms(ARQ_ACK_LEN) + ARQ_TURNAROUND_MS;
+    uint32_t rto = p->st.srtt_ms ? p->st.srtt_ms + 4 * p->st.rttvar_ms : 2 * floor_ms;
+    if (rto < floor_ms) rto = floor_ms;
+    rto <<= p->backoff;
+    p->st.rto_ms = rto;
+    return rto;
+}
+
+static void peer_rtt_sample(ArqPeer *p, uint32_t rtt) {
+    if (p->st.srtt_ms == 0) {
+        p->st.srtt_ms = rtt ? rtt : 1;
+        p->st.rttvar_ms = rtt / 2;
+        return;
+    }
+    int32_t err = (int32_t)rtt - (int32_t)p->st.srtt_ms;
+    p->st.srtt_ms += err / 8;
+    if (p->st.srtt_ms == 0) p->st.srtt_ms = 1;
+    int32_t aerr = err < 0 ? -err : err;
+    p->st.rttvar_ms += (aerr - (int32_t)p->st.rttvar_ms) / 4;
+}
+
+static void msg_finish(ArqMsg *m, ArqPeer *p, bool delivered, uint32_t now) {
+    uint32_t latency = now - m->submit_ms;
+    if (delivered) {
+        p->st.delivered++;
+        if (p->st.delivered == 1 || latency < p->st.lat_min_ms) p->st.lat_min_ms = latency;
+        if (latency > p->st.lat_max_ms) p->st.lat_max_ms = latency;
+        p->st.lat_sum_ms += latency;
+    } else {
+        p->st.failed++;
+    }
+    m->used = false;
+    if (arq_io->on_result) arq_io->on_result(m->dst, m->seq, delivered, latency, m->tries);
+}
+
+int arq_submit(uint16_t dst, const uint8_t *data, size_t len) {
+    if (!arq_io || len > ARQ_MAX_PAYLOAD) return -1;
+    ArqMsg *m = NULL;
+    for (int i = 0; i < ARQ_QUEUE_LEN && !m; i++) {
+        if (!arq_msgs[i].used) m = &arq_msgs[i];
+    }
+    if (!m) return -1;
+    ArqPeer *p = peer_get(dst, true);
+    if (!p) return -1;
+
+    m->inflight = false;
+    m->dst = dst;
+    m->seq = p->tx_seq++;
+    m->len = (uint8_t)len;
+    m->tries = 0;
+    m->order = arq_order++;
+    m->submit_ms = arq_io->now_ms();
+    memcpy(m->data, data, len);
+    m->used = true;             // last: the message is complete once visible
+    p->st.submitted++;
+    return m->seq;
+}
+
+// Send every in-flight message of a peer in submission order; the last
+// frame asks for the ack.
+static void peer_send_burst(ArqPeer *p) {
+    ArqMsg *burst[ARQ_MAX_WINDOW];
+    int n = 0;
+    for (int i = 0; i < ARQ_QUEUE_LEN; i++) {
+        ArqMsg *m = &arq_msgs[i];
+        if (!m->used || !m->inflight || m->dst != p->st.id) continue;
+        if (m->tries > arq_max_retries) {
+            msg_finish(m, p, false, arq_io->now_ms());
+            continue;
+        }
+        int j = n++;
+        while (j > 0 && burst[j - 1]->order > m->order) {
+            burst[j] = burst[j - 1];
+            j--;
+        }
+        burst[j] = m;
+    }
+    if (n == 0) return;
+
+    for (int i = 0; i < n; i++) {
+        ArqMsg *m = burst[i];
+        bool last = (i == n - 1);
+        uint32_t tx_ms = arq_io->now_ms();
+        if (m->tries > 0) p->st.retransmits++;
+        m->tries++;
+        p->st.tx_frames++;
+        if (last) {
+            p->burst_seq = m->seq;
+            p->burst_tx_ms = tx_ms;
+            p->burst_clean = (m->tries == 1);
+        }
+        arq_io->send_data(m->dst, m->seq, last, m->data, m->len);   // a failed send times out like a lost one
+    }
+    p->deadline = p->burst_tx_ms + peer_rto(p, burst[n - 1]->len);
+    p->waiting = true;
+}
+
+void arq_poll() {
+    if (!arq_io) return;
+    for (int pi = 0; pi < ARQ_MAX_PEERS; pi++) {
+        ArqPeer *p = &arq_peers[pi];
+        if (!p->used) continue;
+        if (p->waiting) {
+            if ((int32_t)(arq_io->now_ms() - p->deadline) < 0) continue;
+            p->waiting = false;
+            p->st.timeouts++;
+            if (p->backoff < ARQ_MAX_BACKOFF) p->backoff++;
+        }
+
+        // top the window up from the queue, oldest first
+        int inflight = 0;
+        for (int i = 0; i < ARQ_QUEUE_LEN; i++) {
+            if (arq_msgs[i].used && arq_msgs[i].inflight && arq_msgs[i].dst == p->st.id) inflight++;
+        }
+        while (inflight < arq_win) {
+            ArqMsg *next = NULL;
+            for (int i = 0; i < ARQ_QUEUE_LEN; i++) {
+                ArqMsg *m = &arq_msgs[i];
+                if (m->used && !m->inflight && m->dst == p->st.id && (!next || m->order < next->order)) next = m;
+            }
+            if (!next) break;
+            next->inflight = true;
+            inflight++;
+        }
+        if (inflight > 0) peer_send_burst(p);
+    }
+}
+
+void arq_on_ack(uint16_t src, const uint8_t *ack, size_t len) {
+    if (!arq_io || len < ARQ_ACK_LEN) return;
+    ArqPeer *p = peer_get(src, false);
+    if (!p) return;
+    uint16_t high = get_u16(ack);
+    uint16_t hist = get_u16(ack + 2);
+    uint32_t now = arq_io->now_ms();
+    p->last_ms = now;
+
+    for (int i = 0; i < ARQ_QUEUE_LEN; i++) {
+        ArqMsg *m = &arq_msgs[i];
+        if (!m->used || !m->inflight || m->dst != src) continue;
+        int16_t d = (int16_t)(high - m->seq);
+        if (d >= 0 && d < 16 && ((hist >> d) & 1)) msg_finish(m, p, true, now);
+    }
+
+    // an ack covering the burst tail ends the wait; holes go out again at once
+    int16_t d = (int16_t)(high - p->burst_seq);
+    if (p->waiting && d >= 0 && d < 16 && ((hist >> d) & 1)) {
+        if (p->burst_clean) peer_rtt_sample(p, now - p->burst_tx_ms);
+        p->backoff = 0;
+        p->waiting = false;
+    }
+}
+
+// Receiver side: track the sequence history of a peer. Returns false for a
+// duplicate; the ack is sent either way since the previous one may be lost.
+bool arq_on_data(uint16_t src, uint16_t seq, bool ackreq) {
+    if (!arq_io) return true;
+    ArqPeer *p = peer_get(src, true);
+    bool fresh = true;
+    uint16_t high = seq;
+    uint16_t hist = 1;
+    if (p) {
+        p->last_ms = arq_io->now_ms();
+        int16_t d = (int16_t)(seq - p->rx_high);
+        if (!p->rx_valid || d >= 16 || d <= -16) {
+            // first frame, or far outside the window (peer restarted): resync
+            p->rx_valid = true;
+            p->rx_high = seq;
+            p->rx_hist = 1;
+        } else if (d > 0) {
+            p->rx_hist = (uint16_t)((p->rx_hist << d) | 1);
+            p->rx_high = seq;
+        } else if ((p->rx_hist >> -d) & 1) {
+            fresh = false;
+        } else {
+            p->rx_hist |= (uint16_t)(1 << -d);
+        }
+        if (fresh) {
+            p->st.rx_new++;
+        } else {
+            p->st.rx_dup++;
+        }
+        high = p->rx_high;
+        hist = p->rx_hist;
+    }
+    if (ackreq) {
+        uint8_t ack[ARQ_ACK_LEN];
+        put_u16(ack, high);
+        put_u16(ack + 2, hist);
+        arq_io->send_ack(src, ack, sizeof(ack));
+    }
+    return fresh;
+}
+
+int arq_pending() {
+    int n = 0;
+    for (int i = 0; i < ARQ_QUEUE_LEN; i++) {
+        if (arq_msgs[i].used) n++;
+    }
+    return n;
+}
+
+int arq_peer_count() {
+    int n = 0;
+    for (int i = 0; i < ARQ_MAX_PEERS; i++) {
+        if (arq_peers[i].used) n++;
+    }
+    return n;
+}
+
+const ARQ_PeerStats *arq_peer_stats(int index) {
+    for (int i = 0; i < ARQ_MAX_PEERS; i++) {
+        if (!arq_peers[i].used) continue;
+        if (index-- == 0) return &arq_peers[i].st;
+    }
+    return NULL;
+}
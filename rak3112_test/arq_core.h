@@ -0,0 +1,73 @@
+#ifndef ARQ_CORE_H
+#define ARQ_CORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "p2p.h"
+
+// Automatic repeat request engine for P2P DATA frames. This file has no
+// Arduino or RadioLib dependency (p2p.h is plain C): all I/O goes through
+// ARQ_Io so the same state machine can run on a Linux host against a
+// simulated lossy link (host_test/test_arq.cpp).
+//
+// Sender: up to `window` messages per peer are in flight. They are sent as
+// one burst whose last frame asks for an ack; stop-and-wait is window 1.
+// Receiver: acks carry the highest sequence seen plus a 16-bit history
+// bitmap, which also drives duplicate suppression.
+// The engine takes no lock; a caller running it from several tasks
+// serializes the calls (arq.cpp does).
+#define ARQ_MAX_PEERS       8
+#define ARQ_QUEUE_LEN       16
+#define ARQ_MAX_PAYLOAD     P2P_MAX_PAYLOAD
+#define ARQ_MAX_WINDOW      8
+#define ARQ_DEFAULT_RETRIES 5
+#define ARQ_TURNAROUND_MS   150     // peer RX processing and TX/RX switching
+#define ARQ_MAX_BACKOFF     3       // RTO doubles at most this many times
+#define ARQ_ACK_LEN         4       // ack payload: seq u16 | history u16
+
+struct ARQ_Io {
+    // send a reliable DATA frame; ackreq marks the last frame of a burst
+    int (*send_data)(uint16_t dst, uint16_t seq, bool ackreq, const uint8_t *data, size_t len);
+    // send an ACK frame carrying the ack payload built by the engine
+    int (*send_ack)(uint16_t dst, const uint8_t *ack, size_t len);
+    uint32_t (*now_ms)();
+    uint32_t (*toa_ms)(size_t len);   // time on air of a payload of len bytes
+    // final outcome of a submitted message
+    void (*on_result)(uint16_t dst, uint16_t seq, bool delivered, uint32_t latency_ms, uint8_t tries);
+};
+
+struct ARQ_PeerStats {
+    uint16_t id;
+    uint32_t submitted;
+    uint32_t delivered;
+    uint32_t failed;
+    uint32_t tx_frames;       // DATA frames sent, including retransmits
+    uint32_t retransmits;
+    uint32_t timeouts;
+    uint32_t rx_new;          // reliable frames accepted from this peer
+    uint32_t rx_dup;          // duplicates suppressed
+    uint32_t lat_min_ms;
+    uint32_t lat_max_ms;
+    uint32_t lat_sum_ms;      // over delivered messages
+    uint32_t srtt_ms;         // 0 until the first clean sample
+    uint32_t rttvar_ms;
+    uint32_t rto_ms;          // current retransmission timeout
+};
+
+void arq_init(const ARQ_Io *io);
+void arq_reset();
+void arq_set_window(uint8_t window);
+void arq_set_retries(uint8_t retries);
+uint8_t arq_window();
+uint8_t arq_retries();
+
+int arq_submit(uint16_t dst, const uint8_t *data, size_t len);   // seq, or -1 when full
+void arq_poll();
+void arq_on_ack(uint16_t src, const uint8_t *ack, size_t len);
+bool arq_on_data(uint16_t src, uint16_t seq, bool ackreq);        // false = duplicate
+int arq_pending();
+
+int arq_peer_count();
+const ARQ_PeerStats *arq_peer_stats(int index);
+
+#endif // ARQ_CORE_H
@@ -0,0 +1,320 @@
+#include "collector.h"
+#include "p2p.h"
+#include "Arduino.h"
+#include "command.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Sort snapshot for AT+NODES: key taken once, so the RX path can keep
+// updating the table while the AT task sorts
+struct CollKey {
+    int32_t key;            // larger first
+    uint16_t slot;
+};
+
+enum CollSort {
+    CS_ID = 0,
+    CS_SEEN,
+    CS_RSSI,
+    CS_SNR,
+    CS_PER,
+    CS_RX,
+    CS_LOST
+};
+static const char *coll_sort_names[] = {"ID", "SEEN", "RSSI", "SNR", "PER", "RX", "LOST"};
+
+static COLL_Node *coll_table = NULL;
+static CollKey *coll_keys = NULL;
+static uint32_t coll_cap = 0;
+static uint8_t coll_bits = 0;
+static bool coll_in_psram = false;
+static volatile bool coll_enabled = false;
+static volatile bool coll_quiet = false;
+static volatile uint8_t coll_gen = 1;
+static volatile uint32_t coll_count = 0;    // nodes in the current generation
+static uint32_t coll_full = 0;              // frames from new nodes refused
+static uint32_t coll_anon = 0;              // frames without a P2P header
+static uint32_t coll_probe_max = 0;
+
+static void *coll_malloc(size_t n) {
+    return coll_in_psram ? ps_malloc(n) : malloc(n);
+}
+
+static bool collector_alloc() {
+    if (coll_table) return true;
+    uint32_t cap = COLL_CAPACITY;
+    coll_in_psram = psramFound();
+    if (coll_in_psram) {
+        coll_table = (COLL_Node *)coll_malloc(cap * sizeof(COLL_Node));
+        coll_keys = (CollKey *)coll_malloc(cap * sizeof(CollKey));
+    }
+    if (!coll_table || !coll_keys) {
+        free(coll_table);
+        free(coll_keys);
+        coll_in_psram = false;
+        cap = COLL_FALLBACK_CAPACITY;
+        coll_table = (COLL_Node *)coll_malloc(cap * sizeof(COLL_Node));
+        coll_keys = (CollKey *)coll_malloc(cap * sizeof(CollKey));
+    }
+    if (!coll_table || !coll_keys) {
+        free(coll_table);
+        free(coll_keys);
+        coll_table = NULL;
+        coll_keys = NULL;
+        return false;
+    }
+    memset(coll_table, 0, cap * sizeof(COLL_Node));
+    coll_cap = cap;
+    coll_bits = 0;
+    while ((1UL << coll_bits) < cap) coll_bits++;
+    return true;
+}
+
+static inline bool coll_live(const COLL_Node *n) {
+    return n->id != 0 && n->gen == coll_gen;
+}
+
+static inline uint32_t coll_hash(uint16_t id) {
+    return ((uint32_t)id * 2654435761u) >> (32 - coll_bits);
+}
+
+// Slot of id, or of the empty slot where it would go; -1 when not found and
+// the table is at its load limit (insert) or fully probed
+static int32_t coll_find(uint16_t id, bool insert) {
+    uint32_t mask = coll_cap - 1;
+    uint32_t i = coll_hash(id);
+    for (uint32_t probe = 0; probe < coll_cap; probe++, i = (i + 1) & mask) {
+        COLL_Node *n = &coll_table[i];
+        if (!coll_live(n)) {
+            if (!insert || coll_count >= (uint32_t)(coll_cap * COLL_MAX_LOAD)) return -1;
+            if (probe > coll_probe_max) coll_probe_max = probe;
+            return (int32_t)i;
+        }
+        if (n->id == id) {
+            if (probe > coll_probe_max) coll_probe_max = probe;
+            return (int32_t)i;
+        }
+    }
+    return -1;
+}
+
+bool collector_quiet() {
+    return coll_enabled && coll_quiet;
+}
+
+// Packet path: hash lookup and a few counters, nothing allocated
+void collector_on_rx(const uint8_t *frame, const RX_Packet_Info *info) {
+    if (!coll_enabled) return;
+    P2P_Header hdr;
+    if (!p2p_parse(frame, info->len, &hdr) || hdr.src == P2P_ANON_ID) {
+        coll_anon++;
+        return;
+    }
+    int32_t slot = coll_find(hdr.src, true);
+    if (slot < 0) {
+        coll_full++;
+        return;
+    }
+    COLL_Node *n = &coll_table[slot];
+    if (!coll_live(n)) {
+        memset(n, 0, sizeof(*n));
+        n->gen = coll_gen;
+        n->first_ms = info->t_ms;
+        n->last_seq = hdr.seq;
+        n->rssi = info->rssi;
+        n->snr = info->snr;
+        n->id = hdr.src;
+        coll_count++;
+    } else {
+        // reliable DATA repeats its per-peer sequence on retries
+        if (!(hdr.flags & P2P_FLAG_RELIABLE)) {
+            int16_t d = (int16_t)(hdr.seq - n->last_seq);
+            if (d > 1 && d < 256) n->lost += d - 1;     // larger jumps: sender restarted
+            if (d <= 0 && d > -256) {
+                n->dup++;
+            } else {
+                n->last_seq = hdr.seq;
+            }
+        }
+        n->rssi += COLL_EWMA_ALPHA * (info->rssi - n->rssi);
+        n->snr += COLL_EWMA_ALPHA * (info->snr - n->snr);
+    }
+    n->rx++;
+    n->bytes += info->len;
+    n->last_ms = info->t_ms;
+}
+
+void init_collector() {
+    register_at_handler("AT+COLLECT", handle_at_collect, "Collector node table: AT+COLLECT=1[,quiet], AT+COLLECT=0 or AT+COLLECT=?");
+    register_at_handler("AT+COLLECTCLR", handle_at_collect_clear, "Clear the collector node table");
+    register_at_handler("AT+NODES", handle_at_nodes, "List collector nodes: AT+NODES=[ID|SEEN|RSSI|SNR|PER|RX|LOST][,page[,size]]");
+    register_at_handler("AT+NODE", handle_at_node, "Show one collector node, e.g. AT+NODE=42");
+}
+
+static uint32_t coll_per_ppm(const COLL_Node *n) {
+    uint32_t sent = n->rx + n->lost;
+    return sent ? (uint32_t)((uint64_t)n->lost * 1000000 / sent) : 0;
+}
+
+static int coll_key_cmp(const void *a, const void *b) {
+    const CollKey *x = (const CollKey *)a;
+    const CollKey *y = (const CollKey *)b;
+    if (x->key != y->key) return x->key > y->key ? -1 : 1;
+    return (int)coll_table[x->slot].id - (int)coll_table[y->slot].id;
+}
+
+static void coll_print_node(const COLL_Node *n, uint32_t now) {
+    Serial.printf("%u,%lu,%lu,%.2f,%lu,%.1f,%.1f,%lu,%lu\r\n", n->id, (unsigned long)n->rx, (unsigned long)n->lost,
+                  coll_per_ppm(n) / 10000.0f, (unsigned long)n->dup, n->rssi, n->snr,
+                  (unsigned long)((now - n->last_ms) / 1000), (unsigned long)n->bytes);
+}
+
+// AT+COLLECT=1[,quiet] / 0 / ?
+void handle_at_collect(const AT_Command *cmd) {
+    if (strcmp(cmd->params, "?") == 0) {
+        Serial.print("COLLECT: "); Serial.print(coll_enabled ? "ON" : "OFF");
+        Serial.print(", quiet="); Serial.println(coll_quiet ? 1 : 0);
+        if (coll_table) {
+            Serial.printf("Table: %lu of %lu nodes (%u bytes each) in %s, longest probe %lu\r\n",
+                          (unsigned long)coll_count, (unsigned long)(coll_cap * COLL_MAX_LOAD),
+                          (unsigned)sizeof(COLL_Node), coll_in_psram ? "PSRAM" : "internal RAM",
+                          (unsigned long)coll_probe_max);
+            Serial.printf("Refused (table full): %lu, without header: %lu\r\n", (unsigned long)coll_full,
+                          (unsigned long)coll_anon);
+        } else {
+            Serial.println("Table: not allocated");
+        }
+        return;
+    }
+
+    char buf[32];
+    strncpy(buf, cmd->params, sizeof(buf)-1);
+    buf[sizeof(buf)-1] = 0;
+    char *p = strtok(buf, ",");
+    if (!p) {
+        Serial.println("ERROR: Need params: on[,quiet]");
+        return;
+    }
+    int on = atoi(p);
+    p = strtok(NULL, ",");
+    int quiet = p ? atoi(p) : 0;
+
+    if (on) {
+        if (!collector_alloc()) {
+            Serial.println("ERROR: Unable to allocate node table");
+            return;
+        }
+        coll_quiet = quiet != 0;
+        coll_enabled = true;
+        Serial.printf("OK, COLLECT ON, up to %lu nodes in %s%s\r\n", (unsigned long)(coll_cap * COLL_MAX_LOAD),
+                      coll_in_psram ? "PSRAM" : "internal RAM", coll_quiet ? ", quiet" : "");
+    } else {
+        coll_enabled = false;
+        Serial.println("OK, COLLECT OFF");
+    }
+}
+
+// A new generation empties the table in O(1); stale entries are reused
+void handle_at_collect_clear(const AT_Command *cmd) {
+    if (coll_table) {
+        uint8_t gen = coll_gen + 1;
+        if (gen == 0) {
+            // generation wrapped: old entries could look live again
+            memset(coll_table, 0, coll_cap * sizeof(COLL_Node));
+            gen = 1;
+        }
+        coll_gen = gen;
+        coll_count = 0;
+        coll_probe_max = 0;
+    }
+    coll_full = 0;
+    coll_anon = 0;
+    Serial.println("OK, collector table cleared");
+}
+
+// AT+NODES=[sort][,page[,size]]: CSV, one page of the sorted table
+void handle_at_nodes(const AT_Command *cmd) {
+    if (!coll_table) {
+        Serial.println("ERROR: Collector off, use AT+COLLECT=1");
+        return;
+    }
+    char buf[32];
+    strncpy(buf, cmd->params, sizeof(buf)-1);
+    buf[sizeof(buf)-1] = 0;
+    char *s_sort = strtok(buf, ",");
+    char *s_page = strtok(NULL, ",");
+    char *s_size = strtok(NULL, ",");
+
+    int sort = CS_ID;
+    if (s_sort && strcmp(s_sort, "?") != 0) {
+        sort = -1;
+        for (int i = 0; i <= CS_LOST; i++) {
+            if (strcasecmp(s_sort, coll_sort_names[i]) == 0) sort = i;
+        }
+        if (sort < 0) {
+            Serial.println("ERROR: Sort by ID, SEEN, RSSI, SNR, PER, RX or LOST");
+            return;
+        }
+    }
+    long page = s_page ? atol(s_page) : 0;
+    long size = s_size ? atol(s_size) : COLL_PAGE_DEFAULT;
+    if (page < 0 || size < 1 || size > COLL_PAGE_MAX) {
+        Serial.printf("ERROR: Page from 0, size 1-%d\r\n", COLL_PAGE_MAX);
+        return;
+    }
+
+    uint32_t now = millis();
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < coll_cap; i++) {
+        const COLL_Node *e = &coll_table[i];
+        if (!coll_live(e)) continue;
+        int32_t key;
+        switch (sort) {
+        case CS_SEEN: key = -(int32_t)(now - e->last_ms); break;
+        case CS_RSSI: key = (int32_t)(e->rssi * 100); break;
+        case CS_SNR:  key = (int32_t)(e->snr * 100); break;
+        case CS_PER:  key = (int32_t)coll_per_ppm(e); break;
+        case CS_RX:   key = e->rx > INT32_MAX ? INT32_MAX : (int32_t)e->rx; break;
+        case CS_LOST: key = e->lost > INT32_MAX ? INT32_MAX : (int32_t)e->lost; break;
+        default:      key = -(int32_t)e->id; break;
+        }
+        coll_keys[n].key = key;
+        coll_keys[n].slot = (uint16_t)i;
+        n++;
+    }
+    qsort(coll_keys, n, sizeof(CollKey), coll_key_cmp);
+
+    uint32_t first = (uint32_t)page * size;
+    uint32_t last = first + size < n ? first + size : n;
+    Serial.printf("Nodes %lu-%lu of %lu by %s\r\n", (unsigned long)(first < n ? first + 1 : 0),
+                  (unsigned long)last, (unsigned long)n, coll_sort_names[sort]);
+    Serial.println("id,rx,lost,per%,dup,rssi,snr,seen_s_ago,bytes");
+    for (uint32_t i = first; i < last; i++) {
+        coll_print_node(&coll_table[coll_keys[i].slot], now);
+    }
+}
+
+void handle_at_node(const AT_Command *cmd) {
+    if (!coll_table) {
+        Serial.println("ERROR: Collector off, use AT+COLLECT=1");
+        return;
+    }
+    long id = atol(cmd->params);
+    if (id <= P2P_ANON_ID || id >= P2P_BROADCAST) {
+        Serial.println("ERROR: Invalid node id (1-65534)");
+        return;
+    }
+    int32_t slot = coll_find((uint16_t)id, false);
+    if (slot < 0) {
+        Serial.println("ERROR: Node not seen");
+        return;
+    }
+    const COLL_Node *e = &coll_table[slot];
+    uint32_t now = millis();
+    Serial.printf("Node %u: rx %lu, lost %lu (PER %.2f%%), dup %lu, %lu bytes\r\n", e->id, (unsigned long)e->rx,
+                  (unsigned long)e->lost, coll_per_ppm(e) / 10000.0f, (unsigned long)e->dup, (unsigned long)e->bytes);
+    Serial.printf("RSSI %.1f dBm, SNR %.1f dB (EWMA), first seen %lu s ago, last %lu s ago, seq %u\r\n", e->rssi,
+                  e->snr, (unsigned long)((now - e->first_ms) / 1000), (unsigned long)((now - e->last_ms) / 1000),
+                  e->last_seq);
+}
@@ -0,0 +1,46 @@
+#ifndef COLLECTOR_H
+#define COLLECTOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "command.h"
+#include "lora.h"
+
+// Collector: per-node table keyed by the P2P source id, an open-addressing
+// hash table with linear probing. Capacity is a power of two and the table
+// is only filled to COLL_MAX_LOAD, so probes stay short. The RX path never
+// allocates; the table (and the sort buffer for queries) is allocated once
+// when collecting is switched on, in PSRAM when there is some.
+#define COLL_CAPACITY           8192
+#define COLL_FALLBACK_CAPACITY  512
+#define COLL_MAX_LOAD           0.75f
+#define COLL_EWMA_ALPHA         0.125f
+#define COLL_PAGE_DEFAULT       20
+#define COLL_PAGE_MAX           200
+
+struct COLL_Node {
+    uint16_t id;            // 0 = empty
+    uint8_t gen;            // table generation, stale entries count as empty
+    uint8_t reserved;
+    uint16_t last_seq;
+    uint16_t reserved2;
+    uint32_t first_ms;
+    uint32_t last_ms;
+    uint32_t rx;
+    uint32_t lost;          // sequence gaps
+    uint32_t dup;           // repeated or reordered sequence numbers
+    uint32_t bytes;
+    float rssi;             // EWMA, dBm
+    float snr;              // EWMA, dB
+};
+
+void init_collector();
+bool collector_quiet();
+void collector_on_rx(const uint8_t *frame, const RX_Packet_Info *info);
+
+void handle_at_collect(const AT_Command *cmd);
+void handle_at_collect_clear(const AT_Command *cmd);
+void handle_at_nodes(const AT_Command *cmd);
+void handle_at_node(const AT_Command *cmd);
+
+#endif // COLLECTOR_H
@@ -151,7 +151,8 @@ void atCmd(void *parameter)
 {
 	while (1)
 	{
-		if (Serial.available() > 0)
+		// drain everything pending, one byte per tick caps input at ~1 KB/s
+		while (Serial.available() > 0)
 		{
 			// 读取一个字节的数据
 			char received = Serial.read();
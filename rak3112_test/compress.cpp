@@ -0,0 +1,117 @@
+#include "compress.h"
+#include "lzss.h"
+#include "lora.h"
+#include "p2p.h"
+#include "Arduino.h"
+#include "command.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static bool lz_on = false;
+static LZ_Stats lz_stats;
+
+// Typical frames for AT+LZBENCH
+static const char *lz_samples[] = {
+    "TEMP=23.5,HUM=41.2,BAT=3.91",
+    "TEMP=23.6,HUM=41.0,PRES=1013.2,BAT=3.90,RSSI=-92,SNR=6.5",
+    "{\"id\":17,\"seq\":4711,\"temp\":21.75,\"hum\":55.1,\"bat\":3.87}",
+    "LAT=31.230416,LON=121.473701,ALT=12.0,SPD=0.00",
+    "ACC X=0.012,Y=-0.003,Z=1.001 GYR X=0.10,Y=0.00,Z=-0.20",
+    "hello world"
+};
+
+void init_compress() {
+    register_at_handler("AT+LZ", handle_at_lz, "Compress P2P DATA payloads (needs AT+P2PHDR): AT+LZ=1, AT+LZ=0 or AT+LZ=?");
+    register_at_handler("AT+LZSTAT", handle_at_lzstat, "Show compression ratio and counters: AT+LZSTAT or AT+LZSTAT=CLR");
+    register_at_handler("AT+LZBENCH", handle_at_lzbench, "Benchmark compression on sample payloads: AT+LZBENCH[=rounds]");
+}
+
+bool lz_enabled() {
+    return lz_on;
+}
+
+// Compress a payload for sending; 0 means send it uncompressed
+size_t lz_pack(const uint8_t *in, size_t len, uint8_t *out, size_t cap) {
+    size_t n = lzss_compress(in, len, out, cap);
+    if (n == 0 || n >= len) {
+        lz_stats.tx_plain++;
+        return 0;
+    }
+    lz_stats.tx_packed++;
+    lz_stats.tx_in_bytes += len;
+    lz_stats.tx_out_bytes += n;
+    return n;
+}
+
+int lz_unpack(const uint8_t *in, size_t len, uint8_t *out, size_t cap) {
+    int n = lzss_decompress(in, len, out, cap);
+    if (n < 0) {
+        lz_stats.rx_errors++;
+    } else {
+        lz_stats.rx_unpacked++;
+    }
+    return n;
+}
+
+// AT+LZ=0 / AT+LZ=1 / AT+LZ=?
+void handle_at_lz(const AT_Command *cmd) {
+    if (strcmp(cmd->params, "?") == 0) {
+        Serial.printf("LZ: %s, dictionary %u bytes%s\r\n", lz_on ? "ON" : "OFF", (unsigned)lzss_dict_len(),
+                      p2p_header_mode() ? "" : " (inactive, AT+P2PHDR is off)");
+        return;
+    }
+    lz_on = atoi(cmd->params) != 0;
+    Serial.print("OK, LZ=");
+    Serial.println(lz_on ? 1 : 0);
+}
+
+// AT+LZSTAT / AT+LZSTAT=CLR
+void handle_at_lzstat(const AT_Command *cmd) {
+    if (strcasecmp(cmd->params, "CLR") == 0) {
+        memset(&lz_stats, 0, sizeof(lz_stats));
+        Serial.println("OK, LZ stats cleared");
+        return;
+    }
+    float ratio = lz_stats.tx_in_bytes ? 100.0f * lz_stats.tx_out_bytes / lz_stats.tx_in_bytes : 100.0f;
+    Serial.printf("LZ TX: %lu packed, %lu plain, %lu -> %lu bytes (%.1f%%)\r\n",
+                  (unsigned long)lz_stats.tx_packed, (unsigned long)lz_stats.tx_plain,
+                  (unsigned long)lz_stats.tx_in_bytes, (unsigned long)lz_stats.tx_out_bytes, ratio);
+    Serial.printf("LZ RX: %lu unpacked, %lu errors\r\n",
+                  (unsigned long)lz_stats.rx_unpacked, (unsigned long)lz_stats.rx_errors);
+}
+
+// AT+LZBENCH[=rounds]: size, CPU time and airtime at the current radio
+// settings for each sample payload
+void handle_at_lzbench(const AT_Command *cmd) {
+    long rounds = strlen(cmd->params) ? atol(cmd->params) : LZ_BENCH_ROUNDS;
+    if (rounds < 1 || rounds > 100000) {
+        Serial.println("ERROR: Invalid rounds (1-100000)");
+        return;
+    }
+    uint8_t packed[LZSS_MAX_INPUT + 1];
+    uint8_t plain[LZSS_MAX_INPUT];
+    uint32_t sum_in = 0, sum_out = 0;
+    Serial.println("  len -> lz   ratio  enc us  dec us  ToA ms (plain/lz)");
+    for (size_t i = 0; i < sizeof(lz_samples) / sizeof(lz_samples[0]); i++) {
+        const uint8_t *in = (const uint8_t *)lz_samples[i];
+        size_t len = strlen(lz_samples[i]);
+        size_t n = 0;
+        int m = 0;
+        uint32_t t0 = micros();
+        for (long r = 0; r < rounds; r++) n = lzss_compress(in, len, packed, sizeof(packed));
+        uint32_t t1 = micros();
+        for (long r = 0; r < rounds; r++) m = lzss_decompress(packed, n, plain, sizeof(plain));
+        uint32_t t2 = micros();
+        bool ok = (m == (int)len && memcmp(plain, in, len) == 0);
+        size_t sent = (n && n < len) ? n : len;
+        sum_in += len;
+        sum_out += sent;
+        Serial.printf("%5u -> %3u  %5.1f%%  %6.1f  %6.1f  %lu/%lu%s\r\n", (unsigned)len, (unsigned)n,
+                      100.0f * n / len, (float)(t1 - t0) / rounds, (float)(t2 - t1) / rounds,
+                      (unsigned long)lora_time_on_air_ms(P2P_HDR_LEN + len),
+                      (unsigned long)lora_time_on_air_ms(P2P_HDR_LEN + sent), ok ? "" : "  MISMATCH");
+    }
+    Serial.printf("Total %lu -> %lu bytes on air (%.1f%%)\r\n", (unsigned long)sum_in, (unsigned long)sum_out,
+                  100.0f * sum_out / sum_in);
+}
@@ -0,0 +1,31 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "command.h"
+
+// Optional LZSS compression of P2P DATA payloads (lzss.cpp). Compressed
+// frames carry P2P_FLAG_LZ; payloads that do not shrink go out as is, and
+// unflagged frames are never touched, so nodes without AT+LZ interoperate.
+#define LZ_BENCH_ROUNDS     100
+
+struct LZ_Stats {
+    uint32_t tx_packed;     // payloads sent compressed
+    uint32_t tx_plain;      // payloads that did not shrink
+    uint32_t tx_in_bytes;   // before compression (packed payloads only)
+    uint32_t tx_out_bytes;  // after compression
+    uint32_t rx_unpacked;
+    uint32_t rx_errors;     // flagged frames that failed to decode
+};
+
+void init_compress();
+bool lz_enabled();
+size_t lz_pack(const uint8_t *in, size_t len, uint8_t *out, size_t cap);
+int lz_unpack(const uint8_t *in, size_t len, uint8_t *out, size_t cap);
+
+void handle_at_lz(const AT_Command *cmd);
+void handle_at_lzstat(const AT_Command *cmd);
+void handle_at_lzbench(const AT_Command *cmd);
+
+#endif // COMPRESS_H
@@ -0,0 +1,142 @@
+#include "console.h"
+#include "Arduino.h"
+#include "command.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t console_rate = CONSOLE_DEFAULT_BAUD;
+
+bool console_is_usb_cdc() {
+#if ARDUINO_USB_CDC_ON_BOOT
+    return true;
+#else
+    return false;
+#endif
+}
+
+uint32_t console_baud() {
+    return console_rate;
+}
+
+// Replaces the plain Serial.begin(115200): larger driver buffers let bulk
+// output (RX dumps, SD reads) return to the caller instead of blocking on
+// the hardware FIFO.
+void init_console() {
+#if ARDUINO_USB_CDC_ON_BOOT
+#if ARDUINO_USB_MODE
+    Serial.setRxBufferSize(CONSOLE_RX_BUF_SIZE);
+    Serial.setTxBufferSize(CONSOLE_TX_BUF_SIZE);
+#endif
+    Serial.begin(console_rate);
+#else
+    Serial.setRxBufferSize(CONSOLE_RX_BUF_SIZE);
+    Serial.setTxBufferSize(CONSOLE_TX_BUF_SIZE);
+    Serial.begin(console_rate);
+#endif
+
+    register_at_handler("AT+BAUD", handle_at_baud, "Set/query console baud, reverts unless AT is received at the new rate, e.g. AT+BAUD=921600 or AT+BAUD=?");
+    register_at_handler("AT+CONTPUT", handle_at_contput, "Measure console TX throughput, e.g. AT+CONTPUT=65536");
+}
+
+// Wait for the host to send "AT" at the new rate
+static bool console_wait_confirm(unsigned long timeout_ms) {
+    char last = 0;
+    unsigned long start = millis();
+    while (millis() - start < timeout_ms) {
+        while (Serial.available() > 0) {
+            char c = Serial.read();
+            if ((last == 'A' || last == 'a') && (c == 'T' || c == 't')) {
+                // swallow the rest of the line
+                delay(20);
+                while (Serial.available() > 0) Serial.read();
+                return true;
+            }
+            last = c;
+        }
+        delay(1);
+    }
+    return false;
+}
+
+// AT+BAUD=921600[,timeout_ms] or AT+BAUD=?
+void handle_at_baud(const AT_Command *cmd) {
+    if (strcmp(cmd->params, "?") == 0) {
+        if (console_is_usb_cdc()) {
+            Serial.println("Current BAUD: native USB-CDC (baud not applicable)");
+        } else {
+            Serial.print("Current BAUD: ");
+            Serial.println(console_rate);
+        }
+        return;
+    }
+    if (console_is_usb_cdc()) {
+        Serial.println("ERROR: Console is native USB-CDC, baud not applicable");
+        return;
+    }
+
+    char buf[32];
+    strncpy(buf, cmd->params, sizeof(buf)-1);
+    buf[sizeof(buf)-1] = 0;
+    char *p = strtok(buf, ",");
+    uint32_t rate = p ? strtoul(p, NULL, 10) : 0;
+    p = strtok(NULL, ",");
+    unsigned long timeout_ms = p ? strtoul(p, NULL, 10) : CONSOLE_BAUD_TIMEOUT_MS;
+    if (rate < CONSOLE_MIN_BAUD || rate > CONSOLE_MAX_BAUD) {
+        Serial.println("ERROR: Invalid BAUD (9600-5000000)");
+        return;
+    }
+
+    uint32_t old_rate = console_rate;
+    Serial.printf("OK, switching to %lu, send AT within %lu ms\r\n", (unsigned long)rate, timeout_ms);
+    Serial.flush();
+    Serial.updateBaudRate(rate);
+
+    if (console_wait_confirm(timeout_ms)) {
+        console_rate = rate;
+        Serial.print("OK, BAUD=");
+        Serial.println(console_rate);
+    } else {
+        Serial.updateBaudRate(old_rate);
+        delay(10);
+        Serial.print("ERROR: No confirmation, BAUD reverted to ");
+        Serial.println(old_rate);
+    }
+}
+
+// AT+CONTPUT=<bytes>: write a printable test pattern and time it until drained
+void handle_at_contput(const AT_Command *cmd) {
+    uint32_t total = strlen(cmd->params) ? strtoul(cmd->params, NULL, 10) : 16384;
+    if (total == 0 || total > 4 * 1024 * 1024) {
+        Serial.println("ERROR: Invalid size (1-4194304 bytes)");
+        return;
+    }
+
+    static uint8_t block[256];
+    for (size_t i = 0; i < sizeof(block); i++) {
+        block[i] = (i % 64 == 63) ? '\n' : (uint8_t)('0' + (i % 64) % 10);
+    }
+
+    Serial.println("+CONTPUT:BEGIN");
+    Serial.flush();
+    unsigned long start = micros();
+    uint32_t left = total;
+    while (left > 0) {
+        size_t n = left > sizeof(block) ? sizeof(block) : left;
+        Serial.write(block, n);
+        left -= n;
+    }
+    Serial.flush();
+    unsigned long elapsed_us = micros() - start;
+
+    float kbytes_s = elapsed_us ? (total * 1000.0f) / elapsed_us : 0.0f;
+    Serial.printf("\r\n+CONTPUT:END %lu bytes in %lu us, %.1f KB/s", (unsigned long)total, elapsed_us, kbytes_s);
+    if (console_is_usb_cdc()) {
+        Serial.println(" (native USB-CDC)");
+    } else {
+        // 8N1: 10 bits on the wire per byte
+        float line_kbytes_s = console_rate / 10.0f / 1000.0f;
+        Serial.printf(" (UART %lu, %.0f%% of line rate)\r\n", (unsigned long)console_rate, line_kbytes_s > 0 ? kbytes_s * 100.0f / line_kbytes_s : 0.0f);
+    }
+    Serial.println("OK");
+}
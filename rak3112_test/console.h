@@ -0,0 +1,24 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <stdint.h>
+#include "command.h"
+
+// AT console transport. With "USB CDC On Boot" enabled in the board menu,
+// Serial is the ESP32-S3 native USB-CDC port and baud switching is moot;
+// otherwise it is UART0 behind the USB-UART bridge.
+#define CONSOLE_DEFAULT_BAUD    115200
+#define CONSOLE_MIN_BAUD        9600
+#define CONSOLE_MAX_BAUD        5000000
+#define CONSOLE_RX_BUF_SIZE     4096
+#define CONSOLE_TX_BUF_SIZE     8192
+#define CONSOLE_BAUD_TIMEOUT_MS 3000   // time the host has to confirm a new baud
+
+void init_console();
+uint32_t console_baud();
+bool console_is_usb_cdc();
+
+void handle_at_baud(const AT_Command *cmd);
+void handle_at_contput(const AT_Command *cmd);
+
+#endif // CONSOLE_H
@@ -0,0 +1,283 @@
+#include "dualrx.h"
+#include "lora.h"
+#include "Arduino.h"
+#include <RadioLib.h>
+#include "command.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+extern SX1262 radio;
+
+enum DualPhase {
+    DUAL_CAD = 0,       // LoRa slot, channel activity detection running
+    DUAL_LORA_RX,       // CAD hit, receiving the LoRa frame
+    DUAL_FSK_RX,        // FSK slot, RX window open
+    DUAL_FSK_HOLD       // FSK preamble seen, waiting for the end of the frame
+};
+
+static volatile bool dual_on = false;
+static TaskHandle_t dual_task = NULL;
+static uint32_t dual_lora_ms = DUALRX_DEFAULT_LORA_MS;
+static uint32_t dual_fsk_ms = DUALRX_DEFAULT_FSK_MS;
+static int dual_prev_mode = RADIO_MODE_LORA;
+static bool dual_prev_rx = false;
+static DualRX_Stats dual_stats;
+static uint32_t dual_stats_ms = 0;      // millis() of the last clear
+
+// scheduler task state
+static uint8_t dual_phase = DUAL_CAD;
+static uint32_t slot_start_ms = 0;
+static uint32_t slot_end_ms = 0;
+static uint32_t hold_until_ms = 0;
+static uint32_t frame_max_ms = 0;       // airtime of a full frame on the current modem
+
+static bool expired(uint32_t deadline, uint32_t now) {
+    return (int32_t)(now - deadline) >= 0;
+}
+
+static int dual_switch(int mode) {
+    uint32_t now = millis();
+    dual_stats.modem[g_radio_mode].dwell_ms += now - slot_start_ms;
+    if (mode != g_radio_mode) {
+        uint32_t t0 = micros();
+        int state = lora_switch_modem(mode);
+        uint32_t us = micros() - t0;
+        if (state != RADIOLIB_ERR_NONE) return state;
+        if (dual_stats.switches == 0 || us < dual_stats.switch_us_min) dual_stats.switch_us_min = us;
+        if (us > dual_stats.switch_us_max) dual_stats.switch_us_max = us;
+        dual_stats.switch_us_sum += us;
+        dual_stats.switches++;
+    }
+    slot_start_ms = millis();
+    dual_stats.modem[mode].slots++;
+    frame_max_ms = lora_time_on_air_ms(255) + DUALRX_HOLD_MARGIN_MS;
+    return RADIOLIB_ERR_NONE;
+}
+
+static int cad_start() {
+    dual_stats.modem[RADIO_MODE_LORA].cad++;
+    dual_phase = DUAL_CAD;
+    hold_until_ms = millis() + DUALRX_HOLD_MARGIN_MS;   // CAD done is a few symbols away
+    return radio.startChannelScan();
+}
+
+static int lora_slot_begin() {
+    int state = dual_switch(RADIO_MODE_LORA);
+    if (state != RADIOLIB_ERR_NONE) return state;
+    slot_end_ms = millis() + dual_lora_ms;
+    return cad_start();
+}
+
+// RX after a CAD hit: the timer covers preamble and header only, the modem
+// stops it on a valid header (units of 15.625 us)
+static int lora_rx_start() {
+    uint32_t sym_us = (uint32_t)((1UL << g_lora_sf) * 1000.0f / g_lora_bandwidth);
+    uint32_t timeout = (uint32_t)(g_lora_preamble + 8) * sym_us * 64 / 1000;
+    dual_phase = DUAL_LORA_RX;
+    hold_until_ms = millis() + frame_max_ms;
+    return radio.startReceive(timeout, RADIOLIB_SX126X_IRQ_RX_DEFAULT,
+                              RADIOLIB_SX126X_IRQ_RX_DONE | RADIOLIB_SX126X_IRQ_TIMEOUT);
+}
+
+static int fsk_slot_begin() {
+    int state = dual_switch(RADIO_MODE_FSK);
+    if (state != RADIOLIB_ERR_NONE) return state;
+    // keep receiving past the window once a preamble has been detected
+    uint8_t stop_on_preamble = 1;
+    state = radio.getMod()->SPIwriteStream(RADIOLIB_SX126X_CMD_STOP_TIMER_ON_PREAMBLE, &stop_on_preamble, 1);
+    if (state != RADIOLIB_ERR_NONE) return state;
+    dual_phase = DUAL_FSK_RX;
+    slot_end_ms = millis() + dual_fsk_ms;
+    hold_until_ms = slot_end_ms + DUALRX_HOLD_MARGIN_MS;
+    return radio.startReceive(dual_fsk_ms * 64, RADIOLIB_SX126X_IRQ_RX_DEFAULT | RADIOLIB_SX126X_IRQ_PREAMBLE_DETECTED,
+                              RADIOLIB_SX126X_IRQ_RX_DONE | RADIOLIB_SX126X_IRQ_TIMEOUT);
+}
+
+// Read the frame behind an RX_DONE and hand it to loop(), or count the
+// detection as missed (also when loop() has fallen LORA_RX_QUEUE behind)
+static void rx_finish(int mode, uint16_t irq) {
+    DualRX_ModemStats *m = &dual_stats.modem[mode];
+    if ((irq & RADIOLIB_SX126X_IRQ_RX_DONE) && lora_rx_defer() == RADIOLIB_ERR_NONE) {
+        m->rx++;
+    } else {
+        m->missed++;
+    }
+}
+
+static int dual_step() {
+    bool irq = lora_irq_take();
+    uint32_t now = millis();
+    uint16_t flags;
+
+    switch (dual_phase) {
+    case DUAL_CAD:
+        if (!irq && !expired(hold_until_ms, now)) return RADIOLIB_ERR_NONE;
+        if (irq && radio.getChannelScanResult() == RADIOLIB_LORA_DETECTED) {
+            dual_stats.modem[RADIO_MODE_LORA].detect++;
+            return lora_rx_start();
+        }
+        return expired(slot_end_ms, now) ? fsk_slot_begin() : cad_start();
+
+    case DUAL_LORA_RX:
+        if (!irq && !expired(hold_until_ms, now)) return RADIOLIB_ERR_NONE;
+        flags = radio.getIrqStatus();
+        rx_finish(RADIO_MODE_LORA, flags);
+        radio.standby();
+        return fsk_slot_begin();
+
+    case DUAL_FSK_RX:
+        if (irq) {
+            flags = radio.getIrqStatus();
+            if (flags & RADIOLIB_SX126X_IRQ_RX_DONE) {
+                dual_stats.modem[RADIO_MODE_FSK].detect++;
+                rx_finish(RADIO_MODE_FSK, flags);
+            }
+            radio.standby();
+            return lora_slot_begin();
+        }
+        if (!expired(hold_until_ms, now)) return RADIOLIB_ERR_NONE;
+        // no timeout: the timer was stopped by a preamble
+        flags = radio.getIrqStatus();
+        if (flags & RADIOLIB_SX126X_IRQ_PREAMBLE_DETECTED) {
+            dual_stats.modem[RADIO_MODE_FSK].detect++;
+            dual_phase = DUAL_FSK_HOLD;
+            hold_until_ms = now + frame_max_ms;
+            return RADIOLIB_ERR_NONE;
+        }
+        radio.standby();
+        return lora_slot_begin();
+
+    case DUAL_FSK_HOLD:
+        if (!irq && !expired(hold_until_ms, now)) return RADIOLIB_ERR_NONE;
+        rx_finish(RADIO_MODE_FSK, radio.getIrqStatus());
+        radio.standby();
+        return lora_slot_begin();
+    }
+    return RADIOLIB_ERR_NONE;
+}
+
+static void dualrx_run(void *param) {
+    slot_start_ms = millis();
+    int state = lora_slot_begin();
+    while (dual_on && state == RADIOLIB_ERR_NONE) {
+        state = dual_step();
+        vTaskDelay(1);
+    }
+    dual_stats.modem[g_radio_mode].dwell_ms += millis() - slot_start_ms;
+    if (state != RADIOLIB_ERR_NONE) {
+        Serial.printf("+DUALRX: ERROR,%d\r\n", state);
+    }
+
+    lora_dual_claim(false);
+    lora_switch_modem(dual_prev_mode);
+    if (dual_prev_rx) lora_listen();
+    dual_on = false;
+    dual_task = NULL;
+    vTaskDelete(NULL);
+}
+
+void init_dualrx() {
+    dual_stats_ms = millis();
+    register_at_handler("AT+DUALRX", handle_at_dualrx, "Time-sliced LoRa/FSK receive: AT+DUALRX=1[,lora_ms,fsk_ms], AT+DUALRX=0 or AT+DUALRX=?");
+    register_at_handler("AT+DUALSTAT", handle_at_dualstat, "Show dual receive detections, captures and switch cost: AT+DUALSTAT or AT+DUALSTAT=CLR");
+}
+
+bool dualrx_active() {
+    return dual_task != NULL;
+}
+
+static void dualrx_stop() {
+    dual_on = false;
+    // let the scheduler hand the radio back before the next command
+    for (int i = 0; i < 200 && dual_task; i++) delay(1);
+}
+
+// AT+DUALRX=1[,lora_ms,fsk_ms], AT+DUALRX=0, AT+DUALRX=?
+void handle_at_dualrx(const AT_Command *cmd) {
+    if (strcmp(cmd->params, "?") == 0) {
+        Serial.printf("DUALRX: %s, LoRa %lu ms, FSK %lu ms\r\n", dualrx_active() ? "on" : "off",
+                      (unsigned long)dual_lora_ms, (unsigned long)dual_fsk_ms);
+        return;
+    }
+
+    char buf[64];
+    strncpy(buf, cmd->params, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = 0;
+    char *tok = strtok(buf, ",");
+    if (!tok) {
+        Serial.println("ERROR: Usage AT+DUALRX=1[,lora_ms,fsk_ms] or AT+DUALRX=0");
+        return;
+    }
+    int on = atoi(tok);
+    if (on == 0) {
+        dualrx_stop();
+        Serial.println("OK, DUALRX=0");
+        return;
+    }
+
+    uint32_t lora_ms = dual_lora_ms;
+    uint32_t fsk_ms = dual_fsk_ms;
+    tok = strtok(NULL, ",");
+    if (tok) {
+        char *fsk_tok = strtok(NULL, ",");
+        if (!fsk_tok) {
+            Serial.println("ERROR: Give both slot lengths, e.g. AT+DUALRX=1,40,40");
+            return;
+        }
+        long l = atol(tok);
+        long f = atol(fsk_tok);
+        if (l < 1 || l > DUALRX_MAX_SLOT_MS || f < 1 || f > DUALRX_MAX_SLOT_MS) {
+            Serial.printf("ERROR: Slot lengths must be 1-%d ms\r\n", DUALRX_MAX_SLOT_MS);
+            return;
+        }
+        lora_ms = l;
+        fsk_ms = f;
+    }
+
+    if (dualrx_active()) dualrx_stop();
+    dual_prev_mode = g_radio_mode;
+    dual_prev_rx = lora_listening();
+    int state = lora_dual_claim(true);
+    if (state != RADIOLIB_ERR_NONE) {
+        Serial.print("ERROR: Device busy, code ");
+        Serial.println(state);
+        return;
+    }
+    dual_lora_ms = lora_ms;
+    dual_fsk_ms = fsk_ms;
+    dual_on = true;
+    if (xTaskCreate(dualrx_run, "dualRx", 8192, NULL, DUALRX_TASK_PRIORITY, &dual_task) != pdPASS) {
+        dual_on = false;
+        dual_task = NULL;
+        lora_dual_claim(false);
+        Serial.println("ERROR: Unable to start scheduler task");
+        return;
+    }
+    Serial.printf("OK, DUALRX=1, LoRa %lu ms, FSK %lu ms\r\n", (unsigned long)lora_ms, (unsigned long)fsk_ms);
+}
+
+void handle_at_dualstat(const AT_Command *cmd) {
+    if (strcasecmp(cmd->params, "CLR") == 0) {
+        memset(&dual_stats, 0, sizeof(dual_stats));
+        dual_stats_ms = millis();
+        slot_start_ms = dual_stats_ms;
+        Serial.println("OK, DUALRX stats cleared");
+        return;
+    }
+    uint32_t total_ms = dual_stats.modem[0].dwell_ms + dual_stats.modem[1].dwell_ms;
+    static const char *names[2] = {"LoRa", "FSK "};
+    for (int i = 0; i < 2; i++) {
+        const DualRX_ModemStats *m = &dual_stats.modem[i];
+        float duty = total_ms ? 100.0f * m->dwell_ms / total_ms : 0.0f;
+        float capture = m->detect ? 100.0f * m->rx / m->detect : 0.0f;
+        Serial.printf("%s: %lu slots, %lu CAD, %lu detected, %lu received, %lu missed, capture %.1f%%, duty %.1f%%\r\n",
+                      names[i], (unsigned long)m->slots, (unsigned long)m->cad, (unsigned long)m->detect,
+                      (unsigned long)m->rx, (unsigned long)m->missed, capture, duty);
+    }
+    unsigned long avg = dual_stats.switches ? (unsigned long)(dual_stats.switch_us_sum / dual_stats.switches) : 0;
+    Serial.printf("Switches: %lu, min/avg/max %lu/%lu/%lu us\r\n", (unsigned long)dual_stats.switches,
+                  (unsigned long)dual_stats.switch_us_min, avg, (unsigned long)dual_stats.switch_us_max);
+    Serial.printf("Since clear: %lu ms (missed senders show as lost frames in AT+RXSTAT)\r\n",
+                  (unsigned long)(millis() - dual_stats_ms));
+}
@@ -0,0 +1,41 @@
+#ifndef DUALRX_H
+#define DUALRX_H
+
+#include <stdint.h>
+#include "command.h"
+
+// Time-sliced receive on both modems. A LoRa slot runs back-to-back CADs;
+// when one detects a preamble the radio stays in LoRa RX for the packet. An
+// FSK slot is an RX window with the RX timer stopped on preamble detection,
+// so a packet that starts inside the window is received to the end. The
+// radio alternates between the two with lora_switch_modem(), no reset.
+#define DUALRX_DEFAULT_LORA_MS  40
+#define DUALRX_DEFAULT_FSK_MS   40
+#define DUALRX_MAX_SLOT_MS      10000
+#define DUALRX_HOLD_MARGIN_MS   20      // on top of the longest frame airtime
+#define DUALRX_TASK_PRIORITY    2
+
+struct DualRX_ModemStats {
+    uint32_t slots;
+    uint32_t cad;           // CAD runs (LoRa only)
+    uint32_t detect;        // CAD hits / FSK preambles
+    uint32_t rx;            // frames read without error
+    uint32_t missed;        // detections that did not end in a good frame
+    uint32_t dwell_ms;
+};
+
+struct DualRX_Stats {
+    DualRX_ModemStats modem[2];     // indexed by RADIO_MODE_LORA / RADIO_MODE_FSK
+    uint32_t switches;
+    uint32_t switch_us_min;
+    uint32_t switch_us_max;
+    uint64_t switch_us_sum;
+};
+
+void init_dualrx();
+bool dualrx_active();
+
+void handle_at_dualrx(const AT_Command *cmd);
+void handle_at_dualstat(const AT_Command *cmd);
+
+#endif // DUALRX_H
@@ -0,0 +1,148 @@
+#include "hex.h"
+
+#include <string.h>
+
+#define HEX_BAD     0x10
+
+#define B HEX_BAD
+static const uint8_t hex_nibble[256] = {
+    B, B, B, B, B, B, B, B, B, B, B, B, B, B, B, B,
+    B, B, B, B, B, B, B, B, B, B, B, B, B, B, B, B,
+    B, B, B, B, B, B, B, B, B, B, B, B, B, B, B, B,
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, B, B, B, B, B, B,                 // '0'-'9'
+    B, 10, 11, 12, 13, 14, 15, B, B, B, B, B, B, B, B, B,           // 'A'-'F'
+    B, B, B, B, B, B, B, B, B, B, B, B, B, B, B, B,
+    B, 10, 11, 12, 13, 14, 15, B, B, B, B, B, B, B, B, B,           // 'a'-'f'
+    B, B, B, B, B, B, B, B, B, B, B, B, B, B, B, B,
+    B, B, B, B, B, B, B, B, B, B, B, B, B, B, B, B,
+    B, B, B, B, B, B, B, B, B, B, B, B, B, B, B, B,
+    B, B, B, B, B, B, B, B, B, B, B, B, B, B, B, B,
+    B, B, B, B, B, B, B, B, B, B, B, B, B, B, B, B,
+    B, B, B, B, B, B, B, B, B, B, B, B, B, B, B, B,
+    B, B, B, B, B, B, B, B, B, B, B, B, B, B, B, B,
+    B, B, B, B, B, B, B, B, B, B, B, B, B, B, B, B,
+    B, B, B, B, B, B, B, B, B, B, B, B, B, B, B, B,
+};
+#undef B
+
+#define HEX_ROW(h) h "0" h "1" h "2" h "3" h "4" h "5" h "6" h "7" \
+                   h "8" h "9" h "A" h "B" h "C" h "D" h "E" h "F"
+static const char hex_pairs[] =
+    HEX_ROW("0") HEX_ROW("1") HEX_ROW("2") HEX_ROW("3") HEX_ROW("4") HEX_ROW("5") HEX_ROW("6") HEX_ROW("7")
+    HEX_ROW("8") HEX_ROW("9") HEX_ROW("A") HEX_ROW("B") HEX_ROW("C") HEX_ROW("D") HEX_ROW("E") HEX_ROW("F");
+#undef HEX_ROW
+
+#define HEX_PAIR(out, b)    memcpy((out), &hex_pairs[2 * (b)], 2)
+
+size_t hex_encode(char *out, const uint8_t *data, size_t len) {
+    size_t i = 0;
+    for (; i + 4 <= len; i += 4) {
+        HEX_PAIR(out + 2 * i, data[i]);
+        HEX_PAIR(out + 2 * i + 2, data[i + 1]);
+        HEX_PAIR(out + 2 * i + 4, data[i + 2]);
+        HEX_PAIR(out + 2 * i + 6, data[i + 3]);
+    }
+    for (; i < len; i++) HEX_PAIR(out + 2 * i, data[i]);
+    return 2 * len;
+}
+
+size_t hex_encode_spaced(char *out, const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        HEX_PAIR(out, data[i]);
+        out[2] = ' ';
+        out += 3;
+    }
+    return 3 * len;
+}
+
+static bool hex_valid(const uint8_t *s, size_t len) {
+    uint8_t bad = 0;
+    for (size_t i = 0; i < len; i++) bad |= hex_nibble[s[i]];
+    return !(bad & HEX_BAD);
+}
+
+int hex_decode(uint8_t *out, size_t max, const char *hex, size_t len) {
+    const uint8_t *s = (const uint8_t *)hex;
+    if (len & 1) return HEX_ERR_INVALID;
+    size_t n = len / 2;
+    if (n > max) return hex_valid(s, len) ? HEX_ERR_TOO_LONG : HEX_ERR_INVALID;
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4, s += 8) {
+        uint8_t h0 = hex_nibble[s[0]], l0 = hex_nibble[s[1]];
+        uint8_t h1 = hex_nibble[s[2]], l1 = hex_nibble[s[3]];
+        uint8_t h2 = hex_nibble[s[4]], l2 = hex_nibble[s[5]];
+        uint8_t h3 = hex_nibble[s[6]], l3 = hex_nibble[s[7]];
+        if ((h0 | l0 | h1 | l1 | h2 | l2 | h3 | l3) & HEX_BAD) return HEX_ERR_INVALID;
+        out[i] = (uint8_t)(h0 << 4 | l0);
+        out[i + 1] = (uint8_t)(h1 << 4 | l1);
+        out[i + 2] = (uint8_t)(h2 << 4 | l2);
+        out[i + 3] = (uint8_t)(h3 << 4 | l3);
+    }
+    for (; i < n; i++, s += 2) {
+        uint8_t h = hex_nibble[s[0]], l = hex_nibble[s[1]];
+        if ((h | l) & HEX_BAD) return HEX_ERR_INVALID;
+        out[i] = (uint8_t)(h << 4 | l);
+    }
+    return (int)n;
+}
+
+#ifdef ESP_PLATFORM
+#include "p2p.h"
+#include "Arduino.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+void init_hex() {
+    register_at_handler("AT+HEXBENCH", handle_at_hexbench, "Benchmark hex decode/encode against the strtol/printf path per payload length: AT+HEXBENCH[=rounds]");
+}
+
+// AT+HEXBENCH[=rounds]: the old per-byte strtol/printf path against the
+// table codec, for payload lengths 16-255
+void handle_at_hexbench(const AT_Command *cmd) {
+    long rounds = strlen(cmd->params) ? atol(cmd->params) : HEX_BENCH_ROUNDS;
+    if (rounds < 1 || rounds > 100000) {
+        Serial.println("ERROR: Invalid rounds (1-100000)");
+        return;
+    }
+    static const size_t lens[] = {16, 32, 64, 128, P2P_MAX_FRAME};
+    static uint8_t data[P2P_MAX_FRAME];
+    static uint8_t out[P2P_MAX_FRAME];
+    static char text[2 * P2P_MAX_FRAME + 1];
+    for (size_t i = 0; i < sizeof(data); i++) data[i] = (uint8_t)(i * 37 + 11);
+
+    Serial.println("  len  strtol us  table us  printf us  table us");
+    for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+        size_t len = lens[l];
+        size_t digits = hex_encode(text, data, len);
+        bool ok = true;
+        uint32_t t_dec_old = 0, t_dec = 0, t_enc_old = 0, t_enc = 0;
+        for (long r = 0; r < rounds; r++) {
+            uint32_t t0 = micros();
+            bool isHex = true;
+            for (size_t i = 0; i < digits && isHex; i++) {
+                if (!isxdigit(text[i])) isHex = false;
+            }
+            for (size_t i = 0; i < len && isHex; i++) {
+                char tmp[3] = {text[2*i], text[2*i+1], 0};
+                out[i] = (uint8_t)strtol(tmp, NULL, 16);
+            }
+            uint32_t t1 = micros();
+            ok &= hex_decode(out, sizeof(out), text, digits) == (int)len;
+            uint32_t t2 = micros();
+            for (size_t i = 0; i < len; i++) snprintf(text + 2 * i, 3, "%02X", data[i]);
+            uint32_t t3 = micros();
+            hex_encode(text, data, len);
+            t_dec_old += t1 - t0;
+            t_dec += t2 - t1;
+            t_enc_old += t3 - t2;
+            t_enc += micros() - t3;
+        }
+        ok &= memcmp(out, data, len) == 0;
+        Serial.printf("%5u  %9.1f  %8.1f  %9.1f  %8.1f%s\r\n", (unsigned)len, (float)t_dec_old / rounds,
+                      (float)t_dec / rounds, (float)t_enc_old / rounds, (float)t_enc / rounds, ok ? "" : "  FAIL");
+    }
+}
+#endif
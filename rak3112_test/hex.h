@@ -0,0 +1,36 @@
+#ifndef HEX_H
+#define HEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Hex codec for AT payloads and RX output. Like arq_core, the codec has no
+// Arduino dependency, so it is checked and benchmarked on the host
+// (host_test/bench_hex.cpp); only AT+HEXBENCH is ESP32 code.
+//
+// Decoding looks every character up in a 256 entry table (value, or a bad
+// marker), so one pass both validates and decodes. Encoding copies both
+// digits of a byte from a 256 entry table of digit pairs. The main loops
+// take 4 bytes (8 digits) per step with the bad markers OR'ed together, so
+// there is a single branch per word.
+#define HEX_ERR_INVALID     (-1)    // odd length or not a hex digit
+#define HEX_ERR_TOO_LONG    (-2)    // valid, but more bytes than fit
+
+#define HEX_BENCH_ROUNDS    100     // AT+HEXBENCH default
+
+// Upper case digits, no terminator. Returns 2 * len.
+size_t hex_encode(char *out, const uint8_t *data, size_t len);
+// "XX " per byte, no terminator. Returns 3 * len.
+size_t hex_encode_spaced(char *out, const uint8_t *data, size_t len);
+// Decodes len digits (either case) into at most max bytes. Returns the
+// byte count or a HEX_ERR_ code (out may be partly written).
+int hex_decode(uint8_t *out, size_t max, const char *hex, size_t len);
+
+#ifdef ESP_PLATFORM
+#include "command.h"
+
+void init_hex();
+void handle_at_hexbench(const AT_Command *cmd);
+#endif
+
+#endif // HEX_H
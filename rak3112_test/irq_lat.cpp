@@ -0,0 +1,127 @@
+#include "irq_lat.h"
+#include "lora.h"
+#include "Arduino.h"
+#include "command.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct LatHist {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t hist[IRQLAT_BINS];
+};
+
+static const char *lat_names[IRQLAT_KINDS] = {
+    "ISR->task", "task->read", "done->rearm", "pre->done", "hdr->done", "tx->done", "done->ret"
+};
+
+static LatHist lat[IRQLAT_KINDS];
+static uint32_t lat_merged = 0;         // RX done with no edge of its own
+static IRQLAT_Rx lat_last_rx;
+static uint32_t lat_last_tx[3];
+
+static void lat_add(int kind, uint32_t us) {
+    LatHist *h = &lat[kind];
+    if (h->count == 0 || us < h->min) h->min = us;
+    if (us > h->max) h->max = us;
+    h->count++;
+    h->sum += us;
+    int bin = 0;
+    for (uint32_t v = us >> 5; v && bin < IRQLAT_BINS - 1; v >>= 1) bin++;
+    h->hist[bin]++;
+}
+
+static void lat_reset() {
+    memset(lat, 0, sizeof(lat));
+    memset(&lat_last_rx, 0, sizeof(lat_last_rx));
+    memset(lat_last_tx, 0, sizeof(lat_last_tx));
+    lat_merged = 0;
+}
+
+void init_irqlat() {
+    lat_reset();
+    register_at_handler("AT+IRQLAT", handle_at_irqlat, "Radio IRQ latency: AT+IRQLAT=? (summary), AT+IRQLAT=HIST, AT+IRQLAT=CLR, AT+IRQLAT=DETAIL,0|1 (preamble/header IRQs)");
+}
+
+// Packet path: unsigned differences, so micros() wrapping is harmless
+void irqlat_rx(const IRQLAT_Rx *rx) {
+    lat_last_rx = *rx;
+    if (rx->done_us) {
+        lat_add(IRQLAT_ISR_TASK, rx->task_us - rx->done_us);
+        lat_add(IRQLAT_DONE_REARM, rx->armed_us - rx->done_us);
+        if (rx->pre_us) lat_add(IRQLAT_PRE_DONE, rx->done_us - rx->pre_us);
+        if (rx->hdr_us) lat_add(IRQLAT_HDR_DONE, rx->done_us - rx->hdr_us);
+    } else {
+        lat_merged++;
+    }
+    lat_add(IRQLAT_TASK_READ, rx->read_us - rx->task_us);
+}
+
+void irqlat_tx(uint32_t start_us, uint32_t done_us, uint32_t return_us) {
+    lat_last_tx[0] = start_us;
+    lat_last_tx[1] = done_us;
+    lat_last_tx[2] = return_us;
+    lat_add(IRQLAT_TX_DONE, done_us - start_us);
+    lat_add(IRQLAT_TX_RETURN, return_us - done_us);
+}
+
+static void print_hist(int kind) {
+    const LatHist *h = &lat[kind];
+    if (h->count == 0) return;
+    Serial.printf("%s histogram (us):\r\n", lat_names[kind]);
+    for (int i = 0; i < IRQLAT_BINS; i++) {
+        if (!h->hist[i]) continue;
+        if (i == 0) {
+            Serial.printf("  <  %7lu : %lu\r\n", 32UL, (unsigned long)h->hist[i]);
+        } else if (i == IRQLAT_BINS - 1) {
+            Serial.printf("  >= %7lu : %lu\r\n", 16UL << i, (unsigned long)h->hist[i]);
+        } else {
+            Serial.printf("  %7lu.. : %lu\r\n", 16UL << i, (unsigned long)h->hist[i]);
+        }
+    }
+}
+
+// AT+IRQLAT / AT+IRQLAT=? / HIST / CLR / DETAIL,0|1
+void handle_at_irqlat(const AT_Command *cmd) {
+    if (strcasecmp(cmd->params, "CLR") == 0) {
+        lat_reset();
+        Serial.println("OK, IRQ latency cleared");
+        return;
+    }
+    if (strncasecmp(cmd->params, "DETAIL,", 7) == 0) {
+        bool on = atoi(cmd->params + 7) != 0;
+        lora_rx_detail(on);
+        Serial.print("OK, preamble/header IRQs on DIO1 ");
+        Serial.println(on ? "ON" : "OFF");
+        return;
+    }
+    if (strcasecmp(cmd->params, "HIST") == 0) {
+        for (int i = 0; i < IRQLAT_KINDS; i++) print_hist(i);
+        return;
+    }
+    if (strlen(cmd->params) != 0 && strcmp(cmd->params, "?") != 0) {
+        Serial.println("ERROR: Use AT+IRQLAT=?, HIST, CLR or DETAIL,0|1");
+        return;
+    }
+
+    for (int i = 0; i < IRQLAT_KINDS; i++) {
+        const LatHist *h = &lat[i];
+        if (h->count == 0) {
+            Serial.printf("%-12s: no data\r\n", lat_names[i]);
+            continue;
+        }
+        Serial.printf("%-12s: min=%lu avg=%lu max=%lu us (n=%lu)\r\n", lat_names[i], (unsigned long)h->min,
+                      (unsigned long)(h->sum / h->count), (unsigned long)h->max, (unsigned long)h->count);
+    }
+    Serial.printf("RX done without own edge: %lu, detail %s\r\n", (unsigned long)lat_merged,
+                  lora_rx_detail_on() ? "ON" : "OFF");
+    const IRQLAT_Rx *r = &lat_last_rx;
+    Serial.printf("Last RX (us): pre=%lu hdr=%lu done=%lu task=%lu read=%lu armed=%lu\r\n",
+                  (unsigned long)r->pre_us, (unsigned long)r->hdr_us, (unsigned long)r->done_us,
+                  (unsigned long)r->task_us, (unsigned long)r->read_us, (unsigned long)r->armed_us);
+    Serial.printf("Last TX (us): start=%lu done=%lu return=%lu\r\n",
+                  (unsigned long)lat_last_tx[0], (unsigned long)lat_last_tx[1], (unsigned long)lat_last_tx[2]);
+}
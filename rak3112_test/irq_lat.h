@@ -0,0 +1,39 @@
+#ifndef IRQ_LAT_H
+#define IRQ_LAT_H
+
+#include <stdint.h>
+#include "command.h"
+
+// Radio IRQ latency. The DIO1 ISR stamps micros(); the packet path adds the
+// task side. Histogram bins are powers of two: bin 0 < 32 us, bin i covers
+// 2^(i+4) .. 2^(i+5) us, the last bin is open ended (>= ~0.5 s).
+#define IRQLAT_BINS 16
+
+enum IRQLAT_Kind {
+    IRQLAT_ISR_TASK = 0,    // RX done edge -> loop() picks up the flag
+    IRQLAT_TASK_READ,       // flag seen -> FIFO read over SPI complete
+    IRQLAT_DONE_REARM,      // RX done edge -> RX re-armed (dead time)
+    IRQLAT_PRE_DONE,        // preamble detected -> RX done (detail mode)
+    IRQLAT_HDR_DONE,        // LoRa header valid -> RX done (detail mode)
+    IRQLAT_TX_DONE,         // transmit() called -> TX done edge
+    IRQLAT_TX_RETURN,       // TX done edge -> transmit() returns
+    IRQLAT_KINDS
+};
+
+// DIO1 edges and task marks of one received frame, micros(), 0 = not seen
+struct IRQLAT_Rx {
+    uint32_t pre_us;
+    uint32_t hdr_us;
+    uint32_t done_us;
+    uint32_t task_us;
+    uint32_t read_us;
+    uint32_t armed_us;
+};
+
+void init_irqlat();
+void irqlat_rx(const IRQLAT_Rx *rx);
+void irqlat_tx(uint32_t start_us, uint32_t done_us, uint32_t return_us);
+
+void handle_at_irqlat(const AT_Command *cmd);
+
+#endif // IRQ_LAT_H
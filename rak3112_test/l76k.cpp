@@ -1,5 +1,6 @@
 #include "l76k.h"
 #include "command.h"
+#include "timebase.h"
 
 bool verifyChecksum(String sentence);
 int32_t convertToDecimalDegrees(String rawCoord, String direction);
@@ -7,6 +8,7 @@ void parseGNGGA(String sentence);
 
 String nmeaSentence = "";
 bool sentenceStarted = false;
+int64_t sentenceStartUs = 0;   // local time the '$' was read, for the clock
 GPSData gpsData;
 
 void init_gps()
@@ -33,6 +35,7 @@ void gpsParseDate()
     if (c == '$')
     {
       sentenceStarted = true;
+      sentenceStartUs = tb_local_us();
       nmeaSentence = "";
     }
 
@@ -139,6 +142,15 @@ void parseGNGGA(String sentence)
   gpsData.sate = fields[7].toInt();                  // Satellites
   gpsData.acc = (uint8_t)(fields[8].toFloat() * 10); // HDOP -> scale as needed
 
+  // hhmmss.sss with a fix: discipline the network clock
+  if (gpsData.sta > 0 && fields[1].length() >= 6)
+  {
+    uint32_t tod_ms = fields[1].substring(0, 2).toInt() * 3600000UL +
+                      fields[1].substring(2, 4).toInt() * 60000UL +
+                      (uint32_t)(fields[1].substring(4).toFloat() * 1000 + 0.5f);
+    tb_gnss_fix(tod_ms, sentenceStartUs);
+  }
+
 //  GPS_PRINTLN("==== Parsed GPS Data ====");
   GPS_PRINT("[GPS] UTC Time: ");
   GPS_PRINTLN(gpsData.utc);
@@ -3,8 +3,26 @@
 #include "Arduino.h"
 #include <RadioLib.h>
 #include "command.h"
+#include "rx_capture.h"
+#include "rx_output.h"
+#include "rx_stats.h"
+#include "p2p.h"
+#include "afc.h"
+#include "arq.h"
+#include "adr.h"
+#include "compress.h"
+#include "secure.h"
+#include "irq_lat.h"
+#include "tdma.h"
+#include "collector.h"
+#include "relay.h"
+#include "agg.h"
+#include "txq.h"
+#include "pktbuf.h"
+#include "hex.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <vector>
 #include <algorithm>
 
@@ -39,17 +57,54 @@ static int transmissionState = RADIOLIB_ERR_NONE;
 // flag to indicate that a packet was sent
 static volatile bool transmittedFlag = false;
 static volatile bool receivedFlag = false;
-static uint32_t counter = 0;
-static String payload;
+// DIO1 edge time, stamped in the ISR (irq_lat.cpp)
+static volatile uint32_t dio1_us = 0;
+static volatile uint32_t dio1_edges = 0;
+static bool rx_detail = false;          // preamble/header IRQs routed to DIO1
+static IRQLAT_Rx rx_marks;              // edges of the frame being received
+static uint32_t rx_edge_us = 0;         // RX done edge handed to lora_rx_packet
+static uint32_t tx_done_us = 0;
+static uint32_t tx_start_us = 0;        // TX done edge minus time on air
+
+// Frames read on the dual RX task wait here for loop(); read errors travel
+// with a NULL buffer so they are counted there too
+struct RX_Deferred {
+    PKT_Buf *buf;
+    RX_Packet_Info info;
+    int state;
+};
+static QueueHandle_t rx_defer_q = NULL;
+
+// Add LoRa busy state
+volatile enum LoraState {
+    LORA_IDLE = 0,
+    LORA_CW,
+    LORA_RX,
+    LORA_TX,        // FSK stream on air
+    LORA_DUAL,      // time-sliced LoRa/FSK receive (dualrx.cpp) owns the radio
+    LORA_SEND       // frame from lora_start_frame on air
+} lora_state = LORA_IDLE;
 
-static String rssi = "0dBm";
-static String snr = "0dB";
+// Frame started by lora_start_frame; the TX done edge raises
+// transmittedFlag while lora_state == LORA_SEND
+static bool send_was_rx = false;
+static size_t send_len = 0;
+static uint32_t send_start_us = 0;
+static uint32_t send_deadline_ms = 0;
+static int send_result = RADIOLIB_ERR_NONE;
+static bool send_closing = false;       // a task is finishing the frame
+
+// FSK stream sender, woken by the TX done IRQ while lora_state == LORA_TX
+static TaskHandle_t fsk_stream_task = NULL;
+static uint32_t counter = 0;
 
 
 float g_lora_freq = CONFIG_RADIO_FREQ;
 int g_lora_sf = 10;
 int g_lora_power = CONFIG_RADIO_OUTPUT_POWER;
 int g_lora_preamble = 8; // add global variable
+int g_lora_cr = 5;              // coding rate 4/5
+uint8_t g_lora_sync = 0x34;     // public network sync word
 
 // Global radio mode variable (0=LoRa, 1=FSK)
 int g_radio_mode = RADIO_MODE_LORA;
@@ -69,7 +124,10 @@ int g_radio_mode = RADIO_MODE_LORA;
 #endif
 
 static FSK_Config fsk_config = {CONFIG_FSK_FREQ, CONFIG_FSK_POWER, CONFIG_FSK_BITRATE, CONFIG_FSK_DEVIATION};
+// RadioLib defaults: sync 0x12AD, 2-byte CRC, whitening, variable length
+static FSK_Packet_Config fsk_packet = {{0x12, 0xAD}, 2, 2, true, 0};
 static bool fsk_initialized = false;
+static bool lora_configured = false;   // LoRa settings in the chip since the last reset
 static uint16_t fsk_preamble = 16;  // FSK preamble length in bits
 
 // Bandwidth variables - separate for LoRa and FSK
@@ -106,15 +164,12 @@ void build_fhss_channel_order() {
     fhss_channel_idx = 0;
 }
 
-void random_hop_channel() {
+// Channel of the current hop, 0 when the order is used up
+static float fhss_hop_freq() {
     if (fh_channels.empty()) build_fh_channels();
     if (fhss_channel_order.empty()) build_fhss_channel_order();
-    if (fhss_channel_idx >= fhss_channel_order.size()) return;
-    size_t idx = fhss_channel_order[fhss_channel_idx];
-    float freq = fh_channels[idx];
-    radio.setFrequency(freq);
-    Serial.print("Hopped to channel: ");
-    Serial.println(((int)(freq * 10 + 0.5)) / 10.0, 1);
+    if (fhss_channel_idx >= fhss_channel_order.size()) return 0;
+    return fh_channels[fhss_channel_order[fhss_channel_idx]];
 }
 
 // this function is called when a complete packet
@@ -132,14 +187,37 @@ void setFlag(void)
 
 void setRXFlag(void)
 {
+    dio1_us = micros();
+    dio1_edges++;
+    if (lora_state == LORA_TX && fsk_stream_task) {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(fsk_stream_task, &woken);
+        if (woken) portYIELD_FROM_ISR();
+        return;
+    }
+    if (lora_state == LORA_SEND) {
+        transmittedFlag = true;
+        return;
+    }
     receivedFlag = true;
 }
 
+// Continuous RX. In detail mode preamble detected and header valid also
+// raise DIO1, so their edges get timestamps of their own.
+static int lora_start_rx() {
+    if (!rx_detail) return radio.startReceive();
+    uint16_t early = RADIOLIB_SX126X_IRQ_PREAMBLE_DETECTED | RADIOLIB_SX126X_IRQ_HEADER_VALID;
+    return radio.startReceive(RADIOLIB_SX126X_RX_TIMEOUT_INF, RADIOLIB_SX126X_IRQ_RX_DEFAULT | early,
+                              RADIOLIB_SX126X_IRQ_RX_DONE | early);
+}
+
 
 
 void init_lora_radio() {
     // When the power is turned on, a delay is required.
     delay(1500);
+    // AT+MODE=0 runs this again
+    if (!rx_defer_q) rx_defer_q = xQueueCreate(LORA_RX_QUEUE, sizeof(RX_Deferred));
 
     register_at_handler("AT+PFREQ", handle_at_freq, "Set/query LoRa frequency, e.g. AT+PFREQ=868.0 or AT+PFREQ=?");
     register_at_handler("AT+PSF", handle_at_sf, "Set/query LoRa spreading factor, e.g. AT+PSF=10 or AT+PSF=?");
@@ -148,16 +226,18 @@ void init_lora_radio() {
     register_at_handler("AT+PBW", handle_at_bandwidth, "Set/query bandwidth, e.g. AT+PBW=125 or AT+PBW=?");
     register_at_handler("AT+PBR", handle_at_fsk_bitrate, "Set/query FSK bitrate (0.6-300.0 kbps), e.g. AT+PBR=50.0 or AT+PBR=?");
     register_at_handler("AT+PFDEV", handle_at_fsk_deviation, "Set/query FSK frequency deviation (0.0-200.0 kHz), e.g. AT+PFDEV=25.0 or AT+PFDEV=?");
+    register_at_handler("AT+FSKPKT", handle_at_fsk_packet, "Set/query FSK packet format: AT+FSKPKT=<sync hex>,<crc 0|1|2>,<whitening 0|1>,<fixed len, 0=variable> or AT+FSKPKT=?");
     register_at_handler("AT+CW", handle_at_cw, "Start LoRa continuous wave (single carrier)");
     register_at_handler("AT+CWSTOP", handle_at_cw_stop, "Stop LoRa continuous wave (single carrier)");
     register_at_handler("AT+PPL", handle_at_preamble, "Set/query LoRa preamble length, e.g. AT+PPL=8 or AT+PPL=?");
     register_at_handler("AT+PPREAMBLE", handle_at_preamble, "Set/query LoRa preamble length, e.g. AT+PPREAMBLE=8 or AT+PPREAMBLE=?");
-    register_at_handler("AT+PRECV", handle_at_rx, "Start LoRa receive mode");
+    register_at_handler("AT+PRECV", handle_at_rx, "Start receive mode (LoRa or FSK, per AT+MODE)");
     register_at_handler("AT+RXSTOP", handle_at_rx_stop, "Stop LoRa receive mode");
     register_at_handler("AT+FHSET", handle_at_fhset, "Set/query FHSS params: AT+FHSET=start,end,step,bw,num e.g. AT+FHSET=902.3,914.9,0.2,125,64 or AT+FHSET=?");
 
     // Register FSK and MODE AT commands
     register_at_handler("AT+FSKSEND", handle_at_fsk_send, "Send FSK packet, e.g. AT+FSKSEND=433.92,HELLO or AT+FSKSEND=HELLO");
+    register_at_handler("AT+FSKSTREAM", handle_at_fsk_stream, "Stream a test buffer over FSK as back-to-back packets, e.g. AT+FSKSTREAM=4096[,A55A] or AT+FSKSTREAM=?");
     register_at_handler("AT+MODE", handle_at_mode, "Set/query radio mode, e.g. AT+MODE=1 (FSK) or AT+MODE=0 (LoRa) or AT+MODE=?");
 
     // initialize radio with default settings
@@ -178,7 +258,7 @@ void init_lora_radio() {
     //radio.setPacketSentAction(setFlag);   //果然后面会覆盖前面的   其实这两个函数注册的是一个接口
     radio.setPacketReceivedAction(setRXFlag);
 
-    if (radio.setFrequency(g_lora_freq) == RADIOLIB_ERR_INVALID_FREQUENCY) {
+    if (afc_tune(g_lora_freq, afc_rx_peer()) == RADIOLIB_ERR_INVALID_FREQUENCY) {
         Serial.println(F("Selected frequency is invalid for this module!"));
         while (true);
     }
@@ -193,12 +273,12 @@ void init_lora_radio() {
         while (true);
     }
 
-    if (radio.setCodingRate(5) == RADIOLIB_ERR_INVALID_CODING_RATE) {
+    if (radio.setCodingRate(g_lora_cr) == RADIOLIB_ERR_INVALID_CODING_RATE) {
         Serial.println(F("Selected coding rate is invalid for this module!"));
         while (true);
     }
 
-    if (radio.setSyncWord(0x34) != RADIOLIB_ERR_NONE) {
+    if (radio.setSyncWord(g_lora_sync) != RADIOLIB_ERR_NONE) {
         Serial.println(F("Unable to set sync word!"));
         while (true);
     }
@@ -237,18 +317,14 @@ void init_lora_radio() {
 #endif //USING_SX1262
 #endif //USING_DIO2_AS_RF_SWITCH
 
+    lora_configured = true;
+
     // start transmitting the first packet
     // Serial.print(F("Radio Sending first packet ... "));
     // transmissionState = radio.startTransmit(String(counter).c_str());
     // delay(1000);
 }
 
-// Add LoRa busy state
-volatile enum LoraState {
-    LORA_IDLE = 0,
-    LORA_CW,
-    LORA_RX
-} lora_state = LORA_IDLE;
 
 void handle_at_freq(const AT_Command *cmd) {
     if (strcmp(cmd->params, "?") == 0) {
@@ -263,6 +339,7 @@ void handle_at_freq(const AT_Command *cmd) {
     
     float freq = atof(cmd->params);
     if (freq >= 137.0 && freq <= 960.0) {
+        lora_tx_wait();
         if (g_radio_mode == RADIO_MODE_FSK) {
             // Set FSK frequency
             fsk_config.freq = freq;
@@ -274,7 +351,7 @@ void handle_at_freq(const AT_Command *cmd) {
         } else {
             // Set LoRa frequency
             g_lora_freq = freq;
-            radio.setFrequency(g_lora_freq);
+            afc_tune(g_lora_freq, afc_rx_peer());
             Serial.print("OK, LoRa FREQ=");
             Serial.println(g_lora_freq, 3);
         }
@@ -291,6 +368,7 @@ void handle_at_sf(const AT_Command *cmd) {
     }
     int sf = atoi(cmd->params);
     if (sf >= 5 && sf <= 12) {
+        lora_tx_wait();
         g_lora_sf = sf;
         radio.setSpreadingFactor(g_lora_sf);
         Serial.print("OK, SF=");
@@ -313,6 +391,7 @@ void handle_at_power(const AT_Command *cmd) {
     
     int power = atoi(cmd->params);
     if (power >= -9 && power <= 22) {
+        lora_tx_wait();
         if (g_radio_mode == RADIO_MODE_FSK) {
             // Set FSK power
             fsk_config.power = power;
@@ -333,61 +412,90 @@ void handle_at_power(const AT_Command *cmd) {
     }
 }
 
+// Queue a P2P transmission, wrapped in a DATA header when AT+P2PHDR is on.
+// msg stays the caller's; raw frames are queued by reference.
+static int p2p_start_transmit(PKT_Buf *msg) {
+    if (arq_enabled()) return arq_queue(msg->data, msg->len);
+    PKT_Buf *frame;
+    uint16_t peer = afc_rx_peer();
+    if (!p2p_header_mode()) {
+        frame = pkt_ref(msg);
+    } else {
+        if (agg_accepts(msg->len)) return agg_queue(msg->data, msg->len);
+        if (msg->len > P2P_MAX_PAYLOAD) return RADIOLIB_ERR_PACKET_TOO_LONG;
+        frame = pkt_alloc();
+        if (!frame) return RADIOLIB_ERR_MEMORY_ALLOCATION_FAILED;
+        P2P_Header hdr = {P2P_TYPE_DATA, 0, 0, g_node_id, p2p_default_dst(), p2p_next_seq()};
+        frame->len = p2p_build(frame->data, &hdr, msg->data, msg->len);
+        if (frame->len == 0) {
+            pkt_unref(frame);
+            return P2P_ERR_NO_KEY;
+        }
+        if (hdr.dst != P2P_BROADCAST) peer = hdr.dst;
+    }
+    int state = txq_submit_buf(TXQ_HIGH, frame, peer, 0, 0);
+    if (state != RADIOLIB_ERR_NONE) pkt_unref(frame);
+    return state;
+}
+
 void handle_at_send(const AT_Command *cmd) {
 
-    if (lora_state == LORA_CW) {
-        Serial.println("ERROR: Device busy (CW mode)");
+    if (lora_state == LORA_TX) {
+        Serial.println("ERROR: Device busy (FSK stream)");
         return;
     }
-    if (lora_state == LORA_RX) {
-        Serial.println("ERROR: Device busy (RX mode)");
+    if (lora_state == LORA_DUAL) {
+        Serial.println("ERROR: Device busy (dual RX), use AT+DUALRX=0 first");
+        return;
+    }
+    if (lora_state == LORA_CW) {
+        Serial.println("ERROR: Device busy (CW mode)");
         return;
     }
     if (strlen(cmd->params) == 0) {
         Serial.println("ERROR: No data to send");
         return;
     }
-    // Check if input is hex string (only 0-9, a-f, A-F, even length)
     const char* p = cmd->params;
     int len = strlen(p);
-    bool isHex = (len % 2 == 0);
-    for (int i = 0; i < len && isHex; ++i) {
-        if (!isxdigit(p[i])) isHex = false;
-    }
-    if (isHex) {
-        // Convert hex string to byte array
-        int byteLen = len / 2;
-        uint8_t buf[128];
-        if (byteLen > 128) {
-            Serial.println("ERROR: Data too long");
-            return;
-        }
-        for (int i = 0; i < byteLen; ++i) {
-            char tmp[3] = {p[2*i], p[2*i+1], 0};
-            buf[i] = (uint8_t)strtol(tmp, NULL, 16);
-        }
-        transmittedFlag = false;
-        int state = radio.startTransmit(buf, byteLen);
-        if (state == RADIOLIB_ERR_NONE) {
-            Serial.println("OK");
-        } else {
-            Serial.print("ERROR, code ");
-            Serial.println(state);
-        }
+    PKT_Buf *msg = pkt_alloc();
+    if (!msg) {
+        Serial.println("ERROR: No packet buffer free");
+        return;
+    }
+    // hex (even length, 0-9 a-f A-F) is sent decoded, anything else as text
+    int byteLen = hex_decode(msg->data, P2P_MAX_FRAME, p, len);
+    bool isHex = byteLen >= 0;
+    if (byteLen == HEX_ERR_INVALID) {
+        byteLen = len;
+        if (len <= P2P_MAX_FRAME) memcpy(msg->data, p, len);
+    }
+    if (byteLen == HEX_ERR_TOO_LONG || byteLen > P2P_MAX_FRAME) {
+        Serial.println("ERROR: Data too long");
+        pkt_unref(msg);
+        return;
+    }
+    msg->len = byteLen;
+    int state = p2p_start_transmit(msg);
+    pkt_unref(msg);
+    if (state == RADIOLIB_ERR_NONE) {
+        Serial.println(isHex ? "OK" : "OK, sending...");
     } else {
-        // Fallback: send as string
-        transmittedFlag = false;
-        int state = radio.startTransmit(cmd->params);
-        if (state == RADIOLIB_ERR_NONE) {
-            Serial.println("OK, sending...");
-        } else {
-            Serial.print("ERROR, code ");
-            Serial.println(state);
-        }
+        Serial.print("ERROR, code ");
+        Serial.println(state);
     }
 }
 
 void handle_at_cw(const AT_Command *cmd) {
+    lora_tx_wait();
+    if (lora_state == LORA_TX) {
+        Serial.println("ERROR: Device busy (FSK stream)");
+        return;
+    }
+    if (lora_state == LORA_DUAL) {
+        Serial.println("ERROR: Device busy (dual RX), use AT+DUALRX=0 first");
+        return;
+    }
     int state = radio.transmitDirect();
     if (state == RADIOLIB_ERR_NONE) {
         lora_state = LORA_CW;
@@ -399,6 +507,7 @@ void handle_at_cw(const AT_Command *cmd) {
 }
 
 void handle_at_cw_stop(const AT_Command *cmd) {
+    lora_tx_wait();
     radio.standby();
     lora_state = LORA_IDLE;
     Serial.println("CW mode stopped.");
@@ -412,6 +521,7 @@ void handle_at_preamble(const AT_Command *cmd) {
     }
     int preamble = atoi(cmd->params);
     if (preamble >= 6 && preamble <= 65535) {
+        lora_tx_wait();
         g_lora_preamble = preamble;
         if (radio.setPreambleLength(g_lora_preamble) == RADIOLIB_ERR_NONE) {
             Serial.print("OK, PREAMBLE=");
@@ -425,51 +535,342 @@ void handle_at_preamble(const AT_Command *cmd) {
 }
 
 
+// Read the frame waiting in the radio buffer into a pool buffer. *out is
+// NULL unless the read succeeded. Only the task that owns the radio calls
+// this; it touches nothing but the radio and the pool.
+static int lora_rx_read(PKT_Buf **out, RX_Packet_Info *info, uint32_t edge_us) {
+    *out = NULL;
+    PKT_Buf *rx = pkt_alloc();
+    if (!rx) {
+        // pool exhausted: the frame is lost when RX is re-armed
+        return RADIOLIB_ERR_MEMORY_ALLOCATION_FAILED;
+    }
+    int len = radio.getPacketLength();
+    int state = radio.readData(rx->data, len);
+    if (state != RADIOLIB_ERR_NONE) {
+        pkt_unref(rx);
+        return state;
+    }
+    rx->len = len;
+    info->t_ms = millis();
+    info->t_us = edge_us;
+    info->rssi = radio.getRSSI();
+    // SNR and frequency error are only reported by the LoRa modem
+    info->mode = (uint8_t)g_radio_mode;
+    bool lora = (g_radio_mode == RADIO_MODE_LORA);
+    info->snr = lora ? radio.getSNR() : 0;
+    info->freq_err = lora ? radio.getFrequencyError() : 0;
+    info->len = len;
+    info->air_len = len;
+    *out = rx;
+    return RADIOLIB_ERR_NONE;
+}
+
+// Pass a read frame (or the read error) through the RX pipeline. Runs on
+// loop() only: the statistics, relay, ARQ and output state live there.
+// Takes over the reference to rx.
+static void lora_rx_process(PKT_Buf *rx, RX_Packet_Info *info, int state) {
+    if (state == RADIOLIB_ERR_NONE) {
+        uint8_t *byteArr = rx->data;
+        int len = rx->len;
+        rx_stats_update(byteArr, info);
+        if (info->mode == RADIO_MODE_LORA) afc_on_rx(p2p_peer_of(byteArr, len), info->freq_err);
+        adr_on_rx(byteArr, len, info);
+        tdma_on_rx(byteArr, info);
+        collector_on_rx(byteArr, info);
+        rx_capture_push(byteArr, info);
+
+        // the capture keeps the frame as sent on air, the rest sees it
+        // opened and expanded; forged, replayed or corrupt frames stop here,
+        // as do copies already heard through another relay. Unwrap works in
+        // place, so a frame the relay keeps is copied first.
+        int plain = -1;
+        if (!relay_on_rx(rx, info)) {
+            PKT_Buf *own = pkt_unshare(rx);
+            if (own) {
+                rx = own;
+                byteArr = rx->data;
+                plain = p2p_unwrap(byteArr, len);
+            } else {
+                // no buffer for the private copy: the frame is lost
+                rx_stats_error(RADIOLIB_ERR_MEMORY_ALLOCATION_FAILED);
+            }
+        }
+        if (plain >= 0 && relay_on_opened(byteArr, plain, info)) plain = -1;
+        if (plain >= 0) {
+            len = plain;
+            info->len = plain;
+
+            // protocol frames (fragments, acks, ...) are consumed here;
+            // quiet capture: the ring keeps the frame, skip the slow hex dump
+            if (!p2p_dispatch(byteArr, len, info) && !rx_capture_quiet() && !collector_quiet() && rx_output_pass(byteArr, info)) {
+                rx_output_emit(byteArr, info);
+            }
+        }
+    } else if (state == RADIOLIB_ERR_CRC_MISMATCH) {
+        rx_stats_error(state);
+        tdma_on_rx_error();
+        Serial.println(F("CRC error!"));
+    } else if (state == RADIOLIB_ERR_MEMORY_ALLOCATION_FAILED) {
+        rx_stats_error(state);
+    } else {
+        rx_stats_error(state);
+        Serial.print(F("failed, code "));
+        Serial.println(state);
+    }
+    pkt_unref(rx);
+}
+
+// Read the frame waiting in the radio buffer and pass it through the RX
+// pipeline. The caller re-arms receive.
+int lora_rx_packet() {
+    rx_alloc_watch_begin();
+    PKT_Buf *rx;
+    RX_Packet_Info info;
+    int state = lora_rx_read(&rx, &info, rx_edge_us);
+    rx_marks.read_us = micros();
+    lora_rx_process(rx, &info, state);
+    rx_alloc_watch_end();
+    return state;
+}
+
+// lora_rx_packet for a task other than loop(): read the frame now, run the
+// pipeline on loop() (receive_packet). A frame that finds the queue full is
+// dropped and reported as RADIOLIB_ERR_MEMORY_ALLOCATION_FAILED.
+int lora_rx_defer() {
+    RX_Deferred d;
+    d.state = lora_rx_read(&d.buf, &d.info, 0);
+    if (xQueueSend(rx_defer_q, &d, 0) != pdTRUE) {
+        pkt_unref(d.buf);
+        return RADIOLIB_ERR_MEMORY_ALLOCATION_FAILED;
+    }
+    return d.state;
+}
+
+static void lora_rx_drain() {
+    RX_Deferred d;
+    while (xQueueReceive(rx_defer_q, &d, 0) == pdTRUE) {
+        rx_alloc_watch_begin();
+        lora_rx_process(d.buf, &d.info, d.state);
+        rx_alloc_watch_end();
+    }
+}
+
 void receive_packet() {
+    lora_rx_drain();
     if (receivedFlag && lora_state == LORA_RX) {
+        uint32_t task_us = micros();
+        uint32_t edge_us = dio1_us;
         // reset flag
         receivedFlag = false;
 
-        // read received data as byte array
-        uint8_t byteArr[256];
-        int len = radio.getPacketLength();
-        int state = radio.readData(byteArr, len);
-
-        if (state == RADIOLIB_ERR_NONE) {
-            rssi = String(radio.getRSSI()) + "dBm";
-            snr = String(radio.getSNR()) + "dB";
-
-            Serial.println(F("Radio Received packet!"));
-            Serial.print(F("Radio Data (HEX):"));
-            for (int i = 0; i < len; i++) {
-                if (byteArr[i] < 16) Serial.print("0");
-                Serial.print(byteArr[i], HEX);
-                Serial.print(" ");
+        if (rx_detail) {
+            // a preamble or header edge: note it and clear the bits so that
+            // RX done raises DIO1 again
+            uint16_t irq = radio.getIrqStatus();
+            uint16_t early = irq & (RADIOLIB_SX126X_IRQ_PREAMBLE_DETECTED | RADIOLIB_SX126X_IRQ_HEADER_VALID);
+            if (early) {
+                if (early & RADIOLIB_SX126X_IRQ_PREAMBLE_DETECTED) {
+                    rx_marks.pre_us = edge_us;
+                    rx_marks.hdr_us = 0;
+                } else {
+                    rx_marks.hdr_us = edge_us;
+                }
+                radio.clearIrqStatus(early);
+                // RX done that landed while DIO1 was still high has no edge
+                if (!(radio.getIrqStatus() & RADIOLIB_SX126X_IRQ_RX_DONE)) return;
+                edge_us = 0;
             }
-            Serial.println();
-
-            Serial.print(F("Radio RSSI:"));
-            Serial.println(rssi);
-            Serial.print(F("Radio SNR:"));
-            Serial.println(snr);
-        } else if (state == RADIOLIB_ERR_CRC_MISMATCH) {
-            Serial.println(F("CRC error!"));
-        } else {
-            Serial.print(F("failed, code "));
-            Serial.println(state);
         }
 
+        rx_marks.done_us = edge_us;
+        rx_marks.task_us = task_us;
+        rx_edge_us = edge_us;
+        lora_rx_packet();
+        rx_edge_us = 0;
+
         // put module back to listen mode
-        radio.startReceive();
+        lora_start_rx();
+        rx_marks.armed_us = micros();
+        irqlat_rx(&rx_marks);
+        memset(&rx_marks, 0, sizeof(rx_marks));
+    }
+}
 
+// Blocking transmit of one frame for protocol layers. The TX done IRQ also
+// raises receivedFlag, so it is cleared here and RX is re-armed if we were
+// listening. A frame from lora_start_frame still on air goes first.
+int lora_send_frame(const uint8_t *frame, size_t len) {
+    lora_tx_wait();
+    if (lora_state == LORA_CW || lora_state == LORA_TX || lora_state == LORA_DUAL) return LORA_ERR_BUSY;
+    bool was_rx = (lora_state == LORA_RX);
+    uint32_t edges = dio1_edges;
+    uint32_t start_us = micros();
+    int state = radio.transmit(frame, len);
+    uint32_t return_us = micros();
+    receivedFlag = false;
+    if (state == RADIOLIB_ERR_NONE && dio1_edges != edges) {
+        tx_done_us = dio1_us;
+        tx_start_us = tx_done_us - radio.getTimeOnAir(len);
+        irqlat_tx(start_us, tx_done_us, return_us);
+    }
+    if (was_rx) lora_start_rx();
+    return state;
+}
+
+// Start one frame and return; lora_poll_frame reports the result. The
+// radio stays in LORA_SEND until then, so RX, reconfiguration and other
+// frames wait for it (lora_tx_wait).
+int lora_start_frame(const uint8_t *frame, size_t len) {
+    if (lora_state == LORA_SEND) return LORA_ERR_BUSY;
+    if (lora_state == LORA_CW || lora_state == LORA_TX || lora_state == LORA_DUAL) return LORA_ERR_BUSY;
+    send_was_rx = (lora_state == LORA_RX);
+    send_len = len;
+    lora_state = LORA_SEND;
+    radio.standby();
+    transmittedFlag = false;
+    send_start_us = micros();
+    int state = radio.startTransmit(frame, len);
+    if (state != RADIOLIB_ERR_NONE) {
+        radio.finishTransmit();
+        receivedFlag = false;
+        lora_state = send_was_rx && lora_start_rx() == RADIOLIB_ERR_NONE ? LORA_RX : LORA_IDLE;
+        return state;
     }
+    send_deadline_ms = millis() + 2 * lora_time_on_air_ms(len) + LORA_TX_SLACK_MS;
+    return RADIOLIB_ERR_NONE;
+}
+
+// LORA_ERR_BUSY while the frame of lora_start_frame is on air, then its
+// result (RADIOLIB_ERR_TX_TIMEOUT when TX done never came). The first
+// call after TX done puts the radio in standby and re-arms RX if it was
+// listening; later calls return the same result.
+int lora_poll_frame() {
+    if (lora_state != LORA_SEND) return send_result;
+    bool done = transmittedFlag;
+    if (!done && (int32_t)(millis() - send_deadline_ms) < 0) return LORA_ERR_BUSY;
+    // the AT task may be waiting on the same frame (lora_tx_wait)
+    if (__atomic_exchange_n(&send_closing, true, __ATOMIC_ACQUIRE)) return LORA_ERR_BUSY;
+    if (lora_state != LORA_SEND) {
+        __atomic_store_n(&send_closing, false, __ATOMIC_RELEASE);
+        return send_result;
+    }
+    uint32_t return_us = micros();
+    int state = radio.finishTransmit();
+    if (!done) {
+        state = RADIOLIB_ERR_TX_TIMEOUT;
+    } else if (state == RADIOLIB_ERR_NONE) {
+        tx_done_us = dio1_us;
+        tx_start_us = tx_done_us - radio.getTimeOnAir(send_len);
+        irqlat_tx(send_start_us, tx_done_us, return_us);
+    }
+    send_result = state;
+    transmittedFlag = false;
+    receivedFlag = false;
+    lora_state = send_was_rx && lora_start_rx() == RADIOLIB_ERR_NONE ? LORA_RX : LORA_IDLE;
+    __atomic_store_n(&send_closing, false, __ATOMIC_RELEASE);
+    return state;
+}
+
+// Block until a frame from lora_start_frame is done, before the radio is
+// used or reconfigured
+void lora_tx_wait() {
+    while (lora_poll_frame() == LORA_ERR_BUSY) delay(1);
+}
+
+// micros() of the last TX done edge of lora_send_frame or lora_start_frame
+uint32_t lora_tx_done_us() {
+    return tx_done_us;
+}
+
+// micros() at which that frame went on air
+uint32_t lora_tx_start_us() {
+    return tx_start_us;
+}
+
+// Route preamble/header IRQs to DIO1 (AT+IRQLAT=DETAIL); re-arms RX
+void lora_rx_detail(bool on) {
+    lora_tx_wait();
+    rx_detail = on;
+    memset(&rx_marks, 0, sizeof(rx_marks));
+    if (lora_state == LORA_RX) {
+        radio.standby();
+        receivedFlag = false;
+        lora_start_rx();
+    }
+}
+
+bool lora_rx_detail_on() {
+    return rx_detail;
+}
+
+// Enter RX mode without the AT+PRECV console chatter
+int lora_listen() {
+    lora_tx_wait();
+    if (lora_state == LORA_CW || lora_state == LORA_TX || lora_state == LORA_DUAL) return LORA_ERR_BUSY;
+    receivedFlag = false;
+    afc_retune(afc_rx_peer());
+    int state = lora_start_rx();
+    if (state == RADIOLIB_ERR_NONE) lora_state = LORA_RX;
+    return state;
+}
+
+bool lora_listening() {
+    return lora_state == LORA_RX;
+}
+
+// Change SF, bandwidth and power together (link adaptation); the radio is
+// put in standby for the switch and RX is re-armed if we were listening.
+int lora_set_rate(int sf, float bw, int power) {
+    if (g_radio_mode != RADIO_MODE_LORA) return RADIOLIB_ERR_WRONG_MODEM;
+    lora_tx_wait();
+    if (lora_state == LORA_CW || lora_state == LORA_TX || lora_state == LORA_DUAL) return LORA_ERR_BUSY;
+    radio.standby();
+    int state = radio.setSpreadingFactor(sf);
+    if (state == RADIOLIB_ERR_NONE) state = radio.setBandwidth(bw);
+    if (state == RADIOLIB_ERR_NONE) state = radio.setOutputPower(power);
+    if (state == RADIOLIB_ERR_NONE) {
+        g_lora_sf = sf;
+        g_lora_bandwidth = bw;
+        g_lora_power = power;
+    } else {
+        // keep globals and radio consistent
+        radio.setSpreadingFactor(g_lora_sf);
+        radio.setBandwidth(g_lora_bandwidth);
+        radio.setOutputPower(g_lora_power);
+    }
+    receivedFlag = false;
+    if (lora_state == LORA_RX) lora_start_rx();
+    return state;
+}
+
+uint32_t lora_time_on_air_ms(size_t len) {
+    return (radio.getTimeOnAir(len) + 999) / 1000;
+}
+
+uint32_t lora_time_on_air_us(size_t len) {
+    return radio.getTimeOnAir(len);
 }
 
 void handle_at_rx(const AT_Command *cmd) {
+    lora_tx_wait();
+    if (lora_state == LORA_TX) {
+        Serial.println("ERROR: Device busy (FSK stream)");
+        return;
+    }
+    if (lora_state == LORA_DUAL) {
+        Serial.println("ERROR: Device busy (dual RX), use AT+DUALRX=0 first");
+        return;
+    }
+    if (g_radio_mode == RADIO_MODE_FSK && !fsk_initialized) {
+        Serial.println("ERROR: FSK not initialized");
+        return;
+    }
     Serial.print(F("Radio Starting to listen ... "));
     //radio.setPacketReceivedAction(setRXFlag);
     receivedFlag = false;
-    int state = radio.startReceive();
+    afc_retune(afc_rx_peer());
+    int state = lora_start_rx();
     if (state == RADIOLIB_ERR_NONE) {
         lora_state = LORA_RX;
         Serial.println(F("success!"));
@@ -480,6 +881,11 @@ void handle_at_rx(const AT_Command *cmd) {
 }
 
 void handle_at_rx_stop(const AT_Command *cmd) {
+    lora_tx_wait();
+    if (lora_state == LORA_DUAL) {
+        Serial.println("ERROR: Device busy (dual RX), use AT+DUALRX=0 first");
+        return;
+    }
     radio.standby();
     lora_state = LORA_IDLE;
     Serial.println("LoRa RX mode stopped.");
@@ -548,11 +954,12 @@ void fhss_auto_hop_send_loop() {
             Serial.println("FHSS all channels sent, auto hopping stopped.");
             return;
         }
-        random_hop_channel();
-        // 发送测试数据
-        int state = radio.startTransmit(fhss_send_data);
+        // tuned to the hop channel when the queue sends it; a hop still
+        // waiting when the next one is due is dropped
+        int state = txq_submit(TXQ_LOW, (const uint8_t *)fhss_send_data, strlen(fhss_send_data), afc_rx_peer(),
+                               fhss_hop_freq(), fhss_hop_interval_ms);
         if (state == RADIOLIB_ERR_NONE) {
-            Serial.print("FHSS TX OK, channel idx: ");
+            Serial.print("FHSS TX queued, channel idx: ");
             Serial.println(fhss_channel_idx);
         } else {
             Serial.print("FHSS TX ERROR, code ");
@@ -565,6 +972,25 @@ void fhss_auto_hop_send_loop() {
 
 // ============= FSK Functions =============
 
+static int fsk_apply_packet() {
+    int state = radio.setSyncWord(fsk_packet.sync, fsk_packet.sync_len);
+    if (state != RADIOLIB_ERR_NONE) return state;
+    if (fsk_packet.crc_len == 2) {
+        state = radio.setCRC(2);                        // CCITT, as RadioLib default
+    } else if (fsk_packet.crc_len == 1) {
+        state = radio.setCRC(1, 0xFF, 0x07, false);     // CRC-8
+    } else {
+        state = radio.setCRC(0);
+    }
+    if (state != RADIOLIB_ERR_NONE) return state;
+    state = radio.setWhitening(fsk_packet.whitening);
+    if (state != RADIOLIB_ERR_NONE) return state;
+    if (fsk_packet.fixed_len) {
+        return radio.fixedPacketLengthMode(fsk_packet.fixed_len);
+    }
+    return radio.variablePacketLengthMode();
+}
+
 void init_fsk_radio() {
     if (fsk_initialized) return;
     
@@ -572,6 +998,7 @@ void init_fsk_radio() {
     
     // Initialize FSK modem with default settings (like RadioLib example)
     int state = radio.beginFSK();
+    lora_configured = false;    // beginFSK resets the chip
     
     if (state == RADIOLIB_ERR_NONE) {
         Serial.println(F("success!"));
@@ -626,16 +1053,12 @@ void init_fsk_radio() {
             Serial.println(state);
         }
 
-        // state = radio.setSyncBits(syncWord, 64);
-        // This will use 0x012 as sync word (12 bits only):
-        // state = radio.setSyncBits(syncWord, 12);
-        
-        // // Enable CRC
-        // state = radio.setCRC(2, 0xFFFF, 0x8005, false);
-        // if (state != RADIOLIB_ERR_NONE) {
-        //     Serial.print(F("Failed to enable CRC, code "));
-        //     Serial.println(state);
-        // }
+        // Sync word, CRC, whitening and length mode (AT+FSKPKT)
+        state = fsk_apply_packet();
+        if (state != RADIOLIB_ERR_NONE) {
+            Serial.print(F("Failed to set packet format, code "));
+            Serial.println(state);
+        }
         
         fsk_initialized = true;
         Serial.println(F("FSK configuration completed"));
@@ -650,6 +1073,7 @@ void init_fsk_radio() {
 void set_fsk_freq(float freq) {
     fsk_config.freq = freq;
     if (g_radio_mode == RADIO_MODE_FSK && fsk_initialized) {
+        lora_tx_wait();
         int state = radio.setFrequency(freq);
         if (state != RADIOLIB_ERR_NONE) {
             Serial.print("Failed to set FSK frequency, code "); Serial.println(state);
@@ -664,11 +1088,226 @@ int fsk_send_packet(const char* data, int len) {
     if (!fsk_initialized) {
         return -2; // Not initialized
     }
+    lora_tx_wait();
+    if (lora_state == LORA_TX || lora_state == LORA_DUAL) {
+        return LORA_ERR_BUSY; // stream on air or dual RX
+    }
     
     // Send packet directly using RadioLib FSK transmit method
     return radio.transmit((uint8_t*)data, len);
 }
 
+// FSK counterpart of p2p_start_transmit: DATA header (and compression)
+// when AT+P2PHDR is on
+static int fsk_send_payload(const uint8_t *data, size_t len) {
+    if (arq_enabled()) return arq_queue(data, len);
+    if (!p2p_header_mode()) return fsk_send_packet((const char *)data, len);
+    if (fsk_packet.fixed_len) return FSK_ERR_FIXED_HDR;
+    if (len > P2P_MAX_PAYLOAD) return RADIOLIB_ERR_PACKET_TOO_LONG;
+    PKT_Buf *frame = pkt_alloc();
+    if (!frame) return RADIOLIB_ERR_MEMORY_ALLOCATION_FAILED;
+    P2P_Header hdr = {P2P_TYPE_DATA, 0, 0, g_node_id, p2p_default_dst(), p2p_next_seq()};
+    size_t n = p2p_build(frame->data, &hdr, data, len);
+    int state = n ? fsk_send_packet((const char *)frame->data, n) : P2P_ERR_NO_KEY;
+    pkt_unref(frame);
+    return state;
+}
+
+// ============= FSK Stream =============
+// The SX1262 packet engine caps a packet at 255 bytes and has no FIFO level
+// interrupt, so a large buffer goes out as back-to-back packets instead: the
+// TX done IRQ wakes a high priority task which starts the next packet
+// straight away. The gap between packets is the SPI write plus PA ramp,
+// not a loop() tick.
+
+static const uint8_t *fsk_stream_data = NULL;
+static size_t fsk_stream_len = 0;
+static FSK_Stream_Done fsk_stream_done = NULL;
+static bool fsk_stream_was_rx = false;
+// settings taken when the stream starts; AT commands may change the
+// originals while the stream task runs
+static bool fsk_stream_hdr = false;
+static uint16_t fsk_stream_dst = P2P_BROADCAST;
+static uint8_t fsk_stream_fixed = 0;
+static uint8_t *fsk_stream_buf = NULL;              // AT+FSKSTREAM test data
+static FSK_Stream_Result fsk_stream_last = {RADIOLIB_ERR_NONE, 0, 0, 0};
+
+// Payload bytes carried by each packet of the stream
+static size_t fsk_stream_chunk(bool hdr, uint8_t fixed) {
+    if (hdr) return P2P_MAX_PAYLOAD;
+    if (fixed) return fixed;
+    return FSK_STREAM_PACKET;
+}
+
+// Frames are built here, off loop(): p2p_build takes the sequence number
+// atomically and seals under the key lock (secure.cpp), and the frame
+// lives in a pool buffer owned by this task.
+static void fsk_stream_run(void *param) {
+    FSK_Stream_Result res = {RADIOLIB_ERR_NONE, 0, 0, 0};
+    size_t chunk = fsk_stream_chunk(fsk_stream_hdr, fsk_stream_fixed);
+    PKT_Buf *frame = pkt_alloc();
+    if (!frame) res.state = RADIOLIB_ERR_MEMORY_ALLOCATION_FAILED;
+    uint32_t t0 = millis();
+
+    while (frame && res.bytes < fsk_stream_len) {
+        const uint8_t *src = fsk_stream_data + res.bytes;
+        size_t n = fsk_stream_len - res.bytes;
+        if (n > chunk) n = chunk;
+        const uint8_t *pkt = src;
+        size_t pkt_len = n;
+        if (fsk_stream_hdr) {
+            P2P_Header hdr = {P2P_TYPE_DATA, 0, 0, g_node_id, fsk_stream_dst, p2p_next_seq()};
+            pkt_len = p2p_build(frame->data, &hdr, src, n);
+            if (pkt_len == 0) {
+                res.state = P2P_ERR_NO_KEY;
+                break;
+            }
+            pkt = frame->data;
+        } else if (fsk_stream_fixed && n < fsk_stream_fixed) {
+            // last packet of a fixed length stream, zero padded
+            memcpy(frame->data, src, n);
+            memset(frame->data + n, 0, fsk_stream_fixed - n);
+            pkt = frame->data;
+            pkt_len = fsk_stream_fixed;
+        }
+
+        ulTaskNotifyTake(pdTRUE, 0);                // drop a stale wakeup
+        int state = radio.startTransmit(pkt, pkt_len);
+        if (state != RADIOLIB_ERR_NONE) {
+            res.state = state;
+            break;
+        }
+        uint32_t wait_ms = 2 * lora_time_on_air_ms(pkt_len) + FSK_STREAM_SLACK_MS;
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_ms)) == 0) {
+            res.state = RADIOLIB_ERR_TX_TIMEOUT;
+            break;
+        }
+        radio.finishTransmit();
+        res.bytes += n;
+        res.packets++;
+    }
+    res.elapsed_ms = millis() - t0;
+    pkt_unref(frame);
+
+    if (res.state != RADIOLIB_ERR_NONE) radio.finishTransmit();
+    receivedFlag = false;
+    if (fsk_stream_was_rx && lora_start_rx() == RADIOLIB_ERR_NONE) {
+        lora_state = LORA_RX;
+    } else {
+        lora_state = LORA_IDLE;
+    }
+    fsk_stream_last = res;
+    FSK_Stream_Done done = fsk_stream_done;
+    fsk_stream_task = NULL;
+    if (done) done(&res);
+    vTaskDelete(NULL);
+}
+
+// Start streaming len bytes; data must stay valid until done is called (from
+// the stream task). Returns at once. P2P headers and a fixed packet length
+// do not mix: the frames would not fill the fixed length.
+int fsk_stream_start(const uint8_t *data, size_t len, FSK_Stream_Done done) {
+    if (g_radio_mode != RADIO_MODE_FSK) return -1;
+    if (!fsk_initialized) return -2;
+    lora_tx_wait();
+    if (lora_state == LORA_CW || lora_state == LORA_TX || lora_state == LORA_DUAL) return LORA_ERR_BUSY;
+    if (len == 0) return RADIOLIB_ERR_PACKET_TOO_LONG;
+    if (p2p_header_mode() && fsk_packet.fixed_len) return FSK_ERR_FIXED_HDR;
+
+    fsk_stream_hdr = p2p_header_mode();
+    fsk_stream_dst = p2p_default_dst();
+    fsk_stream_fixed = fsk_packet.fixed_len;
+    fsk_stream_data = data;
+    fsk_stream_len = len;
+    fsk_stream_done = done;
+    fsk_stream_was_rx = (lora_state == LORA_RX);
+    radio.standby();
+    lora_state = LORA_TX;
+    if (xTaskCreate(fsk_stream_run, "fskStream", 4096, NULL, FSK_STREAM_PRIORITY, &fsk_stream_task) != pdPASS) {
+        fsk_stream_task = NULL;
+        receivedFlag = false;
+        lora_state = fsk_stream_was_rx && lora_start_rx() == RADIOLIB_ERR_NONE ? LORA_RX : LORA_IDLE;
+        return RADIOLIB_ERR_MEMORY_ALLOCATION_FAILED;
+    }
+    return RADIOLIB_ERR_NONE;
+}
+
+bool fsk_stream_busy() {
+    return lora_state == LORA_TX;
+}
+
+static void fsk_stream_print_done(const FSK_Stream_Result *res) {
+    float kbps = res->elapsed_ms ? res->bytes * 8.0f / res->elapsed_ms : 0.0f;
+    if (res->state == RADIOLIB_ERR_NONE) {
+        Serial.printf("+FSKSTREAM: DONE,%u,%u,%lu,%.1f\r\n", (unsigned)res->bytes,
+                      (unsigned)res->packets, (unsigned long)res->elapsed_ms, kbps);
+    } else {
+        Serial.printf("+FSKSTREAM: ERROR,%d,%u\r\n", res->state, (unsigned)res->bytes);
+    }
+}
+
+// AT+FSKSTREAM=<bytes>[,<pattern hex>] streams a test buffer, AT+FSKSTREAM=?
+// shows the state and the last result
+void handle_at_fsk_stream(const AT_Command *cmd) {
+    if (strcmp(cmd->params, "?") == 0) {
+        Serial.printf("FSK stream: %s, %u bytes per packet\r\n", fsk_stream_busy() ? "busy" : "idle",
+                      (unsigned)fsk_stream_chunk(p2p_header_mode(), fsk_packet.fixed_len));
+        Serial.print("Last: ");
+        fsk_stream_print_done(&fsk_stream_last);
+        return;
+    }
+    if (g_radio_mode != RADIO_MODE_FSK) {
+        Serial.println("ERROR: Not in FSK mode, use AT+MODE=1 first");
+        return;
+    }
+    if (fsk_stream_busy()) {
+        Serial.println("ERROR: Device busy (FSK stream)");
+        return;
+    }
+
+    char buf[MAX_PARAM_LEN + 1];
+    strncpy(buf, cmd->params, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = 0;
+    char *tok = strtok(buf, ",");
+    long len = tok ? atol(tok) : 0;
+    if (len <= 0 || len > FSK_STREAM_MAX) {
+        Serial.printf("ERROR: Length must be 1-%d\r\n", FSK_STREAM_MAX);
+        return;
+    }
+    uint8_t pattern[64];
+    size_t pattern_len = 0;
+    tok = strtok(NULL, ",");
+    if (tok) {
+        int n = hex_decode(pattern, sizeof(pattern), tok, strlen(tok));
+        if (n <= 0) {
+            Serial.println("ERROR: Pattern must be 1-64 bytes of hex");
+            return;
+        }
+        pattern_len = n;
+    }
+
+    if (!fsk_stream_buf) {
+        fsk_stream_buf = (uint8_t *)(psramFound() ? ps_malloc(FSK_STREAM_MAX) : malloc(FSK_STREAM_MAX));
+        if (!fsk_stream_buf) {
+            Serial.println("ERROR: Unable to allocate stream buffer");
+            return;
+        }
+    }
+    for (long i = 0; i < len; i++) {
+        fsk_stream_buf[i] = pattern_len ? pattern[i % pattern_len] : (uint8_t)i;
+    }
+
+    int state = fsk_stream_start(fsk_stream_buf, len, fsk_stream_print_done);
+    if (state == RADIOLIB_ERR_NONE) {
+        Serial.printf("OK, streaming %ld bytes\r\n", len);
+    } else if (state == FSK_ERR_FIXED_HDR) {
+        Serial.println("ERROR: AT+P2PHDR=1 needs variable length packets, clear the AT+FSKPKT fixed length");
+    } else {
+        Serial.print("ERROR, code ");
+        Serial.println(state);
+    }
+}
+
 // AT+FSKSEND=433.92,HELLO or AT+FSKSEND=HELLO (use default freq)
 void handle_at_fsk_send(const AT_Command *cmd) {
     if (g_radio_mode != RADIO_MODE_FSK) {
@@ -676,52 +1315,40 @@ void handle_at_fsk_send(const AT_Command *cmd) {
         return;
     }
     
-    char buf[128];
-    strncpy(buf, cmd->params, sizeof(buf)-1);
-    buf[sizeof(buf)-1] = 0;
-    char *comma = strchr(buf, ',');
-    float freq = fsk_config.freq;
-    const char* data = buf;
+    const char *comma = strchr(cmd->params, ',');
+    const char *data = cmd->params;
     if (comma) {
-        *comma = 0;
-        freq = atof(buf);
+        set_fsk_freq(atof(cmd->params));
         data = comma + 1;
-        set_fsk_freq(freq);
     }
     if (strlen(data) == 0) {
         Serial.println("ERROR: No data to send");
         return;
     }
     
-    // Check if input is hex string (only 0-9, a-f, A-F, even length)
-    const char* p = data;
-    int len = strlen(p);
-    bool isHex = (len % 2 == 0);
-    for (int i = 0; i < len && isHex; ++i) {
-        if (!isxdigit(p[i])) isHex = false;
+    PKT_Buf *msg = pkt_alloc();
+    if (!msg) {
+        Serial.println("ERROR: No packet buffer free");
+        return;
     }
-    
+    // hex (even length, 0-9 a-f A-F) is sent decoded, anything else as text
     int state;
-    if (isHex) {
-        // Convert hex string to byte array
-        int byteLen = len / 2;
-        uint8_t hexBuf[128];
-        if (byteLen > 128) {
-            Serial.println("ERROR: Data too long");
-            return;
-        }
-        for (int i = 0; i < byteLen; ++i) {
-            char tmp[3] = {p[2*i], p[2*i+1], 0};
-            hexBuf[i] = (uint8_t)strtol(tmp, NULL, 16);
-        }
-        state = fsk_send_packet((const char*)hexBuf, byteLen);
+    int byteLen = hex_decode(msg->data, P2P_MAX_FRAME, data, strlen(data));
+    if (byteLen == HEX_ERR_TOO_LONG) {
+        Serial.println("ERROR: Data too long");
+        pkt_unref(msg);
+        return;
+    } else if (byteLen >= 0) {
+        state = fsk_send_payload(msg->data, byteLen);
     } else {
-        // Send as ASCII string
-        state = fsk_send_packet(data, strlen(data));
+        state = fsk_send_payload((const uint8_t *)data, strlen(data));
     }
-    
+    pkt_unref(msg);
+
     if (state == RADIOLIB_ERR_NONE) {
         Serial.println("FSK SEND OK");
+    } else if (state == FSK_ERR_FIXED_HDR) {
+        Serial.println("ERROR: AT+P2PHDR=1 needs variable length packets, clear the AT+FSKPKT fixed length");
     } else if (state == -1) {
         Serial.println("ERROR: Not in FSK mode");
     } else if (state == -2) {
@@ -741,7 +1368,21 @@ void handle_at_mode(const AT_Command *cmd) {
         return;
     }
     
+    if (lora_state == LORA_TX) {
+        Serial.println("ERROR: Device busy (FSK stream)");
+        return;
+    }
+    if (lora_state == LORA_DUAL) {
+        Serial.println("ERROR: Device busy (dual RX), use AT+DUALRX=0 first");
+        return;
+    }
+    lora_tx_wait();
     int mode = atoi(cmd->params);
+    if (mode == RADIO_MODE_LORA || mode == RADIO_MODE_FSK) {
+        // re-initialising the modem leaves the radio in standby
+        lora_state = LORA_IDLE;
+        receivedFlag = false;
+    }
     if (mode == RADIO_MODE_LORA) {
         g_radio_mode = RADIO_MODE_LORA;
         fsk_initialized = false; // Reset FSK state
@@ -757,6 +1398,175 @@ void handle_at_mode(const AT_Command *cmd) {
     }
 }
 
+// ============= Modem Switch =============
+// Time-sliced receive needs both modems without a chip reset per switch:
+// SetPacketType, then the modulation and packet parameters of the new modem
+// (the chip drops them on a type change), then the frequency. Registers such
+// as sync words and CRC polynomials survive. A modem that has not been set
+// up since the last begin()/beginFSK() gets its full settings once.
+
+static int lora_apply_config() {
+    int state = radio.setBandwidth(g_lora_bandwidth);
+    if (state == RADIOLIB_ERR_NONE) state = radio.setSpreadingFactor(g_lora_sf);
+    if (state == RADIOLIB_ERR_NONE) state = radio.setCodingRate(g_lora_cr);
+    if (state == RADIOLIB_ERR_NONE) state = radio.setSyncWord(g_lora_sync);
+    if (state == RADIOLIB_ERR_NONE) state = radio.setOutputPower(g_lora_power);
+    if (state == RADIOLIB_ERR_NONE) state = radio.setPreambleLength(g_lora_preamble);
+    if (state == RADIOLIB_ERR_NONE) state = radio.setCRC(true);
+    return state;
+}
+
+static int fsk_apply_config() {
+    int state = radio.setBitRate(fsk_config.bitrate);
+    if (state == RADIOLIB_ERR_NONE) state = radio.setFrequencyDeviation(fsk_config.deviation);
+    if (state == RADIOLIB_ERR_NONE) state = radio.setRxBandwidth(g_fsk_bandwidth);
+    if (state == RADIOLIB_ERR_NONE) state = radio.setOutputPower(fsk_config.power);
+    if (state == RADIOLIB_ERR_NONE) state = radio.setPreambleLength(fsk_preamble);
+    if (state == RADIOLIB_ERR_NONE) state = fsk_apply_packet();
+    return state;
+}
+
+int lora_switch_modem(int mode) {
+    if (mode != RADIO_MODE_LORA && mode != RADIO_MODE_FSK) return RADIOLIB_ERR_WRONG_MODEM;
+    if (mode == g_radio_mode) return RADIOLIB_ERR_NONE;
+    lora_tx_wait();
+    radio.standby();
+    uint8_t type = (mode == RADIO_MODE_LORA) ? RADIOLIB_SX126X_PACKET_TYPE_LORA : RADIOLIB_SX126X_PACKET_TYPE_GFSK;
+    int state = radio.getMod()->SPIwriteStream(RADIOLIB_SX126X_CMD_SET_PACKET_TYPE, &type, 1);
+    if (state != RADIOLIB_ERR_NONE) return state;
+    g_radio_mode = mode;
+    receivedFlag = false;
+
+    if (mode == RADIO_MODE_LORA) {
+        if (lora_configured) {
+            state = radio.setSpreadingFactor(g_lora_sf);                 // modulation params
+            if (state == RADIOLIB_ERR_NONE) state = radio.setPreambleLength(g_lora_preamble);   // packet params
+        } else {
+            state = lora_apply_config();
+        }
+        if (state == RADIOLIB_ERR_NONE) state = afc_tune(afc_base_freq(), afc_rx_peer());
+        lora_configured = (state == RADIOLIB_ERR_NONE);
+    } else {
+        if (fsk_initialized) {
+            state = radio.setBitRate(fsk_config.bitrate);
+            if (state == RADIOLIB_ERR_NONE) state = radio.setPreambleLength(fsk_preamble);
+        } else {
+            state = fsk_apply_config();
+        }
+        if (state == RADIOLIB_ERR_NONE) state = radio.setFrequency(fsk_config.freq);
+        fsk_initialized = (state == RADIOLIB_ERR_NONE);
+    }
+    return state;
+}
+
+// ============= Radio Settings =============
+
+void lora_get_settings(Radio_Settings *s) {
+    memset(s, 0, sizeof(*s));
+    s->mode = g_radio_mode;
+    s->lora_freq = g_lora_freq;
+    s->lora_bw = g_lora_bandwidth;
+    s->sf = g_lora_sf;
+    s->cr = g_lora_cr;
+    s->lora_power = g_lora_power;
+    s->lora_sync = g_lora_sync;
+    s->lora_preamble = g_lora_preamble;
+    s->fsk_freq = fsk_config.freq;
+    s->fsk_bitrate = fsk_config.bitrate;
+    s->fsk_dev = fsk_config.deviation;
+    s->fsk_bw = g_fsk_bandwidth;
+    s->fsk_power = fsk_config.power;
+    s->fsk_preamble = fsk_preamble;
+    s->fsk_pkt = fsk_packet;
+    s->fh_start = fh_start_freq;
+    s->fh_end = fh_end_freq;
+    s->fh_step = fh_step;
+    s->fh_bw = fh_bw;
+    s->fh_num = fh_num;
+}
+
+// Apply a full settings set in one pass: one standby, the packet type of the
+// target modem and its parameters, no chip reset. The other modem is set up
+// from the new values on the next lora_switch_modem().
+int lora_apply_settings(const Radio_Settings *s) {
+    lora_tx_wait();
+    if (lora_state == LORA_CW || lora_state == LORA_TX || lora_state == LORA_DUAL) return LORA_ERR_BUSY;
+    if (s->mode != RADIO_MODE_LORA && s->mode != RADIO_MODE_FSK) return RADIOLIB_ERR_WRONG_MODEM;
+    if (s->fsk_pkt.sync_len < 1 || s->fsk_pkt.sync_len > FSK_MAX_SYNC_LEN || s->fh_step <= 0 || s->fh_num <= 0) {
+        return RADIOLIB_ERR_UNKNOWN;
+    }
+
+    g_lora_freq = s->lora_freq;
+    g_lora_bandwidth = s->lora_bw;
+    g_lora_sf = s->sf;
+    g_lora_cr = s->cr;
+    g_lora_power = s->lora_power;
+    g_lora_sync = s->lora_sync;
+    g_lora_preamble = s->lora_preamble;
+    fsk_config.freq = s->fsk_freq;
+    fsk_config.bitrate = s->fsk_bitrate;
+    fsk_config.deviation = s->fsk_dev;
+    fsk_config.power = s->fsk_power;
+    g_fsk_bandwidth = s->fsk_bw;
+    fsk_preamble = s->fsk_preamble;
+    fsk_packet = s->fsk_pkt;
+    fh_start_freq = s->fh_start;
+    fh_end_freq = s->fh_end;
+    fh_step = s->fh_step;
+    fh_bw = s->fh_bw;
+    fh_num = s->fh_num;
+    build_fh_channels();
+    build_fhss_channel_order();
+
+    radio.standby();
+    uint8_t type = (s->mode == RADIO_MODE_LORA) ? RADIOLIB_SX126X_PACKET_TYPE_LORA : RADIOLIB_SX126X_PACKET_TYPE_GFSK;
+    int state = radio.getMod()->SPIwriteStream(RADIOLIB_SX126X_CMD_SET_PACKET_TYPE, &type, 1);
+    g_radio_mode = s->mode;
+    lora_configured = false;
+    fsk_initialized = false;
+    if (state == RADIOLIB_ERR_NONE) {
+        if (s->mode == RADIO_MODE_LORA) {
+            state = lora_apply_config();
+            if (state == RADIOLIB_ERR_NONE) state = afc_tune(g_lora_freq, afc_rx_peer());
+            lora_configured = (state == RADIOLIB_ERR_NONE);
+        } else {
+            state = fsk_apply_config();
+            if (state == RADIOLIB_ERR_NONE) state = radio.setFrequency(fsk_config.freq);
+            fsk_initialized = (state == RADIOLIB_ERR_NONE);
+        }
+    }
+
+    receivedFlag = false;
+    if (lora_state == LORA_RX) {
+        if (state != RADIOLIB_ERR_NONE || lora_start_rx() != RADIOLIB_ERR_NONE) lora_state = LORA_IDLE;
+    }
+    return state;
+}
+
+// Consume a pending DIO1 event (RX done, timeout, CAD done)
+bool lora_irq_take() {
+    if (!receivedFlag) return false;
+    receivedFlag = false;
+    return true;
+}
+
+// Hand the radio to the dual receive scheduler, or take it back
+int lora_dual_claim(bool on) {
+    if (!on) {
+        if (lora_state == LORA_DUAL) {
+            radio.standby();
+            lora_state = LORA_IDLE;
+        }
+        return RADIOLIB_ERR_NONE;
+    }
+    lora_tx_wait();
+    if (lora_state == LORA_CW || lora_state == LORA_TX) return LORA_ERR_BUSY;
+    radio.standby();
+    receivedFlag = false;
+    lora_state = LORA_DUAL;
+    return RADIOLIB_ERR_NONE;
+}
+
 // ============= Shared Functions =============
 
 // AT+PBW=125 or AT+PBW=? (bandwidth for both LoRa and FSK)
@@ -777,6 +1587,7 @@ void handle_at_bandwidth(const AT_Command *cmd) {
         if (bw == 7.8 || bw == 10.4 || bw == 15.6 || bw == 20.8 || 
             bw == 31.25 || bw == 41.7 || bw == 62.5 || bw == 125 || 
             bw == 250 || bw == 500) {
+            lora_tx_wait();
             g_lora_bandwidth = bw;
             if (radio.setBandwidth(g_lora_bandwidth) == RADIOLIB_ERR_NONE) {
                 Serial.print("OK, LoRa BW=");
@@ -802,6 +1613,7 @@ void handle_at_bandwidth(const AT_Command *cmd) {
             
             // Apply immediately if FSK is initialized
             if (fsk_initialized) {
+                lora_tx_wait();
                 int state = radio.setRxBandwidth(g_fsk_bandwidth);
                 // if (state != RADIOLIB_ERR_NONE) {
                 //     Serial.print("Failed to set RX bandwidth, code "); Serial.println(state);
@@ -831,6 +1643,7 @@ void handle_at_fsk_bitrate(const AT_Command *cmd) {
         
         // Apply immediately if FSK is initialized
         if (g_radio_mode == RADIO_MODE_FSK && fsk_initialized) {
+            lora_tx_wait();
             int state = radio.setBitRate(fsk_config.bitrate);
             if (state != RADIOLIB_ERR_NONE) {
                 Serial.print("Failed to set bitrate, code "); Serial.println(state);
@@ -859,6 +1672,7 @@ void handle_at_fsk_deviation(const AT_Command *cmd) {
         
         // Apply immediately if FSK is initialized
         if (g_radio_mode == RADIO_MODE_FSK && fsk_initialized) {
+            lora_tx_wait();
             int state = radio.setFrequencyDeviation(fsk_config.deviation);
             if (state != RADIOLIB_ERR_NONE) {
                 Serial.print("Failed to set frequency deviation, code "); Serial.println(state);
@@ -872,3 +1686,66 @@ void handle_at_fsk_deviation(const AT_Command *cmd) {
         Serial.println("ERROR: Invalid FSK deviation (0.0-200.0 kHz)");
     }
 }
+
+// AT+FSKPKT=12AD,2,1,0 (sync word, CRC bytes, whitening, fixed length) or AT+FSKPKT=?
+void handle_at_fsk_packet(const AT_Command *cmd) {
+    if (strcmp(cmd->params, "?") == 0) {
+        char sync[2 * FSK_MAX_SYNC_LEN + 1];
+        sync[hex_encode(sync, fsk_packet.sync, fsk_packet.sync_len)] = 0;
+        Serial.printf("FSK packet: sync=%s, crc=%u, whitening=%u, length=", sync, fsk_packet.crc_len, fsk_packet.whitening ? 1 : 0);
+        if (fsk_packet.fixed_len) {
+            Serial.printf("fixed %u\r\n", fsk_packet.fixed_len);
+        } else {
+            Serial.println("variable");
+        }
+        return;
+    }
+    char buf[48];
+    strncpy(buf, cmd->params, sizeof(buf)-1);
+    buf[sizeof(buf)-1] = 0;
+    char *sync = strtok(buf, ",");
+    char *crc = strtok(NULL, ",");
+    char *whiten = strtok(NULL, ",");
+    char *fixed = strtok(NULL, ",");
+    if (!sync || !crc || !whiten) {
+        Serial.println("ERROR: Need params: <sync hex>,<crc 0|1|2>,<whitening 0|1>[,<fixed len>]");
+        return;
+    }
+    FSK_Packet_Config cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    int sync_len = hex_decode(cfg.sync, FSK_MAX_SYNC_LEN, sync, strlen(sync));
+    if (sync_len <= 0) {
+        Serial.println("ERROR: Sync word must be 1-8 bytes of hex");
+        return;
+    }
+    cfg.sync_len = sync_len;
+    int crc_len = atoi(crc);
+    int fixed_len = fixed ? atoi(fixed) : 0;
+    if (crc_len < 0 || crc_len > 2 || fixed_len < 0 || fixed_len > 255) {
+        Serial.println("ERROR: Invalid crc (0-2) or fixed length (0-255)");
+        return;
+    }
+    if (fsk_stream_busy()) {
+        Serial.println("ERROR: Device busy (FSK stream)");
+        return;
+    }
+    cfg.crc_len = crc_len;
+    cfg.whitening = atoi(whiten) != 0;
+    cfg.fixed_len = fixed_len;
+    fsk_packet = cfg;
+
+    // Apply immediately if FSK is initialized
+    if (g_radio_mode == RADIO_MODE_FSK && fsk_initialized) {
+        lora_tx_wait();
+        bool was_rx = (lora_state == LORA_RX);
+        radio.standby();
+        int state = fsk_apply_packet();
+        if (was_rx) lora_start_rx();
+        if (state != RADIOLIB_ERR_NONE) {
+            Serial.print("ERROR: Failed to set FSK packet format, code ");
+            Serial.println(state);
+            return;
+        }
+    }
+    Serial.println("OK, FSK packet format set");
+}
@@ -1,6 +1,8 @@
 #ifndef LORA_H
 #define LORA_H
 
+#include <stdint.h>
+#include <stddef.h>
 #include "command.h"
 
 // Radio mode definitions
@@ -15,8 +17,85 @@ struct FSK_Config {
     float deviation;  // Frequency deviation in kHz (0.0-200.0)
 };
 
+// FSK packet format, shared by TX and RX
+#define FSK_MAX_SYNC_LEN 8
+struct FSK_Packet_Config {
+    uint8_t sync[FSK_MAX_SYNC_LEN];
+    uint8_t sync_len;   // sync word bytes (1-8)
+    uint8_t crc_len;    // hardware CRC bytes: 0 (off), 1 or 2
+    bool whitening;
+    uint8_t fixed_len;  // 0 = variable length (length byte on air)
+};
+
+// Streamed FSK transmit (fsk_stream_start)
+#define FSK_STREAM_PACKET   255     // SX1262 packet length limit
+#define FSK_STREAM_MAX      16384   // AT+FSKSTREAM test buffer
+#define FSK_STREAM_SLACK_MS 20      // TX done wait on top of 2x time on air
+#define FSK_STREAM_PRIORITY 3       // above loop() and the AT task
+
+#define FSK_ERR_FIXED_HDR   (-1001) // AT+P2PHDR frames vary in length, AT+FSKPKT fixes it
+#define LORA_ERR_BUSY       (-1002) // CW, an FSK stream or dual RX owns the radio
+#define LORA_TX_SLACK_MS    20      // lora_start_frame TX done wait on top of 2x time on air
+
+#define LORA_RX_QUEUE       8       // frames read by the dual RX task, waiting for loop()
+
+struct FSK_Stream_Result {
+    int state;            // RADIOLIB_ERR_NONE or the first error
+    size_t bytes;         // payload bytes sent
+    uint32_t packets;
+    uint32_t elapsed_ms;
+};
+typedef void (*FSK_Stream_Done)(const FSK_Stream_Result *res);
+
+// Everything AT+PROFILE saves and restores (profile.cpp)
+struct Radio_Settings {
+    uint8_t mode;           // RADIO_MODE_LORA or RADIO_MODE_FSK
+    // LoRa
+    float lora_freq;
+    float lora_bw;
+    uint8_t sf;
+    uint8_t cr;
+    int8_t lora_power;
+    uint8_t lora_sync;
+    uint16_t lora_preamble;
+    // FSK
+    float fsk_freq;
+    float fsk_bitrate;
+    float fsk_dev;
+    float fsk_bw;
+    int8_t fsk_power;
+    uint16_t fsk_preamble;
+    FSK_Packet_Config fsk_pkt;
+    // FHSS plan (AT+FHSET)
+    float fh_start;
+    float fh_end;
+    float fh_step;
+    uint16_t fh_bw;
+    uint16_t fh_num;
+};
+
+// Metadata captured alongside each received frame
+struct RX_Packet_Info {
+    uint32_t t_ms;    // millis() when the frame was read out
+    uint32_t t_us;    // micros() of the RX done DIO1 edge, 0 if unknown
+    float rssi;       // RSSI in dBm
+    float snr;        // SNR in dB
+    float freq_err;   // Frequency error in Hz
+    uint16_t len;     // Payload length in bytes
+    uint16_t air_len; // Frame length on air, before P2P unwrap
+    uint8_t mode;     // RADIO_MODE_LORA or RADIO_MODE_FSK it arrived on
+};
+
 extern int g_radio_mode; // Global radio mode variable
 
+// LoRa settings
+extern float g_lora_freq;       // LoRa frequency in MHz
+extern int g_lora_sf;           // LoRa spreading factor
+extern int g_lora_power;        // LoRa output power in dBm
+extern int g_lora_preamble;     // LoRa preamble length in symbols
+extern int g_lora_cr;           // LoRa coding rate denominator (5-8)
+extern uint8_t g_lora_sync;     // LoRa sync word
+
 // Bandwidth variables - separate for LoRa and FSK
 extern float g_lora_bandwidth;  // LoRa bandwidth in kHz
 extern float g_fsk_bandwidth;   // FSK bandwidth in kHz
@@ -33,6 +112,28 @@ void handle_at_rx_stop(const AT_Command *cmd);
 void handle_at_rx(const AT_Command *cmd);
 void receive_packet();
 
+// Radio primitives for protocol layers
+int lora_send_frame(const uint8_t *frame, size_t len);
+int lora_start_frame(const uint8_t *frame, size_t len);
+int lora_poll_frame();
+void lora_tx_wait();
+int lora_listen();
+bool lora_listening();
+int lora_set_rate(int sf, float bw, int power);
+uint32_t lora_time_on_air_ms(size_t len);
+uint32_t lora_time_on_air_us(size_t len);
+int lora_rx_packet();
+int lora_rx_defer();
+int lora_switch_modem(int mode);
+bool lora_irq_take();
+int lora_dual_claim(bool on);
+void lora_rx_detail(bool on);
+bool lora_rx_detail_on();
+uint32_t lora_tx_done_us();
+uint32_t lora_tx_start_us();
+void lora_get_settings(Radio_Settings *s);
+int lora_apply_settings(const Radio_Settings *s);
+
 // Shared functions for both LoRa and FSK
 void handle_at_bandwidth(const AT_Command *cmd);
 
@@ -41,10 +142,14 @@ void init_fsk_radio();
 void reinit_fsk_for_send();
 void set_fsk_freq(float freq);
 int fsk_send_packet(const char* data, int len);
+int fsk_stream_start(const uint8_t *data, size_t len, FSK_Stream_Done done);
+bool fsk_stream_busy();
 void handle_at_fsk_send(const AT_Command *cmd);
+void handle_at_fsk_stream(const AT_Command *cmd);
 void handle_at_mode(const AT_Command *cmd);
 void handle_at_fsk_bitrate(const AT_Command *cmd);
 void handle_at_fsk_deviation(const AT_Command *cmd);
+void handle_at_fsk_packet(const AT_Command *cmd);
 
 #ifdef __cplusplus
 extern "C" {
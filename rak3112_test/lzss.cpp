@@ -0,0 +1,136 @@
+#include "lzss.h"
+
+#include <string.h>
+
+// Preset dictionary: keys and number fragments seen in telemetry frames.
+// The most frequent tokens sit at the end, closest to the payload.
+static const char lzss_dict[] =
+    "VBAT=PRES=ALT=SPD=GYR=ACC=X=Y=Z=ID=SEQ=CNT=LAT=LON="
+    "{\"id\":\"seq\":\"ts\":\"lat\":\"lon\":\"alt\":\"bat\":\"rssi\":\"snr\":\"hum\":\"temp\":}"
+    "OK,ERROR,mV,dBm,dB,hPa,%,km/h,3.3V,-1,1000,100,50.0,25.0,"
+    "0.00,1.00,.5,.0,20,10,temp:hum:batt:rssi:snr:RSSI=SNR=BAT=HUM=TEMP=";
+
+#define LZSS_DICT_LEN (sizeof(lzss_dict) - 1)
+
+size_t lzss_dict_len() {
+    return LZSS_DICT_LEN;
+}
+
+struct BitWriter {
+    uint8_t *buf;
+    size_t cap;
+    size_t pos;
+    uint8_t bit;        // bits used in buf[pos]
+    bool overflow;
+};
+
+static void bw_put(BitWriter *w, uint32_t value, int bits) {
+    while (bits-- > 0) {
+        if (w->bit == 0) {
+            if (w->pos >= w->cap) {
+                w->overflow = true;
+                return;
+            }
+            w->buf[w->pos] = 0;
+        }
+        if ((value >> bits) & 1) w->buf[w->pos] |= (uint8_t)(0x80 >> w->bit);
+        if (++w->bit == 8) {
+            w->bit = 0;
+            w->pos++;
+        }
+    }
+}
+
+struct BitReader {
+    const uint8_t *buf;
+    size_t len;
+    size_t pos;
+    uint8_t bit;
+};
+
+static int br_get(BitReader *r, int bits) {
+    uint32_t v = 0;
+    while (bits-- > 0) {
+        if (r->pos >= r->len) return -1;
+        v = (v << 1) | ((r->buf[r->pos] >> (7 - r->bit)) & 1);
+        if (++r->bit == 8) {
+            r->bit = 0;
+            r->pos++;
+        }
+    }
+    return (int)v;
+}
+
+// Byte i of the virtual history dictionary || data
+static inline uint8_t hist_at(const uint8_t *data, size_t i) {
+    return i < LZSS_DICT_LEN ? (uint8_t)lzss_dict[i] : data[i - LZSS_DICT_LEN];
+}
+
+size_t lzss_compress(const uint8_t *in, size_t len, uint8_t *out, size_t cap) {
+    if (len > LZSS_MAX_INPUT || cap < 1) return 0;
+    out[0] = (uint8_t)len;
+    BitWriter w = {out + 1, cap - 1, 0, 0, false};
+
+    size_t pos = LZSS_DICT_LEN;
+    size_t end = LZSS_DICT_LEN + len;
+    while (pos < end && !w.overflow) {
+        size_t max_len = end - pos < LZSS_MAX_MATCH ? end - pos : LZSS_MAX_MATCH;
+        size_t start = pos > LZSS_WINDOW ? pos - LZSS_WINDOW : 0;
+        size_t best_len = 0;
+        size_t best_dist = 0;
+        uint8_t first = in[pos - LZSS_DICT_LEN];
+        for (size_t cand = pos; cand-- > start; ) {
+            if (hist_at(in, cand) != first) continue;
+            size_t l = 1;
+            while (l < max_len && hist_at(in, cand + l) == in[pos + l - LZSS_DICT_LEN]) l++;
+            if (l > best_len) {
+                best_len = l;
+                best_dist = pos - cand;
+                if (l == max_len) break;
+            }
+        }
+        if (best_len >= LZSS_MIN_MATCH) {
+            bw_put(&w, 0, 1);
+            bw_put(&w, (uint32_t)(best_dist - 1), LZSS_OFFSET_BITS);
+            bw_put(&w, (uint32_t)(best_len - LZSS_MIN_MATCH), LZSS_LENGTH_BITS);
+            pos += best_len;
+        } else {
+            bw_put(&w, 1, 1);
+            bw_put(&w, first, 8);
+            pos++;
+        }
+    }
+    if (w.overflow) return 0;
+    return 1 + w.pos + (w.bit ? 1 : 0);
+}
+
+int lzss_decompress(const uint8_t *in, size_t len, uint8_t *out, size_t cap) {
+    if (len < 1) return -1;
+    size_t n = in[0];
+    if (n > cap) return -1;
+    BitReader r = {in + 1, len - 1, 0, 0};
+
+    size_t olen = 0;
+    while (olen < n) {
+        int flag = br_get(&r, 1);
+        if (flag < 0) return -1;
+        if (flag) {
+            int b = br_get(&r, 8);
+            if (b < 0) return -1;
+            out[olen++] = (uint8_t)b;
+            continue;
+        }
+        int dist = br_get(&r, LZSS_OFFSET_BITS);
+        int mlen = br_get(&r, LZSS_LENGTH_BITS);
+        if (dist < 0 || mlen < 0) return -1;
+        dist += 1;
+        mlen += LZSS_MIN_MATCH;
+        size_t pos = LZSS_DICT_LEN + olen;
+        if ((size_t)dist > pos || olen + mlen > n) return -1;
+        size_t src = pos - dist;
+        for (int k = 0; k < mlen; k++, src++) {
+            out[olen++] = hist_at(out, src);
+        }
+    }
+    return (int)n;
+}
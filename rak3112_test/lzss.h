@@ -0,0 +1,29 @@
+#ifndef LZSS_H
+#define LZSS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Small LZSS codec for P2P payloads, primed with a preset dictionary of
+// common telemetry tokens so even short frames find matches. No Arduino
+// dependency, builds as is on a host.
+//
+// Stream: original length u8, then MSB-first tokens
+//   1 + 8 bits               literal
+//   0 + 9 bits + 4 bits      match: distance-1 (1..512), length-2 (2..17)
+// Matches may reach back into the dictionary, which sits just before the
+// first payload byte.
+#define LZSS_OFFSET_BITS    9
+#define LZSS_LENGTH_BITS    4
+#define LZSS_WINDOW         (1 << LZSS_OFFSET_BITS)
+#define LZSS_MIN_MATCH      2
+#define LZSS_MAX_MATCH      (LZSS_MIN_MATCH + (1 << LZSS_LENGTH_BITS) - 1)
+#define LZSS_MAX_INPUT      255
+
+// Returns the compressed size, or 0 when the result would not fit in cap
+size_t lzss_compress(const uint8_t *in, size_t len, uint8_t *out, size_t cap);
+// Returns the decompressed size, or -1 for a corrupt or oversized stream
+int lzss_decompress(const uint8_t *in, size_t len, uint8_t *out, size_t cap);
+size_t lzss_dict_len();
+
+#endif // LZSS_H
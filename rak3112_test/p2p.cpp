@@ -0,0 +1,203 @@
+#include "p2p.h"
+#include "afc.h"
+#include "compress.h"
+#include "pktbuf.h"
+#include "secure.h"
+#include "txq.h"
+#include "Arduino.h"
+#include <RadioLib.h>
+#include "command.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+uint16_t g_node_id = 0;
+
+static bool hdr_mode = false;             // AT+PSEND prepends a DATA header
+static uint16_t hdr_dst = P2P_BROADCAST;
+static uint16_t tx_seq = 0;
+
+struct P2P_HandlerEntry {
+    uint8_t type;
+    P2P_Handler handler;
+};
+
+static P2P_HandlerEntry p2p_handlers[P2P_MAX_HANDLERS];
+static int p2p_handler_count = 0;
+
+void init_p2p() {
+    // default node id from the factory MAC, never the anonymous/broadcast id
+    uint64_t mac = ESP.getEfuseMac();
+    g_node_id = (uint16_t)((mac >> 32) ^ (mac >> 16) ^ mac);
+    if (g_node_id == P2P_ANON_ID || g_node_id == P2P_BROADCAST) g_node_id = 1;
+
+    register_at_handler("AT+NODEID", handle_at_nodeid, "Set/query P2P node id (1-65534), e.g. AT+NODEID=42 or AT+NODEID=?");
+    register_at_handler("AT+P2PHDR", handle_at_p2phdr, "Set/query P2P header on AT+PSEND, e.g. AT+P2PHDR=1,42 (to node 42), AT+P2PHDR=1 (broadcast), AT+P2PHDR=0 or AT+P2PHDR=?");
+}
+
+bool p2p_parse(const uint8_t *frame, size_t len, P2P_Header *hdr) {
+    if (len < P2P_HDR_LEN || frame[0] != P2P_MAGIC) return false;
+    hdr->type = frame[1];
+    hdr->flags = frame[2];
+    hdr->hops = frame[3];
+    hdr->src = frame[4] | (frame[5] << 8);
+    hdr->dst = frame[6] | (frame[7] << 8);
+    hdr->seq = frame[8] | (frame[9] << 8);
+    return true;
+}
+
+size_t p2p_write_header(uint8_t *out, const P2P_Header *hdr) {
+    out[0] = P2P_MAGIC;
+    out[1] = hdr->type;
+    out[2] = hdr->flags;
+    out[3] = hdr->hops;
+    out[4] = hdr->src & 0xFF;
+    out[5] = hdr->src >> 8;
+    out[6] = hdr->dst & 0xFF;
+    out[7] = hdr->dst >> 8;
+    out[8] = hdr->seq & 0xFF;
+    out[9] = hdr->seq >> 8;
+    return P2P_HDR_LEN;
+}
+
+// Header plus payload into frame (P2P_MAX_FRAME bytes); DATA and AGG
+// payloads are compressed when AT+LZ is on and it saves space, then the
+// frame is sealed when AT+SEC is on. Returns the frame length, 0 if it may not be sent.
+size_t p2p_build(uint8_t *frame, const P2P_Header *hdr, const uint8_t *payload, size_t len) {
+    P2P_Header h = *hdr;
+    size_t n = 0;
+    if ((h.type == P2P_TYPE_DATA || h.type == P2P_TYPE_AGG) && lz_enabled()) {
+        n = lz_pack(payload, len, frame + P2P_HDR_LEN, P2P_MAX_PAYLOAD);
+    }
+    if (n) {
+        h.flags |= P2P_FLAG_LZ;
+    } else {
+        memcpy(frame + P2P_HDR_LEN, payload, len);
+        n = len;
+    }
+    return sec_seal(frame, p2p_write_header(frame, &h) + n);
+}
+
+// Undo sealing and compression in place. Returns the plain frame length,
+// or -1 when the frame must be dropped (bad tag, replay, corrupt payload).
+int p2p_unwrap(uint8_t *frame, size_t len) {
+    int n = sec_open(frame, len);
+    if (n < 0) return -1;
+    P2P_Header hdr;
+    if (!p2p_parse(frame, n, &hdr) || !(hdr.flags & P2P_FLAG_LZ)) return n;
+    uint8_t plain[P2P_MAX_PAYLOAD];
+    int m = lz_unpack(frame + P2P_HDR_LEN, n - P2P_HDR_LEN, plain, sizeof(plain));
+    if (m < 0) return -1;
+    frame[2] &= ~P2P_FLAG_LZ;
+    memcpy(frame + P2P_HDR_LEN, plain, m);
+    return P2P_HDR_LEN + m;
+}
+
+uint16_t p2p_peer_of(const uint8_t *frame, size_t len) {
+    P2P_Header hdr;
+    return p2p_parse(frame, len, &hdr) ? hdr.src : P2P_ANON_ID;
+}
+
+bool p2p_register_handler(uint8_t type, P2P_Handler handler) {
+    if (p2p_handler_count >= P2P_MAX_HANDLERS) return false;
+    p2p_handlers[p2p_handler_count].type = type;
+    p2p_handlers[p2p_handler_count].handler = handler;
+    p2p_handler_count++;
+    return true;
+}
+
+// Hand a received frame to the layer that owns its type. Returns false for
+// raw frames, frames for other nodes, unknown types and frames the handler
+// passed on, so they get printed.
+bool p2p_dispatch(const uint8_t *frame, size_t len, const RX_Packet_Info *info) {
+    P2P_Header hdr;
+    if (!p2p_parse(frame, len, &hdr)) return false;
+    if (hdr.dst != g_node_id && hdr.dst != P2P_BROADCAST) return false;
+    for (int i = 0; i < p2p_handler_count; i++) {
+        if (p2p_handlers[i].type == hdr.type) {
+            return p2p_handlers[i].handler(&hdr, frame + P2P_HDR_LEN, len - P2P_HDR_LEN, info);
+        }
+    }
+    return false;
+}
+
+// Build a frame from this node and send it, tuned for the destination peer
+int p2p_send(uint8_t type, uint8_t flags, uint16_t dst, const uint8_t *payload, size_t len) {
+    return p2p_send_seq(type, flags, dst, p2p_next_seq(), payload, len);
+}
+
+// Same, with a caller-owned sequence number (ARQ retransmits reuse theirs)
+int p2p_send_seq(uint8_t type, uint8_t flags, uint16_t dst, uint16_t seq, const uint8_t *payload, size_t len) {
+    if (len > P2P_MAX_PAYLOAD) return RADIOLIB_ERR_PACKET_TOO_LONG;
+    PKT_Buf *frame = pkt_alloc();
+    if (!frame) return RADIOLIB_ERR_MEMORY_ALLOCATION_FAILED;
+    P2P_Header hdr = {type, flags, 0, g_node_id, dst, seq};
+    size_t n = p2p_build(frame->data, &hdr, payload, len);
+    int state = P2P_ERR_NO_KEY;
+    if (n) state = txq_send_now(frame->data, n, dst == P2P_BROADCAST ? afc_rx_peer() : dst);
+    pkt_unref(frame);
+    return state;
+}
+
+bool p2p_header_mode() {
+    return hdr_mode;
+}
+
+uint16_t p2p_default_dst() {
+    return hdr_dst;
+}
+
+// Called from loop(), the AT task and the FSK stream task
+uint16_t p2p_next_seq() {
+    return __atomic_fetch_add(&tx_seq, 1, __ATOMIC_RELAXED);
+}
+
+void handle_at_nodeid(const AT_Command *cmd) {
+    if (strcmp(cmd->params, "?") == 0) {
+        Serial.print("Current NODEID: ");
+        Serial.println(g_node_id);
+        return;
+    }
+    long id = atol(cmd->params);
+    if (id > P2P_ANON_ID && id < P2P_BROADCAST) {
+        g_node_id = (uint16_t)id;
+        Serial.print("OK, NODEID=");
+        Serial.println(g_node_id);
+    } else {
+        Serial.println("ERROR: Invalid NODEID (1-65534)");
+    }
+}
+
+// AT+P2PHDR=0 / AT+P2PHDR=1[,dst] / AT+P2PHDR=?
+void handle_at_p2phdr(const AT_Command *cmd) {
+    if (strcmp(cmd->params, "?") == 0) {
+        Serial.print("P2PHDR: ");
+        Serial.print(hdr_mode ? 1 : 0);
+        Serial.print(", dst=");
+        if (hdr_dst == P2P_BROADCAST) {
+            Serial.println("broadcast");
+        } else {
+            Serial.println(hdr_dst);
+        }
+        return;
+    }
+    char buf[32];
+    strncpy(buf, cmd->params, sizeof(buf)-1);
+    buf[sizeof(buf)-1] = 0;
+    char *p = strtok(buf, ",");
+    if (!p) {
+        Serial.println("ERROR: Need params: on[,dst]");
+        return;
+    }
+    int on = atoi(p);
+    p = strtok(NULL, ",");
+    long dst = p ? atol(p) : P2P_BROADCAST;
+    if (dst <= P2P_ANON_ID || dst > P2P_BROADCAST) {
+        Serial.println("ERROR: Invalid dst (1-65535)");
+        return;
+    }
+    hdr_mode = on != 0;
+    hdr_dst = (uint16_t)dst;
+    Serial.print("OK, P2PHDR=");
+    Serial.println(hdr_mode ? 1 : 0);
+}
@@ -0,0 +1,76 @@
+#ifndef P2P_H
+#define P2P_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "command.h"
+#include "lora.h"
+
+// Optional header in front of P2P payloads so peers can be told apart.
+// Frames without the magic byte are treated as raw payloads from an
+// anonymous peer, so plain AT+PSEND traffic keeps working.
+//
+//  0      1     2      3     4..5   6..7   8..9
+//  magic  type  flags  hops  src    dst    seq      (little endian)
+#define P2P_MAGIC       0xA7
+#define P2P_HDR_LEN     10
+#define P2P_MAX_FRAME   255
+#define P2P_SEC_OVERHEAD 12     // counter u32 + CCM tag when sealed (secure.cpp)
+#define P2P_MAX_PAYLOAD (P2P_MAX_FRAME - P2P_HDR_LEN - P2P_SEC_OVERHEAD)
+
+#define P2P_BROADCAST   0xFFFF
+#define P2P_ANON_ID     0x0000   // peer id used for raw (headerless) frames
+
+// Frame types
+#define P2P_TYPE_DATA   0x01
+#define P2P_TYPE_FRAG   0x02    // transport fragment (xfer.cpp)
+#define P2P_TYPE_SACK   0x03    // transport selective ack (xfer.cpp)
+#define P2P_TYPE_ACK    0x04    // ARQ acknowledgement (arq.cpp)
+#define P2P_TYPE_LINK   0x05    // link adaptation signaling (adr.cpp)
+#define P2P_TYPE_SWEEP  0x06    // parameter sweep sync and burst (sweep.cpp)
+#define P2P_TYPE_TIME   0x07    // time sync beacon (timebase.cpp)
+#define P2P_TYPE_AGG    0x08    // several small DATA payloads (agg.cpp)
+
+// Flags
+#define P2P_FLAG_ACKREQ   0x01  // sender waits for an acknowledgement
+#define P2P_FLAG_RELIABLE 0x02  // DATA under ARQ: seq is per peer, duplicates dropped
+#define P2P_FLAG_LZ       0x04  // payload is LZSS compressed (compress.cpp)
+#define P2P_FLAG_SEC      0x08  // payload is AES-CCM sealed (secure.cpp)
+
+#define P2P_ERR_NO_KEY  (-1101)  // strict AT+SEC and no key for the destination
+
+#define P2P_MAX_HANDLERS 16
+
+struct P2P_Header {
+    uint8_t type;
+    uint8_t flags;
+    uint8_t hops;
+    uint16_t src;
+    uint16_t dst;
+    uint16_t seq;
+};
+
+// Receive handler for one frame type; payload excludes the header.
+// Returns false to let the frame go on to normal RX output.
+typedef bool (*P2P_Handler)(const P2P_Header *hdr, const uint8_t *payload, size_t len, const RX_Packet_Info *info);
+
+extern uint16_t g_node_id;
+
+void init_p2p();
+bool p2p_parse(const uint8_t *frame, size_t len, P2P_Header *hdr);
+size_t p2p_write_header(uint8_t *out, const P2P_Header *hdr);
+size_t p2p_build(uint8_t *frame, const P2P_Header *hdr, const uint8_t *payload, size_t len);
+int p2p_unwrap(uint8_t *frame, size_t len);
+uint16_t p2p_peer_of(const uint8_t *frame, size_t len);
+bool p2p_header_mode();
+uint16_t p2p_default_dst();
+uint16_t p2p_next_seq();
+bool p2p_register_handler(uint8_t type, P2P_Handler handler);
+bool p2p_dispatch(const uint8_t *frame, size_t len, const RX_Packet_Info *info);
+int p2p_send(uint8_t type, uint8_t flags, uint16_t dst, const uint8_t *payload, size_t len);
+int p2p_send_seq(uint8_t type, uint8_t flags, uint16_t dst, uint16_t seq, const uint8_t *payload, size_t len);
+
+void handle_at_nodeid(const AT_Command *cmd);
+void handle_at_p2phdr(const AT_Command *cmd);
+
+#endif // P2P_H
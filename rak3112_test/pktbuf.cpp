@@ -0,0 +1,96 @@
+#include "pktbuf.h"
+#include "Arduino.h"
+#include "command.h"
+
+#include <string.h>
+
+#define PKT_ALL     ((uint32_t)(((uint64_t)1 << PKT_POOL) - 1))
+
+static_assert(PKT_POOL >= 1 && PKT_POOL <= 32, "PKT_POOL must fit the free bitmap");
+
+static PKT_Buf pk_pool[PKT_POOL];
+static uint32_t pk_free = PKT_ALL;      // bit set = block free
+
+static uint32_t pk_allocs = 0;
+static uint32_t pk_exhausted = 0;       // alloc found no free block
+static uint32_t pk_high = 0;            // most blocks in use at once
+
+static uint32_t pkt_in_use() {
+    return PKT_POOL - __builtin_popcount(__atomic_load_n(&pk_free, __ATOMIC_RELAXED));
+}
+
+// Returns a buffer holding one reference, or NULL when the pool is empty
+PKT_Buf *pkt_alloc() {
+    uint32_t free = __atomic_load_n(&pk_free, __ATOMIC_ACQUIRE);
+    while (free) {
+        uint32_t bit = free & (0 - free);
+        if (!__atomic_compare_exchange_n(&pk_free, &free, free & ~bit, true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            continue;               // free was reloaded
+        }
+        PKT_Buf *buf = &pk_pool[__builtin_ctz(bit)];
+        buf->len = 0;
+        buf->tx_state = PKT_TX_PENDING;
+        __atomic_store_n(&buf->refs, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&pk_allocs, 1, __ATOMIC_RELAXED);
+        uint32_t used = PKT_POOL - __builtin_popcount(free) + 1;
+        uint32_t high = __atomic_load_n(&pk_high, __ATOMIC_RELAXED);
+        while (used > high && !__atomic_compare_exchange_n(&pk_high, &high, used, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        }
+        return buf;
+    }
+    __atomic_add_fetch(&pk_exhausted, 1, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+PKT_Buf *pkt_ref(PKT_Buf *buf) {
+    __atomic_add_fetch(&buf->refs, 1, __ATOMIC_RELAXED);
+    return buf;
+}
+
+void pkt_unref(PKT_Buf *buf) {
+    if (!buf || __atomic_sub_fetch(&buf->refs, 1, __ATOMIC_ACQ_REL) != 0) return;
+    __atomic_fetch_or(&pk_free, (uint32_t)1 << (buf - pk_pool), __ATOMIC_RELEASE);
+}
+
+// A buffer the caller may write: buf itself when nobody else holds it,
+// otherwise a private copy (and the reference to buf is dropped). NULL when
+// a copy is needed and the pool is empty; buf is then still held.
+PKT_Buf *pkt_unshare(PKT_Buf *buf) {
+    if (__atomic_load_n(&buf->refs, __ATOMIC_ACQUIRE) == 1) return buf;
+    PKT_Buf *copy = pkt_alloc();
+    if (!copy) return NULL;
+    memcpy(copy->data, buf->data, buf->len);
+    copy->len = buf->len;
+    pkt_unref(buf);
+    return copy;
+}
+
+// Record the outcome of a queued frame before the queue drops its
+// reference; the first outcome sticks. NULL-safe.
+void pkt_tx_done(PKT_Buf *buf, bool sent) {
+    if (!buf || __atomic_load_n(&buf->tx_state, __ATOMIC_RELAXED) != PKT_TX_PENDING) return;
+    buf->tx_ms = millis();
+    __atomic_store_n(&buf->tx_state, sent ? PKT_TX_SENT : PKT_TX_DROPPED, __ATOMIC_RELEASE);
+}
+
+void init_pktbuf() {
+    register_at_handler("AT+PKTPOOL", handle_at_pktpool, "Packet buffer pool occupancy: AT+PKTPOOL=? or AT+PKTPOOL=CLR");
+}
+
+// AT+PKTPOOL=? / CLR
+void handle_at_pktpool(const AT_Command *cmd) {
+    if (strcasecmp(cmd->params, "CLR") == 0) {
+        pk_allocs = 0;
+        pk_exhausted = 0;
+        pk_high = pkt_in_use();
+        Serial.println("OK, packet pool statistics cleared");
+        return;
+    }
+    if (strcmp(cmd->params, "?") != 0) {
+        Serial.println("ERROR: Use AT+PKTPOOL=? or AT+PKTPOOL=CLR");
+        return;
+    }
+    Serial.printf("PKTPOOL: %d blocks of %d bytes (%u bytes), in use %lu, high water %lu\r\n", PKT_POOL, PKT_BLOCK,
+                  (unsigned)sizeof(pk_pool), (unsigned long)pkt_in_use(), (unsigned long)pk_high);
+    Serial.printf("Allocs %lu, exhausted %lu\r\n", (unsigned long)pk_allocs, (unsigned long)pk_exhausted);
+}
@@ -0,0 +1,40 @@
+#ifndef PKTBUF_H
+#define PKTBUF_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "command.h"
+
+// Packet buffer pool: PKT_POOL static blocks, each large enough for any
+// frame. Free blocks are bits in one word claimed with compare-and-swap,
+// so alloc and release take no lock and may run in an ISR or another task.
+// A buffer is reference counted and returns to the pool when the last
+// holder lets go; queues take over the caller's reference, so a frame is
+// written once and sent or read from the same block. A holder that keeps
+// a reference to a queued frame learns from tx_state when the TX queue has
+// let go of it, and whether it went on air.
+#define PKT_POOL        32      // one bit per block in a 32 bit word
+#define PKT_BLOCK       256
+
+#define PKT_TX_PENDING  0
+#define PKT_TX_SENT     1       // on air, tx_ms set
+#define PKT_TX_DROPPED  2       // failed, expired, evicted, cancelled or flushed
+
+struct PKT_Buf {
+    uint16_t len;
+    uint8_t refs;
+    uint8_t tx_state;       // PKT_TX_*
+    uint32_t tx_ms;         // millis() when the TX queue was done with it
+    uint8_t data[PKT_BLOCK];
+};
+
+void init_pktbuf();
+PKT_Buf *pkt_alloc();
+PKT_Buf *pkt_ref(PKT_Buf *buf);
+void pkt_unref(PKT_Buf *buf);
+PKT_Buf *pkt_unshare(PKT_Buf *buf);
+void pkt_tx_done(PKT_Buf *buf, bool sent);
+
+void handle_at_pktpool(const AT_Command *cmd);
+
+#endif // PKTBUF_H
@@ -0,0 +1,204 @@
+#include "profile.h"
+#include "lora.h"
+#include "Arduino.h"
+#include <RadioLib.h>
+#include <Preferences.h>
+#include "command.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+struct ProfileBlob {
+    uint8_t magic;
+    uint8_t version;
+    uint16_t len;           // sizeof(Radio_Settings) when written
+    Radio_Settings s;
+};
+
+static Preferences prof_prefs;
+static char prof_names[PROFILE_MAX][PROFILE_NAME_LEN + 1];
+static char prof_boot[PROFILE_NAME_LEN + 1] = "";
+static uint32_t prof_ready_ms = 0;      // millis() when the boot profile was in place
+static uint32_t prof_apply_us = 0;      // duration of the last apply
+
+static void prof_key(char *out, const char *name) {
+    snprintf(out, 16, "p:%s", name);
+}
+
+static bool prof_name_ok(const char *name) {
+    size_t n = strlen(name);
+    if (n == 0 || n > PROFILE_NAME_LEN) return false;
+    for (size_t i = 0; i < n; i++) {
+        if (!isalnum((unsigned char)name[i]) && name[i] != '_' && name[i] != '-') return false;
+    }
+    return true;
+}
+
+static int prof_find(const char *name) {
+    for (int i = 0; i < PROFILE_MAX; i++) {
+        if (prof_names[i][0] && strcmp(prof_names[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+static void prof_store_names() {
+    prof_prefs.putBytes("names", prof_names, sizeof(prof_names));
+}
+
+static bool prof_read(const char *name, Radio_Settings *s) {
+    char key[16];
+    ProfileBlob blob;
+    prof_key(key, name);
+    if (prof_prefs.getBytes(key, &blob, sizeof(blob)) != sizeof(blob)) return false;
+    if (blob.magic != PROFILE_MAGIC || blob.version != PROFILE_VERSION || blob.len != sizeof(Radio_Settings)) return false;
+    *s = blob.s;
+    return true;
+}
+
+static int prof_apply(const char *name) {
+    Radio_Settings s;
+    if (!prof_read(name, &s)) return RADIOLIB_ERR_UNKNOWN;
+    uint32_t t0 = micros();
+    int state = lora_apply_settings(&s);
+    prof_apply_us = micros() - t0;
+    return state;
+}
+
+void init_profile() {
+    prof_prefs.begin("radioprof", false);
+    memset(prof_names, 0, sizeof(prof_names));
+    if (prof_prefs.getBytes("names", prof_names, sizeof(prof_names)) != sizeof(prof_names)) {
+        memset(prof_names, 0, sizeof(prof_names));
+    }
+    for (int i = 0; i < PROFILE_MAX; i++) prof_names[i][PROFILE_NAME_LEN] = 0;
+    prof_prefs.getString("boot", prof_boot, sizeof(prof_boot));
+
+    register_at_handler("AT+PROFILE", handle_at_profile, "Radio profiles in flash: AT+PROFILE=SAVE|LOAD|DEL,name, AT+PROFILE=BOOT,name|NONE or AT+PROFILE=?");
+
+    if (prof_boot[0]) {
+        int state = prof_apply(prof_boot);
+        prof_ready_ms = millis();
+        if (state == RADIOLIB_ERR_NONE) {
+            Serial.printf("Profile %s restored in %lu us, radio ready %lu ms after boot\r\n", prof_boot,
+                          (unsigned long)prof_apply_us, (unsigned long)prof_ready_ms);
+        } else {
+            Serial.printf("Profile %s not restored, code %d, defaults in use\r\n", prof_boot, state);
+        }
+    } else {
+        prof_ready_ms = millis();
+        Serial.printf("Radio ready %lu ms after boot (default settings)\r\n", (unsigned long)prof_ready_ms);
+    }
+}
+
+static void prof_print(const char *name) {
+    Radio_Settings s;
+    if (!prof_read(name, &s)) {
+        Serial.printf("%-12s unreadable (other version?)\r\n", name);
+        return;
+    }
+    if (s.mode == RADIO_MODE_LORA) {
+        Serial.printf("%-12s LoRa %.3f MHz SF%u BW%.1f CR4/%u %d dBm sync 0x%02X pre %u",
+                      name, s.lora_freq, s.sf, s.lora_bw, s.cr, s.lora_power, s.lora_sync, s.lora_preamble);
+    } else {
+        Serial.printf("%-12s FSK %.3f MHz %.1f kbps dev %.1f kHz BW%.1f %d dBm pre %u",
+                      name, s.fsk_freq, s.fsk_bitrate, s.fsk_dev, s.fsk_bw, s.fsk_power, s.fsk_preamble);
+    }
+    Serial.printf(", FHSS %.3f-%.3f/%.3f x%u%s\r\n", s.fh_start, s.fh_end, s.fh_step, s.fh_num,
+                  strcmp(name, prof_boot) == 0 ? " [boot]" : "");
+}
+
+// AT+PROFILE=SAVE,name | LOAD,name | DEL,name | BOOT,name | BOOT,NONE | ?
+void handle_at_profile(const AT_Command *cmd) {
+    if (strcmp(cmd->params, "?") == 0) {
+        for (int i = 0; i < PROFILE_MAX; i++) {
+            if (prof_names[i][0]) prof_print(prof_names[i]);
+        }
+        Serial.printf("Boot profile: %s, ready %lu ms after boot, last apply %lu us\r\n",
+                      prof_boot[0] ? prof_boot : "none", (unsigned long)prof_ready_ms, (unsigned long)prof_apply_us);
+        return;
+    }
+
+    char buf[48];
+    strncpy(buf, cmd->params, sizeof(buf)-1);
+    buf[sizeof(buf)-1] = 0;
+    char *op = strtok(buf, ",");
+    char *name = strtok(NULL, ",");
+    if (!op || !name) {
+        Serial.println("ERROR: Need params: SAVE|LOAD|DEL|BOOT,name");
+        return;
+    }
+    if (strcasecmp(op, "BOOT") == 0 && strcasecmp(name, "NONE") == 0) {
+        prof_boot[0] = 0;
+        prof_prefs.remove("boot");
+        Serial.println("OK, no boot profile");
+        return;
+    }
+    if (!prof_name_ok(name)) {
+        Serial.printf("ERROR: Name must be 1-%d chars of A-Z a-z 0-9 _ -\r\n", PROFILE_NAME_LEN);
+        return;
+    }
+    int idx = prof_find(name);
+    char key[16];
+    prof_key(key, name);
+
+    if (strcasecmp(op, "SAVE") == 0) {
+        if (idx < 0) {
+            for (int i = 0; i < PROFILE_MAX && idx < 0; i++) {
+                if (!prof_names[i][0]) idx = i;
+            }
+            if (idx < 0) {
+                Serial.println("ERROR: Profile table full, delete one first");
+                return;
+            }
+        }
+        ProfileBlob blob;
+        memset(&blob, 0, sizeof(blob));
+        blob.magic = PROFILE_MAGIC;
+        blob.version = PROFILE_VERSION;
+        blob.len = sizeof(Radio_Settings);
+        lora_get_settings(&blob.s);
+        if (prof_prefs.putBytes(key, &blob, sizeof(blob)) != sizeof(blob)) {
+            Serial.println("ERROR: Unable to write profile");
+            return;
+        }
+        strcpy(prof_names[idx], name);
+        prof_store_names();
+        Serial.printf("OK, profile %s saved (%u bytes)\r\n", name, (unsigned)sizeof(blob));
+    } else if (strcasecmp(op, "LOAD") == 0) {
+        if (idx < 0) {
+            Serial.println("ERROR: No such profile");
+            return;
+        }
+        int state = prof_apply(name);
+        if (state == RADIOLIB_ERR_NONE) {
+            Serial.printf("OK, profile %s applied in %lu us\r\n", name, (unsigned long)prof_apply_us);
+        } else {
+            Serial.print("ERROR: Profile not applied, code ");
+            Serial.println(state);
+        }
+    } else if (strcasecmp(op, "DEL") == 0) {
+        if (idx < 0) {
+            Serial.println("ERROR: No such profile");
+            return;
+        }
+        prof_prefs.remove(key);
+        prof_names[idx][0] = 0;
+        prof_store_names();
+        if (strcmp(prof_boot, name) == 0) {
+            prof_boot[0] = 0;
+            prof_prefs.remove("boot");
+        }
+        Serial.println("OK, profile deleted");
+    } else if (strcasecmp(op, "BOOT") == 0) {
+        if (idx < 0) {
+            Serial.println("ERROR: No such profile");
+            return;
+        }
+        strcpy(prof_boot, name);
+        prof_prefs.putString("boot", prof_boot);
+        Serial.printf("OK, profile %s restored at boot\r\n", name);
+    } else {
+        Serial.println("ERROR: Unknown operation, use SAVE, LOAD, DEL or BOOT");
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include "command.h"
+
+// Named radio profiles in NVS (namespace "radioprof"). Each profile is one
+// blob: a 4-byte header (magic, version, payload length) and Radio_Settings.
+// Blobs with another version or length are refused instead of misread.
+#define PROFILE_MAX         8
+#define PROFILE_NAME_LEN    12      // NVS keys are at most 15 chars ("p:" + name)
+#define PROFILE_MAGIC       0x52    // 'R'
+#define PROFILE_VERSION     1
+
+void init_profile();
+
+void handle_at_profile(const AT_Command *cmd);
+
+#endif // PROFILE_H
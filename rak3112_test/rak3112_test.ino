@@ -14,7 +14,30 @@
 #include "utilities.h"
 #include "WiFi.h"
 #include "command.h"
+#include "console.h"
 #include "lora.h"
+#include "pktbuf.h"
+#include "rx_capture.h"
+#include "rx_output.h"
+#include "rx_stats.h"
+#include "irq_lat.h"
+#include "p2p.h"
+#include "afc.h"
+#include "xfer.h"
+#include "arq.h"
+#include "adr.h"
+#include "compress.h"
+#include "secure.h"
+#include "dualrx.h"
+#include "profile.h"
+#include "sweep.h"
+#include "timebase.h"
+#include "tdma.h"
+#include "collector.h"
+#include "relay.h"
+#include "agg.h"
+#include "txq.h"
+#include "hex.h"
 #include "ble.h"
 #include "rak1904.h"
 #include <U8g2lib.h>	
@@ -153,7 +176,7 @@ void handle_at_bat(const AT_Command *cmd)
 
 void setupBoards(void)
 {
-  Serial.begin(115200);
+  init_console();  // Serial with large buffers, AT+BAUD
 
   Serial.println("setupBoards");
 
@@ -193,6 +216,28 @@ void setup()
   setupBoards();
   init_buzzer();   // 初始化蜂鸣器
   init_lora_radio();
+  init_pktbuf();     // packet buffer pool
+  init_rx_capture(); // RX capture ring (PSRAM)
+  init_rx_output();  // RX output format and filters
+  init_rx_stats();   // RX running statistics
+  init_collector();  // per-node table for collector mode
+  init_irqlat();     // radio IRQ latency histograms
+  init_p2p();        // P2P node id and frame header
+  init_afc();        // frequency offset tracking
+  init_xfer();       // fragmented bulk transfer
+  init_arq();        // reliable P2P send (ARQ)
+  init_adr();        // link adaptation (SF/BW/power)
+  init_compress();   // P2P payload compression
+  init_secure();     // P2P AES-CCM keys and sealing
+  init_dualrx();     // time-sliced LoRa/FSK receive
+  init_sweep();      // SF/BW/power sweep benchmark
+  init_timebase();   // GNSS/beacon disciplined network clock
+  init_tdma();       // slotted TX on the network clock
+  init_relay();      // store-and-forward relay
+  init_agg();        // small payload aggregation
+  init_txq();        // prioritized transmit queue
+  init_hex();        // AT+HEXBENCH
+  init_profile();    // restore the boot radio profile
   init_command();
   init_ble();
   init_rak1904();  // Initialize RAK1904 accelerometer
@@ -213,6 +258,15 @@ void loop()
 {
   receive_packet();
   fhss_auto_hop_send_loop();
+  xfer_loop();
+  arq_loop();
+  adr_loop();
+  sweep_loop();
+  timebase_loop();
+  tdma_loop();
+  relay_loop();
+  agg_loop();
+  txq_loop();
   gpsParseDate();
   test_lcd_touch();
   check_button();
@@ -0,0 +1,306 @@
+#include "relay.h"
+#include "p2p.h"
+#include "afc.h"
+#include "txq.h"
+#include "Arduino.h"
+#include <RadioLib.h>
+#include "command.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// key: src << 32 | seq << 16 | type << 8 | reliable flag, plus
+// RELAY_KEY_OPENED for lookups after opening
+#define RELAY_KEY_OPENED    0x80
+
+struct RelayWay {
+    uint64_t key;
+    uint32_t t_ms;          // 0 = empty
+};
+
+struct RelayEntry {
+    bool used;
+    uint64_t key;
+    uint32_t due_ms;
+    uint32_t rx_ms;
+    bool queued;            // in the TX queue, waiting for its outcome
+    PKT_Buf *buf;           // the received frame, shared with the RX path
+};
+
+static bool rl_on = false;
+static volatile bool rl_flush = false;  // AT+RELAY=0, applied by relay_loop
+static bool rl_dedup = false;           // drop duplicates without relaying
+static uint8_t rl_max_hops = RELAY_DEFAULT_HOPS;
+static uint16_t rl_backoff_ms = RELAY_DEFAULT_BACKOFF;
+
+static RelayWay rl_cache[RELAY_CACHE_BUCKETS][RELAY_CACHE_WAYS];
+static RelayEntry rl_queue[RELAY_QUEUE];
+static uint8_t rl_depth = 0;
+
+struct RelayStats {
+    uint32_t lookups;
+    uint32_t hits;          // duplicates dropped
+    uint32_t evictions;     // live entries overwritten before their TTL
+    uint32_t own;           // our own frames heard back
+    uint32_t queued;
+    uint32_t sent;          // on air
+    uint32_t lost;          // TX failed, or expired or evicted in the TX queue
+    uint32_t suppressed;    // copy heard before it went on air
+    uint32_t full;          // relay or TX queue full
+    uint32_t hop_limit;     // not relayed, hop limit reached
+    uint32_t lat_min;
+    uint32_t lat_max;
+    uint64_t lat_sum;
+    uint32_t depth_max;
+    uint32_t depth_sum;     // depth at enqueue, for the mean
+};
+static RelayStats rl_st;
+
+static void relay_reset_stats() {
+    memset(&rl_st, 0, sizeof(rl_st));
+}
+
+static uint64_t relay_key(const P2P_Header *hdr, bool opened) {
+    return ((uint64_t)hdr->src << 32) | ((uint32_t)hdr->seq << 16) | ((uint32_t)hdr->type << 8) |
+           (hdr->flags & P2P_FLAG_RELIABLE) | (opened ? RELAY_KEY_OPENED : 0);
+}
+
+// Returns true when key was seen within the TTL, otherwise records it
+static bool relay_cache_seen(uint64_t key, uint32_t now) {
+    uint32_t h = (uint32_t)(key ^ (key >> 32)) * 2654435761u;
+    RelayWay *b = rl_cache[(h >> 16) & (RELAY_CACHE_BUCKETS - 1)];
+    RelayWay *victim = NULL;
+    for (int w = 0; w < RELAY_CACHE_WAYS; w++) {
+        bool live = b[w].t_ms && now - b[w].t_ms < RELAY_CACHE_TTL_MS;
+        if (live && b[w].key == key) return true;
+        if (!live) {
+            if (!victim || victim->t_ms) victim = &b[w];
+        } else if (!victim || (victim->t_ms && (int32_t)(b[w].t_ms - victim->t_ms) < 0)) {
+            victim = &b[w];
+        }
+    }
+    if (victim->t_ms && now - victim->t_ms < RELAY_CACHE_TTL_MS) rl_st.evictions++;
+    victim->key = key;
+    victim->t_ms = now | 1;
+    return false;
+}
+
+static RelayEntry *relay_queued(uint64_t key) {
+    for (int i = 0; i < RELAY_QUEUE; i++) {
+        if (rl_queue[i].used && rl_queue[i].key == key) return &rl_queue[i];
+    }
+    return NULL;
+}
+
+static void relay_drop(RelayEntry *e) {
+    pkt_unref(e->buf);
+    e->buf = NULL;
+    e->used = false;
+    e->queued = false;
+    rl_depth--;
+}
+
+// Count a forwarded frame once the TX queue is done with it; latency runs
+// from reception to TX done
+static void relay_collect(RelayEntry *e) {
+    uint8_t state = __atomic_load_n(&e->buf->tx_state, __ATOMIC_ACQUIRE);
+    if (state == PKT_TX_PENDING) return;
+    if (state == PKT_TX_SENT) {
+        uint32_t lat = e->buf->tx_ms - e->rx_ms;
+        if (rl_st.sent == 0 || lat < rl_st.lat_min) rl_st.lat_min = lat;
+        if (lat > rl_st.lat_max) rl_st.lat_max = lat;
+        rl_st.lat_sum += lat;
+        rl_st.sent++;
+    } else {
+        rl_st.lost++;
+    }
+    relay_drop(e);
+}
+
+static void relay_enqueue(PKT_Buf *rx, uint64_t key, uint32_t now) {
+    RelayEntry *e = NULL;
+    for (int i = 0; i < RELAY_QUEUE && !e; i++) {
+        if (!rl_queue[i].used) e = &rl_queue[i];
+    }
+    if (!e) {
+        rl_st.full++;
+        return;
+    }
+    e->buf = pkt_ref(rx);
+    e->key = key;
+    e->rx_ms = now;
+    e->due_ms = now + (rl_backoff_ms ? esp_random() % (rl_backoff_ms + 1) : 0);
+    e->queued = false;
+    e->used = true;
+    rl_depth++;
+    rl_st.queued++;
+    rl_st.depth_sum += rl_depth;
+    if (rl_depth > rl_st.depth_max) rl_st.depth_max = rl_depth;
+}
+
+// Air frame, before unwrap. Returns true for a duplicate, which then goes
+// no further up the RX path; broadcasts always go on to be opened. A frame
+// to forward is kept by reference, so the RX path must unshare it before
+// changing it.
+bool relay_on_rx(PKT_Buf *rx, const RX_Packet_Info *info) {
+    if (!rl_on && !rl_dedup) return false;
+    P2P_Header hdr;
+    if (!p2p_parse(rx->data, rx->len, &hdr)) return false;
+    if (hdr.src == g_node_id) {
+        rl_st.own++;
+        return true;
+    }
+    // ours to open: nothing to relay, the lookup waits for relay_on_opened
+    if (hdr.dst == g_node_id) return false;
+    uint64_t key = relay_key(&hdr, false);
+    uint32_t now = info->t_ms;
+    rl_st.lookups++;
+    bool seen = relay_cache_seen(key, now);
+    // ARQ retries repeat the sequence; a copy straight from the source
+    // that asks for an ack is taken as a retry, not a duplicate
+    bool retry = seen && hdr.hops == 0 && (hdr.flags & P2P_FLAG_ACKREQ);
+    if (seen && !retry) {
+        rl_st.hits++;
+        RelayEntry *e = relay_queued(key);
+        if (e && (!e->queued || txq_cancel(e->buf))) {
+            // someone else got there first
+            relay_drop(e);
+            rl_st.suppressed++;
+        }
+        // a broadcast copy is ours too: relay_on_opened decides on it
+        return hdr.dst != P2P_BROADCAST;
+    }
+    if (rl_on && !relay_queued(key)) {
+        if (hdr.hops >= rl_max_hops) {
+            rl_st.hop_limit++;
+        } else {
+            relay_enqueue(rx, key, now);
+        }
+    }
+    return false;
+}
+
+// Frame addressed to this node or broadcast, after unwrap. Returns true
+// for a duplicate to drop. Reliable and ack-requesting frames always pass,
+// also when a retry arrives through a relay: their handlers ack it again
+// and drop the duplicate themselves.
+bool relay_on_opened(const uint8_t *frame, size_t len, const RX_Packet_Info *info) {
+    if (!rl_on && !rl_dedup) return false;
+    P2P_Header hdr;
+    if (!p2p_parse(frame, len, &hdr) || hdr.src == g_node_id) return false;
+    if (hdr.dst != g_node_id && hdr.dst != P2P_BROADCAST) return false;
+    rl_st.lookups++;
+    if (!relay_cache_seen(relay_key(&hdr, true), info->t_ms)) return false;
+    if (hdr.flags & (P2P_FLAG_RELIABLE | P2P_FLAG_ACKREQ)) return false;
+    rl_st.hits++;
+    return true;
+}
+
+// Collect the outcome of frames in the TX queue and hand over one frame
+// whose backoff is up. The entry keeps a reference to the submitted frame,
+// so a copy heard meanwhile can still withdraw it.
+void relay_loop() {
+    if (rl_flush) {
+        rl_flush = false;
+        for (int i = 0; i < RELAY_QUEUE; i++) {
+            if (rl_queue[i].used) relay_drop(&rl_queue[i]);
+        }
+    }
+    if (!rl_depth) return;
+    uint32_t now = millis();
+    bool submitted = false;
+    for (int i = 0; i < RELAY_QUEUE; i++) {
+        RelayEntry *e = &rl_queue[i];
+        if (!e->used) continue;
+        if (e->queued) {
+            relay_collect(e);
+            continue;
+        }
+        if (submitted || (int32_t)(now - e->due_ms) < 0) continue;
+        submitted = true;       // one frame per loop
+        PKT_Buf *buf = pkt_unshare(e->buf);
+        if (!buf) continue;     // pool empty, try again next loop
+        e->buf = buf;
+        buf->data[3]++;         // hops
+        int state = txq_submit_buf(TXQ_NORMAL, pkt_ref(buf), afc_rx_peer(), 0, 0);
+        if (state == RADIOLIB_ERR_NONE) {
+            e->queued = true;
+        } else {
+            pkt_unref(buf);
+            relay_drop(e);
+            rl_st.full++;
+        }
+    }
+}
+
+void init_relay() {
+    memset(rl_cache, 0, sizeof(rl_cache));
+    memset(rl_queue, 0, sizeof(rl_queue));
+    relay_reset_stats();
+    register_at_handler("AT+RELAY", handle_at_relay, "Store-and-forward relay: AT+RELAY=1[,max hops[,backoff ms]], AT+RELAY=0, AT+RELAY=DEDUP,0|1, AT+RELAY=CLR or AT+RELAY=?");
+}
+
+static void relay_print() {
+    Serial.printf("RELAY: %s, max hops %u, backoff 0-%u ms, dedup %s\r\n", rl_on ? "ON" : "OFF", rl_max_hops,
+                  rl_backoff_ms, (rl_on || rl_dedup) ? "ON" : "OFF");
+    Serial.printf("Cache: %d x %d entries (%u bytes), TTL %d s, lookups %lu, hits %lu (%.1f%%), early evictions %lu\r\n",
+                  RELAY_CACHE_BUCKETS, RELAY_CACHE_WAYS, (unsigned)sizeof(rl_cache), RELAY_CACHE_TTL_MS / 1000,
+                  (unsigned long)rl_st.lookups, (unsigned long)rl_st.hits,
+                  rl_st.lookups ? 100.0f * rl_st.hits / rl_st.lookups : 0.0f, (unsigned long)rl_st.evictions);
+    Serial.printf("Queue: depth %u (max %lu, avg %.2f at enqueue), queued %lu, full %lu, hop limit %lu, own echoes %lu\r\n",
+                  rl_depth, (unsigned long)rl_st.depth_max,
+                  rl_st.queued ? (float)rl_st.depth_sum / rl_st.queued : 0.0f, (unsigned long)rl_st.queued,
+                  (unsigned long)rl_st.full, (unsigned long)rl_st.hop_limit, (unsigned long)rl_st.own);
+    Serial.printf("Relayed %lu, lost %lu, suppressed %lu, latency to TX done min %lu avg %lu max %lu ms\r\n",
+                  (unsigned long)rl_st.sent, (unsigned long)rl_st.lost, (unsigned long)rl_st.suppressed,
+                  (unsigned long)rl_st.lat_min,
+                  (unsigned long)(rl_st.sent ? rl_st.lat_sum / rl_st.sent : 0), (unsigned long)rl_st.lat_max);
+}
+
+// AT+RELAY=1[,max hops[,backoff ms]] / 0 / DEDUP,0|1 / CLR / ?
+void handle_at_relay(const AT_Command *cmd) {
+    if (strcmp(cmd->params, "?") == 0) {
+        relay_print();
+        return;
+    }
+    if (strcasecmp(cmd->params, "CLR") == 0) {
+        relay_reset_stats();
+        Serial.println("OK, relay statistics cleared");
+        return;
+    }
+    if (strncasecmp(cmd->params, "DEDUP,", 6) == 0) {
+        rl_dedup = atoi(cmd->params + 6) != 0;
+        Serial.print("OK, duplicate suppression ");
+        Serial.println(rl_dedup ? "ON" : "OFF");
+        return;
+    }
+
+    char buf[32];
+    strncpy(buf, cmd->params, sizeof(buf)-1);
+    buf[sizeof(buf)-1] = 0;
+    char *p = strtok(buf, ",");
+    if (!p) {
+        Serial.println("ERROR: Need params: on[,max hops[,backoff ms]]");
+        return;
+    }
+    int on = atoi(p);
+    char *s_hops = strtok(NULL, ",");
+    char *s_backoff = strtok(NULL, ",");
+    long hops = s_hops ? atol(s_hops) : RELAY_DEFAULT_HOPS;
+    long backoff = s_backoff ? atol(s_backoff) : RELAY_DEFAULT_BACKOFF;
+    if (hops < 1 || hops > 15 || backoff < 0 || backoff > 10000) {
+        Serial.println("ERROR: Max hops 1-15, backoff 0-10000 ms");
+        return;
+    }
+    if (on) {
+        rl_max_hops = (uint8_t)hops;
+        rl_backoff_ms = (uint16_t)backoff;
+        rl_on = true;
+        Serial.printf("OK, RELAY ON, max hops %u, backoff 0-%u ms\r\n", rl_max_hops, rl_backoff_ms);
+    } else {
+        // the queue belongs to loop(), which empties it
+        rl_on = false;
+        rl_flush = true;
+        Serial.println("OK, RELAY OFF");
+    }
+}
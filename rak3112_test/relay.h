@@ -0,0 +1,40 @@
+#ifndef RELAY_H
+#define RELAY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "command.h"
+#include "lora.h"
+#include "pktbuf.h"
+
+// Store-and-forward relay. P2P frames not addressed to us are re-broadcast
+// unchanged (still sealed, so the relay needs no keys) after a random
+// backoff, with the header hops field counting the relays passed. The
+// sealing AAD zeroes hops, so the tag stays valid.
+//
+// Duplicates are found in a set-associative cache of (source, sequence,
+// type, reliable flag), so ARQ and other sequence spaces of one source do
+// not collide: fixed memory, one bucket probed per lookup, entries expire after the TTL
+// and the oldest way of a full bucket is overwritten. A queued frame whose
+// copy is heard from another relay before it goes on air is dropped, also
+// once it waits in the TX queue; it counts as relayed at TX done. Frames
+// addressed to this node are looked up only once they have been opened
+// (relay_on_opened), so forged copies cannot poison the cache, and reliable
+// or ack-requesting ones always go on to ARQ, which acks retries itself.
+// Broadcasts are both: the air copy decides on relaying, local delivery is
+// deduplicated after opening, under a separate key.
+#define RELAY_CACHE_BUCKETS     128     // power of two
+#define RELAY_CACHE_WAYS        4
+#define RELAY_CACHE_TTL_MS      30000
+#define RELAY_QUEUE             8
+#define RELAY_DEFAULT_HOPS      1
+#define RELAY_DEFAULT_BACKOFF   200     // ms, upper bound of the random backoff
+
+void init_relay();
+void relay_loop();
+bool relay_on_rx(PKT_Buf *rx, const RX_Packet_Info *info);
+bool relay_on_opened(const uint8_t *frame, size_t len, const RX_Packet_Info *info);
+
+void handle_at_relay(const AT_Command *cmd);
+
+#endif // RELAY_H
@@ -0,0 +1,295 @@
+#include "rx_capture.h"
+#include "Arduino.h"
+#include "command.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// One captured frame. seq == 0 marks a slot that is empty or being written,
+// so the AT task can copy slots while the RX path keeps filling the ring.
+struct RxCapEntry {
+    volatile uint32_t seq;
+    uint32_t t_ms;
+    int16_t rssi_x10;   // dBm * 10
+    int8_t snr_x4;      // dB * 4 (SX1262 SNR resolution is 0.25 dB)
+    uint8_t len;
+    uint8_t data[RXCAP_MAX_PAYLOAD];
+};
+
+static RxCapEntry *cap_ring = NULL;
+static uint32_t cap_size = 0;
+static bool cap_in_psram = false;
+static volatile bool cap_enabled = false;
+static volatile bool cap_quiet = false;
+static volatile uint32_t cap_next_seq = 1;  // seq of the next frame written
+static volatile uint32_t cap_base_seq = 1;  // frames before this were cleared
+
+static bool snap_valid = false;
+static uint32_t snap_first = 0;
+static uint32_t snap_last = 0;
+
+static RX_Capture_Filter cap_filter = {0, RXCAP_MAX_PAYLOAD, -200.0f, 0, 0xFFFFFFFF};
+
+static bool rx_capture_alloc() {
+    if (cap_ring) return true;
+    size_t entries = RXCAP_ENTRIES;
+    if (psramFound()) {
+        cap_ring = (RxCapEntry *)ps_malloc(entries * sizeof(RxCapEntry));
+        cap_in_psram = (cap_ring != NULL);
+    }
+    if (!cap_ring) {
+        entries = RXCAP_FALLBACK_ENTRIES;
+        cap_ring = (RxCapEntry *)malloc(entries * sizeof(RxCapEntry));
+    }
+    if (!cap_ring) return false;
+    for (size_t i = 0; i < entries; i++) cap_ring[i].seq = 0;
+    cap_size = entries;
+    return true;
+}
+
+static uint32_t rx_capture_oldest() {
+    uint32_t next = cap_next_seq;
+    uint32_t oldest = next > cap_size ? next - cap_size : 1;
+    return oldest > cap_base_seq ? oldest : cap_base_seq;
+}
+
+// Copy a slot out, returns false if it was overwritten while copying
+static bool rx_capture_read(uint32_t seq, RxCapEntry *out) {
+    const RxCapEntry *e = &cap_ring[seq % cap_size];
+    if (e->seq != seq) return false;
+    __sync_synchronize();
+    memcpy((void *)out, (const void *)e, sizeof(RxCapEntry));
+    __sync_synchronize();
+    return e->seq == seq && out->seq == seq;
+}
+
+static bool rx_capture_match(const RxCapEntry *e) {
+    if (e->len < cap_filter.min_len || e->len > cap_filter.max_len) return false;
+    if (e->rssi_x10 < (int16_t)(cap_filter.min_rssi * 10)) return false;
+    if (e->t_ms < cap_filter.t_from || e->t_ms > cap_filter.t_to) return false;
+    return true;
+}
+
+size_t rx_record_encode(uint8_t *out, uint32_t seq, uint32_t t_ms, int16_t rssi_x10, int8_t snr_x4,
+                        const uint8_t *data, uint8_t len) {
+    size_t n = 0;
+    out[n++] = RXCAP_SYNC0;
+    out[n++] = RXCAP_SYNC1;
+    memcpy(&out[n], &seq, 4); n += 4;
+    memcpy(&out[n], &t_ms, 4); n += 4;
+    memcpy(&out[n], &rssi_x10, 2); n += 2;
+    out[n++] = (uint8_t)snr_x4;
+    out[n++] = len;
+    memcpy(&out[n], data, len); n += len;
+    uint8_t x = 0;
+    for (size_t i = 2; i < n; i++) x ^= out[i];
+    out[n++] = x;
+    return n;
+}
+
+bool rx_capture_enabled() {
+    return cap_enabled;
+}
+
+bool rx_capture_quiet() {
+    return cap_enabled && cap_quiet;
+}
+
+// Called from the RX path for every good frame; single writer
+void rx_capture_push(const uint8_t *data, const RX_Packet_Info *info) {
+    if (!cap_enabled || !cap_ring) return;
+
+    uint32_t seq = cap_next_seq;
+    RxCapEntry *e = &cap_ring[seq % cap_size];
+    e->seq = 0;
+    __sync_synchronize();
+    e->t_ms = info->t_ms;
+    e->rssi_x10 = (int16_t)(info->rssi * 10);
+    e->snr_x4 = (int8_t)constrain((int)(info->snr * 4), -128, 127);
+    e->len = info->len > RXCAP_MAX_PAYLOAD ? RXCAP_MAX_PAYLOAD : info->len;
+    memcpy(e->data, data, e->len);
+    __sync_synchronize();
+    e->seq = seq;
+    cap_next_seq = seq + 1;
+}
+
+void init_rx_capture() {
+    register_at_handler("AT+RXCAP", handle_at_rxcap, "Set/query RX capture ring, e.g. AT+RXCAP=1 (on), AT+RXCAP=1,1 (on, no hex dump), AT+RXCAP=0 or AT+RXCAP=?");
+    register_at_handler("AT+RXCAPCLR", handle_at_rxcap_clear, "Clear the RX capture ring");
+    register_at_handler("AT+RXSNAP", handle_at_rxsnap, "Snapshot the RX capture ring and summarize it");
+    register_at_handler("AT+RXFILT", handle_at_rxfilt, "Set/query snapshot filter: AT+RXFILT=minlen,maxlen,minrssi[,t_from,t_to] or AT+RXFILT=CLR or AT+RXFILT=?");
+    register_at_handler("AT+RXDUMP", handle_at_rxdump, "Stream filtered snapshot as binary records, e.g. AT+RXDUMP or AT+RXDUMP=100");
+}
+
+// AT+RXCAP=1[,quiet] / AT+RXCAP=0 / AT+RXCAP=?
+void handle_at_rxcap(const AT_Command *cmd) {
+    if (strcmp(cmd->params, "?") == 0) {
+        Serial.print("RXCAP: "); Serial.print(cap_enabled ? "ON" : "OFF");
+        Serial.print(", quiet="); Serial.println(cap_quiet ? 1 : 0);
+        if (cap_ring) {
+            uint32_t oldest = rx_capture_oldest();
+            Serial.printf("Ring: %lu slots x %u bytes in %s\r\n",
+                          (unsigned long)cap_size, (unsigned)sizeof(RxCapEntry), cap_in_psram ? "PSRAM" : "internal RAM");
+            Serial.printf("Stored: %lu, total captured: %lu\r\n",
+                          (unsigned long)(cap_next_seq - oldest), (unsigned long)(cap_next_seq - 1));
+        } else {
+            Serial.println("Ring: not allocated");
+        }
+        return;
+    }
+
+    char buf[32];
+    strncpy(buf, cmd->params, sizeof(buf)-1);
+    buf[sizeof(buf)-1] = 0;
+    char *p = strtok(buf, ",");
+    if (!p) {
+        Serial.println("ERROR: Need params: on[,quiet]");
+        return;
+    }
+    int on = atoi(p);
+    p = strtok(NULL, ",");
+    int quiet = p ? atoi(p) : 0;
+
+    if (on) {
+        if (!rx_capture_alloc()) {
+            Serial.println("ERROR: Unable to allocate capture ring");
+            return;
+        }
+        cap_quiet = quiet != 0;
+        cap_enabled = true;
+        Serial.printf("OK, RXCAP ON, %lu slots in %s%s\r\n", (unsigned long)cap_size,
+                      cap_in_psram ? "PSRAM" : "internal RAM", cap_quiet ? ", quiet" : "");
+    } else {
+        cap_enabled = false;
+        Serial.println("OK, RXCAP OFF");
+    }
+}
+
+void handle_at_rxcap_clear(const AT_Command *cmd) {
+    cap_base_seq = cap_next_seq;
+    snap_valid = false;
+    Serial.println("OK, RX capture ring cleared");
+}
+
+void handle_at_rxsnap(const AT_Command *cmd) {
+    if (!cap_ring) {
+        Serial.println("ERROR: Capture ring not allocated, use AT+RXCAP=1 first");
+        return;
+    }
+    snap_first = rx_capture_oldest();
+    snap_last = cap_next_seq - 1;
+    snap_valid = true;
+
+    uint32_t total = snap_last + 1 - snap_first;
+    uint32_t matched = 0;
+    uint32_t t_min = 0xFFFFFFFF, t_max = 0;
+    int16_t rssi_min = 32767, rssi_max = -32768;
+    static RxCapEntry e;
+    for (uint32_t seq = snap_first; seq <= snap_last; seq++) {
+        if (!rx_capture_read(seq, &e) || !rx_capture_match(&e)) continue;
+        matched++;
+        if (e.t_ms < t_min) t_min = e.t_ms;
+        if (e.t_ms > t_max) t_max = e.t_ms;
+        if (e.rssi_x10 < rssi_min) rssi_min = e.rssi_x10;
+        if (e.rssi_x10 > rssi_max) rssi_max = e.rssi_x10;
+    }
+
+    Serial.printf("Snapshot: seq %lu..%lu, %lu frames, %lu match filter\r\n",
+                  (unsigned long)snap_first, (unsigned long)snap_last, (unsigned long)total, (unsigned long)matched);
+    if (matched > 0) {
+        Serial.printf("Time: %lu..%lu ms, RSSI: %.1f..%.1f dBm\r\n",
+                      (unsigned long)t_min, (unsigned long)t_max, rssi_min / 10.0, rssi_max / 10.0);
+    }
+    Serial.println("OK");
+}
+
+// AT+RXFILT=minlen,maxlen,minrssi[,t_from,t_to] / AT+RXFILT=CLR / AT+RXFILT=?
+void handle_at_rxfilt(const AT_Command *cmd) {
+    if (strcmp(cmd->params, "?") == 0) {
+        Serial.printf("RXFILT: len=%u..%u, rssi>=%.1f dBm, t=%lu..%lu ms\r\n",
+                      cap_filter.min_len, cap_filter.max_len, cap_filter.min_rssi,
+                      (unsigned long)cap_filter.t_from, (unsigned long)cap_filter.t_to);
+        return;
+    }
+    if (strcasecmp(cmd->params, "CLR") == 0) {
+        cap_filter.min_len = 0;
+        cap_filter.max_len = RXCAP_MAX_PAYLOAD;
+        cap_filter.min_rssi = -200.0f;
+        cap_filter.t_from = 0;
+        cap_filter.t_to = 0xFFFFFFFF;
+        Serial.println("OK, RXFILT cleared");
+        return;
+    }
+
+    char buf[96];
+    strncpy(buf, cmd->params, sizeof(buf)-1);
+    buf[sizeof(buf)-1] = 0;
+    char *p = strtok(buf, ",");
+    char *vals[5] = {0};
+    int idx = 0;
+    while (p && idx < 5) {
+        vals[idx++] = p;
+        p = strtok(NULL, ",");
+    }
+    if (idx != 3 && idx != 5) {
+        Serial.println("ERROR: Need params: minlen,maxlen,minrssi[,t_from,t_to]");
+        return;
+    }
+    int min_len = atoi(vals[0]);
+    int max_len = atoi(vals[1]);
+    if (min_len < 0 || max_len > RXCAP_MAX_PAYLOAD || min_len > max_len) {
+        Serial.println("ERROR: Invalid length range");
+        return;
+    }
+    uint32_t t_from = 0, t_to = 0xFFFFFFFF;
+    if (idx == 5) {
+        t_from = strtoul(vals[3], NULL, 10);
+        t_to = strtoul(vals[4], NULL, 10);
+        if (t_from > t_to) {
+            Serial.println("ERROR: Invalid time range");
+            return;
+        }
+    }
+    cap_filter.min_len = min_len;
+    cap_filter.max_len = max_len;
+    cap_filter.min_rssi = atof(vals[2]);
+    cap_filter.t_from = t_from;
+    cap_filter.t_to = t_to;
+    Serial.println("OK");
+}
+
+// AT+RXDUMP[=max]: binary records between +RXDUMP:BEGIN and +RXDUMP:END lines
+void handle_at_rxdump(const AT_Command *cmd) {
+    if (!snap_valid) {
+        Serial.println("ERROR: No snapshot, use AT+RXSNAP first");
+        return;
+    }
+    uint32_t limit = 0xFFFFFFFF;
+    if (strlen(cmd->params) > 0) {
+        limit = strtoul(cmd->params, NULL, 10);
+    }
+
+    static RxCapEntry e;
+    static uint8_t rec[RXCAP_RECORD_MAX];
+    uint32_t sent = 0, lost = 0;
+    uint32_t bytes = 0;
+    unsigned long start = millis();
+
+    Serial.println("+RXDUMP:BEGIN");
+    for (uint32_t seq = snap_first; seq <= snap_last && sent < limit; seq++) {
+        if (!rx_capture_read(seq, &e)) {
+            lost++;
+            continue;
+        }
+        if (!rx_capture_match(&e)) continue;
+
+        size_t n = rx_record_encode(rec, e.seq, e.t_ms, e.rssi_x10, e.snr_x4, e.data, e.len);
+        Serial.write(rec, n);
+        bytes += n;
+        sent++;
+    }
+    unsigned long elapsed = millis() - start;
+    Serial.printf("\r\n+RXDUMP:END %lu records, %lu bytes, %lu lost, %lu ms\r\n",
+                  (unsigned long)sent, (unsigned long)bytes, (unsigned long)lost, elapsed);
+    Serial.println("OK");
+}
@@ -0,0 +1,45 @@
+#ifndef RX_CAPTURE_H
+#define RX_CAPTURE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "command.h"
+#include "lora.h"
+
+// Ring geometry. One slot holds a full SX1262 payload plus metadata, so the
+// default 4096 slots take ~1.1 MB of PSRAM. Without PSRAM a small ring is
+// allocated from internal heap instead.
+#ifndef RXCAP_ENTRIES
+#define RXCAP_ENTRIES           4096
+#endif
+#define RXCAP_FALLBACK_ENTRIES  64
+#define RXCAP_MAX_PAYLOAD       255
+
+// Binary dump record: A5 5A | seq u32 | t_ms u32 | rssi_x10 i16 | snr_x4 i8 | len u8 | data | xor u8
+#define RXCAP_SYNC0             0xA5
+#define RXCAP_SYNC1             0x5A
+#define RXCAP_RECORD_MAX        (2 + 4 + 4 + 2 + 1 + 1 + RXCAP_MAX_PAYLOAD + 1)
+
+// Dump filter, applied when listing/streaming a snapshot
+struct RX_Capture_Filter {
+    uint16_t min_len;
+    uint16_t max_len;
+    float min_rssi;      // dBm
+    uint32_t t_from;     // millis(), inclusive
+    uint32_t t_to;       // millis(), inclusive
+};
+
+void init_rx_capture();
+bool rx_capture_enabled();
+bool rx_capture_quiet();
+void rx_capture_push(const uint8_t *data, const RX_Packet_Info *info);
+size_t rx_record_encode(uint8_t *out, uint32_t seq, uint32_t t_ms, int16_t rssi_x10, int8_t snr_x4,
+                        const uint8_t *data, uint8_t len);
+
+void handle_at_rxcap(const AT_Command *cmd);
+void handle_at_rxcap_clear(const AT_Command *cmd);
+void handle_at_rxsnap(const AT_Command *cmd);
+void handle_at_rxfilt(const AT_Command *cmd);
+void handle_at_rxdump(const AT_Command *cmd);
+
+#endif // RX_CAPTURE_H
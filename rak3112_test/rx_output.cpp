@@ -0,0 +1,218 @@
+#include "rx_output.h"
+#include "rx_capture.h"
+#include "hex.h"
+#include "Arduino.h"
+#include "command.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static int rx_format = RXFMT_VERBOSE;
+static RX_Output_Filter out_filter = {0, 255, -200.0f, {0}, 0, false};
+
+static uint32_t dedupe_hash[RXOUT_DEDUPE_DEPTH];
+static uint8_t dedupe_count = 0;
+static uint8_t dedupe_next = 0;
+
+// Per-format accounting of what actually went out on the console
+static uint32_t fmt_packets[RXFMT_COUNT];
+static uint32_t fmt_bytes[RXFMT_COUNT];
+static uint32_t binary_seq = 0;
+
+static uint32_t drop_len = 0;
+static uint32_t drop_rssi = 0;
+static uint32_t drop_prefix = 0;
+static uint32_t drop_dup = 0;
+
+static const char *fmt_names[RXFMT_COUNT] = {"verbose", "compact", "binary"};
+
+static uint32_t payload_hash(const uint8_t *data, uint16_t len) {
+    uint32_t h = 2166136261u;   // FNV-1a
+    for (uint16_t i = 0; i < len; i++) {
+        h ^= data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void init_rx_output() {
+    register_at_handler("AT+RXFMT", handle_at_rxfmt, "Set/query RX output format: 0=verbose, 1=compact, 2=binary, e.g. AT+RXFMT=1 or AT+RXFMT=?");
+    register_at_handler("AT+RXOUTFILT", handle_at_rxoutfilt, "Set/query RX output filter: AT+RXOUTFILT=minlen,maxlen,minrssi,prefixhex|*,dedupe or AT+RXOUTFILT=CLR or AT+RXOUTFILT=?");
+}
+
+bool rx_output_pass(const uint8_t *data, const RX_Packet_Info *info) {
+    if (info->len < out_filter.min_len || info->len > out_filter.max_len) {
+        drop_len++;
+        return false;
+    }
+    if (info->rssi < out_filter.min_rssi) {
+        drop_rssi++;
+        return false;
+    }
+    if (out_filter.prefix_len > 0) {
+        if (info->len < out_filter.prefix_len || memcmp(data, out_filter.prefix, out_filter.prefix_len) != 0) {
+            drop_prefix++;
+            return false;
+        }
+    }
+    if (out_filter.dedupe) {
+        uint32_t h = payload_hash(data, info->len);
+        for (uint8_t i = 0; i < dedupe_count; i++) {
+            if (dedupe_hash[i] == h) {
+                drop_dup++;
+                return false;
+            }
+        }
+        dedupe_hash[dedupe_next] = h;
+        dedupe_next = (dedupe_next + 1) % RXOUT_DEDUPE_DEPTH;
+        if (dedupe_count < RXOUT_DEDUPE_DEPTH) dedupe_count++;
+    }
+    return true;
+}
+
+static size_t emit_verbose(const uint8_t *data, const RX_Packet_Info *info) {
+    size_t n = 0;
+    n += Serial.println(F("Radio Received packet!"));
+    static const char head[] = "Radio Data (HEX):";
+    static char line[sizeof(head) + 3 * 255 + 2];
+    size_t m = sizeof(head) - 1;
+    memcpy(line, head, m);
+    m += hex_encode_spaced(line + m, data, info->len);
+    line[m++] = '\r';
+    line[m++] = '\n';
+    n += Serial.write((const uint8_t *)line, m);
+
+    n += Serial.print(F("Radio RSSI:"));
+    n += Serial.print(info->rssi);
+    n += Serial.println("dBm");
+    n += Serial.print(F("Radio SNR:"));
+    n += Serial.print(info->snr);
+    n += Serial.println("dB");
+    return n;
+}
+
+static size_t emit_compact(const uint8_t *data, const RX_Packet_Info *info) {
+    static char line[48 + 2 * 255 + 2];
+    int n = snprintf(line, sizeof(line), "+RX:%lu,%.1f,%.2f,%u,",
+                     (unsigned long)info->t_ms, info->rssi, info->snr, info->len);
+    n += hex_encode(line + n, data, info->len);
+    line[n++] = '\r';
+    line[n++] = '\n';
+    return Serial.write((const uint8_t *)line, n);
+}
+
+static size_t emit_binary(const uint8_t *data, const RX_Packet_Info *info) {
+    static uint8_t rec[RXCAP_RECORD_MAX];
+    int16_t rssi_x10 = (int16_t)(info->rssi * 10);
+    int8_t snr_x4 = (int8_t)constrain((int)(info->snr * 4), -128, 127);
+    uint8_t len = info->len > 255 ? 255 : info->len;
+    size_t n = rx_record_encode(rec, ++binary_seq, info->t_ms, rssi_x10, snr_x4, data, len);
+    return Serial.write(rec, n);
+}
+
+void rx_output_emit(const uint8_t *data, const RX_Packet_Info *info) {
+    size_t n;
+    switch (rx_format) {
+    case RXFMT_COMPACT:
+        n = emit_compact(data, info);
+        break;
+    case RXFMT_BINARY:
+        n = emit_binary(data, info);
+        break;
+    default:
+        n = emit_verbose(data, info);
+        break;
+    }
+    fmt_packets[rx_format]++;
+    fmt_bytes[rx_format] += n;
+}
+
+// AT+RXFMT=0|1|2 or AT+RXFMT=?
+void handle_at_rxfmt(const AT_Command *cmd) {
+    if (strcmp(cmd->params, "?") == 0) {
+        Serial.print("Current RXFMT: ");
+        Serial.print(rx_format);
+        Serial.print(" (");
+        Serial.print(fmt_names[rx_format]);
+        Serial.println(")");
+        for (int i = 0; i < RXFMT_COUNT; i++) {
+            float avg = fmt_packets[i] ? (float)fmt_bytes[i] / fmt_packets[i] : 0.0f;
+            Serial.printf("%-8s: %lu pkts, %lu bytes, %.1f bytes/pkt\r\n", fmt_names[i],
+                          (unsigned long)fmt_packets[i], (unsigned long)fmt_bytes[i], avg);
+        }
+        return;
+    }
+    int fmt = atoi(cmd->params);
+    if (fmt >= 0 && fmt < RXFMT_COUNT && isdigit(cmd->params[0])) {
+        rx_format = fmt;
+        Serial.print("OK, RXFMT=");
+        Serial.println(rx_format);
+    } else {
+        Serial.println("ERROR: Invalid RXFMT (0=verbose, 1=compact, 2=binary)");
+    }
+}
+
+// AT+RXOUTFILT=minlen,maxlen,minrssi,prefixhex|*,dedupe / AT+RXOUTFILT=CLR / AT+RXOUTFILT=?
+void handle_at_rxoutfilt(const AT_Command *cmd) {
+    if (strcmp(cmd->params, "?") == 0) {
+        char prefix[2 * RXOUT_PREFIX_MAX + 1] = "*";
+        if (out_filter.prefix_len) prefix[hex_encode(prefix, out_filter.prefix, out_filter.prefix_len)] = 0;
+        Serial.printf("RXOUTFILT: len=%u..%u, rssi>=%.1f dBm, prefix=%s", out_filter.min_len, out_filter.max_len,
+                      out_filter.min_rssi, prefix);
+        Serial.printf(", dedupe=%d\r\n", out_filter.dedupe ? 1 : 0);
+        Serial.printf("Dropped: len=%lu, rssi=%lu, prefix=%lu, dup=%lu\r\n",
+                      (unsigned long)drop_len, (unsigned long)drop_rssi, (unsigned long)drop_prefix, (unsigned long)drop_dup);
+        return;
+    }
+    if (strcasecmp(cmd->params, "CLR") == 0) {
+        out_filter.min_len = 0;
+        out_filter.max_len = 255;
+        out_filter.min_rssi = -200.0f;
+        out_filter.prefix_len = 0;
+        out_filter.dedupe = false;
+        dedupe_count = 0;
+        drop_len = drop_rssi = drop_prefix = drop_dup = 0;
+        Serial.println("OK, RXOUTFILT cleared");
+        return;
+    }
+
+    char buf[96];
+    strncpy(buf, cmd->params, sizeof(buf)-1);
+    buf[sizeof(buf)-1] = 0;
+    char *p = strtok(buf, ",");
+    char *vals[5] = {0};
+    int idx = 0;
+    while (p && idx < 5) {
+        vals[idx++] = p;
+        p = strtok(NULL, ",");
+    }
+    if (idx < 5) {
+        Serial.println("ERROR: Need 5 params: minlen,maxlen,minrssi,prefixhex|*,dedupe");
+        return;
+    }
+    int min_len = atoi(vals[0]);
+    int max_len = atoi(vals[1]);
+    if (min_len < 0 || max_len > 255 || min_len > max_len) {
+        Serial.println("ERROR: Invalid length range");
+        return;
+    }
+
+    uint8_t prefix[RXOUT_PREFIX_MAX];
+    int prefix_len = 0;
+    if (strcmp(vals[3], "*") != 0) {
+        prefix_len = hex_decode(prefix, sizeof(prefix), vals[3], strlen(vals[3]));
+        if (prefix_len < 0) {
+            Serial.println("ERROR: Prefix must be up to 8 hex bytes or *");
+            return;
+        }
+    }
+
+    out_filter.min_len = min_len;
+    out_filter.max_len = max_len;
+    out_filter.min_rssi = atof(vals[2]);
+    memcpy(out_filter.prefix, prefix, prefix_len);
+    out_filter.prefix_len = prefix_len;
+    out_filter.dedupe = atoi(vals[4]) != 0;
+    dedupe_count = 0;
+    Serial.println("OK");
+}
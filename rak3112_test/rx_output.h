@@ -0,0 +1,34 @@
+#ifndef RX_OUTPUT_H
+#define RX_OUTPUT_H
+
+#include <stdint.h>
+#include "command.h"
+#include "lora.h"
+
+// RX console output formats
+#define RXFMT_VERBOSE   0   // "Radio Received packet!" + spaced hex + RSSI/SNR lines
+#define RXFMT_COMPACT   1   // +RX:<t_ms>,<rssi>,<snr>,<len>,<hex>
+#define RXFMT_BINARY    2   // A5 5A framed record, same layout as AT+RXDUMP
+#define RXFMT_COUNT     3
+
+#define RXOUT_PREFIX_MAX    8   // bytes matched by the prefix filter
+#define RXOUT_DEDUPE_DEPTH  8   // recent payload hashes kept for dedupe
+
+// Live output filter, applied before a frame is printed
+struct RX_Output_Filter {
+    uint16_t min_len;
+    uint16_t max_len;
+    float min_rssi;                       // dBm
+    uint8_t prefix[RXOUT_PREFIX_MAX];
+    uint8_t prefix_len;                   // 0 = no prefix match
+    bool dedupe;                          // drop repeats of a recent payload
+};
+
+void init_rx_output();
+bool rx_output_pass(const uint8_t *data, const RX_Packet_Info *info);
+void rx_output_emit(const uint8_t *data, const RX_Packet_Info *info);
+
+void handle_at_rxfmt(const AT_Command *cmd);
+void handle_at_rxoutfilt(const AT_Command *cmd);
+
+#endif // RX_OUTPUT_H
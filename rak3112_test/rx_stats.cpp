@@ -0,0 +1,226 @@
+#include "rx_stats.h"
+#include "p2p.h"
+#include "Arduino.h"
+#include "command.h"
+#include <RadioLib.h>
+#include <esp_heap_caps.h>
+
+#include <math.h>
+#include <string.h>
+
+RX_Stats g_rx_stats;
+
+// Allocation counter. With CONFIG_HEAP_USE_HOOKS the heap calls us on every
+// malloc, so transient String-style alloc/free pairs are caught too. Without
+// hooks we compare allocated block counts around the packet path, which only
+// sees allocations that outlive it, and only when enabled (it walks the heap).
+static TaskHandle_t alloc_watch_task = NULL;
+static volatile uint32_t alloc_hook_hits = 0;
+static bool alloc_blocks_on = false;
+static size_t alloc_blocks_before = 0;
+
+// Last P2P sequence number per sender, so frames that never showed up (no
+// sync, no header) count towards PER too
+struct RX_SeqTrack {
+    bool used;
+    uint16_t src;
+    uint16_t seq;
+    uint32_t last_ms;
+};
+static RX_SeqTrack seq_track[RXSTAT_SEQ_PEERS];
+
+#if CONFIG_HEAP_USE_HOOKS
+extern "C" void esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps) {
+    if (alloc_watch_task && xTaskGetCurrentTaskHandle() == alloc_watch_task) alloc_hook_hits++;
+}
+
+extern "C" void esp_heap_trace_free_hook(void *ptr) {
+}
+#endif
+
+void rx_alloc_watch_begin() {
+#if CONFIG_HEAP_USE_HOOKS
+    alloc_hook_hits = 0;
+    alloc_watch_task = xTaskGetCurrentTaskHandle();
+#else
+    if (alloc_blocks_on) {
+        multi_heap_info_t hi;
+        heap_caps_get_info(&hi, MALLOC_CAP_8BIT);
+        alloc_blocks_before = hi.allocated_blocks;
+    }
+#endif
+}
+
+void rx_alloc_watch_end() {
+#if CONFIG_HEAP_USE_HOOKS
+    alloc_watch_task = NULL;
+    g_rx_stats.alloc_events += alloc_hook_hits;
+#else
+    if (alloc_blocks_on) {
+        multi_heap_info_t hi;
+        heap_caps_get_info(&hi, MALLOC_CAP_8BIT);
+        if (hi.allocated_blocks > alloc_blocks_before) {
+            g_rx_stats.alloc_events += hi.allocated_blocks - alloc_blocks_before;
+        }
+    }
+#endif
+}
+
+static void metric_init(RX_Metric *m, float lo, float step) {
+    memset(m, 0, sizeof(*m));
+    m->lo = lo;
+    m->step = step;
+}
+
+static void metric_add(RX_Metric *m, float v) {
+    if (m->count == 0) {
+        m->ewma = m->min = m->max = v;
+    } else {
+        m->ewma += RXSTAT_EWMA_ALPHA * (v - m->ewma);
+        if (v < m->min) m->min = v;
+        if (v > m->max) m->max = v;
+    }
+    m->count++;
+    int bin = (int)floorf((v - m->lo) / m->step);
+    if (bin < 0) bin = 0;
+    if (bin >= RXSTAT_BINS) bin = RXSTAT_BINS - 1;
+    m->hist[bin]++;
+}
+
+void rx_stats_reset() {
+    memset(&g_rx_stats, 0, sizeof(g_rx_stats));
+    memset(seq_track, 0, sizeof(seq_track));
+    metric_init(&g_rx_stats.rssi, -140.0f, 8.0f);        // -140 .. -12 dBm
+    metric_init(&g_rx_stats.snr, -20.0f, 2.5f);          // -20 .. +20 dB
+    metric_init(&g_rx_stats.freq_err, -16000.0f, 2000.0f); // +-16 kHz
+}
+
+void init_rx_stats() {
+    rx_stats_reset();
+    register_at_handler("AT+RXSTAT", handle_at_rxstat, "Query RX statistics: AT+RXSTAT=? (summary), AT+RXSTAT=HIST, AT+RXSTAT=CLR, AT+RXSTAT=ALLOC,1");
+}
+
+static void seq_update(const uint8_t *frame, size_t len, uint32_t t_ms) {
+    P2P_Header hdr;
+    // reliable DATA repeats its per-peer sequence on retries
+    if (!p2p_parse(frame, len, &hdr) || (hdr.flags & P2P_FLAG_RELIABLE)) return;
+    RX_SeqTrack *t = NULL;
+    RX_SeqTrack *victim = NULL;
+    for (int i = 0; i < RXSTAT_SEQ_PEERS && !t; i++) {
+        if (seq_track[i].used && seq_track[i].src == hdr.src) {
+            t = &seq_track[i];
+        } else if (!victim || !seq_track[i].used || (victim->used && seq_track[i].last_ms < victim->last_ms)) {
+            victim = &seq_track[i];
+        }
+    }
+    if (t) {
+        int16_t d = (int16_t)(hdr.seq - t->seq);
+        if (d > 1 && d < 256) g_rx_stats.lost += d - 1;     // larger jumps: sender restarted
+        if (d <= 0 && d > -256) return;                     // duplicate or reordered
+    } else {
+        t = victim;
+        t->used = true;
+        t->src = hdr.src;
+    }
+    t->seq = hdr.seq;
+    t->last_ms = t_ms;
+}
+
+// Packet path: numbers only, nothing is formatted or allocated here
+void rx_stats_update(const uint8_t *frame, const RX_Packet_Info *info) {
+    if (g_rx_stats.ok == 0) g_rx_stats.first_ms = info->t_ms;
+    g_rx_stats.last_ms = info->t_ms;
+    g_rx_stats.ok++;
+    g_rx_stats.bytes += info->len;
+    metric_add(&g_rx_stats.rssi, info->rssi);
+    // the FSK modem reports neither
+    if (info->mode == RADIO_MODE_LORA) {
+        metric_add(&g_rx_stats.snr, info->snr);
+        metric_add(&g_rx_stats.freq_err, info->freq_err);
+    }
+    seq_update(frame, info->len, info->t_ms);
+}
+
+void rx_stats_error(int state) {
+    if (state == RADIOLIB_ERR_CRC_MISMATCH) {
+        g_rx_stats.crc_err++;
+    } else {
+        g_rx_stats.other_err++;
+    }
+}
+
+static void print_metric(const char *name, const char *unit, const RX_Metric *m) {
+    if (m->count == 0) {
+        Serial.printf("%-8s: no data\r\n", name);
+        return;
+    }
+    Serial.printf("%-8s: ewma=%.2f min=%.2f max=%.2f %s (n=%lu)\r\n",
+                  name, m->ewma, m->min, m->max, unit, (unsigned long)m->count);
+}
+
+static void print_hist(const char *name, const char *unit, const RX_Metric *m) {
+    Serial.printf("%s histogram (%s):\r\n", name, unit);
+    for (int i = 0; i < RXSTAT_BINS; i++) {
+        float lo = m->lo + i * m->step;
+        if (i == 0) {
+            Serial.printf("  < %8.1f : %lu\r\n", lo + m->step, (unsigned long)m->hist[i]);
+        } else if (i == RXSTAT_BINS - 1) {
+            Serial.printf("  >=%8.1f : %lu\r\n", lo, (unsigned long)m->hist[i]);
+        } else {
+            Serial.printf("  %8.1f.. : %lu\r\n", lo, (unsigned long)m->hist[i]);
+        }
+    }
+}
+
+// AT+RXSTAT / AT+RXSTAT=? / AT+RXSTAT=HIST / AT+RXSTAT=CLR / AT+RXSTAT=ALLOC,0|1
+void handle_at_rxstat(const AT_Command *cmd) {
+    if (strcasecmp(cmd->params, "CLR") == 0) {
+        rx_stats_reset();
+        Serial.println("OK, RX statistics cleared");
+        return;
+    }
+    if (strncasecmp(cmd->params, "ALLOC,", 6) == 0) {
+#if CONFIG_HEAP_USE_HOOKS
+        Serial.println("OK, heap hooks active, allocation counter always on");
+#else
+        alloc_blocks_on = atoi(cmd->params + 6) != 0;
+        Serial.print("OK, allocation block counter ");
+        Serial.println(alloc_blocks_on ? "ON" : "OFF");
+#endif
+        return;
+    }
+    if (strcasecmp(cmd->params, "HIST") == 0) {
+        print_hist("RSSI", "dBm", &g_rx_stats.rssi);
+        print_hist("SNR", "dB", &g_rx_stats.snr);
+        print_hist("FreqErr", "Hz", &g_rx_stats.freq_err);
+        return;
+    }
+    if (strlen(cmd->params) != 0 && strcmp(cmd->params, "?") != 0) {
+        Serial.println("ERROR: Use AT+RXSTAT=?, HIST, CLR or ALLOC,0|1");
+        return;
+    }
+
+    uint32_t total = g_rx_stats.ok + g_rx_stats.crc_err + g_rx_stats.other_err;
+    float per = total ? 100.0f * (g_rx_stats.crc_err + g_rx_stats.other_err) / total : 0.0f;
+    uint32_t sent = total + g_rx_stats.lost;
+    float per_lost = sent ? 100.0f * (sent - g_rx_stats.ok) / sent : 0.0f;
+    uint32_t span_ms = g_rx_stats.last_ms - g_rx_stats.first_ms;
+    float tput = span_ms ? g_rx_stats.bytes * 8.0f / span_ms : 0.0f;   // kbps
+
+    Serial.printf("Frames: ok=%lu crc_err=%lu other_err=%lu (error rate %.2f%%)\r\n",
+                  (unsigned long)g_rx_stats.ok, (unsigned long)g_rx_stats.crc_err,
+                  (unsigned long)g_rx_stats.other_err, per);
+    Serial.printf("Lost (P2P sequence gaps): %lu, PER incl. lost %.2f%%\r\n",
+                  (unsigned long)g_rx_stats.lost, per_lost);
+    Serial.printf("Payload: %lu bytes over %lu ms, %.2f kbps\r\n",
+                  (unsigned long)g_rx_stats.bytes, (unsigned long)span_ms, tput);
+    print_metric("RSSI", "dBm", &g_rx_stats.rssi);
+    print_metric("SNR", "dB", &g_rx_stats.snr);
+    print_metric("FreqErr", "Hz", &g_rx_stats.freq_err);
+#if CONFIG_HEAP_USE_HOOKS
+    Serial.printf("Packet path heap allocations: %lu (heap hooks)\r\n", (unsigned long)g_rx_stats.alloc_events);
+#else
+    Serial.printf("Packet path heap allocations: %lu (block counter %s)\r\n",
+                  (unsigned long)g_rx_stats.alloc_events, alloc_blocks_on ? "ON" : "OFF");
+#endif
+}
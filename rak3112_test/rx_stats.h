@@ -0,0 +1,51 @@
+#ifndef RX_STATS_H
+#define RX_STATS_H
+
+#include <stdint.h>
+#include "command.h"
+#include "lora.h"
+
+#define RXSTAT_BINS         16
+#define RXSTAT_EWMA_ALPHA   0.125f
+#define RXSTAT_SEQ_PEERS    8       // senders tracked for sequence gaps
+
+// Running statistics for one metric: EWMA, extremes and a fixed-bin histogram.
+// Values below lo land in bin 0, values past the last bin in bin RXSTAT_BINS-1.
+struct RX_Metric {
+    float lo;          // lower edge of bin 0
+    float step;        // bin width
+    float ewma;
+    float min;
+    float max;
+    uint32_t count;
+    uint32_t hist[RXSTAT_BINS];
+};
+
+struct RX_Stats {
+    uint32_t ok;             // frames read without error
+    uint32_t crc_err;        // CRC mismatches
+    uint32_t other_err;      // any other readData failure
+    uint32_t lost;           // P2P frames never received (sequence gaps)
+    uint32_t bytes;          // payload bytes of good frames
+    uint32_t first_ms;       // millis() of the first good frame
+    uint32_t last_ms;        // millis() of the latest good frame
+    RX_Metric rssi;          // dBm
+    RX_Metric snr;           // dB
+    RX_Metric freq_err;      // Hz
+    uint32_t alloc_events;   // heap allocations seen on the packet path
+};
+
+extern RX_Stats g_rx_stats;
+
+void init_rx_stats();
+void rx_stats_reset();
+void rx_stats_update(const uint8_t *frame, const RX_Packet_Info *info);
+void rx_stats_error(int state);
+
+// Bracket the packet path to count heap allocations made by the calling task
+void rx_alloc_watch_begin();
+void rx_alloc_watch_end();
+
+void handle_at_rxstat(const AT_Command *cmd);
+
+#endif // RX_STATS_H
@@ -0,0 +1,444 @@
+#include "secure.h"
+#include "aes_ccm.h"
+#include "lora.h"
+#include "p2p.h"
+#include "hex.h"
+#include "Arduino.h"
+#include <Preferences.h>
+#include "command.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct SecKey {
+    bool used;
+    uint16_t peer;
+    AES_CCM_Ctx ccm;
+    uint32_t tx_ctr;
+    uint32_t tx_reserved;       // counters below this are already persisted
+};
+
+struct SecReplay {
+    bool used;
+    bool seen;                  // high and bitmap are valid
+    uint8_t key;                // index into sec_keys
+    uint16_t src;
+    uint32_t high;              // highest counter accepted
+    uint32_t bitmap;            // bit i: high - i accepted
+    uint32_t floor;             // counters below this are refused
+    uint32_t reserved;          // persisted floor for the next boot
+    uint32_t last_ms;
+};
+
+static bool sec_on = false;
+static bool sec_strict = false;
+static SecKey sec_keys[SEC_MAX_KEYS];
+static SecReplay sec_replay[SEC_MAX_REPLAY];
+static SEC_Stats sec_stats;
+static Preferences sec_prefs;
+// Frames are sealed from loop(), the AT task and the FSK stream task: the
+// key table, TX counters and replay windows are only touched under this.
+static SemaphoreHandle_t sec_lock = NULL;
+
+static void put_u32(uint8_t *p, uint32_t v) { p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24; }
+static uint32_t get_u32(const uint8_t *p) { return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); }
+
+static SecKey *sec_key_for(uint16_t peer) {
+    for (int i = 0; i < SEC_MAX_KEYS; i++) {
+        if (sec_keys[i].used && sec_keys[i].peer == peer) return &sec_keys[i];
+    }
+    return NULL;
+}
+
+static void sec_nvs_name(char *out, char kind, uint16_t peer) {
+    snprintf(out, 8, "%c%04x", kind, peer);
+}
+
+// RX floor of sender src under the key of peer
+static void sec_nvs_floor_name(char *out, uint16_t peer, uint16_t src) {
+    snprintf(out, 12, "r%04x%04x", peer, src);
+}
+
+static uint32_t sec_load_floor(uint8_t key, uint16_t src) {
+    char name[12];
+    sec_nvs_floor_name(name, sec_keys[key].peer, src);
+    return sec_prefs.getUInt(name, 0);
+}
+
+static void sec_store_peers() {
+    uint16_t ids[SEC_MAX_KEYS];
+    int n = 0;
+    for (int i = 0; i < SEC_MAX_KEYS; i++) {
+        if (sec_keys[i].used) ids[n++] = sec_keys[i].peer;
+    }
+    sec_prefs.putBytes("peers", ids, n * sizeof(uint16_t));
+}
+
+// Persist the next block of counters before using any of it
+static void sec_reserve(SecKey *k) {
+    char name[8];
+    k->tx_reserved = k->tx_ctr + SEC_CTR_RESERVE;
+    sec_nvs_name(name, 'c', k->peer);
+    sec_prefs.putUInt(name, k->tx_reserved);
+}
+
+static SecKey *sec_install(uint16_t peer, const uint8_t *key, uint32_t tx_ctr) {
+    SecKey *k = sec_key_for(peer);
+    if (k) {
+        aes_ccm_free(&k->ccm);
+    } else {
+        for (int i = 0; i < SEC_MAX_KEYS && !k; i++) {
+            if (!sec_keys[i].used) k = &sec_keys[i];
+        }
+        if (!k) return NULL;
+        k->tx_ctr = tx_ctr;
+    }
+    k->used = true;
+    k->peer = peer;
+    aes_ccm_init(&k->ccm, key);
+    // windows belong to the old key; floors stay in NVS, since sender
+    // counters carry on across keys
+    for (int i = 0; i < SEC_MAX_REPLAY; i++) {
+        if (sec_replay[i].used && sec_replay[i].key == k - sec_keys) sec_replay[i].used = false;
+    }
+    sec_reserve(k);
+    return k;
+}
+
+static void sec_load() {
+    uint16_t ids[SEC_MAX_KEYS];
+    size_t n = sec_prefs.getBytes("peers", ids, sizeof(ids)) / sizeof(uint16_t);
+    for (size_t i = 0; i < n; i++) {
+        char name[8];
+        uint8_t key[AES_CCM_KEY_LEN];
+        sec_nvs_name(name, 'k', ids[i]);
+        if (sec_prefs.getBytes(name, key, sizeof(key)) != sizeof(key)) continue;
+        sec_nvs_name(name, 'c', ids[i]);
+        sec_install(ids[i], key, sec_prefs.getUInt(name, 0));
+        memset(key, 0, sizeof(key));
+    }
+}
+
+void init_secure() {
+    sec_lock = xSemaphoreCreateMutex();
+    sec_prefs.begin("p2psec", false);
+    sec_load();
+
+    register_at_handler("AT+KEY", handle_at_key, "Set/delete/list P2P AES-128 keys: AT+KEY=peer,<32 hex>, AT+KEY=peer,DEL (peer 65535 = group key) or AT+KEY=?");
+    register_at_handler("AT+SEC", handle_at_sec, "Encrypt P2P frames with AES-CCM where a key exists: AT+SEC=1[,strict], AT+SEC=0 or AT+SEC=?");
+    register_at_handler("AT+SECBENCH", handle_at_secbench, "Benchmark AES-CCM seal/open latency per payload length: AT+SECBENCH[=rounds]");
+}
+
+// nonce: src u16 | dst u16 | counter u32 | type u8 | 0 0 0 0
+static void sec_nonce(uint8_t *nonce, const uint8_t *frame, uint32_t ctr) {
+    memset(nonce, 0, AES_CCM_NONCE_LEN);
+    memcpy(nonce, frame + 4, 4);
+    put_u32(nonce + 4, ctr);
+    nonce[8] = frame[1];
+}
+
+// associated data: the header as sent, hops zeroed
+static void sec_aad(uint8_t *aad, const uint8_t *frame) {
+    memcpy(aad, frame, P2P_HDR_LEN);
+    aad[3] = 0;
+}
+
+static size_t sec_seal_locked(uint8_t *frame, size_t len, const P2P_Header *hdr) {
+    SecKey *k = sec_key_for(hdr->dst);
+    if (!k) {
+        sec_stats.no_key++;
+        return sec_strict ? 0 : len;
+    }
+    if (len + P2P_SEC_OVERHEAD > P2P_MAX_FRAME) return 0;
+
+    size_t plen = len - P2P_HDR_LEN;
+    uint8_t *ctr_p = frame + P2P_HDR_LEN;
+    uint8_t *body = ctr_p + SEC_CTR_LEN;
+    memmove(body, ctr_p, plen);
+    frame[2] |= P2P_FLAG_SEC;
+    uint32_t ctr = k->tx_ctr++;
+    if (k->tx_ctr >= k->tx_reserved) sec_reserve(k);
+    put_u32(ctr_p, ctr);
+
+    uint8_t nonce[AES_CCM_NONCE_LEN];
+    uint8_t aad[P2P_HDR_LEN];
+    sec_nonce(nonce, frame, ctr);
+    sec_aad(aad, frame);
+    if (aes_ccm_encrypt(&k->ccm, nonce, aad, sizeof(aad), body, plen, body + plen) != 0) {
+        // the counter stays used; never send what the engine left behind
+        memset(body, 0, plen + AES_CCM_TAG_LEN);
+        sec_stats.seal_fail++;
+        return 0;
+    }
+    sec_stats.sealed++;
+    return len + P2P_SEC_OVERHEAD;
+}
+
+// Seal a built frame in place. Returns the new length, len when no key
+// applies, or 0 when strict mode forbids sending it in the clear or the
+// AES engine fails.
+size_t sec_seal(uint8_t *frame, size_t len) {
+    P2P_Header hdr;
+    if (!sec_on || !p2p_parse(frame, len, &hdr)) return len;
+    xSemaphoreTake(sec_lock, portMAX_DELAY);
+    size_t n = sec_seal_locked(frame, len, &hdr);
+    xSemaphoreGive(sec_lock);
+    return n;
+}
+
+static SecReplay *sec_replay_find(uint8_t key, uint16_t src) {
+    for (int i = 0; i < SEC_MAX_REPLAY; i++) {
+        SecReplay *r = &sec_replay[i];
+        if (r->used && r->key == key && r->src == src) return r;
+    }
+    return NULL;
+}
+
+// The window of an authenticated sender, loading its floor from NVS when
+// it is not in RAM. A full table evicts the sender heard least recently;
+// its floor is persisted, so only the window bitmap is lost.
+static SecReplay *sec_replay_get(uint8_t key, uint16_t src) {
+    SecReplay *victim = sec_replay_find(key, src);
+    if (victim) return victim;
+    for (int i = 0; i < SEC_MAX_REPLAY; i++) {
+        SecReplay *r = &sec_replay[i];
+        if (!r->used) {
+            victim = r;
+            break;
+        }
+        if (!victim || r->last_ms < victim->last_ms) victim = r;
+    }
+    if (victim->used) sec_stats.replay_evict++;
+    memset(victim, 0, sizeof(*victim));
+    victim->used = true;
+    victim->key = key;
+    victim->src = src;
+    victim->floor = sec_load_floor(key, src);
+    victim->reserved = victim->floor;
+    return victim;
+}
+
+static bool sec_replay_seen(uint8_t key, uint16_t src, uint32_t ctr) {
+    const SecReplay *r = sec_replay_find(key, src);
+    if (!r) return ctr < sec_load_floor(key, src);
+    if (ctr < r->floor) return true;
+    if (!r->seen || ctr > r->high) return false;
+    uint32_t back = r->high - ctr;
+    return back >= SEC_REPLAY_WINDOW || ((r->bitmap >> back) & 1);
+}
+
+static void sec_replay_mark(SecReplay *r, uint32_t ctr) {
+    if (!r->seen) {
+        r->seen = true;
+        r->high = ctr;
+        r->bitmap = 1;
+    } else if (ctr > r->high) {
+        uint32_t shift = ctr - r->high;
+        r->bitmap = shift >= SEC_REPLAY_WINDOW ? 1 : (r->bitmap << shift) | 1;
+        r->high = ctr;
+    } else {
+        r->bitmap |= 1UL << (r->high - ctr);
+    }
+    // persist the next block before accepting counters from it
+    if (r->high >= r->reserved) {
+        char name[12];
+        r->reserved = r->high + 1 + SEC_RX_RESERVE;
+        sec_nvs_floor_name(name, sec_keys[r->key].peer, r->src);
+        sec_prefs.putUInt(name, r->reserved);
+    }
+    r->last_ms = millis();
+}
+
+static int sec_open_locked(uint8_t *frame, size_t len, const P2P_Header *hdr) {
+    if (!(hdr->flags & P2P_FLAG_SEC)) {
+        if (sec_strict) {
+            sec_stats.clear_dropped++;
+            return -1;
+        }
+        return len;
+    }
+    if (len < P2P_HDR_LEN + P2P_SEC_OVERHEAD) {
+        sec_stats.auth_fail++;
+        return -1;
+    }
+    SecKey *k = sec_key_for(hdr->dst == P2P_BROADCAST ? P2P_BROADCAST : hdr->src);
+    if (!k) {
+        sec_stats.no_key++;
+        return -1;
+    }
+    uint8_t key_idx = (uint8_t)(k - sec_keys);
+    uint8_t *ctr_p = frame + P2P_HDR_LEN;
+    uint8_t *body = ctr_p + SEC_CTR_LEN;
+    size_t plen = len - P2P_HDR_LEN - P2P_SEC_OVERHEAD;
+    uint32_t ctr = get_u32(ctr_p);
+    if (sec_replay_seen(key_idx, hdr->src, ctr)) {
+        sec_stats.replay++;
+        return -1;
+    }
+
+    uint8_t nonce[AES_CCM_NONCE_LEN];
+    uint8_t aad[P2P_HDR_LEN];
+    sec_nonce(nonce, frame, ctr);
+    sec_aad(aad, frame);
+    if (!aes_ccm_decrypt(&k->ccm, nonce, aad, sizeof(aad), body, plen, body + plen)) {
+        sec_stats.auth_fail++;
+        return -1;
+    }
+    // only authenticated frames move the window
+    sec_replay_mark(sec_replay_get(key_idx, hdr->src), ctr);
+
+    memmove(ctr_p, body, plen);
+    frame[2] &= ~P2P_FLAG_SEC;
+    sec_stats.opened++;
+    return P2P_HDR_LEN + plen;
+}
+
+// Open a received frame in place. Returns the plain length (len for frames
+// that are not sealed or not for us), or -1 to drop it.
+int sec_open(uint8_t *frame, size_t len) {
+    P2P_Header hdr;
+    if (!p2p_parse(frame, len, &hdr)) return len;
+    if (hdr.dst != g_node_id && hdr.dst != P2P_BROADCAST) return len;
+    xSemaphoreTake(sec_lock, portMAX_DELAY);
+    int n = sec_open_locked(frame, len, &hdr);
+    xSemaphoreGive(sec_lock);
+    return n;
+}
+
+// AT+KEY=peer,<32 hex> / AT+KEY=peer,DEL / AT+KEY=?
+void handle_at_key(const AT_Command *cmd) {
+    if (strcmp(cmd->params, "?") == 0) {
+        xSemaphoreTake(sec_lock, portMAX_DELAY);
+        for (int i = 0; i < SEC_MAX_KEYS; i++) {
+            const SecKey *k = &sec_keys[i];
+            if (!k->used) continue;
+            if (k->peer == P2P_BROADCAST) {
+                Serial.printf("Key group: tx counter %lu\r\n", (unsigned long)k->tx_ctr);
+            } else {
+                Serial.printf("Key %5u: tx counter %lu\r\n", k->peer, (unsigned long)k->tx_ctr);
+            }
+        }
+        xSemaphoreGive(sec_lock);
+        Serial.println("OK");
+        return;
+    }
+    char buf[48];
+    strncpy(buf, cmd->params, sizeof(buf)-1);
+    buf[sizeof(buf)-1] = 0;
+    char *p = strtok(buf, ",");
+    char *hex = strtok(NULL, ",");
+    long peer = p ? atol(p) : 0;
+    if (!hex || peer <= P2P_ANON_ID || peer > P2P_BROADCAST) {
+        Serial.println("ERROR: Need params: peer(1-65535),<32 hex>|DEL");
+        return;
+    }
+    char name[8];
+    if (strcasecmp(hex, "DEL") == 0) {
+        xSemaphoreTake(sec_lock, portMAX_DELAY);
+        SecKey *k = sec_key_for((uint16_t)peer);
+        if (!k) {
+            xSemaphoreGive(sec_lock);
+            Serial.println("ERROR: No key for peer");
+            return;
+        }
+        // the counter stays in NVS, a new key for this peer continues from it
+        aes_ccm_free(&k->ccm);
+        k->used = false;
+        sec_nvs_name(name, 'k', (uint16_t)peer);
+        sec_prefs.remove(name);
+        sec_store_peers();
+        xSemaphoreGive(sec_lock);
+        Serial.println("OK, key deleted");
+        return;
+    }
+    uint8_t key[AES_CCM_KEY_LEN];
+    if (hex_decode(key, sizeof(key), hex, strlen(hex)) != AES_CCM_KEY_LEN) {
+        Serial.println("ERROR: Key must be 32 hex digits");
+        memset(key, 0, sizeof(key));
+        return;
+    }
+    xSemaphoreTake(sec_lock, portMAX_DELAY);
+    sec_nvs_name(name, 'c', (uint16_t)peer);
+    if (!sec_install((uint16_t)peer, key, sec_prefs.getUInt(name, 0))) {
+        xSemaphoreGive(sec_lock);
+        Serial.println("ERROR: Key table full");
+        memset(key, 0, sizeof(key));
+        return;
+    }
+    sec_nvs_name(name, 'k', (uint16_t)peer);
+    sec_prefs.putBytes(name, key, sizeof(key));
+    sec_store_peers();
+    xSemaphoreGive(sec_lock);
+    memset(key, 0, sizeof(key));
+    memset(buf, 0, sizeof(buf));
+    Serial.println("OK, key set");
+}
+
+// AT+SEC=0 / AT+SEC=1[,strict] / AT+SEC=?
+void handle_at_sec(const AT_Command *cmd) {
+    if (strcmp(cmd->params, "?") == 0) {
+        Serial.printf("SEC: %s%s, AES backend: %s\r\n", sec_on ? "ON" : "OFF", sec_strict ? " (strict)" : "",
+                      aes_ccm_hw_in_use() ? "hardware" : "software");
+        Serial.printf("Sealed %lu (failed %lu), opened %lu, auth fail %lu, replay %lu (windows evicted %lu), no key %lu, clear dropped %lu\r\n",
+                      (unsigned long)sec_stats.sealed, (unsigned long)sec_stats.seal_fail,
+                      (unsigned long)sec_stats.opened, (unsigned long)sec_stats.auth_fail,
+                      (unsigned long)sec_stats.replay, (unsigned long)sec_stats.replay_evict,
+                      (unsigned long)sec_stats.no_key, (unsigned long)sec_stats.clear_dropped);
+        return;
+    }
+    char buf[16];
+    strncpy(buf, cmd->params, sizeof(buf)-1);
+    buf[sizeof(buf)-1] = 0;
+    char *p = strtok(buf, ",");
+    if (!p) {
+        Serial.println("ERROR: Need params: on[,strict]");
+        return;
+    }
+    sec_on = atoi(p) != 0;
+    p = strtok(NULL, ",");
+    sec_strict = sec_on && p && atoi(p) != 0;
+    Serial.printf("OK, SEC=%d%s\r\n", sec_on ? 1 : 0, sec_strict ? ", strict" : "");
+}
+
+// AT+SECBENCH[=rounds]: seal/open time per frame for each payload length,
+// on the hardware and the software AES
+void handle_at_secbench(const AT_Command *cmd) {
+    long rounds = strlen(cmd->params) ? atol(cmd->params) : SEC_BENCH_ROUNDS;
+    if (rounds < 1 || rounds > 100000) {
+        Serial.println("ERROR: Invalid rounds (1-100000)");
+        return;
+    }
+    static const size_t lens[] = {16, 32, 64, 128, P2P_MAX_PAYLOAD};
+    uint8_t key[AES_CCM_KEY_LEN];
+    uint8_t nonce[AES_CCM_NONCE_LEN] = {0};
+    uint8_t aad[P2P_HDR_LEN] = {P2P_MAGIC};
+    uint8_t buf[P2P_MAX_PAYLOAD];
+    uint8_t tag[AES_CCM_TAG_LEN];
+    for (int i = 0; i < AES_CCM_KEY_LEN; i++) key[i] = (uint8_t)i;
+    for (size_t i = 0; i < sizeof(buf); i++) buf[i] = (uint8_t)i;
+
+    AES_CCM_Ctx ctx;
+    aes_ccm_init(&ctx, key);
+    bool was_hw = aes_ccm_hw_in_use();
+    Serial.println("  len  backend  seal us  open us");
+    for (int hw = aes_ccm_hw_available() ? 1 : 0; hw >= 0; hw--) {
+        aes_ccm_use_hw(hw);
+        for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+            bool ok = true;
+            uint32_t t_seal = 0, t_open = 0;
+            for (long r = 0; r < rounds; r++) {
+                uint32_t t0 = micros();
+                ok &= aes_ccm_encrypt(&ctx, nonce, aad, sizeof(aad), buf, lens[i], tag) == 0;
+                uint32_t t1 = micros();
+                ok &= aes_ccm_decrypt(&ctx, nonce, aad, sizeof(aad), buf, lens[i], tag);
+                t_seal += t1 - t0;
+                t_open += micros() - t1;
+            }
+            Serial.printf("%5u  %-7s  %7.1f  %7.1f%s\r\n", (unsigned)lens[i], hw ? "hw" : "sw",
+                          (float)t_seal / rounds, (float)t_open / rounds, ok ? "" : "  FAIL");
+        }
+    }
+    aes_ccm_use_hw(was_hw);
+    aes_ccm_free(&ctx);
+}
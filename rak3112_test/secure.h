@@ -0,0 +1,48 @@
+#ifndef SECURE_H
+#define SECURE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "command.h"
+
+// AES-128-CCM for P2P frames (aes_ccm.cpp). A sealed frame keeps its header
+// in the clear, with P2P_FLAG_SEC set, as associated data (hops excluded so
+// relays may bump it):
+//
+//   header | counter u32 | ciphertext | tag[8]
+//
+// Keys are per peer (P2P_BROADCAST holds the group key) and kept in NVS
+// together with a reserved block of TX counters, so counters never repeat
+// across reboots. Receivers keep a 32-frame replay window per key and
+// sender, and persist a counter floor for it the same way: after a reboot
+// or an eviction from the window table, counters below the floor are
+// refused, at the cost of up to SEC_RX_RESERVE frames from a sender that
+// did not reboot.
+#define SEC_MAX_KEYS        16
+#define SEC_MAX_REPLAY      16
+#define SEC_REPLAY_WINDOW   32
+#define SEC_CTR_LEN         4
+#define SEC_CTR_RESERVE     1024    // TX counters persisted in blocks
+#define SEC_RX_RESERVE      64      // RX counter floors persisted in blocks
+#define SEC_BENCH_ROUNDS    100
+
+struct SEC_Stats {
+    uint32_t sealed;
+    uint32_t seal_fail;         // AES engine errors, frame not sent
+    uint32_t opened;
+    uint32_t auth_fail;
+    uint32_t replay;
+    uint32_t replay_evict;      // windows dropped from RAM, floor kept in NVS
+    uint32_t no_key;
+    uint32_t clear_dropped;     // unsealed P2P frames dropped in strict mode
+};
+
+void init_secure();
+size_t sec_seal(uint8_t *frame, size_t len);
+int sec_open(uint8_t *frame, size_t len);
+
+void handle_at_key(const AT_Command *cmd);
+void handle_at_sec(const AT_Command *cmd);
+void handle_at_secbench(const AT_Command *cmd);
+
+#endif // SECURE_H
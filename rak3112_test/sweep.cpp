@@ -0,0 +1,443 @@
+#include "sweep.h"
+#include "lora.h"
+#include "p2p.h"
+#include "Arduino.h"
+#include <RadioLib.h>
+#include "command.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SWEEP_OP_CFG        1
+#define SWEEP_OP_CFG_ACK    2
+#define SWEEP_OP_BURST      3
+#define SWEEP_OP_REPORT_REQ 4
+#define SWEEP_OP_REPORT     5
+
+// CFG: op | run | cell | sf | bw x10 u16 | power i8 | count | len | window_ms u32
+#define SWEEP_CFG_LEN       13
+// REPORT: op | run | cell | rx | rssi x10 i16 | snr x10 i16
+#define SWEEP_REPORT_LEN    8
+
+enum SweepRole {
+    SW_OFF = 0,
+    SW_FOLLOW,
+    SW_LEAD
+};
+
+enum SweepState {
+    SS_IDLE = 0,
+    SS_CFG,             // CFG sent at home, waiting for CFG_ACK
+    SS_BURST,           // at the cell setting, sending the burst
+    SS_WAIT,            // back home, follower still in its window
+    SS_REPORT           // REPORT_REQ sent, waiting for REPORT
+};
+
+static SweepRole sw_role = SW_OFF;
+static uint16_t sw_peer = P2P_ANON_ID;
+static uint8_t sw_run = 0;
+static uint8_t sw_count = SWEEP_DEFAULT_COUNT;
+static uint8_t sw_len = SWEEP_DEFAULT_LEN;
+
+// home setting, restored between cells and at the end
+static int home_sf = 0;
+static float home_bw = 0;
+static int home_power = 0;
+
+// leader
+static SWEEP_Cell sw_cells[SWEEP_MAX_CELLS];
+static int sw_ncells = 0;
+static int sw_cell = 0;
+static SweepState sw_state = SS_IDLE;
+static uint8_t sw_tries = 0;
+static uint32_t sw_deadline = 0;
+static uint32_t sw_window_ms = 0;
+static uint32_t sw_window_end = 0;
+static uint32_t sw_next_tx = 0;
+static uint32_t sw_first_tx = 0;
+static uint32_t sw_start_ms = 0;
+
+// follower: the cell being received or last reported
+static bool fw_active = false;
+static uint8_t fw_run = 0;
+static uint8_t fw_cell = 0;
+static uint16_t fw_src = P2P_ANON_ID;
+static uint32_t fw_deadline = 0;
+static uint8_t fw_rx = 0;
+static float fw_rssi_sum = 0;
+static float fw_snr_sum = 0;
+
+static void put_u16(uint8_t *p, uint16_t v) { p[0] = v & 0xFF; p[1] = v >> 8; }
+static uint16_t get_u16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+static void put_u32(uint8_t *p, uint32_t v) { p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24; }
+static uint32_t get_u32(const uint8_t *p) { return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); }
+
+// LoRa time on air (SX126x datasheet, explicit header, CRC on) for a setting
+// the radio is not on yet
+static uint32_t sweep_toa_ms(int sf, float bw, size_t len) {
+    float tsym = (float)(1UL << sf) / bw;
+    int de = (tsym >= 16.0f) ? 1 : 0;
+    float num = 8.0f * len - 4.0f * sf + 28 + 16;
+    int nsym = (int)ceilf(num / (4.0f * (sf - 2 * de)));
+    if (nsym < 0) nsym = 0;
+    float n = g_lora_preamble + 4.25f + 8 + nsym * g_lora_cr;
+    return (uint32_t)ceilf(n * tsym);
+}
+
+static size_t sweep_frame_len() {
+    return P2P_HDR_LEN + SWEEP_BURST_HDR + sw_len + P2P_SEC_OVERHEAD;
+}
+
+static uint32_t sweep_timeout_ms() {
+    return 2 * lora_time_on_air_ms(P2P_HDR_LEN + SWEEP_CFG_LEN + P2P_SEC_OVERHEAD) + SWEEP_TURNAROUND_MS;
+}
+
+static int sweep_home() {
+    return lora_set_rate(home_sf, home_bw, home_power);
+}
+
+static void sweep_send_cfg() {
+    const SWEEP_Cell *c = &sw_cells[sw_cell];
+    uint8_t msg[SWEEP_CFG_LEN];
+    msg[0] = SWEEP_OP_CFG;
+    msg[1] = sw_run;
+    msg[2] = (uint8_t)sw_cell;
+    msg[3] = c->sf;
+    put_u16(msg + 4, (uint16_t)lroundf(c->bw * 10));
+    msg[6] = (uint8_t)c->power;
+    msg[7] = sw_count;
+    msg[8] = sw_len;
+    put_u32(msg + 9, sw_window_ms);
+    p2p_send(P2P_TYPE_SWEEP, P2P_FLAG_ACKREQ, sw_peer, msg, sizeof(msg));
+    sw_tries++;
+    // after the quick retries the follower may be away in a window whose
+    // ack we missed; wait that out once before the last round
+    sw_deadline = millis() + (sw_tries == SWEEP_RETRIES ? sw_window_ms : sweep_timeout_ms());
+}
+
+static void sweep_send_report_req() {
+    uint8_t msg[3] = {SWEEP_OP_REPORT_REQ, sw_run, (uint8_t)sw_cell};
+    p2p_send(P2P_TYPE_SWEEP, P2P_FLAG_ACKREQ, sw_peer, msg, sizeof(msg));
+    sw_tries++;
+    sw_deadline = millis() + sweep_timeout_ms();
+}
+
+static void sweep_print_cell(const SWEEP_Cell *c) {
+    static const char *status[] = {"PENDING", "OK", "NOSYNC", "NOREPORT", "BADCFG"};
+    float per = c->sent ? 100.0f * (c->sent - c->rx) / c->sent : 100.0f;
+    unsigned long goodput = c->burst_ms ? (unsigned long)((uint64_t)c->rx * sw_len * 8000 / c->burst_ms) : 0;
+    Serial.printf("%u,%.1f,%d,%u,%u,%.1f,%.1f,%.1f,%lu,%s\r\n", c->sf, c->bw, c->power, c->sent, c->rx, per,
+                  c->rssi_x10 / 10.0f, c->snr_x10 / 10.0f, goodput, status[c->status]);
+}
+
+// Window the follower spends at the cell setting, from its CFG_ACK on.
+// The first CFG goes out from sweep_loop, which is due right away.
+static void sweep_start_cell() {
+    const SWEEP_Cell *c = &sw_cells[sw_cell];
+    sw_window_ms = SWEEP_SETTLE_MS + sw_count * (sweep_toa_ms(c->sf, c->bw, sweep_frame_len()) + SWEEP_GAP_MS) + SWEEP_MARGIN_MS;
+    sw_state = SS_CFG;
+    sw_tries = 0;
+    sw_deadline = millis();
+}
+
+// Move on to the next cell, or finish
+static void sweep_next_cell() {
+    Serial.print("+SWEEP: ");
+    sweep_print_cell(&sw_cells[sw_cell]);
+    sw_cell++;
+    if (sw_cell >= sw_ncells) {
+        sw_state = SS_IDLE;
+        sw_role = SW_OFF;
+        sweep_home();
+        Serial.printf("+SWEEP: DONE,%d cells,%lu s\r\n", sw_ncells, (unsigned long)((millis() - sw_start_ms) / 1000));
+        return;
+    }
+    sweep_start_cell();
+}
+
+static void sweep_follow_report(uint16_t dst) {
+    uint8_t msg[SWEEP_REPORT_LEN] = {SWEEP_OP_REPORT, fw_run, fw_cell, fw_rx};
+    int16_t rssi = fw_rx ? (int16_t)lroundf(fw_rssi_sum * 10 / fw_rx) : 0;
+    int16_t snr = fw_rx ? (int16_t)lroundf(fw_snr_sum * 10 / fw_rx) : 0;
+    put_u16(msg + 4, (uint16_t)rssi);
+    put_u16(msg + 6, (uint16_t)snr);
+    p2p_send(P2P_TYPE_SWEEP, 0, dst, msg, sizeof(msg));
+}
+
+static bool sweep_on_frame(const P2P_Header *hdr, const uint8_t *payload, size_t len, const RX_Packet_Info *info) {
+    if (len < 3) return true;
+    uint8_t op = payload[0];
+    uint8_t run = payload[1];
+    uint8_t cell = payload[2];
+
+    switch (op) {
+    case SWEEP_OP_CFG: {
+        if (sw_role != SW_FOLLOW || len < SWEEP_CFG_LEN) break;
+        uint8_t ack[3] = {SWEEP_OP_CFG_ACK, run, cell};
+        // answer at home, then follow for the announced window
+        p2p_send(P2P_TYPE_SWEEP, 0, hdr->src, ack, sizeof(ack));
+        fw_active = true;
+        fw_run = run;
+        fw_cell = cell;
+        fw_src = hdr->src;
+        fw_rx = 0;
+        fw_rssi_sum = 0;
+        fw_snr_sum = 0;
+        fw_deadline = millis() + get_u32(payload + 9);
+        if (lora_set_rate(payload[3], get_u16(payload + 4) / 10.0f, home_power) != RADIOLIB_ERR_NONE) {
+            sweep_home();
+            fw_active = false;
+        }
+        break;
+    }
+    case SWEEP_OP_CFG_ACK:
+        if (sw_role == SW_LEAD && sw_state == SS_CFG && hdr->src == sw_peer && run == sw_run && cell == sw_cell) {
+            const SWEEP_Cell *c = &sw_cells[sw_cell];
+            sw_window_end = millis() + sw_window_ms;
+            if (lora_set_rate(c->sf, c->bw, c->power) != RADIOLIB_ERR_NONE) {
+                sweep_home();
+                sw_cells[sw_cell].status = SWEEP_BADCFG;
+                sw_state = SS_WAIT;
+                break;
+            }
+            sw_next_tx = millis() + SWEEP_SETTLE_MS;
+            sw_state = SS_BURST;
+        }
+        break;
+    case SWEEP_OP_BURST:
+        if (fw_active && hdr->src == fw_src && run == fw_run && cell == fw_cell) {
+            fw_rx++;
+            fw_rssi_sum += info->rssi;
+            fw_snr_sum += info->snr;
+        }
+        break;
+    case SWEEP_OP_REPORT_REQ:
+        // repeats too, our REPORT may have been lost
+        if (sw_role == SW_FOLLOW && !fw_active && hdr->src == fw_src && run == fw_run && cell == fw_cell) {
+            sweep_follow_report(hdr->src);
+        }
+        break;
+    case SWEEP_OP_REPORT:
+        if (sw_role == SW_LEAD && sw_state == SS_REPORT && hdr->src == sw_peer && run == sw_run && cell == sw_cell &&
+            len >= SWEEP_REPORT_LEN) {
+            SWEEP_Cell *c = &sw_cells[sw_cell];
+            c->rx = payload[3];
+            c->rssi_x10 = (int16_t)get_u16(payload + 4);
+            c->snr_x10 = (int16_t)get_u16(payload + 6);
+            c->status = SWEEP_OK;
+            sweep_next_cell();
+        }
+        break;
+    }
+    return true;
+}
+
+void init_sweep() {
+    p2p_register_handler(P2P_TYPE_SWEEP, sweep_on_frame);
+
+    register_at_handler("AT+SWEEP", handle_at_sweep, "SF/BW/power sweep: AT+SWEEP=peer,<sf/sf..>,<bw/bw..>,<pwr/pwr..>[,count[,len]], AT+SWEEP=FOLLOW, AT+SWEEP=STOP or AT+SWEEP=?");
+    register_at_handler("AT+SWEEPRES", handle_at_sweepres, "Print the sweep result matrix as CSV");
+}
+
+void sweep_loop() {
+    uint32_t now = millis();
+    if (fw_active && (int32_t)(now - fw_deadline) >= 0) {
+        fw_active = false;
+        sweep_home();
+    }
+    if (sw_role != SW_LEAD) return;
+
+    SWEEP_Cell *c = &sw_cells[sw_cell];
+    switch (sw_state) {
+    case SS_IDLE:
+        break;
+    case SS_CFG:
+        if ((int32_t)(now - sw_deadline) < 0) break;
+        if (sw_tries < SWEEP_RETRIES + 1) {
+            sweep_send_cfg();
+        } else {
+            c->status = SWEEP_NOSYNC;
+            sweep_next_cell();
+        }
+        break;
+    case SS_BURST: {
+        if ((int32_t)(now - sw_next_tx) < 0) break;
+        uint8_t msg[SWEEP_BURST_HDR + 255];
+        msg[0] = SWEEP_OP_BURST;
+        msg[1] = sw_run;
+        msg[2] = (uint8_t)sw_cell;
+        msg[3] = c->sent;
+        for (int i = 0; i < sw_len; i++) msg[SWEEP_BURST_HDR + i] = (uint8_t)(i + c->sent);
+        if (c->sent == 0) sw_first_tx = now;
+        p2p_send(P2P_TYPE_SWEEP, 0, sw_peer, msg, SWEEP_BURST_HDR + sw_len);
+        c->sent++;
+        sw_next_tx = millis();
+        if (c->sent >= sw_count) {
+            c->burst_ms = millis() - sw_first_tx;
+            sweep_home();
+            sw_state = SS_WAIT;
+        }
+        break;
+    }
+    case SS_WAIT:
+        if ((int32_t)(now - sw_window_end) < 0) break;
+        if (c->status == SWEEP_BADCFG) {
+            sweep_next_cell();
+            break;
+        }
+        sw_state = SS_REPORT;
+        sw_tries = 0;
+        sweep_send_report_req();
+        break;
+    case SS_REPORT:
+        if ((int32_t)(now - sw_deadline) < 0) break;
+        if (sw_tries < 2 * SWEEP_RETRIES) {
+            sweep_send_report_req();
+        } else {
+            c->status = SWEEP_NOREPORT;
+            sweep_next_cell();
+        }
+        break;
+    }
+}
+
+// "7/9/12" -> number of values, -1 when there are more than max
+static int sweep_parse_list(char *s, float *out, int max) {
+    int n = 0;
+    char *save = NULL;
+    for (char *t = strtok_r(s, "/", &save); t; t = strtok_r(NULL, "/", &save)) {
+        if (n >= max) return -1;
+        out[n++] = atof(t);
+    }
+    return n;
+}
+
+static void sweep_save_home() {
+    home_sf = g_lora_sf;
+    home_bw = g_lora_bandwidth;
+    home_power = g_lora_power;
+}
+
+static void sweep_stop() {
+    if (sw_role == SW_LEAD || fw_active) sweep_home();
+    fw_active = false;
+    sw_state = SS_IDLE;
+    sw_role = SW_OFF;
+}
+
+// AT+SWEEP=peer,<sf list>,<bw list>,<power list>[,count[,len]]
+// AT+SWEEP=FOLLOW, AT+SWEEP=STOP, AT+SWEEP=?
+void handle_at_sweep(const AT_Command *cmd) {
+    if (strcmp(cmd->params, "?") == 0) {
+        if (sw_role == SW_LEAD) {
+            Serial.printf("SWEEP: LEAD, peer=%u, cell %d/%d, %u frames of %u bytes per cell\r\n",
+                          sw_peer, sw_cell + 1, sw_ncells, sw_count, sw_len);
+        } else {
+            Serial.printf("SWEEP: %s%s\r\n", sw_role == SW_FOLLOW ? "FOLLOW" : "OFF",
+                          fw_active ? " (in a cell window)" : "");
+        }
+        return;
+    }
+    if (strcasecmp(cmd->params, "STOP") == 0) {
+        sweep_stop();
+        Serial.println("OK, sweep stopped");
+        return;
+    }
+    if (g_radio_mode != RADIO_MODE_LORA) {
+        Serial.println("ERROR: Not in LoRa mode");
+        return;
+    }
+    if (sw_role != SW_OFF) {
+        Serial.println("ERROR: Sweep already running, use AT+SWEEP=STOP first");
+        return;
+    }
+    if (strcasecmp(cmd->params, "FOLLOW") == 0) {
+        if (lora_listen() != RADIOLIB_ERR_NONE) {
+            Serial.println("ERROR: Unable to start RX");
+            return;
+        }
+        sweep_save_home();
+        sw_role = SW_FOLLOW;
+        Serial.println("OK, following sweeps at the current setting");
+        return;
+    }
+
+    char buf[MAX_PARAM_LEN + 1];
+    strncpy(buf, cmd->params, sizeof(buf)-1);
+    buf[sizeof(buf)-1] = 0;
+    char *args[6] = {NULL};
+    int nargs = 0;
+    char *save = NULL;
+    for (char *t = strtok_r(buf, ",", &save); t && nargs < 6; t = strtok_r(NULL, ",", &save)) args[nargs++] = t;
+    if (nargs < 4) {
+        Serial.println("ERROR: Need params: peer,<sf list>,<bw list>,<power list>[,count[,len]]");
+        return;
+    }
+    long peer = atol(args[0]);
+    float sfs[SWEEP_MAX_SF], bws[SWEEP_MAX_BW], pwrs[SWEEP_MAX_POWER];
+    int nsf = sweep_parse_list(args[1], sfs, SWEEP_MAX_SF);
+    int nbw = sweep_parse_list(args[2], bws, SWEEP_MAX_BW);
+    int npw = sweep_parse_list(args[3], pwrs, SWEEP_MAX_POWER);
+    long count = nargs > 4 ? atol(args[4]) : SWEEP_DEFAULT_COUNT;
+    long len = nargs > 5 ? atol(args[5]) : SWEEP_DEFAULT_LEN;
+    if (peer <= P2P_ANON_ID || peer >= P2P_BROADCAST) {
+        Serial.println("ERROR: Invalid peer (1-65534)");
+        return;
+    }
+    if (nsf <= 0 || nbw <= 0 || npw <= 0) {
+        Serial.printf("ERROR: Lists are '/' separated, at most %d SF, %d BW, %d power values\r\n",
+                      SWEEP_MAX_SF, SWEEP_MAX_BW, SWEEP_MAX_POWER);
+        return;
+    }
+    for (int i = 0; i < nsf; i++) {
+        if (sfs[i] < 7 || sfs[i] > 12) {
+            Serial.println("ERROR: SF must be 7-12");
+            return;
+        }
+    }
+    for (int i = 0; i < npw; i++) {
+        if (pwrs[i] < -9 || pwrs[i] > 22) {
+            Serial.println("ERROR: Power must be -9 to 22 dBm");
+            return;
+        }
+    }
+    if (count < 1 || count > SWEEP_MAX_COUNT || len < 0 || len > P2P_MAX_PAYLOAD - SWEEP_BURST_HDR) {
+        Serial.printf("ERROR: Count must be 1-%d, len 0-%d\r\n", SWEEP_MAX_COUNT, P2P_MAX_PAYLOAD - SWEEP_BURST_HDR);
+        return;
+    }
+    if (lora_listen() != RADIOLIB_ERR_NONE) {
+        Serial.println("ERROR: Unable to start RX");
+        return;
+    }
+
+    sw_ncells = 0;
+    for (int i = 0; i < nsf; i++) {
+        for (int j = 0; j < nbw; j++) {
+            for (int k = 0; k < npw; k++) {
+                SWEEP_Cell *c = &sw_cells[sw_ncells++];
+                memset(c, 0, sizeof(*c));
+                c->sf = (uint8_t)sfs[i];
+                c->bw = bws[j];
+                c->power = (int8_t)pwrs[k];
+            }
+        }
+    }
+    sweep_save_home();
+    sw_peer = (uint16_t)peer;
+    sw_count = (uint8_t)count;
+    sw_len = (uint8_t)len;
+    sw_run++;
+    sw_start_ms = millis();
+    sw_cell = 0;
+    sweep_start_cell();
+    // last: sweep_loop on loop() sends from here on, never the AT task
+    __atomic_store_n(&sw_role, SW_LEAD, __ATOMIC_RELEASE);
+    Serial.printf("OK, sweeping %d cells with peer %u\r\n", sw_ncells, sw_peer);
+}
+
+void handle_at_sweepres(const AT_Command *cmd) {
+    Serial.println("sf,bw_khz,power_dbm,sent,received,per_pct,rssi_dbm,snr_db,goodput_bps,status");
+    for (int i = 0; i < sw_ncells; i++) sweep_print_cell(&sw_cells[i]);
+    Serial.println("OK");
+}
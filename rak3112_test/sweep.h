@@ -0,0 +1,57 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "command.h"
+
+// Coordinated SF/BW/power sweep between two nodes. The leader walks the
+// cell matrix; for each cell it agrees the setting with the follower at the
+// home rate, both switch, the leader sends a fixed burst, both return home
+// and the follower reports what it received:
+//
+//   CFG (home) -> CFG_ACK (home) -> both switch -> BURST x count
+//   -> both back home at the end of the window -> REPORT_REQ -> REPORT
+//
+// Power only applies to the leader's burst; sync frames use home settings.
+#define SWEEP_MAX_SF        8
+#define SWEEP_MAX_BW        4
+#define SWEEP_MAX_POWER     8
+#define SWEEP_MAX_CELLS     (SWEEP_MAX_SF * SWEEP_MAX_BW * SWEEP_MAX_POWER)
+#define SWEEP_DEFAULT_COUNT 20
+#define SWEEP_DEFAULT_LEN   32
+#define SWEEP_MAX_COUNT     200
+#define SWEEP_BURST_HDR     4       // op u8 | run u8 | cell u8 | index u8
+#define SWEEP_SETTLE_MS     100     // follower switch time before the first burst frame
+#define SWEEP_GAP_MS        20      // loop() latency between burst frames
+#define SWEEP_MARGIN_MS     300
+#define SWEEP_RETRIES       3
+#define SWEEP_TURNAROUND_MS 150
+
+enum SWEEP_Status {
+    SWEEP_PENDING = 0,
+    SWEEP_OK,
+    SWEEP_NOSYNC,           // follower never acknowledged the cell
+    SWEEP_NOREPORT,         // burst sent, report lost
+    SWEEP_BADCFG            // setting refused by the radio
+};
+
+struct SWEEP_Cell {
+    uint8_t sf;
+    float bw;
+    int8_t power;
+    uint8_t status;
+    uint8_t sent;
+    uint8_t rx;
+    int16_t rssi_x10;       // mean over received frames
+    int16_t snr_x10;
+    uint32_t burst_ms;      // first to last burst frame on the leader
+};
+
+void init_sweep();
+void sweep_loop();
+
+void handle_at_sweep(const AT_Command *cmd);
+void handle_at_sweepres(const AT_Command *cmd);
+
+#endif // SWEEP_H
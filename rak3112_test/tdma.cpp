@@ -0,0 +1,329 @@
+#include "tdma.h"
+#include "timebase.h"
+#include "lora.h"
+#include "p2p.h"
+#include "afc.h"
+#include "Arduino.h"
+#include <RadioLib.h>
+#include "command.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct TdmaEntry {
+    PKT_Buf *buf;
+    uint16_t peer;          // AFC peer to tune for
+    float freq;             // channel to send on, 0 = current
+};
+
+static bool td_on = false;
+static uint16_t td_slots = 0;
+static uint16_t td_slot = 0;            // our slot
+static uint8_t td_max_len = 0;
+static uint32_t td_guard_us = 0;
+static uint32_t td_slot_us = 0;
+static int64_t td_sf_us = 0;            // superframe length
+static int64_t td_first_sf = 0;         // superframe when enabled
+static int64_t td_last_sf = -1;         // superframe of our last release
+static int32_t td_lead_us = 0;          // call -> air start, learned per frame
+static bool td_lead_known = false;
+
+static TdmaEntry td_q[TDMA_QUEUE];
+static uint8_t td_head = 0;
+static uint8_t td_count = 0;
+
+// superframe + 1 in which each slot last carried a frame, 0 = never
+static uint32_t td_seen[TDMA_MAX_SLOTS];
+
+struct TdmaStats {
+    uint32_t sent;
+    uint32_t full;          // frames that found the queue full (txq keeps them)
+    uint32_t held_clock;    // own slot skipped, clock error beyond the guard
+    uint32_t held_busy;     // own slot skipped, radio busy
+    uint32_t tx_err_max;    // |air start - planned|, us
+    uint64_t tx_err_sum;
+    uint32_t rx;
+    uint32_t rx_busy_slots; // slot/superframe pairs that carried a frame
+    uint32_t rx_double;     // second frame in one slot of one superframe
+    uint32_t rx_foreign;    // sender does not own the slot
+    uint32_t rx_crc;        // CRC errors while TDMA is on (mostly collisions)
+    uint32_t rx_off_max;    // |air start - slot TX point|, us
+    uint64_t rx_off_sum;
+};
+static TdmaStats td_st;
+static const PKT_Buf *td_full_last = NULL;  // last frame counted in full
+
+// AT+TDMA runs on the AT task while tdma_loop may be spinning on the head
+// of td_q, so the handler only posts the change and loop() applies it
+enum TdmaOp : uint8_t {
+    TD_OP_NONE = 0,
+    TD_OP_ON,               // td_new holds the new configuration
+    TD_OP_OFF,
+    TD_OP_CLR,
+};
+struct TdmaConfig {
+    uint16_t slots;
+    uint8_t max_len;
+    uint32_t guard_us;
+};
+static TdmaConfig td_new;
+static uint8_t td_op = TD_OP_NONE;
+
+bool tdma_enabled() {
+    return td_on;
+}
+
+// Takes over the caller's reference to buf when it returns RADIOLIB_ERR_NONE.
+// A full queue returns LORA_ERR_BUSY and the TX queue offers the frame
+// again on every pass, so it is counted once.
+int tdma_queue(PKT_Buf *buf, uint16_t peer, float freq) {
+    if (buf->len > td_max_len) return RADIOLIB_ERR_PACKET_TOO_LONG;
+    if (td_count >= TDMA_QUEUE) {
+        if (buf != td_full_last) td_st.full++;
+        td_full_last = buf;
+        return LORA_ERR_BUSY;
+    }
+    td_full_last = NULL;
+    TdmaEntry *e = &td_q[(td_head + td_count) % TDMA_QUEUE];
+    e->buf = buf;
+    e->peer = peer;
+    e->freq = freq;
+    td_count++;
+    return RADIOLIB_ERR_NONE;
+}
+
+// Remove a frame still waiting for its slot; false when it is not queued
+bool tdma_cancel(const PKT_Buf *buf) {
+    for (uint8_t n = 0; n < td_count; n++) {
+        TdmaEntry *e = &td_q[(td_head + n) % TDMA_QUEUE];
+        if (e->buf != buf) continue;
+        pkt_tx_done(e->buf, false);
+        pkt_unref(e->buf);
+        for (; n + 1 < td_count; n++) {
+            td_q[(td_head + n) % TDMA_QUEUE] = td_q[(td_head + n + 1) % TDMA_QUEUE];
+        }
+        td_count--;
+        return true;
+    }
+    return false;
+}
+
+static int64_t td_floor_div(int64_t a, int64_t b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static void tdma_flush();
+static void tdma_clear();
+
+// Apply a change posted by AT+TDMA; loop() only
+static void tdma_apply(uint8_t op) {
+    if (op == TD_OP_CLR) {
+        tdma_clear();
+        return;
+    }
+    tdma_flush();
+    if (op == TD_OP_OFF) {
+        td_on = false;
+        return;
+    }
+    td_slots = td_new.slots;
+    td_slot = g_node_id % td_slots;
+    td_max_len = td_new.max_len;
+    td_guard_us = td_new.guard_us;
+    td_slot_us = lora_time_on_air_us(td_max_len) + td_guard_us;
+    td_sf_us = (int64_t)td_slots * td_slot_us;
+    td_last_sf = -1;
+    td_on = true;
+    tdma_clear();
+}
+
+// Release the head of the queue at our slot. loop() runs every ~10 ms, so
+// once the slot is that close we spin on the timer to the exact point.
+void tdma_loop() {
+    uint8_t op = __atomic_load_n(&td_op, __ATOMIC_ACQUIRE);
+    if (op != TD_OP_NONE) {
+        tdma_apply(op);
+        __atomic_store_n(&td_op, (uint8_t)TD_OP_NONE, __ATOMIC_RELEASE);
+    }
+    if (!td_on || td_count == 0) return;
+    int64_t net = tb_now_us();
+    int64_t sf = td_floor_div(net, td_sf_us);
+    int64_t tx_net = sf * td_sf_us + (int64_t)td_slot * td_slot_us + td_guard_us / 2;
+    if (tx_net < net) {
+        sf++;
+        tx_net += td_sf_us;
+    }
+    if (tx_net - net > TDMA_LOOKAHEAD_US || sf == td_last_sf) return;
+    td_last_sf = sf;
+
+    uint32_t err = tb_error_us();
+    if (err == UINT32_MAX || 2 * (uint64_t)err + TDMA_JITTER_US > td_guard_us) {
+        td_st.held_clock++;
+        return;
+    }
+    TdmaEntry *e = &td_q[td_head];
+    if (e->freq > 0) {
+        afc_tune(e->freq, e->peer);
+    } else {
+        afc_retune(e->peer);
+    }
+
+    int64_t target = tb_local_at(tx_net) - td_lead_us;
+    while (tb_local_us() < target) {
+    }
+    uint32_t done_before = lora_tx_done_us();
+    int64_t t0 = tb_local_us();
+    int state = lora_send_frame(e->buf->data, e->buf->len);
+    if (state == LORA_ERR_BUSY) {
+        td_st.held_busy++;
+        return;
+    }
+    pkt_tx_done(e->buf, state == RADIOLIB_ERR_NONE);
+    pkt_unref(e->buf);
+    td_head = (td_head + 1) % TDMA_QUEUE;
+    td_count--;
+    if (state != RADIOLIB_ERR_NONE) return;
+    td_st.sent++;
+    if (lora_tx_done_us() == done_before) return;
+
+    int64_t start = tb_local_from_micros(lora_tx_start_us());
+    int32_t lead = (int32_t)(start - t0);
+    td_lead_us = td_lead_known ? td_lead_us + (lead - td_lead_us) / 4 : lead;
+    td_lead_known = true;
+    uint32_t tx_err = (uint32_t)llabs(tb_net_at(start) - tx_net);
+    if (tx_err > td_st.tx_err_max) td_st.tx_err_max = tx_err;
+    td_st.tx_err_sum += tx_err;
+}
+
+// Every frame heard while TDMA is on: which slot its air start fell in and
+// how far from the slot's TX point
+void tdma_on_rx(const uint8_t *frame, const RX_Packet_Info *info) {
+    if (!td_on || !info->t_us) return;
+    int64_t start = tb_local_from_micros(info->t_us) - lora_time_on_air_us(info->air_len);
+    int64_t net = tb_net_at(start);
+    int64_t sf = td_floor_div(net, td_sf_us);
+    int64_t pos = net - sf * td_sf_us;
+    uint16_t slot = (uint16_t)(pos / td_slot_us);
+    uint32_t off = (uint32_t)llabs(pos - (int64_t)slot * td_slot_us - td_guard_us / 2);
+
+    td_st.rx++;
+    if (off > td_st.rx_off_max) td_st.rx_off_max = off;
+    td_st.rx_off_sum += off;
+    uint32_t tag = (uint32_t)sf + 1;
+    if (td_seen[slot] == tag) {
+        td_st.rx_double++;
+    } else {
+        td_seen[slot] = tag;
+        td_st.rx_busy_slots++;
+    }
+    P2P_Header hdr;
+    if (p2p_parse(frame, info->air_len, &hdr) && hdr.src % td_slots != slot) td_st.rx_foreign++;
+}
+
+void tdma_on_rx_error() {
+    if (td_on) td_st.rx_crc++;
+}
+
+void init_tdma() {
+    register_at_handler("AT+TDMA", handle_at_tdma, "Slotted TX on the network clock: AT+TDMA=<slots>,<max len>[,guard us], AT+TDMA=0, AT+TDMA=CLR or AT+TDMA=?");
+}
+
+static void tdma_print() {
+    if (!td_on) {
+        Serial.println("TDMA: OFF");
+        return;
+    }
+    int64_t elapsed = td_floor_div(tb_now_us(), td_sf_us) - td_first_sf;
+    if (elapsed < 1) elapsed = 1;
+    Serial.printf("TDMA: slot %u of %u, slot %lu us (guard %lu us, max len %u), superframe %lu ms\r\n", td_slot,
+                  td_slots, (unsigned long)td_slot_us, (unsigned long)td_guard_us, td_max_len,
+                  (unsigned long)(td_sf_us / 1000));
+    Serial.printf("Clock error bound: %lu us, TX lead %ld us, queued %u\r\n", (unsigned long)tb_error_us(),
+                  (long)td_lead_us, td_count);
+    Serial.printf("TX: sent %lu of %lld own slots (%.1f%%), queue full %lu, held clock %lu, held busy %lu\r\n",
+                  (unsigned long)td_st.sent, (long long)elapsed, 100.0 * td_st.sent / elapsed,
+                  (unsigned long)td_st.full, (unsigned long)td_st.held_clock, (unsigned long)td_st.held_busy);
+    Serial.printf("TX start error: avg %lu max %lu us\r\n",
+                  (unsigned long)(td_st.sent ? td_st.tx_err_sum / td_st.sent : 0), (unsigned long)td_st.tx_err_max);
+    Serial.printf("RX: %lu frames, slot use %.2f%%, double %lu, foreign slot %lu, CRC errors %lu\r\n",
+                  (unsigned long)td_st.rx, 100.0 * td_st.rx_busy_slots / ((double)elapsed * td_slots),
+                  (unsigned long)td_st.rx_double, (unsigned long)td_st.rx_foreign, (unsigned long)td_st.rx_crc);
+    Serial.printf("RX offset from slot TX point: avg %lu max %lu us\r\n",
+                  (unsigned long)(td_st.rx ? td_st.rx_off_sum / td_st.rx : 0), (unsigned long)td_st.rx_off_max);
+}
+
+static void tdma_flush() {
+    for (; td_count; td_count--) {
+        pkt_tx_done(td_q[td_head].buf, false);
+        pkt_unref(td_q[td_head].buf);
+        td_head = (td_head + 1) % TDMA_QUEUE;
+    }
+}
+
+static void tdma_clear() {
+    memset(&td_st, 0, sizeof(td_st));
+    memset(td_seen, 0, sizeof(td_seen));
+    if (td_on) td_first_sf = td_floor_div(tb_now_us(), td_sf_us);
+}
+
+// Hand a change to tdma_loop, after the previous one has been applied
+static void tdma_post(uint8_t op, const TdmaConfig *cfg) {
+    while (__atomic_load_n(&td_op, __ATOMIC_ACQUIRE) != TD_OP_NONE) delay(1);
+    if (cfg) td_new = *cfg;
+    __atomic_store_n(&td_op, op, __ATOMIC_RELEASE);
+}
+
+// AT+TDMA=<slots>,<max len>[,guard us] / 0 / CLR / ?
+void handle_at_tdma(const AT_Command *cmd) {
+    if (strcmp(cmd->params, "?") == 0) {
+        tdma_print();
+        return;
+    }
+    if (strcasecmp(cmd->params, "CLR") == 0) {
+        tdma_post(TD_OP_CLR, NULL);
+        Serial.println("OK, TDMA statistics cleared");
+        return;
+    }
+    if (strcmp(cmd->params, "0") == 0) {
+        tdma_post(TD_OP_OFF, NULL);
+        Serial.println("OK, TDMA off, queue flushed");
+        return;
+    }
+
+    char buf[32];
+    strncpy(buf, cmd->params, sizeof(buf)-1);
+    buf[sizeof(buf)-1] = 0;
+    char *s_slots = strtok(buf, ",");
+    char *s_len = strtok(NULL, ",");
+    char *s_guard = strtok(NULL, ",");
+    if (!s_slots || !s_len) {
+        Serial.println("ERROR: Need params: slots,max len[,guard us]");
+        return;
+    }
+    long slots = atol(s_slots);
+    long max_len = atol(s_len);
+    if (slots < 1 || slots > TDMA_MAX_SLOTS || max_len < 1 || max_len > P2P_MAX_FRAME) {
+        Serial.printf("ERROR: Slots 1-%d, max len 1-%d\r\n", TDMA_MAX_SLOTS, P2P_MAX_FRAME);
+        return;
+    }
+    uint32_t guard;
+    if (s_guard) {
+        guard = (uint32_t)atol(s_guard);
+    } else {
+        // both ends may be off by the bound, in opposite directions
+        uint32_t err = tb_error_us();
+        if (err == UINT32_MAX) {
+            Serial.println("ERROR: Clock not synchronized, give the guard or sync first (AT+CLOCK=?)");
+            return;
+        }
+        guard = 2 * err + TDMA_JITTER_US;
+        guard = (guard + TDMA_GUARD_STEP_US - 1) / TDMA_GUARD_STEP_US * TDMA_GUARD_STEP_US;
+    }
+
+    TdmaConfig cfg = {(uint16_t)slots, (uint8_t)max_len, guard};
+    tdma_post(TD_OP_ON, &cfg);
+    uint32_t slot_us = lora_time_on_air_us(cfg.max_len) + guard;
+    Serial.printf("OK, TDMA slot %u of %u, slot %lu us (guard %lu us), superframe %lu ms\r\n", g_node_id % cfg.slots,
+                  cfg.slots, (unsigned long)slot_us, (unsigned long)guard,
+                  (unsigned long)((int64_t)cfg.slots * slot_us / 1000));
+}
@@ -0,0 +1,35 @@
+#ifndef TDMA_H
+#define TDMA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "command.h"
+#include "lora.h"
+#include "pktbuf.h"
+
+// Slotted transmit on the network clock (timebase.cpp). Superframes start
+// at multiples of slots x slot length on the network timeline, so GNSS
+// nodes line up without talking to each other. A node owns slot
+// node_id % slots. Each slot holds one frame of up to max_len bytes
+// between two half guards:
+//
+//   | guard/2 | frame (time on air of max_len) | guard/2 |
+//
+// All nodes must use the same slots, max_len, guard and modem settings.
+#define TDMA_MAX_SLOTS      1024
+#define TDMA_QUEUE          8
+#define TDMA_JITTER_US      300     // release jitter and RX/TX turnaround
+#define TDMA_GUARD_STEP_US  500     // computed guards are rounded up to this
+#define TDMA_LOOKAHEAD_US   15000   // loop() period plus margin; spin this close
+
+void init_tdma();
+void tdma_loop();
+bool tdma_enabled();
+int tdma_queue(PKT_Buf *buf, uint16_t peer, float freq);
+bool tdma_cancel(const PKT_Buf *buf);
+void tdma_on_rx(const uint8_t *frame, const RX_Packet_Info *info);
+void tdma_on_rx_error();
+
+void handle_at_tdma(const AT_Command *cmd);
+
+#endif // TDMA_H
@@ -0,0 +1,289 @@
+#include "timebase.h"
+#include "lora.h"
+#include "p2p.h"
+#include "Arduino.h"
+#include <RadioLib.h>
+#include "command.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define TB_OP_BEACON    1
+// BEACON: op | stratum | net time of the frame's air start, i64 us
+#define TB_BEACON_LEN   10
+
+static volatile int64_t pps_local = 0;
+static volatile uint32_t pps_edges = 0;
+
+static TB_Source tb_source = TB_FREE;
+static uint8_t tb_src_stratum = TB_STRATUM_FREE;
+static bool tb_have = false;            // servo has been given a reference
+static int64_t tb_base_local = 0;
+static int64_t tb_base_net = 0;
+static double tb_freq = 0;              // rate error, net/local - 1
+static int64_t tb_last_local = 0;
+static uint32_t tb_last_ms = 0;         // millis() of the last accepted sample
+static int64_t tb_last_err = 0;
+static uint32_t tb_samples = 0;
+static uint32_t tb_steps = 0;
+static uint16_t tb_master = P2P_ANON_ID;
+
+// GGA output lag behind the second it reports
+static int32_t tb_nmea_lag_us = 0;
+static int64_t tb_lag_sum = 0;
+static uint32_t tb_lag_n = 0;
+
+// beacons
+static uint32_t tb_beacon_ms = 0;       // period, 0 = off
+static uint32_t tb_next_beacon = 0;
+static int32_t tb_tx_lead_us = 0;       // stamp -> air start, learned per beacon
+static bool tb_lead_known = false;
+static uint32_t tb_beacons_tx = 0;
+static uint32_t tb_beacons_rx = 0;
+static uint32_t tb_beacons_noedge = 0;
+
+static void put_u32(uint8_t *p, uint32_t v) { p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24; }
+static uint32_t get_u32(const uint8_t *p) { return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); }
+static void put_i64(uint8_t *p, int64_t v) { put_u32(p, (uint32_t)v); put_u32(p + 4, (uint32_t)((uint64_t)v >> 32)); }
+static int64_t get_i64(const uint8_t *p) { return (int64_t)(get_u32(p) | ((uint64_t)get_u32(p + 4) << 32)); }
+
+static void IRAM_ATTR tb_pps_isr() {
+    pps_local = esp_timer_get_time();
+    pps_edges++;
+}
+
+int64_t tb_local_us() {
+    return esp_timer_get_time();
+}
+
+// micros() is the low 32 bits of esp_timer
+int64_t tb_local_from_micros(uint32_t t) {
+    int64_t now = esp_timer_get_time();
+    return now - (uint32_t)((uint32_t)now - t);
+}
+
+int64_t tb_net_at(int64_t local_us) {
+    if (!tb_have) return local_us;
+    int64_t dt = local_us - tb_base_local;
+    return tb_base_net + dt + (int64_t)(dt * tb_freq);
+}
+
+int64_t tb_local_at(int64_t net_us) {
+    if (!tb_have) return net_us;
+    return tb_base_local + (int64_t)((net_us - tb_base_net) / (1.0 + tb_freq));
+}
+
+int64_t tb_now_us() {
+    return tb_net_at(esp_timer_get_time());
+}
+
+bool tb_synced() {
+    return tb_source != TB_FREE;
+}
+
+uint8_t tb_stratum() {
+    if (tb_source != TB_FREE) return tb_src_stratum;
+    return tb_beacon_ms ? TB_STRATUM_LOCAL : TB_STRATUM_FREE;
+}
+
+// A local master defines the network time, a free-running follower has none
+uint32_t tb_error_us() {
+    if (tb_source == TB_FREE) return tb_beacon_ms ? 0 : UINT32_MAX;
+    // beacon hops below the GNSS or local master
+    uint8_t hops = tb_src_stratum > TB_STRATUM_LOCAL ? tb_src_stratum - TB_STRATUM_LOCAL : tb_src_stratum;
+    uint32_t base = tb_source == TB_PPS ? TB_ERR_PPS_US : tb_source == TB_NMEA ? TB_ERR_NMEA_US : TB_ERR_BEACON_US * hops;
+    uint64_t err = base + (uint64_t)llabs(tb_last_err) + (uint64_t)(millis() - tb_last_ms) * TB_HOLDOVER_PPM / 1000;
+    return err > UINT32_MAX ? UINT32_MAX : (uint32_t)err;
+}
+
+// A better source always wins; a worse one only once the current is lost
+static bool tb_accept(TB_Source src) {
+    return src >= tb_source || millis() - tb_last_ms > TB_LOST_MS;
+}
+
+// Offset/rate servo; local and ref describe the same instant
+static void tb_sample(int64_t local, int64_t ref, TB_Source src, uint8_t stratum) {
+    int64_t pred = tb_net_at(local);
+    int64_t err = ref - pred;
+    if (!tb_have || llabs(err) > TB_STEP_US) {
+        tb_base_local = local;
+        tb_base_net = ref;
+        tb_have = true;
+        tb_steps++;
+    } else {
+        int64_t dt = local - tb_last_local;
+        if (dt > 0) {
+            tb_freq += TB_KI * (double)err / dt;
+            if (tb_freq > TB_MAX_PPM * 1e-6) tb_freq = TB_MAX_PPM * 1e-6;
+            if (tb_freq < -TB_MAX_PPM * 1e-6) tb_freq = -TB_MAX_PPM * 1e-6;
+        }
+        tb_base_net = pred + (int64_t)(TB_KP * err);
+        tb_base_local = local;
+    }
+    if (src != tb_source) {
+        Serial.printf("+CLOCK: source %s, stratum %u\r\n",
+                      src == TB_PPS ? "PPS" : src == TB_NMEA ? "NMEA" : "BEACON", stratum);
+    }
+    tb_source = src;
+    tb_src_stratum = stratum;
+    tb_last_local = local;
+    tb_last_ms = millis();
+    tb_last_err = err;
+    tb_samples++;
+}
+
+void tb_gnss_fix(uint32_t tod_ms, int64_t arrival_us) {
+    uint32_t edges;
+    int64_t pps;
+    do {
+        edges = pps_edges;
+        pps = pps_local;
+    } while (edges != pps_edges);
+    int64_t since = arrival_us - pps;
+    int64_t local;
+    int64_t ref;
+    TB_Source src;
+    if (TB_PPS_PIN >= 0 && edges && since >= 0 && since < TB_PPS_WINDOW_US) {
+        // the edge starts the whole second the sentence reports
+        local = pps;
+        ref = (int64_t)(tod_ms / 1000) * 1000000;
+        src = TB_PPS;
+        tb_lag_sum += since - (int64_t)(tod_ms % 1000) * 1000;
+        tb_lag_n++;
+    } else {
+        local = arrival_us - tb_nmea_lag_us;
+        ref = (int64_t)tod_ms * 1000;
+        src = TB_NMEA;
+    }
+    if (!tb_accept(src)) return;
+    // keep the timeline continuous across midnight
+    int64_t days = (tb_net_at(local) - ref + TB_DAY_US / 2) / TB_DAY_US;
+    if (days < 0) days = 0;
+    tb_sample(local, ref + days * TB_DAY_US, src, TB_STRATUM_GNSS);
+    tb_master = P2P_ANON_ID;
+}
+
+static void tb_send_beacon() {
+    uint8_t msg[TB_BEACON_LEN];
+    msg[0] = TB_OP_BEACON;
+    msg[1] = tb_stratum();
+    uint32_t done_before = lora_tx_done_us();
+    int64_t t0 = tb_local_us();
+    put_i64(msg + 2, tb_net_at(t0 + tb_tx_lead_us));
+    if (p2p_send(P2P_TYPE_TIME, 0, P2P_BROADCAST, msg, sizeof(msg)) != RADIOLIB_ERR_NONE) return;
+    tb_beacons_tx++;
+    if (lora_tx_done_us() == done_before) return;
+    // learn how long after the stamp the frame really goes on air
+    int32_t lead = (int32_t)(tb_local_from_micros(lora_tx_start_us()) - t0);
+    tb_tx_lead_us = tb_lead_known ? tb_tx_lead_us + (lead - tb_tx_lead_us) / 4 : lead;
+    tb_lead_known = true;
+}
+
+// The RX done edge less the time on air gives the local time of the air
+// start the beacon is stamped with. Frames read without their own edge
+// (AT+IRQLAT=DETAIL race, dual RX) carry no usable time.
+static bool tb_on_frame(const P2P_Header *hdr, const uint8_t *payload, size_t len, const RX_Packet_Info *info) {
+    if (len < TB_BEACON_LEN || payload[0] != TB_OP_BEACON) return true;
+    uint8_t stratum = payload[1];
+    if (stratum >= TB_STRATUM_MAX) return true;
+    bool master = (tb_source == TB_BEACON && hdr->src == tb_master);
+    if (!master && stratum >= tb_stratum()) return true;
+    if (!tb_accept(TB_BEACON)) return true;
+    if (!info->t_us) {
+        tb_beacons_noedge++;
+        return true;
+    }
+    int64_t local = tb_local_from_micros(info->t_us) - lora_time_on_air_us(info->air_len);
+    tb_sample(local, get_i64(payload + 2), TB_BEACON, stratum + 1);
+    tb_master = hdr->src;
+    tb_beacons_rx++;
+    return true;
+}
+
+void init_timebase() {
+    if (TB_PPS_PIN >= 0) {
+        pinMode(TB_PPS_PIN, INPUT);
+        attachInterrupt(digitalPinToInterrupt(TB_PPS_PIN), tb_pps_isr, RISING);
+    }
+    p2p_register_handler(P2P_TYPE_TIME, tb_on_frame);
+
+    register_at_handler("AT+CLOCK", handle_at_clock, "Network clock: AT+CLOCK=? (status), AT+CLOCK=NMEALAG,<us>, AT+CLOCK=FREE");
+    register_at_handler("AT+TSYNC", handle_at_tsync, "Time sync beacons: AT+TSYNC=<period s>, AT+TSYNC=0 (off) or AT+TSYNC=?");
+}
+
+void timebase_loop() {
+    uint32_t now = millis();
+    if (tb_source != TB_FREE && now - tb_last_ms > TB_LOST_MS) {
+        tb_source = TB_FREE;
+        tb_master = P2P_ANON_ID;
+        Serial.println("+CLOCK: source lost, free running");
+    }
+    if (tb_beacon_ms && (int32_t)(now - tb_next_beacon) >= 0) {
+        tb_next_beacon = now + tb_beacon_ms;
+        tb_send_beacon();
+    }
+}
+
+// AT+CLOCK=? / NMEALAG,<us> / FREE
+void handle_at_clock(const AT_Command *cmd) {
+    if (strncasecmp(cmd->params, "NMEALAG,", 8) == 0) {
+        tb_nmea_lag_us = atol(cmd->params + 8);
+        Serial.printf("OK, NMEA lag %ld us\r\n", (long)tb_nmea_lag_us);
+        return;
+    }
+    if (strcasecmp(cmd->params, "FREE") == 0) {
+        tb_source = TB_FREE;
+        tb_master = P2P_ANON_ID;
+        Serial.println("OK, clock free running");
+        return;
+    }
+    if (strlen(cmd->params) != 0 && strcmp(cmd->params, "?") != 0) {
+        Serial.println("ERROR: Use AT+CLOCK=?, NMEALAG,<us> or FREE");
+        return;
+    }
+
+    static const char *names[] = {"FREE", "BEACON", "NMEA", "PPS"};
+    int64_t local = tb_local_us();
+    int64_t net = tb_net_at(local);
+    int64_t tod = net % TB_DAY_US;
+    Serial.printf("Source: %s, stratum %u", names[tb_source], tb_stratum());
+    if (tb_source == TB_BEACON) Serial.printf(", master %u", tb_master);
+    Serial.printf(", PPS pin %d (%lu edges)\r\n", TB_PPS_PIN, (unsigned long)pps_edges);
+    Serial.printf("Network time: %lld us (day %lld, %02d:%02d:%02d.%06d)\r\n", (long long)net,
+                  (long long)(net / TB_DAY_US), (int)(tod / 3600000000LL), (int)(tod / 60000000LL % 60),
+                  (int)(tod / 1000000 % 60), (int)(tod % 1000000));
+    Serial.printf("Offset %lld us, rate %+.3f ppm, last error %lld us, samples %lu, steps %lu, last %lu ms ago\r\n",
+                  (long long)(net - local), tb_freq * 1e6, (long long)tb_last_err, (unsigned long)tb_samples,
+                  (unsigned long)tb_steps, (unsigned long)(tb_samples ? millis() - tb_last_ms : 0));
+    uint32_t bound = tb_error_us();
+    if (bound == UINT32_MAX) {
+        Serial.println("Error bound: unknown (free running)");
+    } else {
+        Serial.printf("Error bound: %lu us\r\n", (unsigned long)bound);
+    }
+    Serial.printf("NMEA lag: set %ld us, measured %ld us (n=%lu)\r\n", (long)tb_nmea_lag_us,
+                  (long)(tb_lag_n ? tb_lag_sum / tb_lag_n : 0), (unsigned long)tb_lag_n);
+}
+
+// AT+TSYNC=<period s> / 0 / ?
+void handle_at_tsync(const AT_Command *cmd) {
+    if (strcmp(cmd->params, "?") == 0) {
+        Serial.printf("Beacons: %s", tb_beacon_ms ? "every " : "OFF");
+        if (tb_beacon_ms) Serial.printf("%lu s", (unsigned long)(tb_beacon_ms / 1000));
+        Serial.printf(", sent %lu, TX lead %ld us, taken %lu, without RX edge %lu\r\n", (unsigned long)tb_beacons_tx,
+                      (long)tb_tx_lead_us, (unsigned long)tb_beacons_rx, (unsigned long)tb_beacons_noedge);
+        return;
+    }
+    long period = strlen(cmd->params) ? atol(cmd->params) : TB_BEACON_DEFAULT_S;
+    if (period < 0 || period > 3600) {
+        Serial.println("ERROR: Period 1-3600 s, 0 = off");
+        return;
+    }
+    tb_beacon_ms = (uint32_t)period * 1000;
+    tb_next_beacon = millis();
+    if (period) {
+        Serial.printf("OK, time beacon every %ld s, stratum %u\r\n", period, tb_stratum());
+    } else {
+        Serial.println("OK, time beacons off");
+    }
+}
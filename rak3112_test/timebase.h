@@ -0,0 +1,63 @@
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include <stdint.h>
+#include "command.h"
+
+// Network time: microseconds on a common timeline, derived from the ESP32
+// monotonic timer (esp_timer) by an offset/rate servo. Sources, best first:
+//   PPS    - L76K 1PPS edge, labelled by the GGA sentence that follows it
+//   NMEA   - GGA sentence arrival, minus the configured output lag
+//   BEACON - P2P time beacon from a node of lower stratum
+//   FREE   - none (yet), the clock free-runs from the last estimate
+// With GNSS the timeline is UTC since the midnight before the first fix.
+#ifndef TB_PPS_PIN
+#define TB_PPS_PIN          -1      // L76K 1PPS input, -1 when not wired
+#endif
+#define TB_DAY_US           86400000000LL
+#define TB_STEP_US          50000   // errors above this step the clock
+#define TB_KP               0.5     // servo: share of the error applied now
+#define TB_KI               0.1     // servo: share folded into the rate
+#define TB_MAX_PPM          200.0
+#define TB_LOST_MS          300000  // source silent this long -> FREE
+#define TB_PPS_WINDOW_US    1000000 // GGA must follow its PPS edge within this
+
+#define TB_STRATUM_GNSS     0
+#define TB_STRATUM_LOCAL    8       // free-running node that sends beacons
+#define TB_STRATUM_MAX      14      // deepest stratum a beacon is taken from
+#define TB_STRATUM_FREE     15
+
+#define TB_BEACON_DEFAULT_S 10
+
+// Error bound per source (tb_error_us); beacon error adds up per stratum
+#define TB_ERR_PPS_US       20
+#define TB_ERR_NMEA_US      20000   // loop() polling and UART buffering
+#define TB_ERR_BEACON_US    200
+#define TB_HOLDOVER_PPM     5       // rate residual while between samples
+
+enum TB_Source {
+    TB_FREE = 0,
+    TB_BEACON,
+    TB_NMEA,
+    TB_PPS
+};
+
+void init_timebase();
+void timebase_loop();
+
+int64_t tb_local_us();                      // esp_timer, monotonic
+int64_t tb_local_from_micros(uint32_t t);   // widen a recent micros() stamp
+int64_t tb_net_at(int64_t local_us);
+int64_t tb_local_at(int64_t net_us);
+int64_t tb_now_us();                        // network time
+uint32_t tb_error_us();                     // bound on |network - true time|
+bool tb_synced();
+uint8_t tb_stratum();
+
+// GGA with a fix: time of day and the local time its '$' arrived (l76k.cpp)
+void tb_gnss_fix(uint32_t tod_ms, int64_t arrival_us);
+
+void handle_at_clock(const AT_Command *cmd);
+void handle_at_tsync(const AT_Command *cmd);
+
+#endif // TIMEBASE_H
@@ -0,0 +1,328 @@
+#include "txq.h"
+#include "lora.h"
+#include "p2p.h"
+#include "afc.h"
+#include "tdma.h"
+#include "Arduino.h"
+#include <RadioLib.h>
+#include "command.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define TXQ_NONE    0xFF
+
+struct TxqEntry {
+    uint8_t next;           // pool index, TXQ_NONE = end of list
+    uint8_t cls;
+    uint16_t peer;          // AFC peer to tune for
+    float freq;             // channel to send on, 0 = current
+    PKT_Buf *buf;           // NULL once handed on
+    uint32_t enq_ms;
+    uint32_t deadline_ms;   // millis() after which the frame is dropped
+};
+
+// The lists, the free list and the statistics are shared by the AT task
+// (console and aggregation submits, AT+TXQ) and loop() (relay, FHSS and
+// the sender); every access is under tq_mux. pkt_unref takes no lock, so
+// entries are released inside the critical section.
+static portMUX_TYPE tq_mux = portMUX_INITIALIZER_UNLOCKED;
+static TxqEntry tq_pool[TXQ_POOL];
+static uint8_t tq_free = TXQ_NONE;
+static uint8_t tq_head[TXQ_CLASSES];
+static uint8_t tq_tail[TXQ_CLASSES];
+static uint8_t tq_depth[TXQ_CLASSES];
+static uint32_t tq_deadline[TXQ_CLASSES] = {TXQ_DEADLINE_HIGH, TXQ_DEADLINE_NORMAL, TXQ_DEADLINE_LOW};
+static uint8_t tq_air = TXQ_NONE;       // unlinked entry on air (lora_start_frame), loop() only
+
+static const char *tq_names[TXQ_CLASSES] = {"HIGH", "NORMAL", "LOW"};
+
+struct TxqStats {
+    uint32_t queued;
+    uint32_t sent;          // on air, or handed to TDMA
+    uint32_t failed;
+    uint32_t expired;
+    uint32_t evicted;       // pool slot taken by a higher class
+    uint32_t refused;       // pool full of equal or higher classes
+    uint32_t cancelled;     // withdrawn by the submitter (txq_cancel)
+    uint32_t depth_max;
+    uint32_t lat_max;       // ms, queued -> sent
+    uint64_t lat_sum;
+};
+static TxqStats tq_st[TXQ_CLASSES];
+static uint32_t tq_now_sent = 0;
+static uint32_t tq_now_failed = 0;
+
+// A frame released unsent is marked dropped for holders of another reference
+static void txq_release(uint8_t i) {
+    pkt_tx_done(tq_pool[i].buf, false);
+    pkt_unref(tq_pool[i].buf);
+    tq_pool[i].buf = NULL;
+    tq_pool[i].next = tq_free;
+    tq_free = i;
+}
+
+// Unlink the head of a class; txq_release, txq_pop and txq_push_front are
+// called under tq_mux
+static uint8_t txq_pop(uint8_t cls) {
+    uint8_t i = tq_head[cls];
+    tq_head[cls] = tq_pool[i].next;
+    if (tq_head[cls] == TXQ_NONE) tq_tail[cls] = TXQ_NONE;
+    tq_depth[cls]--;
+    return i;
+}
+
+// Put a popped entry back at the head of its class
+static void txq_push_front(uint8_t cls, uint8_t i) {
+    tq_pool[i].next = tq_head[cls];
+    tq_head[cls] = i;
+    if (tq_tail[cls] == TXQ_NONE) tq_tail[cls] = i;
+    tq_depth[cls]++;
+}
+
+static void txq_reset() {
+    portENTER_CRITICAL(&tq_mux);
+    for (int c = 0; c < TXQ_CLASSES; c++) {
+        while (tq_head[c] != TXQ_NONE) txq_release(txq_pop(c));
+    }
+    portEXIT_CRITICAL(&tq_mux);
+}
+
+// Takes over the caller's reference to buf when it returns RADIOLIB_ERR_NONE
+int txq_submit_buf(uint8_t cls, PKT_Buf *buf, uint16_t peer, float freq, uint32_t deadline_ms) {
+    if (buf->len == 0 || buf->len > P2P_MAX_FRAME) return RADIOLIB_ERR_PACKET_TOO_LONG;
+    TxqStats *st = &tq_st[cls];
+    portENTER_CRITICAL(&tq_mux);
+    if (tq_free == TXQ_NONE) {
+        int victim = TXQ_CLASSES - 1;
+        while (victim > cls && tq_head[victim] == TXQ_NONE) victim--;
+        if (victim <= cls) {
+            st->refused++;
+            portEXIT_CRITICAL(&tq_mux);
+            return TXQ_ERR_FULL;
+        }
+        txq_release(txq_pop(victim));
+        tq_st[victim].evicted++;
+    }
+    uint8_t i = tq_free;
+    tq_free = tq_pool[i].next;
+
+    TxqEntry *e = &tq_pool[i];
+    e->buf = buf;
+    e->cls = cls;
+    e->peer = peer;
+    e->freq = freq;
+    e->enq_ms = millis();
+    e->deadline_ms = e->enq_ms + (deadline_ms ? deadline_ms : tq_deadline[cls]);
+    e->next = TXQ_NONE;
+    if (tq_tail[cls] == TXQ_NONE) {
+        tq_head[cls] = i;
+    } else {
+        tq_pool[tq_tail[cls]].next = i;
+    }
+    tq_tail[cls] = i;
+    tq_depth[cls]++;
+    st->queued++;
+    if (tq_depth[cls] > st->depth_max) st->depth_max = tq_depth[cls];
+    portEXIT_CRITICAL(&tq_mux);
+    return RADIOLIB_ERR_NONE;
+}
+
+// Same for a frame in caller memory, copied into a pool buffer
+int txq_submit(uint8_t cls, const uint8_t *frame, size_t len, uint16_t peer, float freq, uint32_t deadline_ms) {
+    if (len == 0 || len > P2P_MAX_FRAME) return RADIOLIB_ERR_PACKET_TOO_LONG;
+    PKT_Buf *buf = pkt_alloc();
+    if (!buf) return RADIOLIB_ERR_MEMORY_ALLOCATION_FAILED;
+    memcpy(buf->data, frame, len);
+    buf->len = len;
+    int state = txq_submit_buf(cls, buf, peer, freq, deadline_ms);
+    if (state != RADIOLIB_ERR_NONE) pkt_unref(buf);
+    return state;
+}
+
+// Withdraw a frame that is still queued here or in the TDMA slot queue; the
+// caller keeps its own reference. False once the frame is on air or gone.
+bool txq_cancel(const PKT_Buf *buf) {
+    portENTER_CRITICAL(&tq_mux);
+    for (int c = 0; c < TXQ_CLASSES; c++) {
+        uint8_t prev = TXQ_NONE;
+        for (uint8_t i = tq_head[c]; i != TXQ_NONE; prev = i, i = tq_pool[i].next) {
+            if (tq_pool[i].buf != buf) continue;
+            if (prev == TXQ_NONE) {
+                tq_head[c] = tq_pool[i].next;
+            } else {
+                tq_pool[prev].next = tq_pool[i].next;
+            }
+            if (tq_tail[c] == i) tq_tail[c] = prev;
+            tq_depth[c]--;
+            tq_st[c].cancelled++;
+            txq_release(i);
+            portEXIT_CRITICAL(&tq_mux);
+            return true;
+        }
+    }
+    portEXIT_CRITICAL(&tq_mux);
+    return tdma_enabled() && tdma_cancel(buf);
+}
+
+int txq_send_now(const uint8_t *frame, size_t len, uint16_t peer) {
+    // retune only once a queued frame on air is done
+    lora_tx_wait();
+    afc_retune(peer);
+    int state = lora_send_frame(frame, len);
+    portENTER_CRITICAL(&tq_mux);
+    if (state == RADIOLIB_ERR_NONE) {
+        tq_now_sent++;
+    } else {
+        tq_now_failed++;
+    }
+    portEXIT_CRITICAL(&tq_mux);
+    return state;
+}
+
+// Count the outcome of an unlinked entry and free it; latency runs to TX
+// done. Called under tq_mux.
+static void txq_finish(uint8_t i, int state) {
+    TxqEntry *e = &tq_pool[i];
+    TxqStats *st = &tq_st[e->cls];
+    if (state == RADIOLIB_ERR_NONE) {
+        uint32_t lat = millis() - e->enq_ms;
+        pkt_tx_done(e->buf, true);
+        st->sent++;
+        st->lat_sum += lat;
+        if (lat > st->lat_max) st->lat_max = lat;
+    } else {
+        st->failed++;
+    }
+    txq_release(i);
+}
+
+// Wait for the frame on air, drop expired heads, then start the first
+// frame of the highest class and return; TX done is picked up on a later
+// pass. The frame is unlinked while it is sent, so a submit on the AT task
+// cannot evict it; a busy radio (or a full TDMA queue) puts it back at the
+// head for the next pass.
+void txq_loop() {
+    if (tq_air != TXQ_NONE) {
+        int state = lora_poll_frame();
+        if (state == LORA_ERR_BUSY) return;
+        portENTER_CRITICAL(&tq_mux);
+        txq_finish(tq_air, state);
+        portEXIT_CRITICAL(&tq_mux);
+        tq_air = TXQ_NONE;
+    }
+    uint32_t now = millis();
+    portENTER_CRITICAL(&tq_mux);
+    for (int c = 0; c < TXQ_CLASSES; c++) {
+        while (tq_head[c] != TXQ_NONE && (int32_t)(now - tq_pool[tq_head[c]].deadline_ms) >= 0) {
+            txq_release(txq_pop(c));
+            tq_st[c].expired++;
+        }
+    }
+    int c = 0;
+    while (c < TXQ_CLASSES && tq_head[c] == TXQ_NONE) c++;
+    if (c == TXQ_CLASSES) {
+        portEXIT_CRITICAL(&tq_mux);
+        return;
+    }
+    uint8_t i = txq_pop(c);
+    portEXIT_CRITICAL(&tq_mux);
+
+    TxqEntry *e = &tq_pool[i];
+    int state;
+    if (tdma_enabled()) {
+        state = tdma_queue(e->buf, e->peer, e->freq);
+        if (state == RADIOLIB_ERR_NONE) e->buf = NULL;
+    } else {
+        if (e->freq > 0) {
+            afc_tune(e->freq, e->peer);
+        } else {
+            afc_retune(e->peer);
+        }
+        state = lora_start_frame(e->buf->data, e->buf->len);
+        if (state == RADIOLIB_ERR_NONE) {
+            tq_air = i;
+            return;
+        }
+    }
+
+    portENTER_CRITICAL(&tq_mux);
+    if (state == LORA_ERR_BUSY) {
+        txq_push_front(c, i);
+    } else {
+        txq_finish(i, state);
+    }
+    portEXIT_CRITICAL(&tq_mux);
+}
+
+void init_txq() {
+    for (int c = 0; c < TXQ_CLASSES; c++) tq_head[c] = tq_tail[c] = TXQ_NONE;
+    for (int i = TXQ_POOL - 1; i >= 0; i--) txq_release(i);
+    register_at_handler("AT+TXQ", handle_at_txq, "Transmit queue per priority class: AT+TXQ=?, AT+TXQ=DEADLINE,<class 0-2>,<ms>, AT+TXQ=FLUSH or AT+TXQ=CLR");
+}
+
+// Prints a snapshot; Serial is not used inside the critical section
+static void txq_print() {
+    TxqStats st_copy[TXQ_CLASSES];
+    uint8_t depth[TXQ_CLASSES];
+    portENTER_CRITICAL(&tq_mux);
+    memcpy(st_copy, tq_st, sizeof(st_copy));
+    memcpy(depth, tq_depth, sizeof(depth));
+    uint32_t now_sent = tq_now_sent;
+    uint32_t now_failed = tq_now_failed;
+    portEXIT_CRITICAL(&tq_mux);
+
+    int used = 0;
+    for (int c = 0; c < TXQ_CLASSES; c++) used += depth[c];
+    Serial.printf("TXQ: %d of %d frames queued, direct sends %lu, failed %lu\r\n", used, TXQ_POOL,
+                  (unsigned long)now_sent, (unsigned long)now_failed);
+    for (int c = 0; c < TXQ_CLASSES; c++) {
+        TxqStats *st = &st_copy[c];
+        Serial.printf("%d %-6s: depth %u (max %lu), deadline %lu ms, queued %lu, sent %lu, failed %lu, expired %lu, evicted %lu, refused %lu, cancelled %lu, latency avg %lu max %lu ms\r\n",
+                      c, tq_names[c], depth[c], (unsigned long)st->depth_max, (unsigned long)tq_deadline[c],
+                      (unsigned long)st->queued, (unsigned long)st->sent, (unsigned long)st->failed,
+                      (unsigned long)st->expired, (unsigned long)st->evicted, (unsigned long)st->refused, (unsigned long)st->cancelled,
+                      (unsigned long)(st->sent ? st->lat_sum / st->sent : 0), (unsigned long)st->lat_max);
+    }
+}
+
+// AT+TXQ=? / DEADLINE,<class>,<ms> / FLUSH / CLR
+void handle_at_txq(const AT_Command *cmd) {
+    if (strcmp(cmd->params, "?") == 0) {
+        txq_print();
+        return;
+    }
+    if (strcasecmp(cmd->params, "CLR") == 0) {
+        portENTER_CRITICAL(&tq_mux);
+        memset(tq_st, 0, sizeof(tq_st));
+        tq_now_sent = 0;
+        tq_now_failed = 0;
+        portEXIT_CRITICAL(&tq_mux);
+        Serial.println("OK, TXQ statistics cleared");
+        return;
+    }
+    if (strcasecmp(cmd->params, "FLUSH") == 0) {
+        txq_reset();
+        Serial.println("OK, TXQ flushed");
+        return;
+    }
+
+    char buf[32];
+    strncpy(buf, cmd->params, sizeof(buf)-1);
+    buf[sizeof(buf)-1] = 0;
+    char *p = strtok(buf, ",");
+    char *s_cls = strtok(NULL, ",");
+    char *s_ms = strtok(NULL, ",");
+    if (!p || strcasecmp(p, "DEADLINE") != 0 || !s_cls || !s_ms) {
+        Serial.println("ERROR: Use AT+TXQ=?, DEADLINE,<class>,<ms>, FLUSH or CLR");
+        return;
+    }
+    long cls = atol(s_cls);
+    long ms = atol(s_ms);
+    if (cls < 0 || cls >= TXQ_CLASSES || ms < 1 || ms > 600000) {
+        Serial.printf("ERROR: Class 0-%d, deadline 1-600000 ms\r\n", TXQ_CLASSES - 1);
+        return;
+    }
+    tq_deadline[cls] = (uint32_t)ms;
+    Serial.printf("OK, %s deadline %ld ms\r\n", tq_names[cls], ms);
+}
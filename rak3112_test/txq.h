@@ -0,0 +1,44 @@
+#ifndef TXQ_H
+#define TXQ_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "command.h"
+#include "pktbuf.h"
+
+// Transmit scheduler. Deferred frames (AT+PSEND, FHSS, relay, aggregation)
+// are queued here and sent one per loop() pass, highest class first, FIFO
+// within a class. With TDMA on they are handed to its slot queue instead.
+// Sending does not block loop(): a frame is started and its TX done is
+// picked up on a later pass, where its latency is taken. Every frame's
+// outcome is left in its tx_state (pktbuf.h) before the queue lets go, and
+// a frame not yet on air can be withdrawn with txq_cancel.
+// Frames are pool buffers (pktbuf.cpp) and the queue has a fixed number of
+// entries; when they are all taken a new frame takes the oldest entry of a
+// lower class, or is refused. A frame still queued at its deadline is
+// dropped.
+//
+// Protocol frames whose state machines need the result or the exact send
+// time (acks, link, time beacons, sweep) go out at once via txq_send_now.
+#define TXQ_HIGH        0       // console
+#define TXQ_NORMAL      1       // relay, aggregation
+#define TXQ_LOW         2       // FHSS, periodic telemetry
+#define TXQ_CLASSES     3
+
+#define TXQ_POOL        16
+#define TXQ_DEADLINE_HIGH       10000   // ms, default per class
+#define TXQ_DEADLINE_NORMAL     5000
+#define TXQ_DEADLINE_LOW        2000
+
+#define TXQ_ERR_FULL    (-1201)
+
+void init_txq();
+void txq_loop();
+int txq_submit_buf(uint8_t cls, PKT_Buf *buf, uint16_t peer, float freq, uint32_t deadline_ms);
+int txq_submit(uint8_t cls, const uint8_t *frame, size_t len, uint16_t peer, float freq, uint32_t deadline_ms);
+int txq_send_now(const uint8_t *frame, size_t len, uint16_t peer);
+bool txq_cancel(const PKT_Buf *buf);
+
+void handle_at_txq(const AT_Command *cmd);
+
+#endif // TXQ_H
@@ -0,0 +1,414 @@
+#include "xfer.h"
+#include "lora.h"
+#include "p2p.h"
+#include "hex.h"
+#include "Arduino.h"
+#include <RadioLib.h>
+#include "command.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define BIT_SET(map, i)   ((map)[(i) >> 3] |= (uint8_t)(1 << ((i) & 7)))
+#define BIT_GET(map, i)   (((map)[(i) >> 3] >> ((i) & 7)) & 1)
+
+static uint8_t *xfer_alloc_buf() {
+    uint8_t *p = NULL;
+    if (psramFound()) p = (uint8_t *)ps_malloc(XFER_MAX_SIZE);
+    if (!p) p = (uint8_t *)malloc(XFER_MAX_SIZE);
+    return p;
+}
+
+static void put_u16(uint8_t *p, uint16_t v) { p[0] = v & 0xFF; p[1] = v >> 8; }
+static void put_u32(uint8_t *p, uint32_t v) { put_u16(p, v & 0xFFFF); put_u16(p + 2, v >> 16); }
+static uint16_t get_u16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+static uint32_t get_u32(const uint8_t *p) { return get_u16(p) | ((uint32_t)get_u16(p + 2) << 16); }
+
+// ---------------- Sender ----------------
+
+enum XferTxState {
+    XS_IDLE = 0,
+    XS_SEND,
+    XS_WAIT
+};
+
+static uint8_t *tx_buf = NULL;
+static uint32_t tx_len = 0;              // staged bytes
+static volatile XferTxState tx_state = XS_IDLE;
+static uint16_t tx_dst = P2P_BROADCAST;
+static uint8_t tx_id = 0;
+static uint8_t tx_fsize = XFER_MAX_FRAG_DATA;
+static uint16_t tx_count = 0;
+static uint16_t tx_window = XFER_DEFAULT_WINDOW;
+static uint16_t tx_base = 0;             // first fragment not yet acked
+static uint8_t tx_acked[XFER_MAX_FRAGS / 8];
+static uint8_t tx_sent[XFER_MAX_FRAGS / 8];
+static unsigned long tx_start = 0;
+static unsigned long tx_deadline = 0;
+static uint8_t tx_stalls = 0;
+static volatile bool tx_sack_seen = false;
+static XFER_Stats tx_stats;
+
+// ---------------- Receiver ----------------
+
+static uint8_t *rx_buf = NULL;
+static bool rx_active = false;
+static bool rx_complete = false;
+static uint16_t rx_src = 0;
+static uint8_t rx_id = 0;
+static uint16_t rx_count = 0;
+static uint32_t rx_total = 0;
+static uint8_t rx_fsize = 0;
+static uint16_t rx_got = 0;
+static uint16_t rx_base = 0;             // first missing fragment
+static uint8_t rx_have[XFER_MAX_FRAGS / 8];
+static unsigned long rx_first_ms = 0;
+static unsigned long rx_last_ms = 0;
+static uint32_t rx_dup = 0;
+
+static void xfer_send_sack() {
+    uint8_t sack[XFER_SACK_LEN];
+    while (rx_base < rx_count && BIT_GET(rx_have, rx_base)) rx_base++;
+    sack[0] = rx_id;
+    put_u16(&sack[1], rx_base);
+    memset(&sack[3], 0, 8);
+    for (uint16_t i = 0; i < 64 && rx_base + i < rx_count; i++) {
+        if (BIT_GET(rx_have, rx_base + i)) sack[3 + (i >> 3)] |= (uint8_t)(1 << (i & 7));
+    }
+    p2p_send(P2P_TYPE_SACK, 0, rx_src, sack, sizeof(sack));
+}
+
+static bool xfer_on_frag(const P2P_Header *hdr, const uint8_t *payload, size_t len, const RX_Packet_Info *info) {
+    if (len < XFER_FRAG_HDR_LEN) return true;
+    uint8_t id = payload[0];
+    uint16_t idx = get_u16(&payload[1]);
+    uint16_t count = get_u16(&payload[3]);
+    uint32_t total = get_u32(&payload[5]);
+    uint8_t fsize = payload[9];
+    size_t dlen = len - XFER_FRAG_HDR_LEN;
+
+    if (fsize == 0 || count == 0 || count > XFER_MAX_FRAGS || total > XFER_MAX_SIZE || idx >= count) return true;
+    if ((uint32_t)(count - 1) * fsize >= total || (uint32_t)count * fsize < total) return true;
+    uint32_t offset = (uint32_t)idx * fsize;
+    size_t expect = (idx == count - 1) ? total - offset : fsize;
+    if (dlen != expect) return true;
+
+    bool same = rx_active && hdr->src == rx_src && id == rx_id && count == rx_count && total == rx_total;
+    if (!same) {
+        // a different transfer only replaces a live one once it went quiet
+        if (rx_active && !rx_complete && millis() - rx_last_ms < XFER_RX_STALE_MS) return true;
+        if (!rx_buf) rx_buf = xfer_alloc_buf();
+        if (!rx_buf) return true;
+        rx_active = true;
+        rx_complete = false;
+        rx_src = hdr->src;
+        rx_id = id;
+        rx_count = count;
+        rx_total = total;
+        rx_fsize = fsize;
+        rx_got = 0;
+        rx_base = 0;
+        rx_dup = 0;
+        memset(rx_have, 0, sizeof(rx_have));
+        rx_first_ms = millis();
+    }
+    rx_last_ms = millis();
+
+    if (BIT_GET(rx_have, idx)) {
+        rx_dup++;
+    } else {
+        memcpy(rx_buf + offset, payload + XFER_FRAG_HDR_LEN, dlen);
+        BIT_SET(rx_have, idx);
+        rx_got++;
+    }
+
+    bool just_done = !rx_complete && rx_got == rx_count;
+    if (just_done) {
+        rx_complete = true;
+        Serial.printf("+XRECV: src=%u, id=%u, %lu bytes in %lu ms\r\n", rx_src, rx_id,
+                      (unsigned long)rx_total, (unsigned long)(rx_last_ms - rx_first_ms));
+    }
+    if ((hdr->flags & P2P_FLAG_ACKREQ) || just_done) {
+        xfer_send_sack();
+    }
+    return true;
+}
+
+static bool xfer_on_sack(const P2P_Header *hdr, const uint8_t *payload, size_t len, const RX_Packet_Info *info) {
+    if (tx_state == XS_IDLE || len < XFER_SACK_LEN) return true;
+    if (hdr->src != tx_dst && tx_dst != P2P_BROADCAST) return true;
+    if (payload[0] != tx_id) return true;
+
+    uint16_t base = get_u16(&payload[1]);
+    if (base > tx_count) return true;
+    for (uint16_t i = tx_base; i < base; i++) BIT_SET(tx_acked, i);
+    for (uint16_t i = 0; i < 64 && base + i < tx_count; i++) {
+        if ((payload[3 + (i >> 3)] >> (i & 7)) & 1) BIT_SET(tx_acked, base + i);
+    }
+    if (base > tx_base) {
+        tx_base = base;
+        tx_stalls = 0;
+    }
+    tx_stats.sacks++;
+    tx_sack_seen = true;
+    return true;
+}
+
+void init_xfer() {
+    p2p_register_handler(P2P_TYPE_FRAG, xfer_on_frag);
+    p2p_register_handler(P2P_TYPE_SACK, xfer_on_sack);
+
+    register_at_handler("AT+XBUF", handle_at_xbuf, "Stage transfer data: AT+XBUF=<hex> (append), AT+XBUF=FILL,<len>, AT+XBUF=CLR or AT+XBUF=?");
+    register_at_handler("AT+XSEND", handle_at_xsend, "Send staged data with fragmentation and selective ack: AT+XSEND=dst[,window[,fragsize]]");
+    register_at_handler("AT+XSTAT", handle_at_xstat, "Query last transfer: goodput, retransmissions and receive state");
+    register_at_handler("AT+XREAD", handle_at_xread, "Read received transfer data as hex: AT+XREAD=offset,len (len<=128)");
+    register_at_handler("AT+XABORT", handle_at_xabort, "Abort the outgoing transfer");
+}
+
+bool xfer_busy() {
+    return tx_state != XS_IDLE;
+}
+
+static void xfer_finish(bool ok) {
+    tx_stats.ok = ok;
+    tx_stats.elapsed_ms = millis() - tx_start;
+    tx_state = XS_IDLE;
+    float goodput = tx_stats.elapsed_ms ? tx_stats.bytes * 8.0f / tx_stats.elapsed_ms : 0;
+    Serial.printf("+XSEND: %s, %lu bytes, %lu ms, goodput %.2f kbps, %lu retransmits\r\n",
+                  ok ? "OK" : "FAILED", (unsigned long)tx_stats.bytes, (unsigned long)tx_stats.elapsed_ms,
+                  goodput, (unsigned long)tx_stats.retransmits);
+}
+
+static void xfer_send_window() {
+    static uint8_t frag[XFER_FRAG_HDR_LEN + XFER_MAX_FRAG_DATA];
+    uint16_t end = tx_base + tx_window;
+    if (end > tx_count) end = tx_count;
+
+    // last unacked fragment in the window carries the ack request
+    int last = -1;
+    for (uint16_t i = tx_base; i < end; i++) {
+        if (!BIT_GET(tx_acked, i)) last = i;
+    }
+    if (last < 0) {
+        xfer_finish(true);
+        return;
+    }
+
+    for (uint16_t i = tx_base; i <= last; i++) {
+        if (BIT_GET(tx_acked, i)) continue;
+        uint32_t offset = (uint32_t)i * tx_fsize;
+        size_t dlen = (i == tx_count - 1) ? tx_len - offset : tx_fsize;
+        frag[0] = tx_id;
+        put_u16(&frag[1], i);
+        put_u16(&frag[3], tx_count);
+        put_u32(&frag[5], tx_len);
+        frag[9] = tx_fsize;
+        memcpy(&frag[XFER_FRAG_HDR_LEN], tx_buf + offset, dlen);
+
+        int state = p2p_send(P2P_TYPE_FRAG, i == last ? P2P_FLAG_ACKREQ : 0, tx_dst, frag, XFER_FRAG_HDR_LEN + dlen);
+        if (state != RADIOLIB_ERR_NONE) {
+            Serial.print("XFER TX ERROR, code ");
+            Serial.println(state);
+        }
+        if (BIT_GET(tx_sent, i)) tx_stats.retransmits++;
+        BIT_SET(tx_sent, i);
+        tx_stats.frames_sent++;
+        tx_stats.airtime_ms += lora_time_on_air_ms(P2P_HDR_LEN + XFER_FRAG_HDR_LEN + dlen);
+    }
+
+    tx_sack_seen = false;
+    tx_deadline = millis() + 2 * lora_time_on_air_ms(P2P_HDR_LEN + XFER_SACK_LEN) + XFER_TURNAROUND_MS;
+    tx_state = XS_WAIT;
+}
+
+// Sender state machine, called from the main loop
+void xfer_loop() {
+    if (tx_state == XS_SEND) {
+        xfer_send_window();
+    } else if (tx_state == XS_WAIT) {
+        if (tx_sack_seen) {
+            tx_state = (tx_base >= tx_count) ? XS_IDLE : XS_SEND;
+            if (tx_state == XS_IDLE) xfer_finish(true);
+        } else if ((long)(millis() - tx_deadline) >= 0) {
+            tx_stats.timeouts++;
+            if (++tx_stalls > XFER_MAX_STALLS) {
+                xfer_finish(false);
+            } else {
+                tx_state = XS_SEND;
+            }
+        }
+    }
+}
+
+// AT+XBUF=<hex> / AT+XBUF=FILL,<len> / AT+XBUF=CLR / AT+XBUF=?
+void handle_at_xbuf(const AT_Command *cmd) {
+    if (strcmp(cmd->params, "?") == 0) {
+        Serial.print("XBUF: ");
+        Serial.print(tx_len);
+        Serial.println(" bytes staged");
+        return;
+    }
+    if (xfer_busy()) {
+        Serial.println("ERROR: Transfer in progress");
+        return;
+    }
+    if (!tx_buf) tx_buf = xfer_alloc_buf();
+    if (!tx_buf) {
+        Serial.println("ERROR: Unable to allocate transfer buffer");
+        return;
+    }
+    if (strcasecmp(cmd->params, "CLR") == 0) {
+        tx_len = 0;
+        Serial.println("OK, XBUF cleared");
+        return;
+    }
+    if (strncasecmp(cmd->params, "FILL,", 5) == 0) {
+        uint32_t n = strtoul(cmd->params + 5, NULL, 10);
+        if (n == 0 || n > XFER_MAX_SIZE) {
+            Serial.println("ERROR: Invalid length (1-65536)");
+            return;
+        }
+        for (uint32_t i = 0; i < n; i++) tx_buf[i] = (uint8_t)i;
+        tx_len = n;
+        Serial.print("OK, XBUF=");
+        Serial.println(tx_len);
+        return;
+    }
+
+    const char *p = cmd->params;
+    size_t len = strlen(p);
+    int byteLen = len ? hex_decode(tx_buf + tx_len, XFER_MAX_SIZE - tx_len, p, len) : HEX_ERR_INVALID;
+    if (byteLen == HEX_ERR_INVALID) {
+        Serial.println("ERROR: Data must be hex");
+        return;
+    }
+    if (byteLen == HEX_ERR_TOO_LONG) {
+        Serial.println("ERROR: Data too long");
+        return;
+    }
+    tx_len += byteLen;
+    Serial.print("OK, XBUF=");
+    Serial.println(tx_len);
+}
+
+// AT+XSEND=dst[,window[,fragsize]]
+void handle_at_xsend(const AT_Command *cmd) {
+    if (xfer_busy()) {
+        Serial.println("ERROR: Transfer in progress");
+        return;
+    }
+    if (tx_len == 0) {
+        Serial.println("ERROR: Nothing staged, use AT+XBUF first");
+        return;
+    }
+    char buf[48];
+    strncpy(buf, cmd->params, sizeof(buf)-1);
+    buf[sizeof(buf)-1] = 0;
+    char *p = strtok(buf, ",");
+    if (!p) {
+        Serial.println("ERROR: Need params: dst[,window[,fragsize]]");
+        return;
+    }
+    long dst = atol(p);
+    p = strtok(NULL, ",");
+    long window = p ? atol(p) : XFER_DEFAULT_WINDOW;
+    p = strtok(NULL, ",");
+    long fsize = p ? atol(p) : XFER_MAX_FRAG_DATA;
+
+    if (dst <= P2P_ANON_ID || dst >= P2P_BROADCAST) {
+        Serial.println("ERROR: Invalid dst (1-65534)");
+        return;
+    }
+    if (window < 1 || window > XFER_MAX_WINDOW) {
+        Serial.println("ERROR: Invalid window (1-64)");
+        return;
+    }
+    if (fsize < 1 || fsize > XFER_MAX_FRAG_DATA) {
+        Serial.printf("ERROR: Invalid fragsize (1-%d)\r\n", XFER_MAX_FRAG_DATA);
+        return;
+    }
+    uint32_t count = (tx_len + fsize - 1) / fsize;
+    if (count > XFER_MAX_FRAGS) {
+        Serial.println("ERROR: Too many fragments, use a larger fragsize");
+        return;
+    }
+    if (lora_listen() != RADIOLIB_ERR_NONE) {
+        Serial.println("ERROR: Unable to enter RX mode");
+        return;
+    }
+
+    tx_dst = (uint16_t)dst;
+    tx_window = (uint16_t)window;
+    tx_fsize = (uint8_t)fsize;
+    tx_count = (uint16_t)count;
+    tx_id++;
+    tx_base = 0;
+    tx_stalls = 0;
+    memset(tx_acked, 0, sizeof(tx_acked));
+    memset(tx_sent, 0, sizeof(tx_sent));
+    memset(&tx_stats, 0, sizeof(tx_stats));
+    tx_stats.bytes = tx_len;
+    tx_stats.frags = tx_count;
+    tx_start = millis();
+    tx_state = XS_SEND;
+    Serial.printf("OK, XSEND id=%u, %lu bytes in %u fragments\r\n", tx_id, (unsigned long)tx_len, tx_count);
+}
+
+void handle_at_xstat(const AT_Command *cmd) {
+    uint32_t elapsed = xfer_busy() ? millis() - tx_start : tx_stats.elapsed_ms;
+    float goodput = elapsed ? tx_stats.bytes * 8.0f / elapsed : 0;
+    float overhead = tx_stats.frags ? 100.0f * tx_stats.retransmits / tx_stats.frags : 0;
+    Serial.printf("TX: %s, id=%u, dst=%u, %lu bytes, %u frags, window=%u, fragsize=%u\r\n",
+                  xfer_busy() ? "BUSY" : (tx_stats.ok ? "DONE" : "IDLE/FAILED"), tx_id, tx_dst,
+                  (unsigned long)tx_stats.bytes, tx_stats.frags, tx_window, tx_fsize);
+    Serial.printf("TX: %lu frames, %lu retransmits (%.1f%% overhead), %lu sacks, %lu timeouts\r\n",
+                  (unsigned long)tx_stats.frames_sent, (unsigned long)tx_stats.retransmits, overhead,
+                  (unsigned long)tx_stats.sacks, (unsigned long)tx_stats.timeouts);
+    Serial.printf("TX: %lu ms elapsed, %lu ms on air, goodput %.2f kbps\r\n",
+                  (unsigned long)elapsed, (unsigned long)tx_stats.airtime_ms, goodput);
+    if (rx_active) {
+        Serial.printf("RX: src=%u, id=%u, %u/%u frags, %lu bytes, %s, %lu duplicates\r\n",
+                      rx_src, rx_id, rx_got, rx_count, (unsigned long)rx_total,
+                      rx_complete ? "complete" : "partial", (unsigned long)rx_dup);
+    } else {
+        Serial.println("RX: none");
+    }
+}
+
+// AT+XREAD=offset,len
+void handle_at_xread(const AT_Command *cmd) {
+    if (!rx_active || !rx_complete) {
+        Serial.println("ERROR: No complete transfer received");
+        return;
+    }
+    char buf[32];
+    strncpy(buf, cmd->params, sizeof(buf)-1);
+    buf[sizeof(buf)-1] = 0;
+    char *p = strtok(buf, ",");
+    char *q = strtok(NULL, ",");
+    if (!p || !q) {
+        Serial.println("ERROR: Need params: offset,len");
+        return;
+    }
+    uint32_t offset = strtoul(p, NULL, 10);
+    uint32_t n = strtoul(q, NULL, 10);
+    if (n == 0 || n > 128 || offset >= rx_total) {
+        Serial.println("ERROR: Invalid range");
+        return;
+    }
+    if (offset + n > rx_total) n = rx_total - offset;
+    char line[2 * 128 + 2];
+    size_t m = hex_encode(line, rx_buf + offset, n);
+    line[m++] = '\r';
+    line[m++] = '\n';
+    Serial.write((const uint8_t *)line, m);
+    Serial.println("OK");
+}
+
+void handle_at_xabort(const AT_Command *cmd) {
+    if (!xfer_busy()) {
+        Serial.println("OK, no transfer running");
+        return;
+    }
+    xfer_finish(false);
+}
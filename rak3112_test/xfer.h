@@ -0,0 +1,47 @@
+#ifndef XFER_H
+#define XFER_H
+
+#include <stdint.h>
+#include "command.h"
+#include "p2p.h"
+
+// Bulk transport: a staged buffer is cut into FRAG frames and sent in a
+// sliding window; the receiver answers with selective acks (SACK) and
+// reassembles into one bounded buffer.
+#define XFER_MAX_SIZE       (64 * 1024)
+#define XFER_MAX_FRAGS      1024
+#define XFER_DEFAULT_WINDOW 8
+#define XFER_MAX_WINDOW     64
+#define XFER_MAX_STALLS     8       // SACK timeouts in a row before giving up
+#define XFER_TURNAROUND_MS  150     // peer processing + RX/TX switching
+#define XFER_RX_STALE_MS    30000   // idle partial transfer may be replaced
+
+// FRAG payload: id u8 | idx u16 | count u16 | total u32 | fsize u8 | data
+#define XFER_FRAG_HDR_LEN   10
+#define XFER_MAX_FRAG_DATA  (P2P_MAX_PAYLOAD - XFER_FRAG_HDR_LEN)
+// SACK payload: id u8 | base u16 (first missing) | bitmap[8] for base..base+63
+#define XFER_SACK_LEN       11
+
+struct XFER_Stats {
+    uint32_t bytes;         // payload bytes delivered
+    uint16_t frags;         // fragments in the transfer
+    uint32_t frames_sent;   // FRAG frames put on air, including retransmits
+    uint32_t retransmits;
+    uint32_t sacks;         // SACKs received
+    uint32_t timeouts;      // windows that timed out waiting for a SACK
+    uint32_t airtime_ms;    // time on air of all FRAG frames
+    uint32_t elapsed_ms;
+    bool ok;
+};
+
+void init_xfer();
+void xfer_loop();
+bool xfer_busy();
+
+void handle_at_xbuf(const AT_Command *cmd);
+void handle_at_xsend(const AT_Command *cmd);
+void handle_at_xstat(const AT_Command *cmd);
+void handle_at_xread(const AT_Command *cmd);
+void handle_at_xabort(const AT_Command *cmd);
+
+#endif // XFER_H